@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+
+/*This benchmark compares en_queue_batch and de_queue_batch against the
+  loops they replace: one en_queue or de_queue call per element. Each
+  round enqueues a batch of random priorities into a queue that already
+  holds 'elements' entries, then dequeues the same number again, so the
+  queue size stays constant. Both engines are measured; the list
+  engine is where the sorted merge matters most, since a loop of
+  en_queue walks the list once per element.
+
+  Usage: bench-batch [elements] [batch] [rounds]*/
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Fills 'priorities' with 'count' random values and 'items' with names
+   for them. */
+static void make_batch(char names[][32], const char *items[],
+                       unsigned int priorities[], int count) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    priorities[i] = (unsigned int) rand() * 2654435761u;
+    sprintf(names[i], "job-%u", priorities[i] % 100000);
+    items[i] = names[i];
+  }
+}
+
+/* Runs the rounds one element at a time and returns the ns per element
+   for enqueue and dequeue. */
+static void run_looped(Queue_prio *queue, char names[][32], const char *items[],
+                       unsigned int priorities[], int batch, int rounds,
+                       double *enq, double *deq) {
+  double start;
+  char *name;
+  int round;
+  int i;
+
+  *enq = 0;
+  *deq = 0;
+  for (round = 0; round < rounds; round++) {
+    make_batch(names, items, priorities, batch);
+    start = now_ns();
+    for (i = 0; i < batch; i++)
+      en_queue(queue, items[i], priorities[i]);
+    *enq += now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < batch; i++) {
+      name = de_queue(queue);
+      free(name);
+    }
+    *deq += now_ns() - start;
+  }
+  *enq /= (double) rounds * batch;
+  *deq /= (double) rounds * batch;
+}
+
+/* Same as run_looped, using the batch calls. */
+static void run_batched(Queue_prio *queue, char names[][32], const char *items[],
+                        unsigned int priorities[], char *out[], int batch,
+                        int rounds, double *enq, double *deq) {
+  double start;
+  unsigned int taken;
+  unsigned int i;
+  int round;
+
+  *enq = 0;
+  *deq = 0;
+  for (round = 0; round < rounds; round++) {
+    make_batch(names, items, priorities, batch);
+    start = now_ns();
+    en_queue_batch(queue, items, priorities, (unsigned int) batch, NULL);
+    *enq += now_ns() - start;
+
+    start = now_ns();
+    taken = de_queue_batch(queue, out, (unsigned int) batch);
+    *deq += now_ns() - start;
+    for (i = 0; i < taken; i++)
+      free(out[i]);
+  }
+  *enq /= (double) rounds * batch;
+  *deq /= (double) rounds * batch;
+}
+
+int main(int argc, char *argv[]) {
+  int elements = argc > 1 ? atoi(argv[1]) : 5000;
+  int batch = argc > 2 ? atoi(argv[2]) : 1000;
+  int rounds = argc > 3 ? atoi(argv[3]) : 20;
+  const char *engine_names[] = {"list", "heap"};
+  char (*names)[32] = NULL;
+  const char **items = NULL;
+  unsigned int *priorities = NULL;
+  char **out = NULL;
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  Queue_prio queue;
+  double loop_enq, loop_deq, batch_enq, batch_deq;
+  int engine;
+
+  if (batch < 1)
+    batch = 1;
+  names = malloc((size_t) (elements > batch ? elements : batch) * sizeof(*names));
+  items = malloc((size_t) (elements > batch ? elements : batch) * sizeof(*items));
+  priorities = malloc((size_t) (elements > batch ? elements : batch)
+                      * sizeof(*priorities));
+  out = malloc((size_t) batch * sizeof(*out));
+
+  printf("elements=%d batch=%d rounds=%d\n", elements, batch, rounds);
+  printf("%-8s %-10s %14s %14s %9s\n", "engine", "operation", "loop ns/op",
+         "batch ns/op", "speedup");
+
+  for (engine = QUEUE_ENGINE_LIST; engine <= QUEUE_ENGINE_HEAP; engine++) {
+    options.engine = (Queue_engine) engine;
+
+    /* Both runs start from the same pre-filled queue. */
+    srand(1);
+    init_queue_with_options(&queue, &options);
+    make_batch(names, items, priorities, elements);
+    en_queue_batch(&queue, items, priorities, (unsigned int) elements, NULL);
+    run_looped(&queue, names, items, priorities, batch, rounds, &loop_enq,
+               &loop_deq);
+    clear_queue_prio(&queue);
+
+    srand(1);
+    init_queue_with_options(&queue, &options);
+    make_batch(names, items, priorities, elements);
+    en_queue_batch(&queue, items, priorities, (unsigned int) elements, NULL);
+    run_batched(&queue, names, items, priorities, out, batch, rounds,
+                &batch_enq, &batch_deq);
+    clear_queue_prio(&queue);
+
+    printf("%-8s %-10s %14.1f %14.1f %8.2fx\n", engine_names[engine],
+           "en_queue", loop_enq, batch_enq, loop_enq / batch_enq);
+    printf("%-8s %-10s %14.1f %14.1f %8.2fx\n", engine_names[engine],
+           "de_queue", loop_deq, batch_deq, loop_deq / batch_deq);
+  }
+
+  free(names);
+  free(items);
+  free(priorities);
+  free(out);
+  return 0;
+}
@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "queue-prio.h"
+
+/*This benchmark compares the bucket engine with the list and heap
+  engines over priority ranges of different sizes. For each range it
+  fills a queue with up to 'elements' distinct random priorities from
+  the range using en_queue, then runs 'rounds' rounds of de_queue_into
+  followed by en_queue of a priority not in the queue (a queue that
+  stays at the same depth), then offers every queued priority again
+  with en_queue, which must turn each one down, and finally empties the
+  queue with remove_elements_between over sixteen slices of the range.
+
+  Usage: bench-bucket [elements] [rounds]*/
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  int elements = argc > 1 ? atoi(argv[1]) : 10000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 100000;
+  const unsigned int ranges[] = {256, 4096, 65536, 262144};
+  const char *engine_names[] = {"list", "heap", "bucket"};
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  unsigned int *priorities = NULL;
+  unsigned char *taken = NULL;
+  unsigned int range;
+  unsigned int fill;
+  unsigned int spare;
+  unsigned int next;
+  unsigned int swap;
+  unsigned int low;
+  unsigned int r;
+  long long top;
+  Queue_prio queue;
+  char buffer[32];
+  double start;
+  double elapsed;
+  int engine;
+  int i;
+
+  if (elements < 1)
+    elements = 1;
+  if (rounds < 1)
+    rounds = 1;
+  printf("elements=%d rounds=%d\n", elements, rounds);
+
+  for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+    range = ranges[r];
+    fill = (unsigned int) elements < range / 2 ? (unsigned int) elements
+      : range / 2;
+    priorities = malloc(range * sizeof(*priorities));
+    taken = malloc(range);
+    if (priorities == NULL || taken == NULL)
+      return 1;
+
+    for (engine = QUEUE_ENGINE_LIST; engine <= QUEUE_ENGINE_BUCKET; engine++) {
+      /* The same shuffle of the range for every engine. The first
+         'fill' priorities are queued, the rest are spare. */
+      srand(42);
+      for (i = 0; i < (int) range; i++)
+        priorities[i] = (unsigned int) i;
+      for (i = (int) range - 1; i > 0; i--) {
+        next = (((unsigned int) rand() << 16) ^ (unsigned int) rand())
+          % (unsigned int) (i + 1);
+        swap = priorities[i];
+        priorities[i] = priorities[next];
+        priorities[next] = swap;
+      }
+
+      options.engine = (Queue_engine) engine;
+      options.max_priority = range - 1;
+      init_queue_with_options(&queue, &options);
+
+      start = now_ns();
+      for (i = 0; i < (int) fill; i++)
+        en_queue(&queue, "job", priorities[i]);
+      elapsed = now_ns() - start;
+      printf("range=%-7u %-7s %-26s %8.1f ns/op\n", range,
+             engine_names[engine], "en_queue (fill)", elapsed / fill);
+
+      /* Each round swaps the dequeued priority with the next spare. */
+      spare = fill;
+      start = now_ns();
+      for (i = 0; i < rounds; i++) {
+        top = peek_priority(&queue);
+        de_queue_into(&queue, buffer, sizeof(buffer));
+        en_queue(&queue, "job", priorities[spare]);
+        priorities[spare] = (unsigned int) top;
+        if (++spare == range)
+          spare = fill;
+      }
+      elapsed = now_ns() - start;
+      printf("range=%-7u %-7s %-26s %8.1f ns/op\n", range,
+             engine_names[engine], "de_queue + en_queue", elapsed / rounds);
+
+      /* Every priority that is not spare is queued. */
+      for (i = 0; i < (int) range; i++)
+        taken[i] = 1;
+      for (i = (int) fill; i < (int) range; i++)
+        taken[priorities[i]] = 0;
+      next = 0;
+      for (i = 0; i < (int) range; i++)
+        if (taken[i])
+          priorities[next++] = (unsigned int) i;
+      start = now_ns();
+      for (i = 0; i < (int) fill; i++)
+        en_queue(&queue, "again", priorities[i]);
+      elapsed = now_ns() - start;
+      printf("range=%-7u %-7s %-26s %8.1f ns/op\n", range,
+             engine_names[engine], "en_queue (duplicate)", elapsed / fill);
+
+      start = now_ns();
+      for (low = 0; low < range; low += range / 16)
+        remove_elements_between(&queue, low, low + range / 16 - 1);
+      elapsed = now_ns() - start;
+      printf("range=%-7u %-7s %-26s %8.1f ns/element (%d left)\n", range,
+             engine_names[engine], "remove_elements_between", elapsed / fill,
+             size(&queue));
+      clear_queue_prio(&queue);
+    }
+    free(priorities);
+    free(taken);
+  }
+  return 0;
+}
@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+
+/*This benchmark measures filling an empty queue from unsorted arrays,
+  the warm start of a queue rebuilt from an outside source. For each
+  engine it times build_queue_from_arrays and en_queue_batch on
+  'elements' random priorities, and a loop of en_queue on the first
+  'looped' of them, which for the list engine costs a walk of the list
+  per element and is kept short for that reason. It then drains the
+  built queue to show the cost of reading nodes laid out in priority
+  order.
+
+  Usage: bench-build [elements] [looped]*/
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Empties the queue with de_queue_into and returns the ns it took. */
+static double drain(Queue_prio *queue) {
+  char buffer[64];
+  double start = now_ns();
+
+  while (de_queue_into(queue, buffer, sizeof(buffer)) >= 0)
+    ;
+  return now_ns() - start;
+}
+
+int main(int argc, char *argv[]) {
+  int elements = argc > 1 ? atoi(argv[1]) : 500000;
+  int looped = argc > 2 ? atoi(argv[2]) : 20000;
+  const char *engine_names[] = {"list", "heap"};
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  const char **items = NULL;
+  unsigned int *priorities = NULL;
+  char (*names)[24] = NULL;
+  Queue_prio queue;
+  unsigned int built;
+  double start;
+  double elapsed;
+  int engine;
+  int i;
+
+  if (elements < 1)
+    elements = 1;
+  if (looped > elements)
+    looped = elements;
+  items = malloc((size_t) elements * sizeof(*items));
+  priorities = malloc((size_t) elements * sizeof(*priorities));
+  names = malloc((size_t) elements * sizeof(*names));
+  if (items == NULL || priorities == NULL || names == NULL)
+    return 1;
+  srand(42);
+  for (i = 0; i < elements; i++) {
+    priorities[i] = ((unsigned int) rand() << 16) ^ (unsigned int) rand();
+    sprintf(names[i], "job-%d", i);
+    items[i] = names[i];
+  }
+
+  printf("elements=%d looped=%d\n", elements, looped);
+  for (engine = QUEUE_ENGINE_LIST; engine <= QUEUE_ENGINE_HEAP; engine++) {
+    options.engine = (Queue_engine) engine;
+
+    init_queue_with_options(&queue, &options);
+    start = now_ns();
+    built = build_queue_from_arrays(&queue, items, priorities,
+                                    (unsigned int) elements);
+    elapsed = now_ns() - start;
+    printf("%-6s %-24s %10.1f ms %8.1f ns/element (%u kept)\n",
+           engine_names[engine], "build_queue_from_arrays", elapsed / 1e6,
+           elapsed / elements, built);
+    elapsed = drain(&queue);
+    printf("%-6s %-24s %10.1f ms %8.1f ns/element\n", engine_names[engine],
+           "drain after build", elapsed / 1e6, elapsed / built);
+    clear_queue_prio(&queue);
+
+    init_queue_with_options(&queue, &options);
+    start = now_ns();
+    en_queue_batch(&queue, items, priorities, (unsigned int) elements, NULL);
+    elapsed = now_ns() - start;
+    printf("%-6s %-24s %10.1f ms %8.1f ns/element\n", engine_names[engine],
+           "en_queue_batch", elapsed / 1e6, elapsed / elements);
+    clear_queue_prio(&queue);
+
+    init_queue_with_options(&queue, &options);
+    start = now_ns();
+    for (i = 0; i < looped; i++)
+      en_queue(&queue, items[i], priorities[i]);
+    elapsed = now_ns() - start;
+    printf("%-6s %-24s %10.1f ms %8.1f ns/element (%d elements)\n",
+           engine_names[engine], "en_queue loop", elapsed / 1e6,
+           elapsed / looped, looped);
+    clear_queue_prio(&queue);
+  }
+
+  free(items);
+  free(priorities);
+  free(names);
+  return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "queue-prio.h"
+
+/*This benchmark compares the columns engine with the list and heap
+  engines on the queries that have to look at every element when the
+  queue keeps no name index. For each size it builds a queue of
+  distinct random priorities and distinct names, then times
+  get_priority on 'lookups' names that are in the queue and on as many
+  that are not, change_priority on 'lookups' random elements, and
+  finally empties the queue with
+  remove_elements_between over a hundred slices of the priority range.
+
+  The columns engine scans its name hashes with the kernel reported
+  on the first line. Run it with QUEUEMANAGER_SCAN set to "scalar",
+  "sse2" or "avx2" to compare the kernels.
+
+  Usage: bench-columns [lookups]*/
+
+#define RANGE 0x40000000u
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned int random_priority(void) {
+  return (((unsigned int) rand() << 16) ^ (unsigned int) rand()) % RANGE;
+}
+
+int main(int argc, char *argv[]) {
+  int lookups = argc > 1 ? atoi(argv[1]) : 1000;
+  const unsigned int sizes[] = {1000, 10000, 100000};
+  const char *engine_names[] = {"list", "heap", "bucket", "columns"};
+  const Queue_engine engines[] = {QUEUE_ENGINE_LIST, QUEUE_ENGINE_HEAP,
+                                  QUEUE_ENGINE_COLUMNS};
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  const char **items = NULL;
+  unsigned int *priorities = NULL;
+  char (*names)[24] = NULL;
+  char missing[24];
+  unsigned int count;
+  unsigned int step;
+  unsigned int s;
+  unsigned int e;
+  Queue_prio queue;
+  double start;
+  double elapsed;
+  int i;
+
+  if (lookups < 1)
+    lookups = 1;
+  printf("kernel=%s lookups=%d\n", queue_scan_kernel(), lookups);
+
+  for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    count = sizes[s];
+    items = malloc(count * sizeof(*items));
+    priorities = malloc(count * sizeof(*priorities));
+    names = malloc(count * sizeof(*names));
+    if (items == NULL || priorities == NULL || names == NULL)
+      return 1;
+    srand(42);
+    for (i = 0; i < (int) count; i++) {
+      sprintf(names[i], "job-%d", i);
+      items[i] = names[i];
+      priorities[i] = random_priority();
+    }
+
+    for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+      options.engine = engines[e];
+      init_queue_with_options(&queue, &options);
+      en_queue_batch(&queue, items, priorities, count, NULL);
+
+      srand(7);
+      start = now_ns();
+      for (i = 0; i < lookups; i++)
+        get_priority(&queue, items[rand() % (int) count]);
+      elapsed = now_ns() - start;
+      printf("size=%-7u %-8s %-24s %10.1f ns/op\n", count,
+             engine_names[engines[e]], "get_priority (present)",
+             elapsed / lookups);
+
+      start = now_ns();
+      for (i = 0; i < lookups; i++) {
+        sprintf(missing, "gone-%d", i);
+        get_priority(&queue, missing);
+      }
+      elapsed = now_ns() - start;
+      printf("size=%-7u %-8s %-24s %10.1f ns/op\n", count,
+             engine_names[engines[e]], "get_priority (missing)",
+             elapsed / lookups);
+
+      start = now_ns();
+      for (i = 0; i < lookups; i++)
+        change_priority(&queue, items[rand() % (int) count],
+                        random_priority());
+      elapsed = now_ns() - start;
+      printf("size=%-7u %-8s %-24s %10.1f ns/op\n", count,
+             engine_names[engines[e]], "change_priority", elapsed / lookups);
+
+      step = RANGE / 100;
+      start = now_ns();
+      for (i = 0; i < 100; i++)
+        remove_elements_between(&queue, (unsigned int) i * step,
+                                (unsigned int) (i + 1) * step - 1);
+      elapsed = now_ns() - start;
+      printf("size=%-7u %-8s %-24s %10.1f ns/element\n", count,
+             engine_names[engines[e]], "remove_elements_between",
+             elapsed / count);
+      clear_queue_prio(&queue);
+    }
+
+    free(items);
+    free(priorities);
+    free(names);
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-concurrent.h"
+
+/*Multi-producer/multi-consumer stress run for Queue_prio_concurrent,
+  measured against the pattern it replaces: one Queue_prio behind one
+  global mutex.
+
+  Phase 1 runs producers and consumers together. Every producer
+  enqueues its own block of unique priorities, consumers dequeue until
+  everything has been seen, and afterwards every element must have
+  been dequeued exactly once.
+
+  Phase 2 fills the queue first and then lets the consumers drain it.
+  With no concurrent en_queue, each consumer must see strictly
+  decreasing priorities.
+
+  The program exits non-zero if either check fails.
+
+  Usage: bench-concurrent [threads] [elements per producer]*/
+
+typedef struct run{
+  Queue_prio_concurrent *sharded;
+  Queue_prio *global;
+  pthread_mutex_t global_lock;
+  int producers;
+  int per_producer;
+  int id;
+  atomic_int taken;
+  atomic_int remaining;
+  atomic_uchar *seen;
+  atomic_int errors;
+}Run;
+
+typedef struct worker{
+  Run *run;
+  int id;
+}Worker;
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned short put(Run *run, const char *name, unsigned int priority) {
+  unsigned short ret;
+
+  if (run->sharded != NULL)
+    return en_queue_concurrent(run->sharded, name, priority);
+  pthread_mutex_lock(&run->global_lock);
+  ret = en_queue(run->global, name, priority);
+  pthread_mutex_unlock(&run->global_lock);
+  return ret;
+}
+
+static char *take(Run *run) {
+  char *name;
+
+  if (run->sharded != NULL)
+    return de_queue_concurrent(run->sharded);
+  pthread_mutex_lock(&run->global_lock);
+  name = de_queue(run->global);
+  pthread_mutex_unlock(&run->global_lock);
+  return name;
+}
+
+static void *produce(void *arg) {
+  Worker *worker = arg;
+  Run *run = worker->run;
+  char name[32];
+  int i;
+  int id;
+
+  for (i = 0; i < run->per_producer; i++) {
+    /* Interleave the producers' priorities so shards are shared. */
+    id = i * run->producers + worker->id;
+    sprintf(name, "item-%d", id);
+    if (!put(run, name, (unsigned int) id))
+      atomic_fetch_add(&run->errors, 1);
+  }
+  return NULL;
+}
+
+/* Dequeues until every element has been taken, recording each one.
+   In the drain phase it also checks the order seen by this thread. */
+static void *consume(void *arg) {
+  Worker *worker = arg;
+  Run *run = worker->run;
+  long last = -1;
+  char *name;
+  int id;
+
+  while (atomic_load(&run->remaining) > 0) {
+    name = take(run);
+    if (name == NULL)
+      continue;
+    id = atoi(name + 5);
+    free(name);
+    atomic_fetch_sub(&run->remaining, 1);
+
+    if (atomic_fetch_add(&run->seen[id], 1) != 0)
+      atomic_fetch_add(&run->errors, 1);
+    if (run->id == 2 && last >= 0 && id >= last)
+      atomic_fetch_add(&run->errors, 1);
+    last = id;
+  }
+  return NULL;
+}
+
+/* Runs one phase with 'threads' producers and as many consumers and
+   returns the operations per second. */
+static double run_phase(Run *run, int threads, int phase) {
+  pthread_t ids[128];
+  Worker workers[128];
+  int total = threads * run->per_producer;
+  double start;
+  int i;
+
+  run->producers = threads;
+  run->id = phase;
+  for (i = 0; i < total; i++)
+    atomic_store(&run->seen[i], 0);
+  atomic_store(&run->remaining, total);
+
+  start = now_s();
+  if (phase == 2) {
+    /* Fill first, drain afterwards. */
+    for (i = 0; i < threads; i++) {
+      workers[i].run = run;
+      workers[i].id = i;
+      produce(&workers[i]);
+    }
+    start = now_s();
+  } else {
+    for (i = 0; i < threads; i++) {
+      workers[i].run = run;
+      workers[i].id = i;
+      pthread_create(&ids[i], NULL, produce, &workers[i]);
+    }
+  }
+  for (i = 0; i < threads; i++) {
+    workers[threads + i].run = run;
+    workers[threads + i].id = i;
+    pthread_create(&ids[threads + i], NULL, consume, &workers[threads + i]);
+  }
+  for (i = phase == 2 ? threads : 0; i < 2 * threads; i++)
+    pthread_join(ids[i], NULL);
+
+  for (i = 0; i < total; i++)
+    if (atomic_load(&run->seen[i]) != 1)
+      atomic_fetch_add(&run->errors, 1);
+  return (phase == 2 ? total : 2.0 * total) / (now_s() - start);
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  int per_producer = argc > 2 ? atoi(argv[2]) : 50000;
+  Queue_prio_concurrent sharded;
+  Queue_prio global;
+  Run run;
+  double ops_global, ops_sharded, drain;
+  int threads;
+
+  if (max_threads < 1 || max_threads > 64)
+    max_threads = 8;
+  if (per_producer < 1)
+    per_producer = 1;
+
+  memset(&run, 0, sizeof(run));
+  run.per_producer = per_producer;
+  run.seen = malloc((size_t) max_threads * per_producer * sizeof(*run.seen));
+  if (run.seen == NULL)
+    return 1;
+  pthread_mutex_init(&run.global_lock, NULL);
+
+  printf("%8s %16s %16s %16s\n", "threads", "global ops/s", "sharded ops/s",
+         "drain ops/s");
+  for (threads = 1; threads <= max_threads; threads *= 2) {
+    Queue_options heap = {QUEUE_ENGINE_HEAP, 0, NULL, 0, NULL};
+
+    init_queue_with_options(&global, &heap);
+    run.global = &global;
+    run.sharded = NULL;
+    ops_global = run_phase(&run, threads, 1);
+    clear_queue_prio(&global);
+
+    init_queue_concurrent(&sharded, 0, NULL);
+    run.sharded = &sharded;
+    ops_sharded = run_phase(&run, threads, 1);
+    drain = run_phase(&run, threads, 2);
+    clear_queue_prio_concurrent(&sharded);
+
+    printf("%8d %16.0f %16.0f %16.0f\n", threads, ops_global, ops_sharded,
+           drain);
+  }
+
+  printf("errors=%d\n", atomic_load(&run.errors));
+  free(run.seen);
+  return atomic_load(&run.errors) != 0;
+}
@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+
+/*Compares de_queue_global with what callers did before it: walk every
+  queue of the list, get_queue it by name and peek it, then de_queue
+  the winner. Both drain the same list of 'queues' queues holding
+  'elements' entries, and both must produce the same priorities in the
+  same order. It then drains the list once more with de_queue_fair.
+
+  Usage: bench-global [queues] [elements]*/
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fill(Queue_prio_list *list, int queues, int elements) {
+  char name[32];
+  char element[32];
+  int i;
+
+  init_queue_list(list);
+  for (i = 0; i < queues; i++) {
+    sprintf(name, "queue-%d", i);
+    add_queue_prio(list, name);
+  }
+  srand(1);
+  for (i = 0; i < elements; i++) {
+    sprintf(name, "queue-%d", rand() % queues);
+    sprintf(element, "job-%d", i);
+    en_queue(get_queue(list, name), element, (unsigned int) rand());
+  }
+}
+
+/* The old way: look at every queue through the public API. */
+static char *de_queue_scan(Queue_prio_list *list, long long *priority) {
+  Queue_prio *best = NULL;
+  Queue_prio *queue = NULL;
+  list_Node *curr = NULL;
+  char *head = NULL;
+
+  *priority = -1;
+  for (curr = list->head; curr != NULL; curr = curr->next) {
+    queue = get_queue(list, curr->name);
+    head = peek(queue);
+    if (head != NULL && peek_priority(queue) > *priority) {
+      *priority = peek_priority(queue);
+      best = queue;
+    }
+    free(head);
+  }
+  return best != NULL ? de_queue(best) : NULL;
+}
+
+int main(int argc, char *argv[]) {
+  int queues = argc > 1 ? atoi(argv[1]) : 1000;
+  int elements = argc > 2 ? atoi(argv[2]) : 200000;
+  Queue_prio_list list;
+  long long *order = malloc((size_t) elements * sizeof(*order));
+  long long priority;
+  double start;
+  double scan;
+  double global;
+  double fair;
+  char *name;
+  int errors = 0;
+  int count;
+
+  if (queues < 1)
+    queues = 1;
+
+  fill(&list, queues, elements);
+  start = now_ns();
+  for (count = 0; (name = de_queue_scan(&list, &priority)) != NULL; count++) {
+    order[count] = priority;
+    free(name);
+  }
+  scan = now_ns() - start;
+  clear_queue_prio_list(&list);
+
+  fill(&list, queues, elements);
+  start = now_ns();
+  for (count = 0; (priority = peek_priority_global(&list)) >= 0; count++) {
+    name = de_queue_global(&list, NULL);
+    if (order[count] != priority)
+      errors++;
+    free(name);
+  }
+  global = now_ns() - start;
+  clear_queue_prio_list(&list);
+
+  fill(&list, queues, elements);
+  start = now_ns();
+  while ((name = de_queue_fair(&list, NULL)) != NULL)
+    free(name);
+  fair = now_ns() - start;
+  clear_queue_prio_list(&list);
+
+  printf("queues=%d elements=%d\n", queues, elements);
+  printf("%-20s %10.1f ns/op\n", "scan + peek", scan / elements);
+  printf("%-20s %10.1f ns/op (%.0fx)\n", "de_queue_global", global / elements,
+         scan / global);
+  printf("%-20s %10.1f ns/op\n", "de_queue_fair", fair / elements);
+  free(order);
+  if (errors > 0) {
+    printf("FAILED: %d priorities out of order\n", errors);
+    return 1;
+  }
+  return 0;
+}
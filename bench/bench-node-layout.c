@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+
+/*This benchmark compares the current Node layout, with short names
+  stored inline next to a cached length and hash, against the original
+  layout where every node points at a separately malloc'd copy of its
+  name. The original layout is reproduced here by 'legacy_en_queue'
+  and 'legacy_get_priority', which are the old list algorithms
+  unchanged. Both sides use the list engine without indexes, so they
+  walk the same number of nodes and only the per-node cost differs.
+
+  Usage: bench-node-layout [elements] [lookups]*/
+
+typedef struct legacy_node{
+  char *data;
+  int priority;
+  struct legacy_node *next;
+}Legacy_node;
+
+/* Original en_queue: duplicate scan, then a sorted insert. */
+static int legacy_en_queue(Legacy_node **head, const char element[],
+                           unsigned int priority) {
+  Legacy_node *curr = *head;
+  Legacy_node *prev = NULL;
+  Legacy_node *entry = NULL;
+
+  while (curr != NULL) {
+    if ((unsigned int) curr->priority == priority)
+      return 0;
+    curr = curr->next;
+  }
+
+  entry = malloc(sizeof(Legacy_node));
+  entry->data = malloc(strlen(element) + 1);
+  strcpy(entry->data, element);
+  entry->priority = priority;
+
+  curr = *head;
+  while (curr != NULL && (unsigned int) curr->priority > priority) {
+    prev = curr;
+    curr = curr->next;
+  }
+  entry->next = curr;
+  if (prev == NULL)
+    *head = entry;
+  else
+    prev->next = entry;
+  return 1;
+}
+
+/* Original get_priority: strcmp against every node. */
+static int legacy_get_priority(const Legacy_node *head, const char element[]) {
+  int ret = -1;
+
+  while (head != NULL) {
+    if (strcmp(head->data, element) == 0 && head->priority > ret)
+      ret = head->priority;
+    head = head->next;
+  }
+  return ret;
+}
+
+static void legacy_clear(Legacy_node *head) {
+  Legacy_node *next = NULL;
+
+  while (head != NULL) {
+    next = head->next;
+    free(head->data);
+    free(head);
+    head = next;
+  }
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  int elements = argc > 1 ? atoi(argv[1]) : 5000;
+  int lookups = argc > 2 ? atoi(argv[2]) : 2000;
+  Legacy_node *legacy = NULL;
+  Queue_prio queue;
+  char name[32];
+  double start;
+  double legacy_enq, inline_enq, legacy_get, inline_get;
+  long checksum = 0;
+  int i;
+
+  if (elements < 1)
+    elements = 1;
+  if (lookups < 1)
+    lookups = 1;
+
+  init_queue(&queue);
+
+  /* Descending priorities make every insert walk the whole list in
+     both layouts. */
+  start = now_ns();
+  for (i = 0; i < elements; i++) {
+    sprintf(name, "job-%d", i);
+    legacy_en_queue(&legacy, name, (unsigned int) (elements - i));
+  }
+  legacy_enq = (now_ns() - start) / elements;
+
+  start = now_ns();
+  for (i = 0; i < elements; i++) {
+    sprintf(name, "job-%d", i);
+    en_queue(&queue, name, (unsigned int) (elements - i));
+  }
+  inline_enq = (now_ns() - start) / elements;
+
+  /* Look up names spread across the queue, plus some misses. */
+  srand(1);
+  start = now_ns();
+  for (i = 0; i < lookups; i++) {
+    sprintf(name, "job-%d", rand() % (elements + elements / 10));
+    checksum += legacy_get_priority(legacy, name);
+  }
+  legacy_get = (now_ns() - start) / lookups;
+
+  srand(1);
+  start = now_ns();
+  for (i = 0; i < lookups; i++) {
+    sprintf(name, "job-%d", rand() % (elements + elements / 10));
+    checksum -= get_priority(&queue, name);
+  }
+  inline_get = (now_ns() - start) / lookups;
+
+  printf("elements=%d lookups=%d checksum=%ld\n", elements, lookups, checksum);
+  printf("%-14s %14s %14s %9s\n", "operation", "legacy ns/op", "inline ns/op",
+         "speedup");
+  printf("%-14s %14.1f %14.1f %8.2fx\n", "en_queue", legacy_enq, inline_enq,
+         legacy_enq / inline_enq);
+  printf("%-14s %14.1f %14.1f %8.2fx\n", "get_priority", legacy_get,
+         inline_get, legacy_get / inline_get);
+
+  legacy_clear(legacy);
+  clear_queue_prio(&queue);
+  return checksum != 0;
+}
@@ -0,0 +1,320 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+#include "queue-prio-persist.h"
+
+/*This benchmark measures the on-disk store of queue-prio-persist.c.
+  It fills a list of queues with 'elements' entries in total, writes a
+  snapshot and times recovery from it against a plain sequential read
+  of the same file, which is the bound recovery should stay close to.
+  It then times en_queue with the write-ahead log attached, once per
+  fsync policy. The files go to 'directory', which should be on the
+  disk being measured.
+
+  Every recovery is checked against a list filled the same way without
+  a store. A last check covers crashes: a child process fills a list,
+  writes a snapshot, changes the list further and exits without
+  close_queue_store. Reopening the store must give the list the child
+  had, and so must reopening it again after garbage is appended to the
+  log, as a torn write would leave it. The program exits non-zero if
+  any check fails.
+
+  Usage: bench-persist [elements] [queues] [directory]*/
+
+#define LOGGED_OPS 20000
+#define CRASH_ELEMENTS 2000
+#define CRASH_CHANGES 200
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Reads the whole file once and returns the ns it took. */
+static double read_file(const char path[], long *bytes) {
+  static char buffer[1 << 20];
+  double start = now_ns();
+  ssize_t got;
+  int fd = open(path, O_RDONLY);
+
+  *bytes = 0;
+  if (fd < 0)
+    return 0;
+  while ((got = read(fd, buffer, sizeof(buffer))) > 0)
+    *bytes += got;
+  close(fd);
+  return now_ns() - start;
+}
+
+/* Adds 'queues' queues on 'engine' holding 'elements' entries between
+   them. */
+static void fill(Queue_prio_list *list, int elements, int queues,
+                 Queue_engine engine) {
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  const char **items = malloc((size_t) elements * sizeof(*items));
+  unsigned int *priorities = malloc((size_t) elements * sizeof(*priorities));
+  char (*names)[24] = malloc((size_t) elements * sizeof(*names));
+  char queue_name[32];
+  int per_queue = elements / queues;
+  int q;
+  int i;
+
+  options.engine = engine;
+  for (i = 0; i < elements; i++) {
+    sprintf(names[i], "job-%d", i);
+    items[i] = names[i];
+    priorities[i] = (unsigned int) i * 2654435761u;
+  }
+  for (q = 0; q < queues; q++) {
+    sprintf(queue_name, "queue-%d", q);
+    add_queue_prio_with_options(list, queue_name, &options);
+    en_queue_batch(get_queue(list, queue_name), items + q * per_queue,
+                   priorities + q * per_queue, (unsigned int) per_queue, NULL);
+  }
+  free(items);
+  free(priorities);
+  free(names);
+}
+
+/* Returns 1 if the queue called 'name' is missing from both lists, or
+   is in both on the same engine with the same elements and priorities
+   in the same order. */
+static int same_queue(const Queue_prio_list *a, const Queue_prio_list *b,
+                      const char name[]) {
+  Queue_prio *x = get_queue(a, name);
+  Queue_prio *y = get_queue(b, name);
+  Queue_cursor cx, cy;
+  Queue_element ex, ey;
+  unsigned short more;
+  int same = 1;
+
+  if (x == NULL || y == NULL)
+    return x == y;
+  if (x->engine != y->engine || x->size != y->size)
+    return 0;
+  open_cursor(&cx, x);
+  open_cursor(&cy, y);
+  do {
+    more = cursor_next(&cx, &ex);
+    if (more != cursor_next(&cy, &ey))
+      same = 0;
+    else if (more && (ex.priority != ey.priority || ex.length != ey.length
+                      || memcmp(ex.element, ey.element, ex.length) != 0))
+      same = 0;
+  } while (more && same);
+  close_cursor(&cx);
+  close_cursor(&cy);
+  return same;
+}
+
+/* Returns 1 if the lists hold the same queues, as made by fill and
+   change_list. */
+static int same_list(const Queue_prio_list *a, const Queue_prio_list *b,
+                     int queues) {
+  char queue_name[32];
+  int q;
+
+  if (num_queues(a) != num_queues(b) || !same_queue(a, b, "added"))
+    return 0;
+  for (q = 0; q < queues; q++) {
+    sprintf(queue_name, "queue-%d", q);
+    if (!same_queue(a, b, queue_name))
+      return 0;
+  }
+  return 1;
+}
+
+/* Makes one of each change the log records, the same way every time. */
+static void change_list(Queue_prio_list *list, int queues) {
+  Queue_prio *queue = get_queue(list, "queue-0");
+  Queue_handle handle;
+  char name[32];
+  int i;
+
+  for (i = 0; i < CRASH_CHANGES; i++) {
+    sprintf(name, "late-%d", i);
+    en_queue(queue, name, (unsigned int) (2 * i + 1));
+  }
+  for (i = 0; i < CRASH_CHANGES / 4; i++)
+    free(de_queue(queue));
+  change_priority(queue, "late-7", 4000000001u);
+  if (get_handle(queue, 9, &handle))
+    change_priority_h(queue, &handle, 4000000003u);
+  if (get_handle(queue, 11, &handle))
+    remove_h(queue, &handle);
+  remove_elements_between(queue, 100, 200);
+  add_queue_prio(list, "added");
+  en_queue(get_queue(list, "added"), "extra", 5);
+  if (queues > 1)
+    remove_queue(list, "queue-1");
+}
+
+/* Runs the crash check described at the top of the file and returns
+   the number of failures. */
+static int check_crash(const char snapshot[], const char log[], int queues) {
+  static const char garbage[] = "\x10\0\0\0\xde\xad\xbe\xeftorn write";
+  Queue_store_options options = {QUEUE_SYNC_COMMIT, 0, 0, 0};
+  Queue_prio_list expected;
+  Queue_prio_list list;
+  Queue_store store;
+  pid_t child;
+  int failures = 0;
+  int status;
+  int round;
+  int fd;
+
+  unlink(snapshot);
+  unlink(log);
+  child = fork();
+  if (child < 0) {
+    perror("fork");
+    return 1;
+  }
+  if (child == 0) {
+    init_queue_list(&list);
+    if (!open_queue_store(&store, &list, snapshot, log, &options))
+      _exit(1);
+    fill(&list, CRASH_ELEMENTS, queues, QUEUE_ENGINE_HEAP);
+    if (!snapshot_queue_store(&store))
+      _exit(1);
+    change_list(&list, queues);
+    /* The records are on disk once committed; the store is never
+       closed. */
+    _exit(commit_queue_store(&store) ? 0 : 1);
+  }
+  if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status)
+      || WEXITSTATUS(status) != 0)
+    failures++;
+
+  init_queue_list(&expected);
+  fill(&expected, CRASH_ELEMENTS, queues, QUEUE_ENGINE_HEAP);
+  change_list(&expected, queues);
+
+  for (round = 0; round < 2; round++) {
+    if (round == 1) {
+      fd = open(log, O_WRONLY | O_APPEND);
+      if (fd < 0 || write(fd, garbage, sizeof(garbage))
+          != (ssize_t) sizeof(garbage))
+        failures++;
+      if (fd >= 0)
+        close(fd);
+    }
+    init_queue_list(&list);
+    if (open_queue_store(&store, &list, snapshot, log, NULL)) {
+      if (!same_list(&list, &expected, queues))
+        failures++;
+      close_queue_store(&store);
+    } else {
+      failures++;
+    }
+    clear_queue_prio_list(&list);
+  }
+  clear_queue_prio_list(&expected);
+  return failures;
+}
+
+int main(int argc, char *argv[]) {
+  int elements = argc > 1 ? atoi(argv[1]) : 1000000;
+  int queues = argc > 2 ? atoi(argv[2]) : 4;
+  const char *directory = argc > 3 ? argv[3] : ".";
+  const char *sync_names[] = {"commit", "interval", "none"};
+  const char *engine_names[] = {"list", "heap"};
+  char snapshot[512];
+  char log[512];
+  char name[32];
+  Queue_store_options options = {QUEUE_SYNC_COMMIT, 0, 0, 0};
+  Queue_options heap = {QUEUE_ENGINE_HEAP, 0, NULL, 0, NULL};
+  Queue_prio_list list;
+  Queue_prio_list expected;
+  Queue_store store;
+  Queue_prio *queue;
+  double start;
+  double elapsed;
+  double raw;
+  long bytes;
+  int errors = 0;
+  int engine;
+  int sync;
+  int i;
+
+  if (elements < 1)
+    elements = 1;
+  if (queues < 1)
+    queues = 1;
+  sprintf(snapshot, "%s/bench-persist.snapshot", directory);
+  sprintf(log, "%s/bench-persist.log", directory);
+  unlink(snapshot);
+  unlink(log);
+
+  printf("elements=%d queues=%d\n", elements, queues);
+  for (engine = QUEUE_ENGINE_LIST; engine <= QUEUE_ENGINE_HEAP; engine++) {
+    unlink(snapshot);
+    unlink(log);
+    init_queue_list(&list);
+    open_queue_store(&store, &list, snapshot, log, NULL);
+    fill(&list, elements, queues, (Queue_engine) engine);
+    start = now_ns();
+    snapshot_queue_store(&store);
+    elapsed = now_ns() - start;
+    close_queue_store(&store);
+    clear_queue_prio_list(&list);
+
+    raw = read_file(snapshot, &bytes);
+    printf("%-6s snapshot %ld bytes\n", engine_names[engine], bytes);
+    printf("%-6s %-17s %12.1f ms\n", engine_names[engine], "write snapshot",
+           elapsed / 1e6);
+    printf("%-6s %-17s %12.1f ms\n", engine_names[engine], "sequential read",
+           raw / 1e6);
+
+    start = now_ns();
+    open_queue_store(&store, &list, snapshot, log, NULL);
+    elapsed = now_ns() - start;
+    printf("%-6s %-17s %12.1f ms (%.1fx read)\n", engine_names[engine],
+           "recover", elapsed / 1e6, elapsed / raw);
+
+    init_queue_list(&expected);
+    fill(&expected, elements, queues, (Queue_engine) engine);
+    if (!same_list(&list, &expected, queues))
+      errors++;
+    clear_queue_prio_list(&expected);
+    close_queue_store(&store);
+    clear_queue_prio_list(&list);
+  }
+
+  /* Logged en_queue, group commit at the default 64 records. */
+  for (sync = QUEUE_SYNC_COMMIT; sync <= QUEUE_SYNC_NONE; sync++) {
+    unlink(snapshot);
+    unlink(log);
+    options.sync = (Queue_sync) sync;
+    init_queue_list(&list);
+    open_queue_store(&store, &list, snapshot, log, &options);
+    add_queue_prio_with_options(&list, "logged", &heap);
+    queue = get_queue(&list, "logged");
+    start = now_ns();
+    for (i = 0; i < LOGGED_OPS; i++) {
+      sprintf(name, "job-%d", i);
+      en_queue(queue, name, (unsigned int) i * 2654435761u);
+    }
+    commit_queue_store(&store);
+    elapsed = now_ns() - start;
+    printf("logged en_queue, sync %-8s %12.1f ns/op\n", sync_names[sync],
+           elapsed / LOGGED_OPS);
+    close_queue_store(&store);
+    clear_queue_prio_list(&list);
+  }
+
+  errors += check_crash(snapshot, log, queues);
+  unlink(snapshot);
+  unlink(log);
+  printf("errors=%d\n", errors);
+  return errors != 0;
+}
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-sharded.h"
+
+/*Scaling run for the sharded registry and its worker pool. For each
+  worker count from 1 up to 'threads', doubling, it fills 'queues'
+  named queues with 'elements' entries in total, starts the pool and
+  times how long the workers take to drain everything. The handler
+  burns about 'work' iterations of integer mixing per element to stand
+  in for real processing.
+
+  Every worker count runs twice: once with one shard per worker (at
+  least 16), and once with a single shard, which is a Queue_prio_list
+  behind one global lock. Speedup is against one worker on the sharded
+  registry; near-linear scaling needs as many idle cores as workers.
+
+  Usage: bench-sharded [threads] [queues] [elements] [work]*/
+
+static atomic_long handled;
+static int work_iterations;
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void handle(const char *queue_name, const char *element,
+                   unsigned int priority, void *context) {
+  volatile unsigned int sink = priority;
+  int i;
+
+  (void) queue_name;
+  (void) element;
+  (void) context;
+  for (i = 0; i < work_iterations; i++)
+    sink = sink * 0x9E3779B1u + (unsigned int) i;
+  atomic_fetch_add_explicit(&handled, 1, memory_order_relaxed);
+}
+
+/* Fills a registry with 'shards' shards, drains it with 'workers'
+   workers and returns the seconds the drain took. */
+static double drain(unsigned int shards, unsigned int workers, int queues,
+                    int elements, double *stolen) {
+  Queue_prio_list_sharded list;
+  Queue_worker_pool pool;
+  Queue_options heap = {QUEUE_ENGINE_HEAP, 0, NULL, 0, NULL};
+  struct timespec pause = {0, 100000};
+  char queue_name[32];
+  char element[32];
+  double start;
+  double elapsed;
+  int i;
+
+  init_queue_list_sharded(&list, shards);
+  for (i = 0; i < queues; i++) {
+    sprintf(queue_name, "queue-%d", i);
+    add_queue_prio_sharded(&list, queue_name, &heap);
+  }
+  for (i = 0; i < elements; i++) {
+    sprintf(queue_name, "queue-%d", i % queues);
+    sprintf(element, "job-%d", i);
+    en_queue_sharded(&list, queue_name, element,
+                     (unsigned int) (i / queues) * 2654435761u);
+  }
+
+  atomic_store(&handled, 0);
+  start = now_s();
+  start_worker_pool(&pool, &list, workers, handle, NULL);
+  while (atomic_load(&handled) < elements)
+    nanosleep(&pause, NULL);
+  elapsed = now_s() - start;
+  stop_worker_pool(&pool);
+  *stolen = pool.processed > 0 ? (double) pool.stolen / pool.processed : 0;
+
+  clear_queue_list_sharded(&list);
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int threads = argc > 1 ? (unsigned int) atoi(argv[1]) : 32;
+  int queues = argc > 2 ? atoi(argv[2]) : 4096;
+  int elements = argc > 3 ? atoi(argv[3]) : 1000000;
+  unsigned int workers;
+  unsigned int shards;
+  double base = 0;
+  double sharded;
+  double global;
+  double stolen;
+  double ignored;
+
+  work_iterations = argc > 4 ? atoi(argv[4]) : 200;
+  if (queues < 1)
+    queues = 1;
+
+  printf("queues=%d elements=%d work=%d\n", queues, elements,
+         work_iterations);
+  printf("%8s %14s %9s %8s %14s\n", "workers", "sharded op/s", "speedup",
+         "stolen", "global op/s");
+  for (workers = 1; workers <= threads; workers *= 2) {
+    shards = workers < 16 ? 16 : workers;
+    sharded = drain(shards, workers, queues, elements, &stolen);
+    global = drain(1, workers, queues, elements, &ignored);
+    if (base == 0)
+      base = sharded;
+    printf("%8u %14.0f %8.2fx %7.1f%% %14.0f\n", workers, elements / sharded,
+           base / sharded, stolen * 100, elements / global);
+  }
+  return 0;
+}
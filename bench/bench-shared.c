@@ -0,0 +1,326 @@
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "queue-prio-shared.h"
+
+/*Multi-process check of Queue_prio_shared. Every phase works on one
+  region made by create_queue_shared, which the forked children share
+  through the mapping they inherit.
+
+  Phase 1 runs producer and consumer processes together. Every
+  producer enqueues its own block of unique priorities, consumers
+  dequeue until everything has been seen, and afterwards every element
+  must have been dequeued exactly once.
+
+  Phase 2 lets the producers fill the queue first. A full queue must
+  turn en_queue_shared down, and the parent then drains it, seeing
+  strictly decreasing priorities. A queue whose string area is full
+  must turn long names down too.
+
+  Phase 3 kills a process while it repeatedly enqueues and dequeues
+  long names, so that it most likely dies holding the lock in the
+  middle of a change. The queue must then report itself damaged:
+  en_queue_shared fails and de_queue_shared returns NULL. A kill that
+  lands outside a change must leave the queue usable. The phase is
+  repeated until the damaged case has been seen.
+
+  The program exits non-zero if any check fails.
+
+  Usage: bench-shared [processes] [elements per producer]*/
+
+#define CRASH_ATTEMPTS 50
+#define CRASH_NAME_LENGTH (256 * 1024)
+
+typedef struct run{
+  Queue_prio_shared queue;
+  int producers;
+  int per_producer;
+  /* In memory shared with the children, like the queue itself. */
+  atomic_int *remaining;
+  atomic_uchar *seen;
+}Run;
+
+static int errors;
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+static void produce(Run *run, int producer) {
+  char name[32];
+  int failed = 0;
+  int i;
+  int id;
+
+  for (i = 0; i < run->per_producer; i++) {
+    /* Interleave the producers' priorities. */
+    id = i * run->producers + producer;
+    sprintf(name, "item-%d", id);
+    if (!en_queue_shared(&run->queue, name, (unsigned int) id))
+      failed = 1;
+  }
+  _exit(failed);
+}
+
+static void consume(Run *run) {
+  int failed = 0;
+  char *name;
+  int id;
+
+  while (atomic_load(run->remaining) > 0) {
+    name = de_queue_shared(&run->queue);
+    if (name == NULL)
+      continue;
+    id = atoi(name + 5);
+    free(name);
+    atomic_fetch_sub(run->remaining, 1);
+    if (atomic_fetch_add(&run->seen[id], 1) != 0)
+      failed = 1;
+  }
+  _exit(failed);
+}
+
+/* Starts 'count' producers (role 0) or consumers (role 1) and stores
+   their ids in 'pids'. */
+static void spawn(Run *run, pid_t pids[], int count, int role) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    pids[i] = fork();
+    if (pids[i] < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (pids[i] == 0) {
+      if (role == 0)
+        produce(run, i);
+      else
+        consume(run);
+    }
+  }
+}
+
+/* Waits for 'count' children and counts those that failed. */
+static void reap(pid_t pids[], int count) {
+  int status;
+  int i;
+
+  for (i = 0; i < count; i++)
+    if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+      errors++;
+}
+
+/* Producers and consumers together; returns the operations per
+   second. */
+static double run_together(Run *run, int total) {
+  pid_t pids[128];
+  double start;
+  int i;
+
+  for (i = 0; i < total; i++)
+    atomic_store(&run->seen[i], 0);
+  atomic_store(run->remaining, total);
+
+  start = now_s();
+  spawn(run, pids, run->producers, 0);
+  spawn(run, pids + run->producers, run->producers, 1);
+  reap(pids, 2 * run->producers);
+
+  for (i = 0; i < total; i++)
+    if (atomic_load(&run->seen[i]) != 1)
+      errors++;
+  if (size_shared(&run->queue) != 0)
+    errors++;
+  return 2.0 * total / (now_s() - start);
+}
+
+/* Producers fill the queue to capacity, then the parent drains it;
+   returns the dequeues per second. */
+static double run_fill_drain(Run *run, int total) {
+  pid_t pids[64];
+  double start;
+  long last = -1;
+  char *name;
+  int count = 0;
+  int id;
+
+  spawn(run, pids, run->producers, 0);
+  reap(pids, run->producers);
+  if (size_shared(&run->queue) != total)
+    errors++;
+  /* The region was made for exactly 'total' elements. */
+  if (en_queue_shared(&run->queue, "extra", (unsigned int) total))
+    errors++;
+
+  start = now_s();
+  while ((name = de_queue_shared(&run->queue)) != NULL) {
+    id = atoi(name + 5);
+    free(name);
+    if (last >= 0 && id >= last)
+      errors++;
+    last = id;
+    count++;
+  }
+  if (count != total)
+    errors++;
+  return total / (now_s() - start);
+}
+
+/* A queue whose string area holds one long name turns a second one
+   down but still takes names that fit in a node. */
+static void check_string_area(const char *region_name) {
+  Queue_shared_options options = {4, 64};
+  Queue_prio_shared queue;
+  char name[48];
+
+  if (!create_queue_shared(&queue, region_name, &options)) {
+    errors++;
+    return;
+  }
+  memset(name, 'x', sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+  if (!en_queue_shared(&queue, name, 1) || en_queue_shared(&queue, name, 2)
+      || !en_queue_shared(&queue, "short", 3))
+    errors++;
+  close_queue_shared(&queue);
+  unlink_queue_shared(region_name);
+}
+
+/* Kills a child that keeps the lock busy. Returns 1 if the queue was
+   left damaged, 0 if it was left usable, and counts an error if it was
+   neither. */
+static int crash_once(const char *region_name) {
+  Queue_shared_options options = {16, 4 * CRASH_NAME_LENGTH};
+  Queue_prio_shared queue;
+  char *name = NULL;
+  char *taken = NULL;
+  pid_t child;
+  int damaged;
+
+  if (!create_queue_shared(&queue, region_name, &options)) {
+    errors++;
+    return 0;
+  }
+  child = fork();
+  if (child < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (child == 0) {
+    name = malloc(CRASH_NAME_LENGTH);
+    if (name == NULL)
+      _exit(1);
+    memset(name, 'x', CRASH_NAME_LENGTH - 1);
+    name[CRASH_NAME_LENGTH - 1] = '\0';
+    for (;;) {
+      en_queue_shared(&queue, name, 1);
+      free(de_queue_shared(&queue));
+    }
+  }
+
+  /* Let it get going before the kill. */
+  while (size_shared(&queue) == 0 && waitpid(child, NULL, WNOHANG) == 0)
+    ;
+  sleep_ms(2);
+  kill(child, SIGKILL);
+  waitpid(child, NULL, 0);
+
+  damaged = !en_queue_shared(&queue, "probe", 2);
+  if (damaged) {
+    taken = de_queue_shared(&queue);
+    if (taken != NULL) {
+      free(taken);
+      errors++;
+    }
+  } else {
+    /* The probe went in, so the queue must still work: it holds the
+       probe and at most the child's element, in order. */
+    taken = de_queue_shared(&queue);
+    if (taken == NULL || strcmp(taken, "probe") != 0)
+      errors++;
+    free(taken);
+    while ((taken = de_queue_shared(&queue)) != NULL)
+      free(taken);
+    if (size_shared(&queue) != 0)
+      errors++;
+  }
+  close_queue_shared(&queue);
+  unlink_queue_shared(region_name);
+  return damaged;
+}
+
+int main(int argc, char *argv[]) {
+  int processes = argc > 1 ? atoi(argv[1]) : 4;
+  int per_producer = argc > 2 ? atoi(argv[2]) : 20000;
+  Queue_shared_options options = {0, 0};
+  char region_name[64];
+  double together, drain;
+  int damaged = 0;
+  int attempts;
+  int total;
+  void *shared;
+  Run run;
+
+  if (processes < 1 || processes > 64)
+    processes = 4;
+  if (per_producer < 1)
+    per_producer = 1;
+  total = processes * per_producer;
+
+  shared = mmap(NULL, sizeof(atomic_int) + (size_t) total,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  run.remaining = shared;
+  run.seen = (atomic_uchar *) ((atomic_int *) shared + 1);
+  run.producers = processes;
+  run.per_producer = per_producer;
+
+  sprintf(region_name, "/queuemanager-bench-%ld", (long) getpid());
+  unlink_queue_shared(region_name);
+  options.capacity = (unsigned int) total;
+  if (!create_queue_shared(&run.queue, region_name, &options)) {
+    fprintf(stderr, "cannot create %s\n", region_name);
+    return 1;
+  }
+  together = run_together(&run, total);
+  drain = run_fill_drain(&run, total);
+  close_queue_shared(&run.queue);
+  unlink_queue_shared(region_name);
+
+  check_string_area(region_name);
+
+  for (attempts = 0; attempts < CRASH_ATTEMPTS && !damaged; attempts++)
+    damaged = crash_once(region_name);
+  if (!damaged)
+    errors++;
+
+  printf("%10s %16s %16s %16s\n", "processes", "mixed ops/s", "drain ops/s",
+         "kills");
+  printf("%10d %16.0f %16.0f %16d\n", processes, together, drain, attempts);
+  printf("errors=%d\n", errors);
+  munmap(shared, sizeof(atomic_int) + (size_t) total);
+  return errors != 0;
+}
@@ -0,0 +1,894 @@
+#define _POSIX_C_SOURCE 199309L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+
+/*Regression benchmark for every public function in queue-prio.h and
+  queue-prio-list.h. For each engine, priority distribution and queue
+  size it measures one function at a time and prints one CSV line with
+  the throughput and the p50/p99/p999 latency of single calls:
+
+    suite,function,engine,distribution,size,samples,ops_per_sec,
+    p50_ns,p99_ns,p999_ns
+
+  Queues are filled with 'size' elements whose priorities follow the
+  distribution:
+    uniform     pseudo-random priorities spread over the whole range
+    ascending   every new priority is higher than all before it
+    descending  every new priority is lower than all before it
+    zipf        priorities skewed towards the top of a range twice the
+                queue size (s = 0.99), so new ones often collide
+  Calls that look an element up pick it uniformly from the queue, or
+  with the same Zipf skew towards the highest priorities for 'zipf'.
+
+  Mutating calls are paired with an untimed call that undoes them, so
+  the size holds steady. en_queue is followed by de_queue and
+  de_queue by en_queue, which is the classic "hold" model. For the
+  registry (queue-prio-list.h) the size is the number of queues, and
+  the distribution picks which queue is looked up: at random, in
+  creation order, in reverse creation order or Zipf-skewed.
+
+  Each measurement stops after 'samples' calls or 'budget' ms,
+  whichever comes first, so the O(n) calls of the list engine still
+  finish at 1M elements; the 'samples' column shows how many calls the
+  percentiles rest on. The init functions do not depend on the size
+  and are reported once with size 0. Every latency includes the cost
+  of reading the clock, around 20-30 ns.
+
+  Usage: bench-suite [max size] [samples] [budget ms]*/
+
+#define BATCH 16
+#define RANGE 16
+#define ZIPF_S 0.99
+
+typedef enum distribution{
+  UNIFORM = 0,
+  ASCENDING,
+  DESCENDING,
+  ZIPF,
+  DISTRIBUTIONS
+}Distribution;
+
+static const char *const distribution_names[] = {"uniform", "ascending",
+                                                 "descending", "zipf"};
+/* Queue configurations measured, reported in the 'engine' column. */
+typedef struct config{
+  const char *name;
+  Queue_engine engine;
+  unsigned int indexes;
+}Config;
+
+static const Config configs[] = {
+  {"list", QUEUE_ENGINE_LIST, 0},
+  {"heap", QUEUE_ENGINE_HEAP, 0},
+  {"list+order", QUEUE_ENGINE_LIST, QUEUE_INDEX_ORDER}
+};
+
+/* State shared by the measurements of one table row. */
+typedef struct bench{
+  Distribution distribution;
+  const char *engine;
+  unsigned int size;
+  Queue_prio queue;
+  Queue_options options;
+  Queue_prio_list registry;
+
+  /* Source of new priorities. */
+  unsigned int next_fresh;
+  unsigned int zipf_domain;
+  double *zipf_cdf;
+  unsigned int rng;
+
+  /* Elements that lookups pick from, highest priority first. */
+  char **targets;
+  unsigned int target_count;
+  unsigned int target_step;
+
+  /* Latency samples of the current measurement. */
+  double *latency;
+  unsigned int samples;
+  unsigned int max_samples;
+  double budget_ns;
+  double started;
+}Bench;
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* xorshift32, so runs are repeatable. */
+static unsigned int next_random(Bench *bench) {
+  unsigned int x = bench->rng;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  bench->rng = x;
+  return x;
+}
+
+/* A bijection on 32-bit values, so distinct inputs give distinct
+   pseudo-random priorities. */
+static unsigned int scramble(unsigned int x) {
+  x *= 0x9E3779B1u;
+  x ^= x >> 15;
+  return x * 0x85EBCA77u;
+}
+
+/* Builds the Zipf CDF over ranks 1..domain. */
+static void zipf_setup(Bench *bench, unsigned int domain) {
+  double sum = 0;
+  unsigned int i;
+
+  free(bench->zipf_cdf);
+  bench->zipf_domain = domain;
+  bench->zipf_cdf = malloc(domain * sizeof(double));
+  for (i = 0; i < domain; i++) {
+    sum += 1.0 / pow(i + 1, ZIPF_S);
+    bench->zipf_cdf[i] = sum;
+  }
+  for (i = 0; i < domain; i++)
+    bench->zipf_cdf[i] /= sum;
+}
+
+/* Draws a Zipf rank in 0..domain-1; rank 0 is the most likely. */
+static unsigned int zipf_rank(Bench *bench) {
+  double u = next_random(bench) / 4294967296.0;
+  unsigned int low = 0;
+  unsigned int high = bench->zipf_domain - 1;
+  unsigned int mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (bench->zipf_cdf[mid] < u)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/* Returns the priority of the next element to enqueue. */
+static unsigned int fresh_priority(Bench *bench) {
+  switch (bench->distribution) {
+  case ASCENDING:
+    return bench->next_fresh++;
+  case DESCENDING:
+    return bench->next_fresh--;
+  case ZIPF:
+    return bench->zipf_domain - zipf_rank(bench);
+  default:
+    return scramble(bench->next_fresh++);
+  }
+}
+
+static void element_name(char name[], unsigned int priority) {
+  sprintf(name, "item-%u", priority);
+}
+
+/* Recovers the priority encoded in an element name. */
+static unsigned int name_priority(const char name[]) {
+  return (unsigned int) strtoul(name + 5, NULL, 10);
+}
+
+/* Returns the first free rank at or after 'rank'. 'next_free' links
+   every taken rank towards a later one, with path halving. */
+static unsigned int free_rank(unsigned int next_free[], unsigned int rank) {
+  while (next_free[rank] != rank) {
+    next_free[rank] = next_free[next_free[rank]];
+    rank = next_free[rank];
+  }
+  return rank;
+}
+
+/* Fills the queue with 'size' elements following the distribution. */
+static void fill_queue(Bench *bench) {
+  unsigned int size = bench->size;
+  unsigned int *priorities = malloc((size + 1) * sizeof(unsigned int));
+  const char **items = malloc((size + 1) * sizeof(char *));
+  char (*names)[24] = malloc((size + 1) * sizeof(*names));
+  unsigned int *next_free = NULL;
+  unsigned int rank;
+  unsigned int i;
+
+  if (bench->distribution == ZIPF) {
+    /* Hot ranks fill up first; a taken rank falls through to the next
+       free one, so the queue still reaches its size. */
+    zipf_setup(bench, 2 * size + 16);
+    next_free = malloc((bench->zipf_domain + 1) * sizeof(unsigned int));
+    for (i = 0; i <= bench->zipf_domain; i++)
+      next_free[i] = i;
+  }
+
+  for (i = 0; i < size; i++) {
+    switch (bench->distribution) {
+    case ASCENDING:
+      priorities[i] = i + 1;
+      break;
+    case DESCENDING:
+      priorities[i] = 0xFFFFFFFEu - i;
+      break;
+    case ZIPF:
+      rank = free_rank(next_free, zipf_rank(bench));
+      if (rank == bench->zipf_domain)
+        rank = free_rank(next_free, 0);
+      next_free[rank] = rank + 1;
+      priorities[i] = bench->zipf_domain - rank;
+      break;
+    default:
+      priorities[i] = scramble(i);
+      break;
+    }
+    element_name(names[i], priorities[i]);
+    items[i] = names[i];
+  }
+  en_queue_batch(&bench->queue, items, priorities, size, NULL);
+
+  if (bench->distribution == ASCENDING)
+    bench->next_fresh = size + 1;
+  else if (bench->distribution == DESCENDING)
+    bench->next_fresh = 0xFFFFFFFEu - size;
+  else
+    bench->next_fresh = size;
+
+  free(next_free);
+  free(priorities);
+  free(items);
+  free(names);
+}
+
+/* Snapshots the queue's elements as lookup targets. */
+static void take_targets(Bench *bench) {
+  unsigned int count = 0;
+
+  if (bench->targets != NULL)
+    free_name_list(bench->targets);
+  bench->targets = all_element_names(&bench->queue);
+  while (bench->targets != NULL && bench->targets[count] != NULL)
+    count++;
+  bench->target_count = count;
+  bench->target_step = 0;
+}
+
+/* Picks the index of the next target among 'count'. */
+static unsigned int pick(Bench *bench, unsigned int count) {
+  if (count == 0)
+    return 0;
+  switch (bench->distribution) {
+  case ASCENDING:
+    return bench->target_step++ % count;
+  case DESCENDING:
+    return count - 1 - bench->target_step++ % count;
+  case ZIPF:
+    return zipf_rank(bench) % count;
+  default:
+    return next_random(bench) % count;
+  }
+}
+
+static const char *pick_target(Bench *bench) {
+  return bench->targets[pick(bench, bench->target_count)];
+}
+
+/* Starts a measurement. */
+static void start(Bench *bench) {
+  bench->samples = 0;
+  bench->started = now_ns();
+}
+
+/* Returns 1 while the measurement should take another sample. */
+static int more(const Bench *bench) {
+  return bench->samples < bench->max_samples
+      && (bench->samples == 0
+          || now_ns() - bench->started < bench->budget_ns);
+}
+
+static void record(Bench *bench, double since) {
+  bench->latency[bench->samples++] = now_ns() - since;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double sorted[], unsigned int count, double p) {
+  unsigned int i = (unsigned int) ceil(p * count);
+
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+/* Prints the row for the samples just taken. */
+static void report(Bench *bench, const char *suite, const char *function,
+                   const char *distribution, unsigned int size) {
+  double total = 0;
+  unsigned int i;
+
+  if (bench->samples == 0)
+    return;
+  for (i = 0; i < bench->samples; i++)
+    total += bench->latency[i];
+  qsort(bench->latency, bench->samples, sizeof(double), compare_double);
+  printf("%s,%s,%s,%s,%u,%u,%.0f,%.0f,%.0f,%.0f\n", suite, function,
+         bench->engine, distribution, size, bench->samples,
+         bench->samples / (total / 1e9),
+         percentile(bench->latency, bench->samples, 0.50),
+         percentile(bench->latency, bench->samples, 0.99),
+         percentile(bench->latency, bench->samples, 0.999));
+  fflush(stdout);
+}
+
+/* Runs 'measure' and reports it as a row of the queue suite. */
+static void run(Bench *bench, const char *function,
+                void (*measure)(Bench *bench)) {
+  start(bench);
+  measure(bench);
+  report(bench, "queue", function, distribution_names[bench->distribution],
+         bench->size);
+}
+
+static void measure_en_queue(Bench *bench) {
+  char name[24];
+  unsigned int priority;
+  unsigned short ret;
+  double t;
+
+  while (more(bench)) {
+    priority = fresh_priority(bench);
+    element_name(name, priority);
+    t = now_ns();
+    ret = en_queue(&bench->queue, name, priority);
+    record(bench, t);
+    if (ret)
+      free(de_queue(&bench->queue));
+  }
+}
+
+static void measure_en_queue_batch(Bench *bench) {
+  char names[BATCH][24];
+  const char *items[BATCH];
+  unsigned int priorities[BATCH];
+  char *out[BATCH];
+  unsigned int taken;
+  unsigned int i;
+  double t;
+
+  while (more(bench)) {
+    for (i = 0; i < BATCH; i++) {
+      priorities[i] = fresh_priority(bench);
+      element_name(names[i], priorities[i]);
+      items[i] = names[i];
+    }
+    t = now_ns();
+    taken = en_queue_batch(&bench->queue, items, priorities, BATCH, NULL);
+    record(bench, t);
+    taken = de_queue_batch(&bench->queue, out, taken);
+    for (i = 0; i < taken; i++)
+      free(out[i]);
+  }
+}
+
+static void measure_has_no_elements(Bench *bench) {
+  volatile short sink;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    sink = has_no_elements(&bench->queue);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+static void measure_size(Bench *bench) {
+  volatile short sink;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    sink = size(&bench->queue);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+static void measure_peek(Bench *bench) {
+  char *name;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    name = peek(&bench->queue);
+    record(bench, t);
+    free(name);
+  }
+}
+
+static void measure_peek_ref(Bench *bench) {
+  const char *volatile sink;
+  size_t length;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    sink = peek_ref(&bench->queue, &length);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+static void measure_peek_priority(Bench *bench) {
+  volatile long long sink;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    sink = peek_priority(&bench->queue);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+static void measure_de_queue(Bench *bench) {
+  char *name;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    name = de_queue(&bench->queue);
+    record(bench, t);
+    if (name != NULL)
+      en_queue(&bench->queue, name, name_priority(name));
+    free(name);
+  }
+}
+
+static void measure_de_queue_batch(Bench *bench) {
+  char *out[BATCH];
+  unsigned int priorities[BATCH];
+  unsigned int taken;
+  unsigned int i;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    taken = de_queue_batch(&bench->queue, out, BATCH);
+    record(bench, t);
+    for (i = 0; i < taken; i++)
+      priorities[i] = name_priority(out[i]);
+    en_queue_batch(&bench->queue, (const char *const *) out, priorities, taken,
+                   NULL);
+    for (i = 0; i < taken; i++)
+      free(out[i]);
+  }
+}
+
+static void measure_de_queue_into(Bench *bench) {
+  char name[64];
+  long length;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    length = de_queue_into(&bench->queue, name, sizeof(name));
+    record(bench, t);
+    if (length >= 0)
+      en_queue(&bench->queue, name, name_priority(name));
+  }
+}
+
+static void measure_all_element_names(Bench *bench) {
+  char **names;
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    names = all_element_names(&bench->queue);
+    record(bench, t);
+    free_name_list(names);
+  }
+}
+
+static void measure_free_name_list(Bench *bench) {
+  char **names;
+  double t;
+
+  while (more(bench)) {
+    names = all_element_names(&bench->queue);
+    t = now_ns();
+    free_name_list(names);
+    record(bench, t);
+  }
+}
+
+static void measure_get_priority(Bench *bench) {
+  volatile int sink;
+  const char *name;
+  double t;
+
+  while (more(bench)) {
+    name = pick_target(bench);
+    t = now_ns();
+    sink = get_priority(&bench->queue, name);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+/* Picks a range spanning about RANGE elements of the queue. */
+static void pick_range(Bench *bench, unsigned int *low, unsigned int *high) {
+  unsigned int i = pick(bench, bench->target_count);
+  unsigned int j = i + RANGE - 1 < bench->target_count
+    ? i + RANGE - 1 : bench->target_count - 1;
+
+  *high = name_priority(bench->targets[i]);
+  *low = name_priority(bench->targets[j]);
+}
+
+static void measure_count_between(Bench *bench) {
+  volatile unsigned int sink;
+  unsigned int low;
+  unsigned int high;
+  double t;
+
+  while (more(bench)) {
+    pick_range(bench, &low, &high);
+    t = now_ns();
+    sink = count_between(&bench->queue, low, high);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+static void measure_elements_between(Bench *bench) {
+  unsigned int low;
+  unsigned int high;
+  char **names;
+  double t;
+
+  while (more(bench)) {
+    pick_range(bench, &low, &high);
+    t = now_ns();
+    names = elements_between(&bench->queue, low, high);
+    record(bench, t);
+    free_name_list(names);
+  }
+}
+
+static void measure_change_priority(Bench *bench) {
+  const char *name;
+  unsigned int old_priority;
+  unsigned int ret;
+  double t;
+
+  while (more(bench)) {
+    name = pick_target(bench);
+    old_priority = name_priority(name);
+    t = now_ns();
+    ret = change_priority(&bench->queue, name, fresh_priority(bench));
+    record(bench, t);
+    if (ret)
+      change_priority(&bench->queue, name, old_priority);
+  }
+}
+
+static void measure_get_handle(Bench *bench) {
+  Queue_handle handle;
+  unsigned int priority;
+  unsigned short sink = 0;
+  double t;
+
+  while (more(bench)) {
+    priority = name_priority(pick_target(bench));
+    t = now_ns();
+    sink = get_handle(&bench->queue, priority, &handle);
+    record(bench, t);
+  }
+  (void) sink;
+}
+
+/* Looks the handle up untimed, as a caller would keep it from
+   en_queue_h. A target that is gone gets a handle that is turned
+   down. */
+static void pick_handle(Bench *bench, unsigned int priority,
+                        Queue_handle *handle) {
+  if (!get_handle(&bench->queue, priority, handle))
+    memset(handle, 0, sizeof(Queue_handle));
+}
+
+static void measure_change_priority_h(Bench *bench) {
+  Queue_handle handle;
+  unsigned int old_priority;
+  unsigned short ret;
+  double t;
+
+  while (more(bench)) {
+    old_priority = name_priority(pick_target(bench));
+    pick_handle(bench, old_priority, &handle);
+    t = now_ns();
+    ret = change_priority_h(&bench->queue, &handle, fresh_priority(bench));
+    record(bench, t);
+    if (ret)
+      change_priority_h(&bench->queue, &handle, old_priority);
+  }
+}
+
+static void measure_remove_h(Bench *bench) {
+  Queue_handle handle;
+  const char *name;
+  unsigned int priority;
+  unsigned short ret;
+  double t;
+
+  while (more(bench)) {
+    name = pick_target(bench);
+    priority = name_priority(name);
+    pick_handle(bench, priority, &handle);
+    t = now_ns();
+    ret = remove_h(&bench->queue, &handle);
+    record(bench, t);
+    if (ret)
+      en_queue(&bench->queue, name, priority);
+  }
+}
+
+static void measure_remove_elements_between(Bench *bench) {
+  const char *name;
+  unsigned int priority;
+  unsigned int removed;
+  double t;
+
+  while (more(bench)) {
+    name = pick_target(bench);
+    priority = name_priority(name);
+    t = now_ns();
+    removed = remove_elements_between(&bench->queue, priority, priority);
+    record(bench, t);
+    if (removed)
+      en_queue(&bench->queue, name, priority);
+  }
+}
+
+/* Leaves the queue filled again afterwards. */
+static void measure_clear_queue_prio(Bench *bench) {
+  double t;
+
+  while (more(bench)) {
+    t = now_ns();
+    clear_queue_prio(&bench->queue);
+    record(bench, t);
+    init_queue_with_options(&bench->queue, &bench->options);
+    fill_queue(bench);
+  }
+}
+
+static void *bench_alloc(size_t size, void *context) {
+  (void) context;
+  return malloc(size);
+}
+
+static void bench_free(void *block, void *context) {
+  (void) context;
+  free(block);
+}
+
+/* Measures the init functions, which do not depend on the size. */
+static void run_init(Bench *bench) {
+  Queue_allocator allocator = {bench_alloc, bench_free, NULL};
+  Queue_prio queue;
+  double t;
+  int which;
+
+  for (which = 0; which < 3; which++) {
+    start(bench);
+    while (more(bench)) {
+      t = now_ns();
+      if (which == 0)
+        init_queue(&queue);
+      else if (which == 1)
+        init_queue_with_options(&queue, &bench->options);
+      else
+        init_queue_with_allocator(&queue, &allocator);
+      record(bench, t);
+      clear_queue_prio(&queue);
+    }
+    /* init_queue and init_queue_with_allocator always give a plain
+       list queue, so they are reported with that configuration only. */
+    if (which == 1 || (bench->options.engine == QUEUE_ENGINE_LIST
+                       && bench->options.indexes == 0))
+      report(bench, "queue", which == 0 ? "init_queue"
+             : which == 1 ? "init_queue_with_options"
+             : "init_queue_with_allocator", "none", 0);
+  }
+}
+
+/* Measures every queue-prio.h function on one filled queue. */
+static void run_queue(Bench *bench) {
+  init_queue_with_options(&bench->queue, &bench->options);
+  bench->rng = 2463534242u;
+  fill_queue(bench);
+  take_targets(bench);
+
+  run(bench, "en_queue", measure_en_queue);
+  run(bench, "en_queue_batch/16", measure_en_queue_batch);
+  run(bench, "has_no_elements", measure_has_no_elements);
+  run(bench, "size", measure_size);
+  run(bench, "peek", measure_peek);
+  run(bench, "peek_ref", measure_peek_ref);
+  run(bench, "peek_priority", measure_peek_priority);
+  run(bench, "de_queue", measure_de_queue);
+  run(bench, "de_queue_batch/16", measure_de_queue_batch);
+  run(bench, "de_queue_into", measure_de_queue_into);
+  run(bench, "all_element_names", measure_all_element_names);
+  run(bench, "free_name_list", measure_free_name_list);
+
+  /* The calls above may have moved elements around; look up what is
+     there now. */
+  take_targets(bench);
+  run(bench, "get_priority", measure_get_priority);
+  run(bench, "change_priority", measure_change_priority);
+  run(bench, "get_handle", measure_get_handle);
+  run(bench, "change_priority_h", measure_change_priority_h);
+  run(bench, "remove_h", measure_remove_h);
+  run(bench, "remove_elements_between", measure_remove_elements_between);
+  run(bench, "count_between/16", measure_count_between);
+  run(bench, "elements_between/16", measure_elements_between);
+  run(bench, "clear_queue_prio", measure_clear_queue_prio);
+
+  clear_queue_prio(&bench->queue);
+  free_name_list(bench->targets);
+  bench->targets = NULL;
+}
+
+static void registry_name(char name[], const char *prefix, unsigned int i) {
+  sprintf(name, "%s-%u", prefix, i);
+}
+
+static void fill_registry(Bench *bench) {
+  char name[32];
+  unsigned int i;
+
+  init_queue_list(&bench->registry);
+  for (i = 0; i < bench->size; i++) {
+    registry_name(name, "queue", i);
+    add_queue_prio(&bench->registry, name);
+  }
+}
+
+/* Measures every queue-prio-list.h function on a registry of 'size'
+   queues. */
+static void run_registry(Bench *bench) {
+  const char *distribution = distribution_names[bench->distribution];
+  volatile short sink_short;
+  Queue_prio *volatile sink_queue;
+  unsigned int fresh = 0;
+  char name[32];
+  short ret;
+  double t;
+
+  bench->rng = 2463534242u;
+  bench->target_step = 0;
+  if (bench->distribution == ZIPF)
+    zipf_setup(bench, bench->size);
+  fill_registry(bench);
+
+  start(bench);
+  while (more(bench)) {
+    registry_name(name, "fresh", fresh++);
+    t = now_ns();
+    ret = add_queue_prio(&bench->registry, name);
+    record(bench, t);
+    if (ret == 1)
+      remove_queue(&bench->registry, name);
+  }
+  report(bench, "registry", "add_queue_prio", distribution, bench->size);
+
+  start(bench);
+  while (more(bench)) {
+    registry_name(name, "queue", pick(bench, bench->size));
+    t = now_ns();
+    sink_queue = get_queue(&bench->registry, name);
+    record(bench, t);
+  }
+  report(bench, "registry", "get_queue", distribution, bench->size);
+
+  start(bench);
+  while (more(bench)) {
+    t = now_ns();
+    sink_short = num_queues(&bench->registry);
+    record(bench, t);
+  }
+  report(bench, "registry", "num_queues", distribution, bench->size);
+
+  start(bench);
+  while (more(bench)) {
+    registry_name(name, "queue", pick(bench, bench->size));
+    t = now_ns();
+    ret = remove_queue(&bench->registry, name);
+    record(bench, t);
+    if (ret >= 0)
+      add_queue_prio(&bench->registry, name);
+  }
+  report(bench, "registry", "remove_queue", distribution, bench->size);
+
+  start(bench);
+  while (more(bench)) {
+    t = now_ns();
+    clear_queue_prio_list(&bench->registry);
+    record(bench, t);
+    fill_registry(bench);
+  }
+  report(bench, "registry", "clear_queue_prio_list", distribution,
+         bench->size);
+
+  clear_queue_prio_list(&bench->registry);
+  (void) sink_short;
+  (void) sink_queue;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int max_size = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000000;
+  unsigned int max_samples = argc > 2 ? (unsigned int) atoi(argv[2]) : 2000;
+  double budget_ms = argc > 3 ? atof(argv[3]) : 50;
+  Bench bench;
+  Queue_prio_list registry;
+  unsigned int size;
+  int config;
+  int distribution;
+  double t;
+
+  if (max_samples == 0)
+    max_samples = 1;
+  memset(&bench, 0, sizeof(bench));
+  bench.max_samples = max_samples;
+  bench.budget_ns = budget_ms * 1e6;
+  bench.latency = malloc(max_samples * sizeof(double));
+
+  printf("suite,function,engine,distribution,size,samples,ops_per_sec,"
+         "p50_ns,p99_ns,p999_ns\n");
+
+  for (config = 0; config < ARRSIZE(configs); config++) {
+    bench.options.engine = configs[config].engine;
+    bench.options.indexes = configs[config].indexes;
+    bench.engine = configs[config].name;
+    run_init(&bench);
+    for (distribution = 0; distribution < DISTRIBUTIONS; distribution++) {
+      bench.distribution = (Distribution) distribution;
+      for (size = 10; size <= max_size; size *= 10) {
+        bench.size = size;
+        run_queue(&bench);
+      }
+    }
+  }
+
+  /* The registry does not depend on the engine. */
+  bench.engine = "-";
+  start(&bench);
+  while (more(&bench)) {
+    t = now_ns();
+    init_queue_list(&registry);
+    record(&bench, t);
+    clear_queue_prio_list(&registry);
+  }
+  report(&bench, "registry", "init_queue_list", "none", 0);
+  for (distribution = 0; distribution < DISTRIBUTIONS; distribution++) {
+    bench.distribution = (Distribution) distribution;
+    for (size = 10; size <= max_size; size *= 10) {
+      bench.size = size;
+      run_registry(&bench);
+    }
+  }
+
+  free(bench.zipf_cdf);
+  free(bench.latency);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio64.h"
+#include "queue-prio-timed.h"
+
+/*This benchmark measures delayed elements at millions of pending
+  timers. It schedules 'timers' elements with en_queue_at at random
+  delivery times spread over 'horizon' ms, then drives the wheel with
+  advance_queue_timed one millisecond at a time, dequeuing everything
+  that falls due at each step, until every timer has expired. The
+  wheel runs on simulated time, so the run takes as long as the work
+  and not as long as the horizon.
+
+  The same schedule is run against a binary-heap timer queue (a
+  Queue_prio64 keyed on the inverted delivery time) that moves due
+  elements into a Queue_prio one at a time, which is what a timer
+  heap in front of the queue would do.
+
+  Usage: bench-timed [timers] [horizon ms]*/
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  int timers = argc > 1 ? atoi(argv[1]) : 2000000;
+  long horizon = argc > 2 ? atol(argv[2]) : 600000;
+  unsigned long long *deliver_at = NULL;
+  unsigned long long base;
+  unsigned long long tick;
+  unsigned long long due;
+  Queue_prio_timed timed;
+  Queue_prio64 heap;
+  Queue_prio ready;
+  char name[32];
+  char buffer[32];
+  double start;
+  double elapsed;
+  long expired;
+  int i;
+
+  if (timers < 1)
+    timers = 1;
+  if (horizon < 1)
+    horizon = 1;
+  deliver_at = malloc((size_t) timers * sizeof(*deliver_at));
+  if (deliver_at == NULL)
+    return 1;
+  srand(42);
+
+  printf("timers=%d horizon=%ld ms\n", timers, horizon);
+
+  /* Timing wheel. */
+  init_queue_timed(&timed, NULL);
+  base = timed.wheel.now;
+  for (i = 0; i < timers; i++)
+    deliver_at[i] = base + 1
+      + (((unsigned long long) rand() << 16) ^ (unsigned long long) rand())
+      % (unsigned long long) horizon;
+  start = now_ns();
+  for (i = 0; i < timers; i++) {
+    sprintf(name, "job-%d", i);
+    en_queue_at(&timed, name, (unsigned int) i, deliver_at[i]);
+  }
+  elapsed = now_ns() - start;
+  printf("%-6s %-10s %10.1f ms %8.1f ns/timer\n", "wheel", "schedule",
+         elapsed / 1e6, elapsed / timers);
+
+  expired = 0;
+  start = now_ns();
+  for (tick = base + 1; tick <= base + (unsigned long long) horizon; tick++) {
+    advance_queue_timed(&timed, tick);
+    while (de_queue_into(&timed.ready, buffer, sizeof(buffer)) >= 0)
+      expired++;
+  }
+  elapsed = now_ns() - start;
+  printf("%-6s %-10s %10.1f ms %8.1f ns/timer (%ld expired)\n", "wheel",
+         "expire", elapsed / 1e6, elapsed / timers, expired);
+  clear_queue_prio_timed(&timed);
+
+  /* Binary-heap timer queue. */
+  init_queue64(&heap);
+  init_queue(&ready);
+  start = now_ns();
+  for (i = 0; i < timers; i++) {
+    sprintf(name, "job-%d", i);
+    en_queue64(&heap, name, ~deliver_at[i]);
+  }
+  elapsed = now_ns() - start;
+  printf("%-6s %-10s %10.1f ms %8.1f ns/timer\n", "heap", "schedule",
+         elapsed / 1e6, elapsed / timers);
+
+  expired = 0;
+  start = now_ns();
+  for (tick = base + 1; tick <= base + (unsigned long long) horizon; tick++) {
+    while (peek_priority64(&heap, &due) && ~due <= tick) {
+      de_queue_into64(&heap, buffer, sizeof(buffer));
+      en_queue(&ready, buffer, (unsigned int) atoi(buffer + 4));
+    }
+    while (de_queue_into(&ready, buffer, sizeof(buffer)) >= 0)
+      expired++;
+  }
+  elapsed = now_ns() - start;
+  printf("%-6s %-10s %10.1f ms %8.1f ns/timer (%ld expired)\n", "heap",
+         "expire", elapsed / 1e6, elapsed / timers, expired);
+  clear_queue_prio64(&heap);
+  clear_queue_prio(&ready);
+
+  free(deliver_at);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include "queue-prio.hpp"
+
+/*This benchmark compares queueing a job struct through the C++
+  PriorityQueue with the string round trip it replaces: the struct
+  printed into a name for en_queue, then parsed back with sscanf after
+  de_queue. Each way it enqueues 'count' jobs with distinct random
+  priorities and dequeues them all, on the heap and columns engines, and
+  checks that the jobs come out in the same order.
+
+  Usage: bench-typed [count]*/
+
+namespace {
+
+struct Job {
+  unsigned int id;
+  unsigned int attempts;
+  double weight;
+  std::string owner;
+
+  Job() : id(0), attempts(0), weight(0) {}
+  Job(unsigned int id, unsigned int attempts, double weight,
+      std::string owner)
+    : id(id), attempts(attempts), weight(weight), owner(std::move(owner)) {}
+};
+
+double now_ns() {
+  return static_cast<double>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+unsigned int random_priority() {
+  return ((static_cast<unsigned int>(rand()) << 16)
+          ^ static_cast<unsigned int>(rand())) % 0x40000000u;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  const char *engine_names[] = {"heap", "columns"};
+  const Queue_engine engines[] = {QUEUE_ENGINE_HEAP, QUEUE_ENGINE_COLUMNS};
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  unsigned long long typed_sum;
+  unsigned long long string_sum;
+  char text[96];
+  char owner[32];
+  double start;
+  double elapsed;
+  unsigned int e;
+  int i;
+
+  if (count < 1)
+    count = 1;
+  printf("count=%d\n", count);
+
+  for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+    options.engine = engines[e];
+
+    {
+      queuemanager::PriorityQueue<Job> queue(options);
+      Job job;
+
+      srand(42);
+      typed_sum = 0;
+      start = now_ns();
+      for (i = 0; i < count; i++)
+        queue.emplace(random_priority(), static_cast<unsigned int>(i), 1u,
+                      0.5 * i, "scheduler");
+      while (queue.try_pop(job))
+        typed_sum = typed_sum * 31 + job.id + job.attempts + job.owner.size();
+      elapsed = now_ns() - start;
+      printf("%-8s %-29s %8.1f ns/job\n", engine_names[e],
+             "PriorityQueue<Job>", elapsed / count);
+    }
+
+    {
+      Queue_prio queue;
+      Job job;
+      char *name = NULL;
+
+      init_queue_with_options(&queue, &options);
+      srand(42);
+      string_sum = 0;
+      start = now_ns();
+      for (i = 0; i < count; i++) {
+        snprintf(text, sizeof(text), "%u %u %.17g %s",
+                 static_cast<unsigned int>(i), 1u, 0.5 * i, "scheduler");
+        en_queue(&queue, text, random_priority());
+      }
+      while ((name = de_queue(&queue)) != NULL) {
+        sscanf(name, "%u %u %lg %31s", &job.id, &job.attempts, &job.weight,
+               owner);
+        job.owner = owner;
+        free(name);
+        string_sum = string_sum * 31 + job.id + job.attempts
+          + job.owner.size();
+      }
+      elapsed = now_ns() - start;
+      printf("%-8s %-29s %8.1f ns/job%s\n", engine_names[e],
+             "en_queue + de_queue + sscanf", elapsed / count,
+             typed_sum == string_sum ? "" : " (order differs)");
+      clear_queue_prio(&queue);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+
+/*Checks that a wakeup from en_queue_list is never lost when consumers
+  of de_queue_any wait on overlapping sets of queues. In every round
+  consumer A blocks on {Q, R} and then consumer B blocks on {Q}. A
+  higher priority is put in R behind the list's back, as when it
+  arrives after A is woken but before A runs, and then en_queue_list
+  adds to Q, which wakes A. A takes R's element, so Q's must reach B
+  at once, not when B's timeout makes it look again. The program
+  reports the time per round and exits non-zero if a round took that
+  long or a consumer got the wrong element.
+
+  Usage: bench-wait [rounds]*/
+
+#define WAIT_TIMEOUT_MS 2000
+
+typedef struct consumer{
+  Queue_prio_list *list;
+  const char *const *queues;
+  char *element;
+}Consumer;
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+static void *consume(void *arg) {
+  Consumer *consumer = arg;
+
+  consumer->element = de_queue_any(consumer->list, consumer->queues,
+                                   WAIT_TIMEOUT_MS);
+  return NULL;
+}
+
+/* Returns 1 once some consumer is blocked in de_queue_any. */
+static int has_waiter(Queue_prio_list *list) {
+  int ret;
+
+  pthread_mutex_lock(&list->lock);
+  ret = list->waiters != NULL;
+  pthread_mutex_unlock(&list->lock);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const both[] = {"Q", "R", NULL};
+  static const char *const one[] = {"Q", NULL};
+  int rounds = argc > 1 ? atoi(argv[1]) : 200;
+  Queue_prio_list list;
+  Consumer a = {&list, both, NULL};
+  Consumer b = {&list, one, NULL};
+  pthread_t ta, tb;
+  double start;
+  double round_start;
+  int errors = 0;
+  int round;
+
+  if (rounds < 1)
+    rounds = 1;
+  init_queue_list(&list);
+  add_queue_prio(&list, "Q");
+  add_queue_prio(&list, "R");
+
+  start = now_ns();
+  for (round = 0; round < rounds; round++) {
+    pthread_create(&ta, NULL, consume, &a);
+    while (!has_waiter(&list))
+      ;
+    pthread_create(&tb, NULL, consume, &b);
+    /* B has no record to poll for once A's is there; give it time to
+       block behind A. */
+    sleep_ms(1);
+
+    pthread_mutex_lock(&list.lock);
+    en_queue(get_queue(&list, "R"), "high", 2);
+    pthread_mutex_unlock(&list.lock);
+    round_start = now_ns();
+    en_queue_list(&list, "Q", "low", 1);
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+
+    if (now_ns() - round_start > WAIT_TIMEOUT_MS / 2 * 1e6
+        || a.element == NULL || strcmp(a.element, "high") != 0
+        || b.element == NULL || strcmp(b.element, "low") != 0)
+      errors++;
+    free(a.element);
+    free(b.element);
+    /* Whatever a failed round left behind goes before the next one. */
+    free(de_queue(get_queue(&list, "Q")));
+  }
+
+  printf("rounds=%d %.1f us/round errors=%d\n", rounds,
+         (now_ns() - start) / rounds / 1e3, errors);
+  clear_queue_prio_list(&list);
+  return errors != 0;
+}
@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include "queue-prio-engine.h"
+
+/*This file manages the memory behind a queue's nodes and element
+  strings. Instead of one malloc per node and one per string, nodes
+  come from per-queue slabs and strings are bump-allocated from
+  per-queue chunks, with a free list for each string size class so
+  that churn reuses memory instead of fragmenting the heap. All of it
+  is obtained through the queue's Queue_allocator hooks, and
+  clear_queue_prio returns it in one pass over the slabs and chunks
+  rather than one free per element.*/
+
+#define POOL_FIRST_SLAB 16
+#define POOL_MAX_SLAB 1024
+#define ARENA_FIRST_CHUNK 1024
+#define ARENA_MAX_CHUNK 65536
+#define ARENA_SMALLEST_CLASS 16
+
+/* Header of a slab of nodes. */
+typedef struct slab{
+  struct slab *next;
+  Node nodes[];
+}Slab;
+
+/* Header of a chunk of string storage. The union keeps the strings
+   that follow it aligned for the free-list links. */
+typedef union chunk{
+  union chunk *next;
+  long double align;
+}Chunk;
+
+/* Header of a string too large for any size class. */
+typedef struct large_block{
+  struct large_block *next;
+  struct large_block *prev;
+  long double data[];
+}Large_block;
+
+/* Link stored inside a freed string. */
+typedef struct free_string{
+  struct free_string *next;
+}Free_string;
+
+/* Allocates through the queue's hooks, or malloc without them. */
+static void *storage_alloc(Queue_prio *const queue_prio, size_t size) {
+  STATS_COUNT(QUEUE_STAT_ALLOCATIONS, 1);
+  if (queue_prio->allocator.alloc != NULL)
+    return queue_prio->allocator.alloc(size, queue_prio->allocator.context);
+  return malloc(size);
+}
+
+/* Releases memory obtained by storage_alloc. */
+static void storage_free(Queue_prio *const queue_prio, void *const block) {
+  if (queue_prio->allocator.alloc != NULL)
+    queue_prio->allocator.free(block, queue_prio->allocator.context);
+  else
+    free(block);
+}
+
+/*
+ * Returns a node whose fields are uninitialized but for 'generation',
+ * or NULL if memory runs out.
+ */
+Node *pool_alloc_node(Queue_prio *const queue_prio) {
+  Node_pool *pool = &queue_prio->pool;
+  Slab *slab = NULL;
+  Node *node = NULL;
+
+  /* Reuse a freed node first. */
+  if (pool->free_nodes != NULL) {
+    node = pool->free_nodes;
+    pool->free_nodes = node->next;
+    return node;
+  }
+
+  /* Start a new slab once the current one is used up. Slabs double in
+     size so small queues stay small. */
+  if (pool->fresh_left == 0) {
+    if (pool->next_slab_nodes == 0)
+      pool->next_slab_nodes = POOL_FIRST_SLAB;
+    slab = storage_alloc(queue_prio, sizeof(Slab)
+                         + pool->next_slab_nodes * sizeof(Node));
+    if (slab == NULL)
+      return NULL;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->fresh = slab->nodes;
+    pool->fresh_left = pool->next_slab_nodes;
+    if (pool->next_slab_nodes < POOL_MAX_SLAB)
+      pool->next_slab_nodes *= 2;
+  }
+
+  pool->fresh_left--;
+  pool->fresh->generation = 0;
+  return pool->fresh++;
+}
+
+/*
+ * Returns 'count' nodes, uninitialized as for pool_alloc_node, that
+ * lie one after another in a slab of their own, or NULL if memory runs
+ * out. Nodes of the run that go unused are given back with
+ * pool_free_node like any other.
+ */
+Node *pool_alloc_run(Queue_prio *const queue_prio, unsigned int count) {
+  Slab *slab = storage_alloc(queue_prio, sizeof(Slab)
+                             + (size_t) count * sizeof(Node));
+  unsigned int i;
+
+  if (slab == NULL)
+    return NULL;
+  slab->next = queue_prio->pool.slabs;
+  queue_prio->pool.slabs = slab;
+  for (i = 0; i < count; i++)
+    slab->nodes[i].generation = 0;
+  return slab->nodes;
+}
+
+/*
+ * Gives a node back to the pool.
+ */
+void pool_free_node(Queue_prio *const queue_prio, Node *const node) {
+  node->next = queue_prio->pool.free_nodes;
+  queue_prio->pool.free_nodes = node;
+}
+
+/*
+ * Gives back a chain of nodes linked through 'next' from 'first' to
+ * 'last' in one step.
+ */
+void pool_free_chain(Queue_prio *const queue_prio, Node *const first,
+                     Node *const last) {
+  last->next = queue_prio->pool.free_nodes;
+  queue_prio->pool.free_nodes = first;
+}
+
+/* Returns the size class for a string of 'size' bytes, or
+   ARENA_CLASSES if it is too large for all of them. */
+static unsigned int size_class(size_t size) {
+  unsigned int class = 0;
+  size_t class_size = ARENA_SMALLEST_CLASS;
+
+  while (class < ARENA_CLASSES && class_size < size) {
+    class++;
+    class_size *= 2;
+  }
+  return class;
+}
+
+/*
+ * Returns room for a string of 'size' bytes, including the
+ * terminator, or NULL if memory runs out.
+ */
+char *arena_alloc_string(Queue_prio *const queue_prio, size_t size) {
+  String_arena *arena = &queue_prio->arena;
+  unsigned int class = size_class(size);
+  size_t class_size = (size_t) ARENA_SMALLEST_CLASS << class;
+  size_t chunk_size;
+  Large_block *large = NULL;
+  Free_string *reused = NULL;
+  Chunk *chunk = NULL;
+
+  /* Oversized strings get a block of their own. */
+  if (class == ARENA_CLASSES) {
+    large = storage_alloc(queue_prio, sizeof(Large_block) + size);
+    if (large == NULL)
+      return NULL;
+    large->prev = NULL;
+    large->next = arena->large;
+    if (large->next != NULL)
+      large->next->prev = large;
+    arena->large = large;
+    return (char *) large->data;
+  }
+
+  /* Reuse a freed string of the same class. */
+  if (arena->free_lists[class] != NULL) {
+    reused = arena->free_lists[class];
+    arena->free_lists[class] = reused->next;
+    return (char *) reused;
+  }
+
+  /* Bump-allocate, starting a new chunk when the current one cannot
+     hold the string. The unused tail of the old chunk is abandoned
+     until the queue is cleared. */
+  if (arena->left < class_size) {
+    if (arena->next_chunk_size == 0)
+      arena->next_chunk_size = ARENA_FIRST_CHUNK;
+    chunk_size = arena->next_chunk_size;
+    while (chunk_size < class_size)
+      chunk_size *= 2;
+    chunk = storage_alloc(queue_prio, sizeof(Chunk) + chunk_size);
+    if (chunk == NULL)
+      return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->cursor = (char *) (chunk + 1);
+    arena->left = chunk_size;
+    if (arena->next_chunk_size < ARENA_MAX_CHUNK)
+      arena->next_chunk_size *= 2;
+  }
+
+  arena->cursor += class_size;
+  arena->left -= class_size;
+  return arena->cursor - class_size;
+}
+
+/*
+ * Gives back a string obtained from arena_alloc_string with the same
+ * 'size'.
+ */
+void arena_free_string(Queue_prio *const queue_prio, char *const data,
+                       size_t size) {
+  String_arena *arena = &queue_prio->arena;
+  unsigned int class = size_class(size);
+  Large_block *large = NULL;
+  Free_string *freed = (Free_string *) data;
+
+  if (class == ARENA_CLASSES) {
+    /* Unchain the block and release it right away. */
+    large = (Large_block *) (data - offsetof(Large_block, data));
+    if (large->prev != NULL)
+      large->prev->next = large->next;
+    else
+      arena->large = large->next;
+    if (large->next != NULL)
+      large->next->prev = large->prev;
+    storage_free(queue_prio, large);
+    return;
+  }
+
+  freed->next = arena->free_lists[class];
+  arena->free_lists[class] = freed;
+}
+
+/*
+ * Releases every slab, chunk and large string of the queue at once.
+ * Every node and string handed out before becomes invalid.
+ */
+void storage_release(Queue_prio *const queue_prio) {
+  String_arena *arena = &queue_prio->arena;
+  Slab *slab = queue_prio->pool.slabs;
+  Slab *next_slab = NULL;
+  Chunk *chunk = arena->chunks;
+  Chunk *next_chunk = NULL;
+  Large_block *large = arena->large;
+  Large_block *next_large = NULL;
+  unsigned int i;
+
+  while (slab != NULL) {
+    next_slab = slab->next;
+    storage_free(queue_prio, slab);
+    slab = next_slab;
+  }
+  while (chunk != NULL) {
+    next_chunk = chunk->next;
+    storage_free(queue_prio, chunk);
+    chunk = next_chunk;
+  }
+  while (large != NULL) {
+    next_large = large->next;
+    storage_free(queue_prio, large);
+    large = next_large;
+  }
+
+  /* Forget everything, but keep the allocator itself. */
+  queue_prio->pool.slabs = NULL;
+  queue_prio->pool.free_nodes = NULL;
+  queue_prio->pool.fresh = NULL;
+  queue_prio->pool.fresh_left = 0;
+  queue_prio->pool.next_slab_nodes = 0;
+  arena->chunks = NULL;
+  arena->cursor = NULL;
+  arena->left = 0;
+  arena->next_chunk_size = 0;
+  arena->large = NULL;
+  for (i = 0; i < ARENA_CLASSES; i++)
+    arena->free_lists[i] = NULL;
+}
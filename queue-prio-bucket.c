@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include "queue-prio-engine.h"
+
+/*This file implements the bucket storage engine for Queue_prio, for
+  queues whose priorities are known to stay between 0 and a maximum
+  given when the queue is initialized. Priorities are unique, so each
+  bucket holds at most one node and the buckets are simply an array of
+  node pointers indexed by priority. Next to it sits a three-level
+  occupancy bitmap (see Bucket_map): finding the highest priority in
+  use takes one count-leading-zeros per level, and finding the lowest,
+  which a bounded queue evicts, one count-trailing-zeros per level. The
+  duplicate check done by en_queue is a single bit test, and
+  remove_elements_between clears whole words under a mask. The buckets
+  cost a pointer per priority in the range whether or not it is used,
+  so the engine suits ranges of up to a few hundred thousand
+  priorities.*/
+
+#define WORD_BITS 64
+#define WORD_SHIFT 6
+#define WORD_MASK (WORD_BITS - 1)
+
+#define PRIO(NODE) ((unsigned int) (NODE)->priority)
+
+/* Returns the position of the highest set bit of a non-zero word. */
+static unsigned int highest_bit(unsigned long long bits) {
+#if defined(__GNUC__)
+  return (unsigned int) (WORD_MASK - __builtin_clzll(bits));
+#else
+  unsigned int bit = WORD_MASK;
+
+  while (!(bits & (1ull << bit)))
+    bit--;
+  return bit;
+#endif
+}
+
+/* Returns the position of the lowest set bit of a non-zero word. */
+static unsigned int lowest_bit(unsigned long long bits) {
+#if defined(__GNUC__)
+  return (unsigned int) __builtin_ctzll(bits);
+#else
+  unsigned int bit = 0;
+
+  while (!(bits & (1ull << bit)))
+    bit++;
+  return bit;
+#endif
+}
+
+/* Returns a mask of bits 0 to 'bit' inclusive. */
+static unsigned long long mask_through(unsigned int bit) {
+  return ((1ull << bit) << 1) - 1;
+}
+
+/* Returns the level-1 words of a map, which follow the level-0 ones. */
+static unsigned long long *level_one(const Bucket_map *const map) {
+  return map->bits + map->words;
+}
+
+/* Allocates the buckets and the bitmap on first use. Returns 1 on
+   success. */
+static unsigned short bucket_reserve(Bucket_map *const map) {
+  unsigned int range = map->max_priority + 1;
+
+  if (map->nodes != NULL)
+    return 1;
+
+  map->words = (range + WORD_MASK) >> WORD_SHIFT;
+  map->nodes = calloc(range, sizeof(Node *));
+  map->bits = calloc(map->words + ((map->words + WORD_MASK) >> WORD_SHIFT),
+                     sizeof(unsigned long long));
+  if (map->nodes == NULL || map->bits == NULL) {
+    free(map->nodes);
+    free(map->bits);
+    map->nodes = NULL;
+    map->bits = NULL;
+    return 0;
+  }
+  map->summary = 0;
+  return 1;
+}
+
+/* Marks 'priority' as taken, setting the summary bits above it when
+   its word was empty. */
+static void bit_set(Bucket_map *const map, unsigned int priority) {
+  unsigned int word = priority >> WORD_SHIFT;
+  unsigned int upper = word >> WORD_SHIFT;
+
+  if (map->bits[word] == 0) {
+    if (level_one(map)[upper] == 0)
+      map->summary |= 1ull << upper;
+    level_one(map)[upper] |= 1ull << (word & WORD_MASK);
+  }
+  map->bits[word] |= 1ull << (priority & WORD_MASK);
+}
+
+/* Clears level-0 word 'word' under 'mask', clearing the summary bits
+   above it when it empties. */
+static void word_clear(Bucket_map *const map, unsigned int word,
+                       unsigned long long mask) {
+  unsigned int upper = word >> WORD_SHIFT;
+
+  map->bits[word] &= ~mask;
+  if (map->bits[word] == 0) {
+    level_one(map)[upper] &= ~(1ull << (word & WORD_MASK));
+    if (level_one(map)[upper] == 0)
+      map->summary &= ~(1ull << upper);
+  }
+}
+
+/* Returns the highest taken priority that is at most 'limit', or -1 if
+   there is none. Each level is looked at once at most. */
+static long highest_through(const Bucket_map *const map, unsigned int limit) {
+  unsigned int word = limit >> WORD_SHIFT;
+  unsigned int upper = word >> WORD_SHIFT;
+  unsigned long long bits;
+
+  if (map->summary == 0)
+    return -1;
+
+  /* The word holding 'limit' itself. */
+  bits = map->bits[word] & mask_through(limit & WORD_MASK);
+  if (bits != 0)
+    return (long) ((word << WORD_SHIFT) + highest_bit(bits));
+
+  /* A lower word under the same level-1 word. */
+  bits = level_one(map)[upper] & ((1ull << (word & WORD_MASK)) - 1);
+  if (bits == 0) {
+    /* A lower level-1 word. */
+    bits = map->summary & ((1ull << upper) - 1);
+    if (bits == 0)
+      return -1;
+    upper = highest_bit(bits);
+    bits = level_one(map)[upper];
+  }
+  word = (upper << WORD_SHIFT) + highest_bit(bits);
+  return (long) ((word << WORD_SHIFT) + highest_bit(map->bits[word]));
+}
+
+/* Returns the node with the highest priority at most 'limit', or NULL. */
+static Node *node_through(const Queue_prio *const queue_prio,
+                          unsigned int limit) {
+  long priority;
+
+  if (queue_prio->buckets.nodes == NULL)
+    return NULL;
+  priority = highest_through(&queue_prio->buckets, limit);
+  return priority < 0 ? NULL : queue_prio->buckets.nodes[priority];
+}
+
+/* Puts a node in its bucket. The bit test is the whole duplicate
+   check. */
+static unsigned short bucket_insert(Queue_prio *const queue_prio,
+                                    Node *const node) {
+  Bucket_map *map = &queue_prio->buckets;
+  unsigned int priority = PRIO(node);
+
+  if (priority > map->max_priority || !bucket_reserve(map))
+    return 0;
+  if (map->bits[priority >> WORD_SHIFT] & (1ull << (priority & WORD_MASK))) {
+    STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+    return 0;
+  }
+
+  map->nodes[priority] = node;
+  bit_set(map, priority);
+  queue_prio->size++;
+  return 1;
+}
+
+/* Buckets need no merge: each node goes straight to its own. */
+static unsigned int bucket_insert_sorted(Queue_prio *const queue_prio,
+                                         Node *nodes[], unsigned int count) {
+  unsigned int inserted = 0;
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    if (bucket_insert(queue_prio, nodes[i]))
+      inserted++;
+    else
+      nodes[i] = NULL;
+  }
+  return inserted;
+}
+
+static void bucket_unlink(Queue_prio *const queue_prio, Node *const node) {
+  Bucket_map *map = &queue_prio->buckets;
+  unsigned int priority = PRIO(node);
+
+  map->nodes[priority] = NULL;
+  word_clear(map, priority >> WORD_SHIFT, 1ull << (priority & WORD_MASK));
+  queue_prio->size--;
+}
+
+static Node *bucket_top(const Queue_prio *const queue_prio) {
+  return node_through(queue_prio, queue_prio->buckets.max_priority);
+}
+
+/* The lowest set bit of each level leads straight to the lowest
+   priority taken. */
+static Node *bucket_bottom(const Queue_prio *const queue_prio) {
+  const Bucket_map *map = &queue_prio->buckets;
+  unsigned int word;
+
+  if (map->nodes == NULL || map->summary == 0)
+    return NULL;
+  word = lowest_bit(map->summary);
+  word = (word << WORD_SHIFT) + lowest_bit(level_one(map)[word]);
+  return map->nodes[(word << WORD_SHIFT) + lowest_bit(map->bits[word])];
+}
+
+static Node *bucket_find_priority(const Queue_prio *const queue_prio,
+                                  unsigned int priority) {
+  if (queue_prio->buckets.nodes == NULL
+      || priority > queue_prio->buckets.max_priority)
+    return NULL;
+  return queue_prio->buckets.nodes[priority];
+}
+
+static Node *bucket_first(const Queue_prio *const queue_prio,
+                          unsigned int *const cursor) {
+  (void) cursor;
+  return bucket_top(queue_prio);
+}
+
+static Node *bucket_next(const Queue_prio *const queue_prio,
+                         const Node *const node, unsigned int *const cursor) {
+  (void) cursor;
+  if (PRIO(node) == 0)
+    return NULL;
+  return node_through(queue_prio, PRIO(node) - 1);
+}
+
+/* Takes the nodes of each level-0 word in range out of their buckets,
+   then clears the word under the range's mask in one step. Words under
+   an empty level-1 word are skipped 64 at a time. */
+static Node *bucket_detach_between(Queue_prio *const queue_prio,
+                                   unsigned int low, unsigned int high) {
+  Bucket_map *map = &queue_prio->buckets;
+  unsigned long long mask;
+  unsigned long long bits;
+  unsigned int word;
+  unsigned int first;
+  unsigned int priority;
+  Node *removed = NULL;
+  Node *node = NULL;
+
+  if (map->nodes == NULL || low > map->max_priority)
+    return NULL;
+  if (high > map->max_priority)
+    high = map->max_priority;
+  if (low > high)
+    return NULL;
+
+  first = low >> WORD_SHIFT;
+  for (word = high >> WORD_SHIFT; word + 1 > first; word--) {
+    if (level_one(map)[word >> WORD_SHIFT] == 0) {
+      /* Jump to the last word of the previous level-1 word. */
+      word &= ~(unsigned int) WORD_MASK;
+      if (word == 0)
+        break;
+      continue;
+    }
+
+    mask = ~0ull;
+    if (word == high >> WORD_SHIFT)
+      mask &= mask_through(high & WORD_MASK);
+    if (word == first)
+      mask &= ~((1ull << (low & WORD_MASK)) - 1);
+    bits = map->bits[word] & mask;
+    if (bits == 0)
+      continue;
+
+    while (bits != 0) {
+      priority = highest_bit(bits);
+      bits &= ~(1ull << priority);
+      priority += word << WORD_SHIFT;
+      node = map->nodes[priority];
+      map->nodes[priority] = NULL;
+      node->next = removed;
+      removed = node;
+      queue_prio->size--;
+    }
+    word_clear(map, word, mask);
+  }
+  return removed;
+}
+
+/* The run is every node between its two priorities, so it is removed
+   as a range. */
+static Node *bucket_detach_run(Queue_prio *const queue_prio,
+                               Node *const above, Node *const first,
+                               Node *const last, unsigned int count) {
+  (void) above;
+  (void) count;
+  return bucket_detach_between(queue_prio, PRIO(last), PRIO(first));
+}
+
+/* Releases the buckets; they are allocated again on the next insert.
+   The priority range stays. */
+static void bucket_reset(Queue_prio *const queue_prio) {
+  Bucket_map *map = &queue_prio->buckets;
+
+  free(map->nodes);
+  free(map->bits);
+  map->nodes = NULL;
+  map->bits = NULL;
+  map->summary = 0;
+  map->words = 0;
+  queue_prio->size = 0;
+}
+
+const Queue_engine_ops bucket_engine_ops = {
+  1,
+  bucket_insert,
+  bucket_insert_sorted,
+  bucket_unlink,
+  bucket_top,
+  bucket_bottom,
+  bucket_find_priority,
+  bucket_first,
+  bucket_next,
+  bucket_detach_between,
+  bucket_detach_run,
+  bucket_reset,
+  NULL
+};
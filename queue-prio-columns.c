@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio-engine.h"
+
+/*This file implements the columns storage engine for Queue_prio. The
+  engine keeps no links between nodes. Instead the priorities, the
+  name hashes and the node pointers sit in three parallel arrays (see
+  Node_columns), sorted from lowest to highest priority, so the top of
+  the queue is always the last entry.
+
+  Lookups by priority, the duplicate check of en_queue and the bounds
+  of remove_elements_between are binary searches over the priority
+  array, and a range is removed by cutting one contiguous run out of
+  each array. Lookups by name, for get_priority and change_priority,
+  scan the hash array from the top down with the vector kernels of
+  queue-prio-scan.c and only compare names on a hash hit. Neither ever
+  follows a pointer from one node to the next. Inserting in the middle
+  moves the entries above the new one, which is a memmove of
+  contiguous memory rather than a walk.*/
+
+#define COLUMNS_MIN_CAPACITY 16
+
+#define PRIO(NODE) ((unsigned int) (NODE)->priority)
+
+/* Returns the first entry whose priority is at least 'priority', or
+   the number of entries if there is none. */
+static unsigned int lower_bound(const Queue_prio *const queue_prio,
+                                unsigned int priority) {
+  const unsigned int *priorities = queue_prio->columns.priorities;
+  unsigned int low = 0;
+  unsigned int high = (unsigned int) queue_prio->size;
+  unsigned int middle;
+
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    if (priorities[middle] < priority)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+/* Makes room for 'needed' entries in all three arrays. Returns 1 on
+   success; on failure the arrays may have grown but the capacity is
+   unchanged, which is harmless. */
+static unsigned short columns_reserve(Queue_prio *const queue_prio,
+                                      unsigned int needed) {
+  Node_columns *columns = &queue_prio->columns;
+  unsigned int capacity = columns->capacity;
+  unsigned int *priorities = NULL;
+  unsigned int *hashes = NULL;
+  Node **nodes = NULL;
+
+  if (needed <= capacity)
+    return 1;
+  if (capacity == 0)
+    capacity = COLUMNS_MIN_CAPACITY;
+  while (capacity < needed)
+    capacity *= 2;
+
+  priorities = realloc(columns->priorities, capacity * sizeof(unsigned int));
+  if (priorities == NULL)
+    return 0;
+  columns->priorities = priorities;
+  hashes = realloc(columns->hashes, capacity * sizeof(unsigned int));
+  if (hashes == NULL)
+    return 0;
+  columns->hashes = hashes;
+  nodes = realloc(columns->nodes, capacity * sizeof(Node *));
+  if (nodes == NULL)
+    return 0;
+  columns->nodes = nodes;
+  columns->capacity = capacity;
+  return 1;
+}
+
+/* Stores 'node' as entry 'entry'. */
+static void columns_set(Node_columns *const columns, unsigned int entry,
+                        Node *const node) {
+  columns->priorities[entry] = PRIO(node);
+  columns->hashes[entry] = node->hash;
+  columns->nodes[entry] = node;
+}
+
+/* Moves 'count' entries from 'from' to 'to' in all three arrays. */
+static void columns_move(Node_columns *const columns, unsigned int to,
+                         unsigned int from, unsigned int count) {
+  memmove(columns->priorities + to, columns->priorities + from,
+          count * sizeof(unsigned int));
+  memmove(columns->hashes + to, columns->hashes + from,
+          count * sizeof(unsigned int));
+  memmove(columns->nodes + to, columns->nodes + from, count * sizeof(Node *));
+}
+
+/* Opens a gap at the node's place in the sorted order and fills it. */
+static unsigned short columns_insert(Queue_prio *const queue_prio,
+                                     Node *const node) {
+  unsigned int size = (unsigned int) queue_prio->size;
+  unsigned int entry;
+
+  entry = lower_bound(queue_prio, PRIO(node));
+  if (entry < size && queue_prio->columns.priorities[entry] == PRIO(node)) {
+    STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+    return 0;
+  }
+  if (!columns_reserve(queue_prio, size + 1))
+    return 0;
+
+  columns_move(&queue_prio->columns, entry + 1, entry, size - entry);
+  columns_set(&queue_prio->columns, entry, node);
+  queue_prio->size++;
+  return 1;
+}
+
+/* Drops the nodes whose priority is already stored, then merges the
+   run in from the top end of the arrays, so every entry moves at most
+   once. */
+static unsigned int columns_insert_sorted(Queue_prio *const queue_prio,
+                                          Node *nodes[], unsigned int count) {
+  Node_columns *columns = &queue_prio->columns;
+  unsigned int size = (unsigned int) queue_prio->size;
+  unsigned int kept = 0;
+  unsigned int entry;
+  unsigned int i;
+  unsigned int to;
+
+  for (i = 0; i < count; i++) {
+    entry = lower_bound(queue_prio, PRIO(nodes[i]));
+    if (entry < size && columns->priorities[entry] == PRIO(nodes[i]))
+      nodes[i] = NULL;
+    else
+      kept++;
+  }
+  if (kept == 0)
+    return 0;
+  if (!columns_reserve(queue_prio, size + kept)) {
+    for (i = 0; i < count; i++)
+      nodes[i] = NULL;
+    return 0;
+  }
+
+  /* The run is sorted from highest to lowest, the arrays from lowest
+     to highest, so both are read from their highest end. */
+  to = size + kept;
+  entry = size;
+  for (i = 0; i < count; i++) {
+    if (nodes[i] == NULL)
+      continue;
+    while (entry > 0 && columns->priorities[entry - 1] > PRIO(nodes[i])) {
+      to--;
+      entry--;
+      columns->priorities[to] = columns->priorities[entry];
+      columns->hashes[to] = columns->hashes[entry];
+      columns->nodes[to] = columns->nodes[entry];
+    }
+    columns_set(columns, --to, nodes[i]);
+  }
+  queue_prio->size = (int) (size + kept);
+  return kept;
+}
+
+static void columns_unlink(Queue_prio *const queue_prio, Node *const node) {
+  unsigned int size = (unsigned int) queue_prio->size;
+  unsigned int entry = lower_bound(queue_prio, PRIO(node));
+
+  columns_move(&queue_prio->columns, entry, entry + 1, size - entry - 1);
+  queue_prio->size--;
+}
+
+static Node *columns_top(const Queue_prio *const queue_prio) {
+  return queue_prio->size > 0
+    ? queue_prio->columns.nodes[queue_prio->size - 1] : NULL;
+}
+
+static Node *columns_bottom(const Queue_prio *const queue_prio) {
+  return queue_prio->size > 0 ? queue_prio->columns.nodes[0] : NULL;
+}
+
+static Node *columns_find_priority(const Queue_prio *const queue_prio,
+                                   unsigned int priority) {
+  unsigned int entry = lower_bound(queue_prio, priority);
+
+  if (entry < (unsigned int) queue_prio->size
+      && queue_prio->columns.priorities[entry] == priority)
+    return queue_prio->columns.nodes[entry];
+  return NULL;
+}
+
+/* 'cursor' is the entry of the node just visited. */
+static Node *columns_first(const Queue_prio *const queue_prio,
+                           unsigned int *const cursor) {
+  if (queue_prio->size <= 0)
+    return NULL;
+  *cursor = (unsigned int) queue_prio->size - 1;
+  return queue_prio->columns.nodes[*cursor];
+}
+
+static Node *columns_next(const Queue_prio *const queue_prio,
+                          const Node *const node, unsigned int *const cursor) {
+  (void) node;
+  if (*cursor == 0)
+    return NULL;
+  *cursor -= 1;
+  return queue_prio->columns.nodes[*cursor];
+}
+
+/* The entries in range are one run; chain its nodes and close the
+   gap. */
+static Node *columns_detach_between(Queue_prio *const queue_prio,
+                                    unsigned int low, unsigned int high) {
+  Node_columns *columns = &queue_prio->columns;
+  unsigned int size = (unsigned int) queue_prio->size;
+  unsigned int first;
+  unsigned int end;
+  unsigned int i;
+  Node *removed = NULL;
+
+  if (low > high)
+    return NULL;
+  first = lower_bound(queue_prio, low);
+  end = high == ~0u ? size : lower_bound(queue_prio, high + 1);
+  if (first == end)
+    return NULL;
+
+  for (i = first; i < end; i++) {
+    columns->nodes[i]->next = removed;
+    removed = columns->nodes[i];
+  }
+  columns_move(columns, first, end, size - end);
+  queue_prio->size = (int) (size - (end - first));
+  return removed;
+}
+
+/* The run is every node between its two priorities, so it is removed
+   as a range. */
+static Node *columns_detach_run(Queue_prio *const queue_prio,
+                                Node *const above, Node *const first,
+                                Node *const last, unsigned int count) {
+  (void) above;
+  (void) count;
+  return columns_detach_between(queue_prio, PRIO(last), PRIO(first));
+}
+
+static void columns_reset(Queue_prio *const queue_prio) {
+  Node_columns *columns = &queue_prio->columns;
+
+  free(columns->priorities);
+  free(columns->hashes);
+  free(columns->nodes);
+  memset(columns, 0, sizeof(Node_columns));
+  queue_prio->size = 0;
+}
+
+/* 'cursor' counts the entries already passed, from the top. */
+static Node *columns_find_hash(const Queue_prio *const queue_prio,
+                               unsigned int hash, unsigned int *const cursor) {
+  unsigned int size = (unsigned int) queue_prio->size;
+  long entry;
+
+  if (*cursor >= size)
+    return NULL;
+  entry = scan_equal_below(queue_prio->columns.hashes, size - *cursor, hash);
+  if (entry < 0) {
+    *cursor = size;
+    return NULL;
+  }
+  *cursor = size - (unsigned int) entry;
+  return queue_prio->columns.nodes[entry];
+}
+
+const Queue_engine_ops columns_engine_ops = {
+  1,
+  columns_insert,
+  columns_insert_sorted,
+  columns_unlink,
+  columns_top,
+  columns_bottom,
+  columns_find_priority,
+  columns_first,
+  columns_next,
+  columns_detach_between,
+  columns_detach_run,
+  columns_reset,
+  columns_find_hash
+};
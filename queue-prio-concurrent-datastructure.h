@@ -0,0 +1,36 @@
+#ifndef QUEUE_PRIO_CONCURRENT_DATASTRUCTURE_H
+#define QUEUE_PRIO_CONCURRENT_DATASTRUCTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "queue-prio-datastructure.h"
+
+#define QUEUE_CONCURRENT_MAX_SHARDS 64
+#define QUEUE_CACHE_LINE 64
+
+/* One shard of a concurrent queue: an ordinary Queue_prio behind its
+   own mutex. 'best' holds the priority of the shard's head, or -1 when
+   the shard is empty, and is only written with 'lock' held. Each shard
+   sits on its own cache lines so threads working on different shards
+   do not contend. */
+typedef struct concurrent_shard{
+  _Alignas(QUEUE_CACHE_LINE) pthread_mutex_t lock;
+  Queue_prio queue;
+  atomic_llong best;
+}Concurrent_shard;
+
+/* A priority queue that many threads may use at once. Priorities are
+   spread across the shards by hash, so a given priority always lives
+   in the same shard and the duplicate check stays local to it.
+   'arrivals' is bumped on every successful en_queue_concurrent and is
+   the word blocked consumers sleep on; 'waiters' counts them, so a
+   producer only makes the wake call when someone is asleep. */
+typedef struct queue_prio_concurrent{
+  Concurrent_shard *shards;
+  unsigned int shard_count;
+  _Alignas(QUEUE_CACHE_LINE) atomic_int size;
+  atomic_uint arrivals;
+  atomic_uint waiters;
+}Queue_prio_concurrent;
+
+#endif
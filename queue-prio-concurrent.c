@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sched.h>
+#include <stdlib.h>
+#include "queue-prio.h"
+#include "queue-prio-concurrent.h"
+#include "queue-prio-engine.h"
+
+/*This program provides a priority queue that several producer and
+  consumer threads can use at the same time without an outer lock. The
+  elements are spread over independent shards, each an ordinary
+  Queue_prio with its own mutex, so threads only contend when they
+  touch the same shard. A priority is always stored in the shard
+  picked by its hash, which keeps the duplicate-priority check local
+  to one lock.
+
+  Every shard publishes the priority of its head in an atomic 'best'
+  hint. Consumers scan the hints without locking to find the shard
+  with the highest head, lock only that shard, and before taking its
+  head check that no other shard advertises anything higher; if one
+  does they retry. Size and emptiness are answered from an atomic
+  counter, so a consumer finding the queue empty never takes a lock.
+
+  Guarantees:
+  - en_queue_concurrent is linearizable. It takes effect while the
+    target shard's lock is held, and rejects duplicate priorities
+    exactly like en_queue.
+  - Every element is dequeued at most once, and an element that was
+    enqueued is eventually dequeued if consumers keep calling.
+  - de_queue_concurrent and peek_concurrent return the shard head they
+    validated against every other shard's hint while holding that
+    shard's lock. When no en_queue_concurrent runs concurrently with
+    them, that is the highest priority in the whole queue, so
+    dequeue-only phases drain in exact priority order. An element
+    enqueued concurrently with the validation may be passed over until
+    the next call, which is the same behaviour as if it had been
+    enqueued just after it.
+  - size_concurrent and has_no_elements_concurrent are atomic reads of
+    a counter updated under the shard lock.
+
+  de_queue_wait_concurrent blocks instead of returning NULL. A consumer
+  reads the 'arrivals' word, tries to dequeue, and if that fails counts
+  itself in 'waiters' and sleeps on the word for as long as it still
+  holds the value read. A producer bumps 'arrivals' after a successful
+  en_queue_concurrent and wakes one sleeper, and only when 'waiters' is
+  non-zero, so an element wakes at most one consumer and a producer
+  with nobody waiting makes no system call. An element that arrives
+  between the failed attempt and the sleep changes the word, so the
+  sleep returns at once and the wakeup is not lost.*/
+
+#define DEFAULT_SHARDS 16
+/* Pauses a consumer spends waiting for a hint before it yields. */
+#define HINT_SPINS 64
+
+/* Picks the shard that owns 'priority'. */
+static Concurrent_shard *shard_of(const Queue_prio_concurrent *const queue,
+                                  unsigned int priority) {
+  unsigned int hash = priority * 0x9E3779B1u;
+
+  hash ^= hash >> 16;
+  return &queue->shards[hash % queue->shard_count];
+}
+
+/* Republishes a shard's head priority. Called with the shard locked. */
+static void publish_best(Concurrent_shard *const shard) {
+  atomic_store_explicit(&shard->best, peek_priority(&shard->queue),
+                        memory_order_release);
+}
+
+/* Tells the CPU this thread is spinning, so that it slows down and
+   leaves the core to a sibling hyperthread. */
+static void spin_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* Returns the shard whose hint advertises the highest head, or NULL if
+   every hint says empty. */
+static Concurrent_shard *best_shard(Queue_prio_concurrent *const queue) {
+  Concurrent_shard *best = NULL;
+  long long best_priority = -1;
+  long long priority;
+  unsigned int i;
+
+  for (i = 0; i < queue->shard_count; i++) {
+    priority = atomic_load_explicit(&queue->shards[i].best,
+                                    memory_order_acquire);
+    if (priority > best_priority) {
+      best_priority = priority;
+      best = &queue->shards[i];
+    }
+  }
+  return best;
+}
+
+/* Locks the shard holding the highest head and returns it, or returns
+   NULL if the queue is empty. The head of the returned shard was
+   checked against every other shard's hint while the lock was held. */
+static Concurrent_shard *lock_best_shard(Queue_prio_concurrent *const queue) {
+  Concurrent_shard *shard = NULL;
+  unsigned int spins = 0;
+  long long top;
+  unsigned int i;
+  int higher;
+
+  for (;;) {
+    /* Lock-free fast path for an empty queue. */
+    if (atomic_load_explicit(&queue->size, memory_order_acquire) == 0)
+      return NULL;
+
+    /* An element may be counted before its hint is published; look
+       again in that case, pausing briefly and then yielding so as not
+       to hold up the producer that is about to publish it. */
+    shard = best_shard(queue);
+    if (shard == NULL) {
+      if (spins++ < HINT_SPINS)
+        spin_pause();
+      else
+        sched_yield();
+      continue;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    top = peek_priority(&shard->queue);
+
+    /* Validate the head against the other shards. */
+    higher = top < 0;
+    for (i = 0; i < queue->shard_count && !higher; i++)
+      if (&queue->shards[i] != shard
+          && atomic_load_explicit(&queue->shards[i].best,
+                                  memory_order_acquire) > top)
+        higher = 1;
+
+    if (!higher)
+      return shard;
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+/* This function initializes a concurrent priority queue with
+   'shard_count' shards (0 for the default), each set up with
+   'options' (NULL for the heap engine). It must not be called while
+   other threads use the queue. Returns 1 on success, 0 otherwise. */
+unsigned short init_queue_concurrent(Queue_prio_concurrent *const queue,
+                                     unsigned int shard_count,
+                                     const Queue_options *const options) {
+  Queue_options heap_options = {QUEUE_ENGINE_HEAP, 0, NULL, 0, NULL};
+  const Queue_options *shard_options = options;
+  unsigned int i;
+
+  if (queue == NULL || shard_count > QUEUE_CONCURRENT_MAX_SHARDS)
+    return 0;
+  if (shard_count == 0)
+    shard_count = DEFAULT_SHARDS;
+  if (shard_options == NULL)
+    shard_options = &heap_options;
+
+  queue->shards = aligned_alloc(QUEUE_CACHE_LINE,
+                                shard_count * sizeof(Concurrent_shard));
+  if (queue->shards == NULL)
+    return 0;
+
+  for (i = 0; i < shard_count; i++) {
+    if (!init_queue_with_options(&queue->shards[i].queue, shard_options)) {
+      free(queue->shards);
+      queue->shards = NULL;
+      return 0;
+    }
+    pthread_mutex_init(&queue->shards[i].lock, NULL);
+    atomic_init(&queue->shards[i].best, -1);
+  }
+  queue->shard_count = shard_count;
+  atomic_init(&queue->size, 0);
+  atomic_init(&queue->arrivals, 0);
+  atomic_init(&queue->waiters, 0);
+  return 1;
+}
+
+/* This function enqueues a new element with a specified priority. It
+   may be called from any thread. It returns 1 if the operation is
+   successful and 0 if the priority is already taken, an argument is
+   NULL or memory runs out. */
+unsigned short en_queue_concurrent(Queue_prio_concurrent *const queue,
+                                   const char new_element[],
+                                   unsigned int priority) {
+  Concurrent_shard *shard = NULL;
+  unsigned short ret = 0;
+
+  if (queue == NULL || new_element == NULL)
+    return 0;
+
+  shard = shard_of(queue, priority);
+  pthread_mutex_lock(&shard->lock);
+  ret = en_queue(&shard->queue, new_element, priority);
+  if (ret) {
+    atomic_fetch_add_explicit(&queue->size, 1, memory_order_release);
+    publish_best(shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  /* Both sides use sequentially consistent operations, so either the
+     consumer sees the new 'arrivals' or the producer sees its waiter. */
+  if (ret) {
+    atomic_fetch_add(&queue->arrivals, 1);
+    if (atomic_load(&queue->waiters) > 0)
+      wake_word(&queue->arrivals, 1);
+  }
+  return ret;
+}
+
+/* This function returns a malloc'd copy of the highest-priority
+   element, or NULL if the queue is empty or the pointer is NULL. */
+char *peek_concurrent(Queue_prio_concurrent *const queue) {
+  Concurrent_shard *shard = NULL;
+  char *name = NULL;
+
+  if (queue == NULL)
+    return NULL;
+
+  shard = lock_best_shard(queue);
+  if (shard != NULL) {
+    name = peek(&shard->queue);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return name;
+}
+
+/* This function dequeues the highest-priority element and returns it
+   as a malloc'd string, or NULL if the queue is empty or the pointer
+   is NULL. It may be called from any thread. */
+char *de_queue_concurrent(Queue_prio_concurrent *const queue) {
+  Concurrent_shard *shard = NULL;
+  char *name = NULL;
+
+  if (queue == NULL)
+    return NULL;
+
+  shard = lock_best_shard(queue);
+  if (shard != NULL) {
+    name = de_queue(&shard->queue);
+    if (name != NULL)
+      atomic_fetch_sub_explicit(&queue->size, 1, memory_order_release);
+    publish_best(shard);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return name;
+}
+
+/* This function dequeues the highest-priority element like
+   de_queue_concurrent, but when the queue is empty it sleeps until an
+   element arrives or 'timeout_ms' milliseconds have passed. A negative
+   timeout waits for as long as it takes and 0 does not wait at all.
+   It returns the element as a malloc'd string, or NULL on timeout or
+   if the pointer is NULL. */
+char *de_queue_wait_concurrent(Queue_prio_concurrent *const queue,
+                               long timeout_ms) {
+  struct timespec deadline;
+  char *name = NULL;
+  unsigned int seen;
+  short awake = 1;
+
+  if (queue == NULL)
+    return NULL;
+  if (timeout_ms > 0)
+    wait_deadline(timeout_ms, &deadline);
+
+  for (;;) {
+    seen = atomic_load(&queue->arrivals);
+    name = de_queue_concurrent(queue);
+    if (name != NULL || timeout_ms == 0 || !awake)
+      return name;
+
+    atomic_fetch_add(&queue->waiters, 1);
+    awake = wait_word(&queue->arrivals, seen,
+                      timeout_ms > 0 ? &deadline : NULL);
+    atomic_fetch_sub(&queue->waiters, 1);
+  }
+}
+
+/* This function returns -1 if the queue pointer is NULL, 1 if the
+   queue is empty and 0 if it holds elements. It never blocks. */
+short has_no_elements_concurrent(const Queue_prio_concurrent *const queue) {
+  if (queue == NULL)
+    return -1;
+  return atomic_load_explicit(&queue->size, memory_order_acquire) == 0;
+}
+
+/* This function returns the number of elements in the queue. It never
+   blocks. */
+int size_concurrent(const Queue_prio_concurrent *const queue) {
+  return atomic_load_explicit(&queue->size, memory_order_acquire);
+}
+
+/* This function frees every element and shard of the queue. The queue
+   must be initialized again before further use, and no other thread
+   may use it during the call. Returns 1 on success, 0 otherwise. */
+unsigned short clear_queue_prio_concurrent(Queue_prio_concurrent *const queue) {
+  unsigned int i;
+
+  if (queue == NULL || queue->shards == NULL)
+    return 0;
+
+  for (i = 0; i < queue->shard_count; i++) {
+    clear_queue_prio(&queue->shards[i].queue);
+    pthread_mutex_destroy(&queue->shards[i].lock);
+  }
+  free(queue->shards);
+  queue->shards = NULL;
+  queue->shard_count = 0;
+  atomic_store(&queue->size, 0);
+  return 1;
+}
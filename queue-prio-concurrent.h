@@ -0,0 +1,28 @@
+#ifndef QUEUE_PRIO_CONCURRENT_H
+#define QUEUE_PRIO_CONCURRENT_H
+
+#include "queue-prio-concurrent-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned short init_queue_concurrent(Queue_prio_concurrent *const queue,
+                                     unsigned int shard_count,
+                                     const Queue_options *const options);
+unsigned short en_queue_concurrent(Queue_prio_concurrent *const queue,
+                                   const char new_element[],
+                                   unsigned int priority);
+char *peek_concurrent(Queue_prio_concurrent *const queue);
+char *de_queue_concurrent(Queue_prio_concurrent *const queue);
+char *de_queue_wait_concurrent(Queue_prio_concurrent *const queue,
+                               long timeout_ms);
+short has_no_elements_concurrent(const Queue_prio_concurrent *const queue);
+int size_concurrent(const Queue_prio_concurrent *const queue);
+unsigned short clear_queue_prio_concurrent(Queue_prio_concurrent *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio.h"
+#include "queue-prio-engine.h"
+
+/*This file lets callers read a queue from the highest priority down
+  without copying it, as an alternative to all_element_names. A cursor
+  lives wherever the caller puts it, usually on the stack, and yields
+  each element as a pointer into the queue with its length and
+  priority; the caller may stop after as many as it wants.
+
+  The list engine and the ordered index keep the nodes in priority
+  order already, so a cursor over them just follows the links and
+  never allocates; neither does a cursor over the bucket engine, which
+  steps down the occupancy bitmap, or the columns engine, which steps
+  down its arrays. A heap engine queue without an ordered index is
+  walked best-first: the root comes first, and after each node its
+  children join a small max-heap of candidates (the frontier), whose
+  best is the next node in priority order. Yielding i elements leaves
+  at most 3i + 1 candidates, so the first 21 of them fit in the cursor
+  itself; only a longer walk allocates, once per doubling.*/
+
+/* Returns the operations of an engine whose own walk is in priority
+   order and needs no more state than the cursor's 'count', or NULL. */
+static const Queue_engine_ops *walk_ops(const Queue_prio *const queue_prio) {
+  if (queue_prio->engine == QUEUE_ENGINE_BUCKET)
+    return &bucket_engine_ops;
+  if (queue_prio->engine == QUEUE_ENGINE_COLUMNS)
+    return &columns_engine_ops;
+  return NULL;
+}
+
+/* The priority of the node in heap slot 'slot'. */
+static unsigned int slot_priority(const Queue_prio *const queue_prio,
+                                  unsigned int slot) {
+  return (unsigned int) queue_prio->heap[slot]->priority;
+}
+
+/* Adds a heap slot to the cursor's frontier. Returns 0 if the
+   frontier is full and cannot grow. */
+static unsigned short frontier_push(Queue_cursor *const cursor,
+                                    unsigned int slot) {
+  const Queue_prio *queue_prio = cursor->queue;
+  unsigned int *frontier = NULL;
+  unsigned int capacity;
+  unsigned int position;
+  unsigned int parent;
+
+  if (cursor->count == cursor->capacity) {
+    capacity = cursor->capacity * 2;
+    if (cursor->frontier == cursor->small) {
+      frontier = malloc(capacity * sizeof(unsigned int));
+      if (frontier != NULL)
+        memcpy(frontier, cursor->small, sizeof(cursor->small));
+    } else {
+      frontier = realloc(cursor->frontier, capacity * sizeof(unsigned int));
+    }
+    if (frontier == NULL)
+      return 0;
+    cursor->frontier = frontier;
+    cursor->capacity = capacity;
+  }
+
+  /* Sift the new slot up a binary max-heap on priority. */
+  position = cursor->count++;
+  while (position > 0) {
+    parent = (position - 1) / 2;
+    if (slot_priority(queue_prio, cursor->frontier[parent])
+        >= slot_priority(queue_prio, slot))
+      break;
+    cursor->frontier[position] = cursor->frontier[parent];
+    position = parent;
+  }
+  cursor->frontier[position] = slot;
+  return 1;
+}
+
+/* Removes and returns the best slot of a non-empty frontier. */
+static unsigned int frontier_pop(Queue_cursor *const cursor) {
+  const Queue_prio *queue_prio = cursor->queue;
+  unsigned int *frontier = cursor->frontier;
+  unsigned int best = frontier[0];
+  unsigned int last = frontier[--cursor->count];
+  unsigned int position = 0;
+  unsigned int child;
+
+  for (;;) {
+    child = 2 * position + 1;
+    if (child >= cursor->count)
+      break;
+    if (child + 1 < cursor->count
+        && slot_priority(queue_prio, frontier[child + 1])
+           > slot_priority(queue_prio, frontier[child]))
+      child++;
+    if (slot_priority(queue_prio, frontier[child])
+        <= slot_priority(queue_prio, last))
+      break;
+    frontier[position] = frontier[child];
+    position = child;
+  }
+  frontier[position] = last;
+  return best;
+}
+
+/* This function sets up 'cursor' to walk 'queue_prio' from the highest
+   priority down. The queue must not be modified while the cursor is
+   in use, the cursor must not be copied, and it should be given to
+   close_cursor when the caller is done with it. It returns 1 on
+   success and 0 if an argument is NULL. */
+unsigned short open_cursor(Queue_cursor *const cursor,
+                           const Queue_prio *const queue_prio) {
+  if (cursor == NULL || queue_prio == NULL)
+    return 0;
+
+  cursor->queue = queue_prio;
+  cursor->position = NULL;
+  cursor->frontier = cursor->small;
+  cursor->count = 0;
+  cursor->capacity = QUEUE_CURSOR_FRONTIER;
+
+  if (queue_prio->engine == QUEUE_ENGINE_LIST)
+    cursor->position = queue_prio->head;
+  else if (walk_ops(queue_prio) != NULL)
+    cursor->position = walk_ops(queue_prio)->first(queue_prio,
+                                                   &cursor->count);
+  else if ((queue_prio->indexes & QUEUE_INDEX_ORDER)
+           && queue_prio->order_index.head != NULL)
+    cursor->position = queue_prio->order_index.head->forward[0];
+  else if (queue_prio->size > 0)
+    frontier_push(cursor, 0);
+  return 1;
+}
+
+/* This function stores the next element of the walk in '*element'
+   and moves the cursor past it. It returns 1 if there was one, and 0
+   at the end of the queue or if an argument is NULL. A heap walk that
+   runs out of memory for its frontier ends early. */
+unsigned short cursor_next(Queue_cursor *const cursor,
+                           Queue_element *const element) {
+  const Queue_prio *queue_prio = NULL;
+  const Order_entry *entry = NULL;
+  const Node *node = NULL;
+  unsigned int slot;
+  unsigned int child;
+  unsigned int last;
+
+  if (cursor == NULL || element == NULL || cursor->queue == NULL)
+    return 0;
+  queue_prio = cursor->queue;
+
+  if (queue_prio->engine == QUEUE_ENGINE_LIST) {
+    node = cursor->position;
+    if (node != NULL)
+      cursor->position = node->next;
+  } else if (walk_ops(queue_prio) != NULL) {
+    node = cursor->position;
+    if (node != NULL)
+      cursor->position = walk_ops(queue_prio)->next(queue_prio, node,
+                                                    &cursor->count);
+  } else if (queue_prio->indexes & QUEUE_INDEX_ORDER) {
+    entry = cursor->position;
+    if (entry != NULL) {
+      node = entry->node;
+      cursor->position = entry->forward[0];
+    }
+  } else if (cursor->count > 0) {
+    /* The best candidate is next; its children may follow it. */
+    slot = frontier_pop(cursor);
+    node = queue_prio->heap[slot];
+    child = slot * QUEUE_HEAP_ARITY + 1;
+    last = child + QUEUE_HEAP_ARITY;
+    if (last > (unsigned int) queue_prio->size)
+      last = (unsigned int) queue_prio->size;
+    for (; child < last; child++)
+      if (!frontier_push(cursor, child)) {
+        /* Out of memory: end the walk after this node. */
+        cursor->count = 0;
+        break;
+      }
+  }
+
+  if (node == NULL)
+    return 0;
+  element->element = node->data;
+  element->length = node->length;
+  element->priority = (unsigned int) node->priority;
+  return 1;
+}
+
+/* This function releases whatever memory a cursor took for its walk.
+   The cursor may be opened again afterwards. */
+void close_cursor(Queue_cursor *const cursor) {
+  if (cursor == NULL)
+    return;
+  if (cursor->frontier != cursor->small)
+    free(cursor->frontier);
+  cursor->frontier = cursor->small;
+  cursor->count = 0;
+  cursor->capacity = QUEUE_CURSOR_FRONTIER;
+  cursor->queue = NULL;
+  cursor->position = NULL;
+}
+
+/* This function calls 'visitor' with 'context' for the elements of
+   the queue from the highest priority down, stopping after 'k' of them
+   (all of them if 'k' is 0) or when the visitor returns 0. The queue
+   must not be modified by the visitor. It returns the number of
+   elements visited. */
+unsigned int visit_elements(const Queue_prio *const queue_prio,
+                            unsigned int k, Queue_visitor visitor,
+                            void *context) {
+  Queue_cursor cursor;
+  Queue_element element;
+  unsigned int visited = 0;
+
+  if (visitor == NULL || !open_cursor(&cursor, queue_prio))
+    return 0;
+  while ((k == 0 || visited < k) && cursor_next(&cursor, &element)) {
+    visited++;
+    if (!visitor(&element, context))
+      break;
+  }
+  close_cursor(&cursor);
+  return visited;
+}
@@ -1,15 +1,307 @@
 #ifndef QUEUE_PRIO_DATASTRUCTURE_H
 #define QUEUE_PRIO_DATASTRUCTURE_H
 
+#include <stddef.h>
+
+/* The storage engines a Queue_prio can be built on. QUEUE_ENGINE_LIST
+   is the original sorted linked list and is what a zeroed Queue_prio
+   uses. QUEUE_ENGINE_HEAP keeps the nodes in a contiguous 4-ary
+   max-heap with a priority index, so en_queue and de_queue are
+   O(log n) and peek is O(1). QUEUE_ENGINE_BUCKET is for queues whose
+   priorities fall in a bounded range (see Queue_options.max_priority):
+   every priority has its own slot and an occupancy bitmap, so en_queue,
+   de_queue and the duplicate check are a few word operations.
+   QUEUE_ENGINE_COLUMNS keeps the priorities, name hashes and nodes in
+   parallel sorted arrays, so lookups by priority are binary searches
+   and lookups by name are vector scans of the hashes. */
+typedef enum queue_engine{
+  QUEUE_ENGINE_LIST = 0,
+  QUEUE_ENGINE_HEAP,
+  QUEUE_ENGINE_BUCKET,
+  QUEUE_ENGINE_COLUMNS
+}Queue_engine;
+
+/* Flags for Queue_options.indexes. QUEUE_INDEX_PRIORITY keeps a hash
+   index from priority to node, QUEUE_INDEX_NAME one from element data
+   to the nodes holding it, and QUEUE_INDEX_ORDER a skiplist of the
+   priorities that makes range queries and range removal
+   O(log n + k). All are maintained on every mutation; the heap engine
+   always has the priority index. */
+#define QUEUE_INDEX_PRIORITY 0x1u
+#define QUEUE_INDEX_NAME 0x2u
+#define QUEUE_INDEX_ORDER 0x4u
+
+/* Element names shorter than this are stored inside the node. */
+#define QUEUE_INLINE_DATA 24
+
+/* 'data' points either at 'small', for names that fit, or at a copy in
+   the queue's string arena. 'length' and 'hash' describe 'data' so
+   that lookups can reject most non-matching nodes without touching the
+   string. 'generation' changes every time the node leaves the queue,
+   so a Queue_handle to the element it held no longer matches. */
 typedef struct node{
   char *data;
   int priority;
+  unsigned int hash;
+  unsigned int length;
+  unsigned int generation;
   struct node *next;
+  /* Position of the node in the heap array (heap engine only). */
+  unsigned int slot;
+  char small[QUEUE_INLINE_DATA];
 }Node;
 
+/* Open-addressing hash table of Node pointers, keyed either by
+   priority or, when 'by_name' is set, by element data. The name index
+   may hold several nodes with the same data. 'capacity' is always zero
+   or a power of two. */
+typedef struct node_index{
+  Node **slots;
+  unsigned int capacity;
+  unsigned int count;
+  unsigned short by_name;
+}Node_index;
+
+/* Tallest tower the ordered index builds. With one level in four
+   carried up, that covers far more elements than a queue can hold. */
+#define QUEUE_ORDER_MAX_HEIGHT 16
+
+/* Skiplist of nodes from highest to lowest priority (see
+   queue-prio-order.c). 'head' is a tower of QUEUE_ORDER_MAX_HEIGHT
+   links holding no node, and 'height' the number of levels in use. */
+typedef struct order_index{
+  struct order_entry *head;
+  unsigned int height;
+  unsigned int count;
+  unsigned int seed;
+}Order_index;
+
+/* Priority range of a bucket engine queue when the options give none,
+   and the largest one it can have: three levels of 64-bit words cover
+   2^18 priorities. */
+#define QUEUE_BUCKET_DEFAULT_MAX 65535u
+#define QUEUE_BUCKET_MAX_PRIORITY 262143u
+
+/* Storage of the bucket engine (see queue-prio-bucket.c). 'nodes' has
+   a slot for each priority from 0 to 'max_priority'. Bit p of the
+   'words' level-0 words in 'bits' is set while priority p is taken;
+   they are followed by the level-1 words, whose bit w is set while
+   level-0 word w is non-zero, and 'summary' has bit v set while
+   level-1 word v is. Both arrays are allocated on the first insert. */
+typedef struct bucket_map{
+  Node **nodes;
+  unsigned long long *bits;
+  unsigned long long summary;
+  unsigned int max_priority;
+  unsigned int words;
+}Bucket_map;
+
+/* Storage of the columns engine (see queue-prio-columns.c): entry i
+   of each array describes the same node, and the entries are sorted
+   from lowest to highest priority, so the top of the queue is the last
+   one. The queue's 'size' is the number of entries in use. */
+typedef struct node_columns{
+  unsigned int *priorities;
+  unsigned int *hashes;
+  Node **nodes;
+  unsigned int capacity;
+}Node_columns;
+
+/* Memory hooks used for a queue's nodes and element strings. Both
+   receive the 'context' given here. A zeroed Queue_allocator means
+   malloc and free. */
+typedef struct queue_allocator{
+  void *(*alloc)(size_t size, void *context);
+  void (*free)(void *block, void *context);
+  void *context;
+}Queue_allocator;
+
+/* Nodes are carved out of slabs obtained from the allocator. Freed
+   nodes go on 'free_nodes', chained through 'next'. */
+typedef struct node_pool{
+  void *slabs;
+  Node *free_nodes;
+  Node *fresh;
+  unsigned int fresh_left;
+  unsigned int next_slab_nodes;
+}Node_pool;
+
+/* Number of string size classes: 16, 32, ... 1024 bytes. */
+#define ARENA_CLASSES 7
+
+/* Element strings are bump-allocated from chunks. A freed string goes
+   on the free list of its size class; strings larger than the biggest
+   class get their own block on the 'large' chain. */
+typedef struct string_arena{
+  void *chunks;
+  char *cursor;
+  size_t left;
+  size_t next_chunk_size;
+  void *free_lists[ARENA_CLASSES];
+  void *large;
+}String_arena;
+
+/* The changes a queue reports to its observer. */
+typedef enum queue_event_type{
+  QUEUE_EVENT_EN_QUEUE,
+  QUEUE_EVENT_DE_QUEUE,
+  QUEUE_EVENT_CHANGE_PRIORITY,
+  QUEUE_EVENT_REMOVE_BETWEEN,
+  QUEUE_EVENT_CLEAR,
+  QUEUE_EVENT_EVICT
+}Queue_event_type;
+
+/* One change to a queue. 'element' and 'length' describe the element
+   enqueued, dequeued, moved or evicted, and stay valid only for the
+   duration of the call. 'priority' is its (new) priority; for
+   QUEUE_EVENT_REMOVE_BETWEEN the range is 'priority' to 'high', and
+   for QUEUE_EVENT_CHANGE_PRIORITY 'previous' is the priority the
+   element had before. */
+typedef struct queue_event{
+  Queue_event_type type;
+  const char *element;
+  unsigned int length;
+  unsigned int priority;
+  unsigned int high;
+  unsigned int previous;
+}Queue_event;
+
+/* What en_queue does with an element that does not fit in a bounded
+   queue. QUEUE_FULL_REJECT turns it down. QUEUE_FULL_EVICT_LOWEST
+   evicts the lowest-priority elements until it fits, as long as they
+   are lower than the new element, and turns it down otherwise.
+   QUEUE_FULL_BLOCK makes en_queue_list wait for room (see
+   Queue_limits.block_ms); everywhere else it turns the element down. */
+typedef enum queue_full_policy{
+  QUEUE_FULL_REJECT = 0,
+  QUEUE_FULL_EVICT_LOWEST,
+  QUEUE_FULL_BLOCK
+}Queue_full_policy;
+
+/* Limits for init_queue_with_options. A queue holds at most
+   'capacity' elements, and its elements take up at most 'byte_budget'
+   bytes, each counting as sizeof(Node) plus, when its name is too long
+   to be stored inside the node, the name and its terminator. Zero
+   means no limit. 'block_ms' is how long en_queue_list waits for room
+   under QUEUE_FULL_BLOCK: a negative value waits for as long as it
+   takes and 0 does not wait at all. */
+typedef struct queue_limits{
+  unsigned int capacity;
+  size_t byte_budget;
+  Queue_full_policy policy;
+  long block_ms;
+}Queue_limits;
+
+/* A byte budget shared by several queues, such as the queues of a
+   Queue_prio_list. 'used' is what their elements take up, counted as
+   for Queue_limits.byte_budget, and 'limit' the most they may take up
+   (0 for no limit). */
+typedef struct queue_budget{
+  size_t limit;
+  size_t used;
+}Queue_budget;
+
+struct queue_prio;
+
+/* Called after every successful change to a queue, with 'context'.
+   A zeroed Queue_observer means nobody is told. */
+typedef struct queue_observer{
+  void (*notify)(struct queue_prio *queue_prio, const Queue_event *event,
+                 void *context);
+  void *context;
+}Queue_observer;
+
 typedef struct queue_prio{
   Node *head;
+  /* The lowest node of the list engine. */
+  Node *tail;
   int size;
+  Queue_engine engine;
+  Node **heap;
+  unsigned int heap_capacity;
+  Bucket_map buckets;
+  Node_columns columns;
+  unsigned int indexes;
+  Node_index priority_index;
+  Node_index name_index;
+  Order_index order_index;
+  Queue_allocator allocator;
+  Node_pool pool;
+  String_arena arena;
+  Queue_observer observer;
+  /* Told about the same changes as 'observer', but reserved for the
+     container holding the queue (a Queue_prio_list), so that
+     set_queue_observer leaves it alone. */
+  Queue_observer owner;
+  /* The queue's limits, the bytes its elements take up, counted as
+     for Queue_limits.byte_budget, and the budget it shares with other
+     queues, or NULL. */
+  Queue_limits limits;
+  size_t bytes;
+  Queue_budget *budget;
+  /* Changes every time clear_queue_prio gives the queue's nodes back,
+     so handles taken before are turned down without looking at
+     them. */
+  unsigned int epoch;
 }Queue_prio;
 
+/* Names one element of one queue for en_queue_h, get_handle and the
+   functions ending in _h. The fields are private. A handle stays good
+   while its element is in the queue, whatever its priority becomes;
+   once the element leaves, the functions turn the handle down, until
+   the queue itself is initialized again or freed. */
+typedef struct queue_handle{
+  const struct queue_prio *queue;
+  Node *node;
+  unsigned int generation;
+  unsigned int epoch;
+}Queue_handle;
+
+/* One element as a cursor or visitor sees it. 'element' points at the
+   queue's own terminated copy, 'length' characters long, and stays
+   valid until the queue is next modified. */
+typedef struct queue_element{
+  const char *element;
+  size_t length;
+  unsigned int priority;
+}Queue_element;
+
+/* Called by visit_elements for each element in turn, with 'context'.
+   Returning 0 stops the visit. */
+typedef int (*Queue_visitor)(const Queue_element *element, void *context);
+
+/* Heap slots a cursor can keep track of without allocating. */
+#define QUEUE_CURSOR_FRONTIER 64
+
+/* Walks a queue from the highest priority down (see open_cursor). The
+   fields are private. The list, bucket and columns engines and the
+   ordered index already keep the nodes in order, and 'position' is simply the
+   next one. A heap engine queue without an ordered index is walked
+   best-first: 'frontier' is a max-heap of the heap slots that may come
+   next, stored in 'small' until it outgrows it and in a malloc'd array
+   after that. */
+typedef struct queue_cursor{
+  const struct queue_prio *queue;
+  const void *position;
+  unsigned int *frontier;
+  unsigned int count;
+  unsigned int capacity;
+  unsigned int small[QUEUE_CURSOR_FRONTIER];
+}Queue_cursor;
+
+/* Settings for init_queue_with_options. A zeroed Queue_options gives
+   the same queue as init_queue. */
+typedef struct queue_options{
+  Queue_engine engine;
+  unsigned int indexes;
+  /* NULL for malloc and free. */
+  const Queue_allocator *allocator;
+  /* Highest priority a QUEUE_ENGINE_BUCKET queue accepts, at most
+     QUEUE_BUCKET_MAX_PRIORITY; 0 means QUEUE_BUCKET_DEFAULT_MAX. The
+     other engines ignore it. */
+  unsigned int max_priority;
+  /* NULL for a queue that may grow without limit. */
+  const Queue_limits *limits;
+}Queue_options;
+
 #endif
@@ -0,0 +1,191 @@
+#ifndef QUEUE_PRIO_ENGINE_H
+#define QUEUE_PRIO_ENGINE_H
+
+#include <stdatomic.h>
+#include <time.h>
+#include "queue-prio-datastructure.h"
+#include "queue-prio-stats-datastructure.h"
+
+/* Internal interface between queue-prio.c and the storage engines.
+   The public functions in queue-prio.c own the semantics (unique
+   priorities, node allocation) and call through these operations to
+   place, find and remove nodes. The engine keeps 'size' up to date.
+   None of these are part of the public API. */
+typedef struct queue_engine_ops{
+  /* 1 if 'first'/'next' visit the nodes from highest to lowest
+     priority, 0 if they visit them in storage order. */
+  unsigned short ordered;
+
+  /* Places a node. Returns 1 on success and 0 if the priority is
+     already stored or the engine could not grow its storage. Engines
+     whose queues always keep a priority index may assume the caller
+     has ruled out duplicates. */
+  unsigned short (*insert)(Queue_prio *const queue_prio, Node *const node);
+
+  /* Places 'count' nodes sorted from highest to lowest priority, with
+     no two sharing a priority, in one pass. Nodes that cannot be
+     placed, because their priority is already stored or storage ran
+     out, are replaced by NULL in 'nodes'. Returns how many were
+     placed. Engines that are not ordered may be given the nodes in
+     any order. */
+  unsigned int (*insert_sorted)(Queue_prio *const queue_prio, Node *nodes[],
+                                unsigned int count);
+
+  /* Removes a node that is currently stored in the queue. */
+  void (*unlink)(Queue_prio *const queue_prio, Node *const node);
+
+  /* Returns the highest-priority node, or NULL if the queue is empty. */
+  Node *(*top)(const Queue_prio *const queue_prio);
+
+  /* Returns the lowest-priority node, or NULL if the queue is empty.
+     Engines that cannot reach it without a search leave this NULL, and
+     their queues keep an ordered index when they may have to evict. */
+  Node *(*bottom)(const Queue_prio *const queue_prio);
+
+  /* Returns the node holding 'priority', or NULL. Only used when the
+     queue has no priority index. */
+  Node *(*find_priority)(const Queue_prio *const queue_prio,
+                         unsigned int priority);
+
+  /* Visits every node once. 'cursor' is scratch state owned by the
+     engine. It is safe to free a node once 'next' has been called on
+     it. */
+  Node *(*first)(const Queue_prio *const queue_prio,
+                 unsigned int *const cursor);
+  Node *(*next)(const Queue_prio *const queue_prio, const Node *const node,
+                unsigned int *const cursor);
+
+  /* Detaches every node with low <= priority <= high and returns them
+     as a chain linked through 'next'. */
+  Node *(*detach_between)(Queue_prio *const queue_prio,
+                          unsigned int low, unsigned int high);
+
+  /* Detaches the 'count' nodes from 'first' to 'last', which are every
+     node between their two priorities and are chained through 'next'
+     in descending order. 'above' is the node just above 'first' in
+     priority order, or NULL. Returns the detached nodes as a chain
+     linked through 'next' and ending in NULL, in any order. */
+  Node *(*detach_run)(Queue_prio *const queue_prio, Node *const above,
+                      Node *const first, Node *const last,
+                      unsigned int count);
+
+  /* Forgets every node, sets the size to 0 and releases the engine's
+     own storage. The nodes themselves are freed by the caller. */
+  void (*reset)(Queue_prio *const queue_prio);
+
+  /* Returns the next node, from highest to lowest priority, whose
+     name hash is 'hash', or NULL. '*cursor' is 0 on the first call
+     and is then owned by the engine. Engines that keep the hashes in
+     an array that can be scanned faster than 'first'/'next' walk the
+     nodes provide this; the others leave it NULL. */
+  Node *(*find_hash)(const Queue_prio *const queue_prio, unsigned int hash,
+                     unsigned int *const cursor);
+}Queue_engine_ops;
+
+/* Children per node in the heap engine's array: the children of slot
+   s are the slots s * QUEUE_HEAP_ARITY + 1 onwards. */
+#define QUEUE_HEAP_ARITY 4
+
+extern const Queue_engine_ops list_engine_ops;
+extern const Queue_engine_ops heap_engine_ops;
+extern const Queue_engine_ops bucket_engine_ops;
+extern const Queue_engine_ops columns_engine_ops;
+
+/* Vector scans over arrays of 32-bit values (queue-prio-scan.c). The
+   kernel is picked for the processor on first use. */
+long scan_equal_below(const unsigned int values[], unsigned int end,
+                      unsigned int value);
+
+/* Hash indexes (queue-prio-index.c). */
+unsigned int hash_name(const char element[]);
+unsigned short index_insert(Node_index *const index, Node *const node);
+unsigned short index_reserve(Node_index *const index, unsigned int extra);
+void index_remove(Node_index *const index, const Node *const node);
+Node *index_find_priority(const Node_index *const index,
+                          unsigned int priority);
+Node *index_first_name(const Node_index *const index, const char element[],
+                       unsigned int hash, unsigned int *const position);
+Node *index_next_name(const Node_index *const index, const char element[],
+                      unsigned int hash, unsigned int *const position);
+void index_free(Node_index *const index);
+
+/* An entry of the ordered index: a node and its tower of links to the
+   next entry on each level. */
+typedef struct order_entry{
+  Node *node;
+  unsigned int priority;
+  unsigned int height;
+  struct order_entry *forward[];
+}Order_entry;
+
+/* Ordered index (queue-prio-order.c). */
+unsigned short order_insert(Queue_prio *const queue_prio, Node *const node);
+void order_remove(Queue_prio *const queue_prio, const Node *const node);
+Node *order_find(const Order_index *const index, unsigned int priority);
+Node *order_above(const Order_index *const index, unsigned int priority);
+Node *order_lowest(const Order_index *const index);
+const Order_entry *order_seek(const Order_index *const index,
+                              unsigned int high);
+unsigned int order_detach_range(Queue_prio *const queue_prio,
+                                unsigned int low, unsigned int high,
+                                Node **const above, Node **const first,
+                                Node **const last);
+void order_reset(Order_index *const index);
+
+/* The nodes of a queue from highest to lowest priority, in a malloc'd
+   array (queue-prio.c). */
+Node **sorted_nodes(const Queue_prio *const queue_prio);
+
+/* Checks whether 'element' fits in a queue's limits (queue-prio.c).
+   Returns 1 if it does, 0 if the queue's own limits leave no room for
+   it and -1 if only the budget it shares does not. */
+short queue_room(const Queue_prio *const queue_prio, const char element[]);
+
+/* A batch item while it is being sorted: its priority and its
+   position in the caller's arrays. */
+typedef struct batch_entry{
+  unsigned int priority;
+  unsigned int position;
+}Batch_entry;
+
+/* Sorting batches, on several threads when they are large
+   (queue-prio-sort.c). */
+void sort_batch(Batch_entry entries[], unsigned int count);
+
+/* Statistics (queue-prio-stats.c). Without QUEUE_STATS every hook
+   compiles to nothing. STATS_START declares 'start' and goes last
+   among a function's declarations. */
+#ifdef QUEUE_STATS
+void stats_count(Queue_stat stat, unsigned long long amount);
+void stats_depth(int depth);
+unsigned long long stats_clock(void);
+void stats_latency(Queue_stat_function function, unsigned long long start);
+#define STATS_COUNT(stat, amount) stats_count(stat, amount)
+#define STATS_DEPTH(depth) stats_depth(depth)
+#define STATS_START(start) unsigned long long start = stats_clock()
+#define STATS_END(function, start) stats_latency(function, start)
+#else
+#define STATS_COUNT(stat, amount) ((void) (amount))
+#define STATS_DEPTH(depth) ((void) 0)
+#define STATS_START(start)
+#define STATS_END(function, start) ((void) 0)
+#endif
+
+/* Sleeping and waking on a word (queue-prio-wait.c). */
+void wait_deadline(long timeout_ms, struct timespec *const deadline);
+short wait_word(atomic_uint *const word, unsigned int seen,
+                const struct timespec *const deadline);
+void wake_word(atomic_uint *const word, int count);
+
+/* Node and string storage (queue-prio-alloc.c). */
+Node *pool_alloc_node(Queue_prio *const queue_prio);
+Node *pool_alloc_run(Queue_prio *const queue_prio, unsigned int count);
+void pool_free_node(Queue_prio *const queue_prio, Node *const node);
+void pool_free_chain(Queue_prio *const queue_prio, Node *const first,
+                     Node *const last);
+char *arena_alloc_string(Queue_prio *const queue_prio, size_t size);
+void arena_free_string(Queue_prio *const queue_prio, char *const data,
+                       size_t size);
+void storage_release(Queue_prio *const queue_prio);
+
+#endif
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include "queue-prio-engine.h"
+
+/*This file implements the heap storage engine for Queue_prio. The
+  nodes are kept in a contiguous array ordered as a 4-ary max-heap on
+  priority, and every node remembers its own position in the array so
+  it can be removed without searching. Heap queues always carry a
+  priority index (see queue-prio-index.c), which turns the duplicate
+  check done by en_queue into a single hash lookup. Compared to the list engine,
+  en_queue and de_queue are O(log n) and peek is O(1); listing the
+  elements in priority order costs a sort.*/
+
+#define HEAP_ARITY QUEUE_HEAP_ARITY
+#define HEAP_MIN_CAPACITY 16
+
+#define PRIO(NODE) ((unsigned int) (NODE)->priority)
+
+/* Stores 'node' at position 'slot' and records the position. */
+static void heap_set(Queue_prio *const queue_prio, unsigned int slot,
+                     Node *const node) {
+  queue_prio->heap[slot] = node;
+  node->slot = slot;
+}
+
+/* Moves the node at 'slot' towards the root until its parent has a
+   higher priority. */
+static void sift_up(Queue_prio *const queue_prio, unsigned int slot) {
+  Node *node = queue_prio->heap[slot];
+  unsigned int parent;
+
+  while (slot > 0) {
+    parent = (slot - 1) / HEAP_ARITY;
+    if (PRIO(queue_prio->heap[parent]) >= PRIO(node))
+      break;
+    heap_set(queue_prio, slot, queue_prio->heap[parent]);
+    slot = parent;
+  }
+  heap_set(queue_prio, slot, node);
+}
+
+/* Moves the node at 'slot' towards the leaves until none of its
+   children has a higher priority. */
+static void sift_down(Queue_prio *const queue_prio, unsigned int slot) {
+  Node *node = queue_prio->heap[slot];
+  unsigned int count = (unsigned int) queue_prio->size;
+  unsigned int child;
+  unsigned int best;
+  unsigned int last;
+
+  for (;;) {
+    child = slot * HEAP_ARITY + 1;
+    if (child >= count)
+      break;
+
+    /* Pick the highest-priority child. */
+    best = child;
+    last = child + HEAP_ARITY < count ? child + HEAP_ARITY : count;
+    for (child = child + 1; child < last; child++)
+      if (PRIO(queue_prio->heap[child]) > PRIO(queue_prio->heap[best]))
+        best = child;
+
+    if (PRIO(queue_prio->heap[best]) <= PRIO(node))
+      break;
+    heap_set(queue_prio, slot, queue_prio->heap[best]);
+    slot = best;
+  }
+  heap_set(queue_prio, slot, node);
+}
+
+/* Makes room for at least one more node. Returns 1 on success. */
+static unsigned short heap_reserve(Queue_prio *const queue_prio) {
+  unsigned int capacity;
+  Node **heap = NULL;
+
+  if ((unsigned int) queue_prio->size < queue_prio->heap_capacity)
+    return 1;
+
+  capacity = queue_prio->heap_capacity == 0 ? HEAP_MIN_CAPACITY
+    : queue_prio->heap_capacity * 2;
+  heap = realloc(queue_prio->heap, capacity * sizeof(Node *));
+  if (heap == NULL)
+    return 0;
+
+  queue_prio->heap = heap;
+  queue_prio->heap_capacity = capacity;
+  return 1;
+}
+
+/* Adds a node to the bottom of the heap and restores heap order. */
+static unsigned short heap_insert(Queue_prio *const queue_prio,
+                                  Node *const node) {
+  unsigned int slot = (unsigned int) queue_prio->size;
+
+  if (!heap_reserve(queue_prio))
+    return 0;
+
+  queue_prio->size++;
+  heap_set(queue_prio, slot, node);
+  sift_up(queue_prio, slot);
+  return 1;
+}
+
+/* Adds a run of nodes. Small runs are sifted up one by one; a run at
+   least as large as the heap is appended whole and the heap rebuilt
+   bottom-up, which is O(n + k) instead of O(k log n). */
+static unsigned int heap_insert_sorted(Queue_prio *const queue_prio,
+                                       Node *nodes[], unsigned int count) {
+  unsigned int size = (unsigned int) queue_prio->size;
+  unsigned int needed = size + count;
+  unsigned int capacity = queue_prio->heap_capacity;
+  unsigned int i;
+  Node **heap = NULL;
+
+  /* Grow once for the whole run. */
+  if (needed > capacity) {
+    if (capacity == 0)
+      capacity = HEAP_MIN_CAPACITY;
+    while (capacity < needed)
+      capacity *= 2;
+    heap = realloc(queue_prio->heap, capacity * sizeof(Node *));
+    if (heap == NULL) {
+      for (i = 0; i < count; i++)
+        nodes[i] = NULL;
+      return 0;
+    }
+    queue_prio->heap = heap;
+    queue_prio->heap_capacity = capacity;
+  }
+
+  if (count < size) {
+    for (i = 0; i < count; i++) {
+      heap_set(queue_prio, (unsigned int) queue_prio->size, nodes[i]);
+      queue_prio->size++;
+      sift_up(queue_prio, nodes[i]->slot);
+    }
+  } else {
+    for (i = 0; i < count; i++)
+      heap_set(queue_prio, size + i, nodes[i]);
+    queue_prio->size = (int) needed;
+    for (i = needed / HEAP_ARITY + 1; i-- > 0;)
+      if (i < needed)
+        sift_down(queue_prio, i);
+  }
+  return count;
+}
+
+/* Removes a node by moving the last node into its place. */
+static void heap_unlink(Queue_prio *const queue_prio, Node *const node) {
+  unsigned int slot = node->slot;
+  unsigned int last = (unsigned int) queue_prio->size - 1;
+  Node *moved = NULL;
+
+  moved = queue_prio->heap[last];
+  queue_prio->heap[last] = NULL;
+  queue_prio->size--;
+
+  if (slot != last) {
+    heap_set(queue_prio, slot, moved);
+
+    /* The moved node may belong above or below its new position. */
+    if (slot > 0 && PRIO(queue_prio->heap[(slot - 1) / HEAP_ARITY])
+        < PRIO(moved))
+      sift_up(queue_prio, slot);
+    else
+      sift_down(queue_prio, slot);
+  }
+}
+
+static Node *heap_top(const Queue_prio *const queue_prio) {
+  return queue_prio->size > 0 ? queue_prio->heap[0] : NULL;
+}
+
+/* Heap queues always have a priority index, so this plain scan is
+   only a fallback. */
+static Node *heap_find_priority(const Queue_prio *const queue_prio,
+                                unsigned int priority) {
+  unsigned int i;
+
+  for (i = 0; i < (unsigned int) queue_prio->size; i++)
+    if (PRIO(queue_prio->heap[i]) == priority)
+      return queue_prio->heap[i];
+  return NULL;
+}
+
+static Node *heap_first(const Queue_prio *const queue_prio,
+                        unsigned int *const cursor) {
+  *cursor = 0;
+  return queue_prio->size > 0 ? queue_prio->heap[0] : NULL;
+}
+
+static Node *heap_next(const Queue_prio *const queue_prio,
+                       const Node *const node, unsigned int *const cursor) {
+  (void) node;
+  *cursor += 1;
+  return *cursor < (unsigned int) queue_prio->size
+    ? queue_prio->heap[*cursor] : NULL;
+}
+
+/* Partitions the array into kept and removed nodes in one pass, then
+   rebuilds the heap bottom-up in O(n). */
+static Node *heap_detach_between(Queue_prio *const queue_prio,
+                                 unsigned int low, unsigned int high) {
+  unsigned int count = (unsigned int) queue_prio->size;
+  unsigned int kept = 0;
+  unsigned int i;
+  Node *removed = NULL;
+  Node *node = NULL;
+
+  for (i = 0; i < count; i++) {
+    node = queue_prio->heap[i];
+    if (PRIO(node) >= low && PRIO(node) <= high) {
+      node->next = removed;
+      removed = node;
+    } else {
+      heap_set(queue_prio, kept++, node);
+    }
+  }
+
+  /* Heapify the surviving prefix. */
+  queue_prio->size = (int) kept;
+  for (i = kept / HEAP_ARITY + 1; i-- > 0;)
+    if (i < kept)
+      sift_down(queue_prio, i);
+  return removed;
+}
+
+/* A short run is unlinked node by node in O(k log n); once that would
+   cost more than a rebuild, the run is partitioned out by its priority
+   range like detach_between does. */
+static Node *heap_detach_run(Queue_prio *const queue_prio, Node *const above,
+                             Node *const first, Node *const last,
+                             unsigned int count) {
+  Node *node = first;
+  unsigned int levels = 1;
+  unsigned int i;
+
+  (void) above;
+  for (i = (unsigned int) queue_prio->size; i >= HEAP_ARITY; i /= HEAP_ARITY)
+    levels++;
+  if (count * levels > (unsigned int) queue_prio->size)
+    return heap_detach_between(queue_prio, PRIO(last), PRIO(first));
+
+  for (i = 0; i < count; i++) {
+    heap_unlink(queue_prio, node);
+    node = node->next;
+  }
+  last->next = NULL;
+  return first;
+}
+
+static void heap_reset(Queue_prio *const queue_prio) {
+  free(queue_prio->heap);
+  queue_prio->heap = NULL;
+  queue_prio->heap_capacity = 0;
+  queue_prio->size = 0;
+}
+
+const Queue_engine_ops heap_engine_ops = {
+  0,
+  heap_insert,
+  heap_insert_sorted,
+  heap_unlink,
+  heap_top,
+  NULL,
+  heap_find_priority,
+  heap_first,
+  heap_next,
+  heap_detach_between,
+  heap_detach_run,
+  heap_reset,
+  NULL
+};
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio-engine.h"
+
+/*This file implements the hash indexes a Queue_prio can keep next to
+  its engine: open-addressing tables of Node pointers keyed either by
+  priority or by element data. They use linear probing and
+  backward-shift deletion, so lookups never have to skip over
+  tombstones and the table never needs to be rebuilt just to clean up
+  after removals. The priority index holds each priority at most once;
+  the name index is a multimap, and all nodes with the same data sit
+  in the same probe run.*/
+
+#define INDEX_MIN_CAPACITY 16
+
+/*
+ * Returns the 32-bit FNV-1a hash of an element name.
+ */
+unsigned int hash_name(const char element[]) {
+  unsigned int hash = 2166136261u;
+
+  while (*element != '\0') {
+    hash ^= (unsigned char) *element++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* Scrambles a hash into a slot number for a table of 'capacity'
+   slots. */
+static unsigned int home_slot(unsigned int hash, unsigned int capacity) {
+  hash *= 0x9E3779B1u;
+  hash ^= hash >> 16;
+  return hash & (capacity - 1);
+}
+
+/* Returns the hash a node is filed under in 'index'. */
+static unsigned int node_key(const Node_index *const index,
+                             const Node *const node) {
+  return index->by_name ? node->hash : (unsigned int) node->priority;
+}
+
+/* Places 'node' into 'slots' without checking for growth. */
+static void place(const Node_index *const index, Node **slots,
+                  unsigned int capacity, Node *const node) {
+  unsigned int i = home_slot(node_key(index, node), capacity);
+
+  while (slots[i] != NULL)
+    i = (i + 1) & (capacity - 1);
+  slots[i] = node;
+}
+
+/* Moves the table to one of 'capacity' slots. Returns 1 on success, 0
+   if the allocation failed, in which case the old table is left
+   untouched. */
+static unsigned short resize(Node_index *const index, unsigned int capacity) {
+  unsigned int i;
+  Node **slots = NULL;
+
+  slots = calloc(capacity, sizeof(Node *));
+  if (slots == NULL)
+    return 0;
+
+  /* Rehash every stored node into the new table. */
+  for (i = 0; i < index->capacity; i++)
+    if (index->slots[i] != NULL)
+      place(index, slots, capacity, index->slots[i]);
+
+  free(index->slots);
+  index->slots = slots;
+  index->capacity = capacity;
+  return 1;
+}
+
+/* Doubles the table (or creates it). Returns 1 on success. */
+static unsigned short grow(Node_index *const index) {
+  return resize(index, index->capacity == 0 ? INDEX_MIN_CAPACITY
+                : index->capacity * 2);
+}
+
+/*
+ * Grows the index once so that 'extra' more nodes fit without a
+ * rehash, instead of doubling step by step while they are inserted.
+ * Returns 1 if the operation is successful, 0 otherwise.
+ */
+unsigned short index_reserve(Node_index *const index, unsigned int extra) {
+  unsigned int capacity = index->capacity == 0 ? INDEX_MIN_CAPACITY
+    : index->capacity;
+
+  while ((index->count + extra) * 4 > capacity * 3)
+    capacity *= 2;
+  return capacity == index->capacity || resize(index, capacity);
+}
+
+/*
+ * Adds a node to the index. For the priority index the caller
+ * guarantees that no node with the same priority is already present.
+ * Returns 1 if the operation is successful, 0 otherwise.
+ */
+unsigned short index_insert(Node_index *const index, Node *const node) {
+  /* Keep the load factor at or below 3/4. */
+  if ((index->count + 1) * 4 > index->capacity * 3 && !grow(index))
+    return 0;
+
+  place(index, index->slots, index->capacity, node);
+  index->count++;
+  return 1;
+}
+
+/*
+ * Removes a node from the index. Entries further along the probe run
+ * are shifted back so the run stays unbroken.
+ */
+void index_remove(Node_index *const index, const Node *const node) {
+  unsigned int mask = index->capacity - 1;
+  unsigned int hole;
+  unsigned int i;
+  unsigned int home;
+
+  if (index->capacity == 0)
+    return;
+
+  /* Find the slot holding the node. */
+  hole = home_slot(node_key(index, node), index->capacity);
+  while (index->slots[hole] != NULL && index->slots[hole] != node)
+    hole = (hole + 1) & mask;
+  if (index->slots[hole] == NULL)
+    return;
+
+  index->slots[hole] = NULL;
+  index->count--;
+
+  /* Pull back every following entry whose home slot lies at or
+     before the hole, measured cyclically. */
+  i = (hole + 1) & mask;
+  while (index->slots[i] != NULL) {
+    home = home_slot(node_key(index, index->slots[i]), index->capacity);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      index->slots[hole] = index->slots[i];
+      index->slots[i] = NULL;
+      hole = i;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+/*
+ * Returns the node stored under 'priority' in a priority index, or
+ * NULL if there is none.
+ */
+Node *index_find_priority(const Node_index *const index,
+                          unsigned int priority) {
+  unsigned int i;
+
+  if (index->capacity == 0)
+    return NULL;
+
+  i = home_slot(priority, index->capacity);
+  while (index->slots[i] != NULL) {
+    if ((unsigned int) index->slots[i]->priority == priority)
+      return index->slots[i];
+    i = (i + 1) & (index->capacity - 1);
+  }
+  return NULL;
+}
+
+/* Scans the probe run from '*position' for the next node whose data
+   equals 'element', leaving '*position' just past it. */
+static Node *scan_name(const Node_index *const index, const char element[],
+                       unsigned int hash, unsigned int *const position) {
+  Node *node = NULL;
+  unsigned int i = *position;
+
+  while (index->slots[i] != NULL) {
+    node = index->slots[i];
+    i = (i + 1) & (index->capacity - 1);
+
+    /* Only compare strings when the cached hashes agree. */
+    if (node->hash == hash && strcmp(node->data, element) == 0) {
+      *position = i;
+      return node;
+    }
+  }
+  *position = i;
+  return NULL;
+}
+
+/*
+ * Returns the first node of a name index whose data equals 'element',
+ * or NULL. 'hash' must be hash_name(element). Further matches are
+ * returned by index_next_name with the same 'position'. The index
+ * must not change in between.
+ */
+Node *index_first_name(const Node_index *const index, const char element[],
+                       unsigned int hash, unsigned int *const position) {
+  if (index->capacity == 0)
+    return NULL;
+  *position = home_slot(hash, index->capacity);
+  return scan_name(index, element, hash, position);
+}
+
+/*
+ * Returns the next node of a name index whose data equals 'element',
+ * or NULL once there are no more.
+ */
+Node *index_next_name(const Node_index *const index, const char element[],
+                      unsigned int hash, unsigned int *const position) {
+  return scan_name(index, element, hash, position);
+}
+
+/*
+ * Releases the memory of the index and leaves it empty.
+ */
+void index_free(Node_index *const index) {
+  free(index->slots);
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+}
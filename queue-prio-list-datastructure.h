@@ -1,15 +1,92 @@
 #ifndef QUEUE_PRIO_LIST_DATASTRUCTURE_H
 #define QUEUE_PRIO_LIST_DATASTRUCTURE_H
 
+#include <pthread.h>
+#include "queue-prio-datastructure.h"
+
+/* The largest weight set_queue_weight accepts. */
+#define QUEUE_MAX_WEIGHT 65536u
+
+struct queue_prio_list;
+
+/* One named queue. Nodes are chained twice: through 'next'/'prev' in
+   the list of all queues, and through 'bucket_next' in their hash
+   bucket. A node and its queue never move once created, so Queue_prio
+   pointers stay valid while the table is resized. 'head' mirrors the
+   queue's head priority (-1 when empty), and 'head_slot' and
+   'fair_slot' are the node's positions in the list's two heaps of
+   non-empty queues. 'pass' is how far the queue has advanced in the
+   weighted-fair order, by 'stride' per element served. */
 typedef struct list_node{
   Queue_prio *queue;
   struct list_node *next;
   char *name;
+  struct list_node *prev;
+  struct list_node *bucket_next;
+  unsigned int hash;
+  struct queue_prio_list *list;
+  long long head;
+  unsigned int head_slot;
+  unsigned int fair_slot;
+  unsigned int stride;
+  unsigned long long pass;
 }list_Node;
 
+/* The changes a list of queues reports to its observer. */
+typedef enum queue_list_event_type{
+  QUEUE_LIST_EVENT_ADD,
+  QUEUE_LIST_EVENT_REMOVE,
+  QUEUE_LIST_EVENT_CLEAR
+}Queue_list_event_type;
+
+struct list_waiter;
+
+/* Called after a queue is added and before one is removed or the list
+   is cleared, with 'context'. 'name' and 'queue' are the queue
+   concerned (NULL for QUEUE_LIST_EVENT_CLEAR). A zeroed
+   Queue_list_observer means nobody is told. */
+typedef struct queue_list_observer{
+  void (*notify)(struct queue_prio_list *queue_prio_list,
+                 Queue_list_event_type type, const char *name,
+                 Queue_prio *queue, void *context);
+  void *context;
+}Queue_list_observer;
+
+/* 'buckets' is the current hash table. While it is being grown, the
+   previous table stays in 'old_buckets' and its buckets below
+   'migrated' have already been moved across; each add or remove moves
+   a few more, so no single call pays for the whole rehash. Bucket
+   counts are zero or powers of two. 'lock' serializes en_queue_list
+   and de_queue_any, and 'waiters' is the FIFO of consumers blocked in
+   de_queue_any, each on its own wait record; 'blocked' is the same for
+   producers waiting in en_queue_list for room in a full queue.
+
+   'budget' is the byte budget every queue of the list shares (see
+   set_queue_list_budget).
+
+   'heads' is a max-heap of the non-empty queues by head priority and
+   'fair' a min-heap of the same queues by pass; both hold 'active'
+   nodes and have room for 'heap_capacity'. 'fair_clock' is the pass of
+   the queue served last, which a queue that becomes non-empty starts
+   from. */
 typedef struct queue_prio_list{
   list_Node *head;
   int size;
+  list_Node **buckets;
+  unsigned int bucket_count;
+  list_Node **old_buckets;
+  unsigned int old_bucket_count;
+  unsigned int migrated;
+  Queue_list_observer observer;
+  pthread_mutex_t lock;
+  struct list_waiter *waiters;
+  struct list_waiter *blocked;
+  Queue_budget budget;
+  list_Node **heads;
+  list_Node **fair;
+  unsigned int active;
+  unsigned int heap_capacity;
+  unsigned long long fair_clock;
 }Queue_prio_list;
 
 #endif
@@ -1,5 +1,6 @@
 #include "queue-prio.h"
 #include "queue-prio-list.h"
+#include "queue-prio-engine.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,7 +13,340 @@
   number of queues in the list, and retrieving specific queues by 
   their names. These functionalities collectively allow users to 
   create and maintain a list of priority queues, each identified 
-  by a distinct name, making it a useful tool for efficient organization.*/
+  by a distinct name, making it a useful tool for efficient organization.
+
+  Lookups by name go through a chained hash table over the same nodes,
+  so get_queue, add_queue_prio and remove_queue cost O(1) expected
+  instead of a string compare per queue. The table grows
+  incrementally: when it fills up a table twice the size is started
+  and every later add or remove moves a few buckets across until the
+  old table is empty.
+
+  en_queue_list and de_queue_any let producer and consumer threads
+  share the queues of a list. Both take the list's lock, and a consumer
+  that finds every queue it asked for empty files a wait record naming
+  those queues and sleeps on a word inside the record. A producer that
+  adds to a queue hands the element to the oldest record that names
+  it: it unlinks the record, flips its word and wakes that one thread.
+  Consumers waiting on other queues are never woken, and a producer
+  finds no record and makes no system call when nobody is waiting.
+
+  Queues can be bounded (see Queue_limits), and all the queues of a
+  list share one byte budget, set with set_queue_list_budget. Under
+  QUEUE_FULL_BLOCK, a producer that finds no room files a wait record
+  of its own, naming its queue when the queue's own limits are in the
+  way and no queue when the budget is. Whenever a queue gives up
+  elements, the list wakes every producer waiting on that queue or on
+  the budget, and each of them checks for room again.
+
+  Every queue of the list reports its changes to the list through the
+  queue's 'owner' hook, and the list keeps the non-empty queues in two
+  indexed heaps: one by head priority, which de_queue_global pops
+  from, and one by weighted-fair pass, which de_queue_fair pops from.
+  A change that does not move a queue's head costs one comparison, and
+  one that does costs O(log n) in the number of queues, so neither
+  dequeue ever looks at every queue.
+
+  The weighted-fair order is stride scheduling: serving a queue
+  advances its pass by a stride inversely proportional to its weight,
+  and the queue with the lowest pass is served next, so over time
+  every non-empty queue gets a share of dequeues proportional to its
+  weight whatever the priorities in the other queues. A queue that
+  becomes non-empty starts from the pass of the queue served last, so
+  it cannot bank credit while idle.*/
+
+#define LIST_MIN_BUCKETS 16
+#define LIST_MIGRATE_STEP 4
+#define LIST_NO_SLOT 0xFFFFFFFFu
+#define LIST_FAIR_STRIDE (1u << 20)
+
+/* A consumer blocked in de_queue_any. It lives on that consumer's
+   stack and is linked into the list's 'waiters' while it sleeps. */
+typedef struct list_waiter{
+  Queue_prio **queues;
+  unsigned int count;
+  atomic_uint signaled;
+  struct list_waiter *next;
+}List_waiter;
+
+/* Searches one bucket chain for 'name'. */
+static list_Node *bucket_find(list_Node *curr, const char name[],
+                              unsigned int hash) {
+  unsigned int compared = 0;
+
+  while (curr != NULL) {
+    compared++;
+    if (curr->hash == hash && strcmp(curr->name, name) == 0)
+      break;
+    curr = curr->bucket_next;
+  }
+  STATS_COUNT(QUEUE_STAT_LOOKUP_WALK, compared);
+  return curr;
+}
+
+/* Returns the node called 'name', looking in the old table too while
+   a resize is under way. */
+static list_Node *find_node(const Queue_prio_list *const queue_prio_list,
+                            const char name[], unsigned int hash) {
+  list_Node *found = NULL;
+
+  STATS_COUNT(QUEUE_STAT_LOOKUPS, 1);
+  if (queue_prio_list->bucket_count > 0)
+    found = bucket_find(queue_prio_list->buckets[hash
+                        & (queue_prio_list->bucket_count - 1)], name, hash);
+  if (found == NULL && queue_prio_list->old_buckets != NULL)
+    found = bucket_find(queue_prio_list->old_buckets[hash
+                        & (queue_prio_list->old_bucket_count - 1)],
+                        name, hash);
+  return found;
+}
+
+/* Pushes a node onto its bucket in the current table. */
+static void bucket_add(Queue_prio_list *const queue_prio_list,
+                       list_Node *const node) {
+  list_Node **bucket = &queue_prio_list->buckets[node->hash
+                        & (queue_prio_list->bucket_count - 1)];
+
+  node->bucket_next = *bucket;
+  *bucket = node;
+}
+
+/* Unchains a node from whichever bucket holds it. */
+static void bucket_remove(Queue_prio_list *const queue_prio_list,
+                          list_Node *const node) {
+  list_Node **link = NULL;
+
+  link = &queue_prio_list->buckets[node->hash
+          & (queue_prio_list->bucket_count - 1)];
+  while (*link != NULL && *link != node)
+    link = &(*link)->bucket_next;
+
+  /* Not in the current table, so it is still in the old one. */
+  if (*link == NULL && queue_prio_list->old_buckets != NULL) {
+    link = &queue_prio_list->old_buckets[node->hash
+            & (queue_prio_list->old_bucket_count - 1)];
+    while (*link != NULL && *link != node)
+      link = &(*link)->bucket_next;
+  }
+  if (*link != NULL)
+    *link = node->bucket_next;
+}
+
+/* Moves up to 'steps' buckets of the old table into the current one
+   and drops the old table once it is empty. */
+static void migrate(Queue_prio_list *const queue_prio_list,
+                    unsigned int steps) {
+  list_Node *curr = NULL;
+  list_Node *next = NULL;
+
+  while (queue_prio_list->old_buckets != NULL && steps-- > 0) {
+    curr = queue_prio_list->old_buckets[queue_prio_list->migrated];
+    queue_prio_list->old_buckets[queue_prio_list->migrated] = NULL;
+    while (curr != NULL) {
+      next = curr->bucket_next;
+      bucket_add(queue_prio_list, curr);
+      curr = next;
+    }
+
+    if (++queue_prio_list->migrated == queue_prio_list->old_bucket_count) {
+      free(queue_prio_list->old_buckets);
+      queue_prio_list->old_buckets = NULL;
+      queue_prio_list->old_bucket_count = 0;
+      queue_prio_list->migrated = 0;
+    }
+  }
+}
+
+/* Makes sure there is a table with room for one more queue, starting a
+   resize if the current one is full. Returns 1 on success. */
+static short reserve_bucket(Queue_prio_list *const queue_prio_list) {
+  list_Node **buckets = NULL;
+  unsigned int count;
+
+  if ((unsigned int) queue_prio_list->size < queue_prio_list->bucket_count)
+    return 1;
+
+  /* A previous resize has to finish before the next one starts. */
+  migrate(queue_prio_list, queue_prio_list->old_bucket_count);
+
+  count = queue_prio_list->bucket_count == 0 ? LIST_MIN_BUCKETS
+    : queue_prio_list->bucket_count * 2;
+  buckets = calloc(count, sizeof(list_Node *));
+  if (buckets == NULL)
+    return 0;
+
+  if (queue_prio_list->bucket_count > 0) {
+    queue_prio_list->old_buckets = queue_prio_list->buckets;
+    queue_prio_list->old_bucket_count = queue_prio_list->bucket_count;
+    queue_prio_list->migrated = 0;
+  }
+  queue_prio_list->buckets = buckets;
+  queue_prio_list->bucket_count = count;
+  return 1;
+}
+
+/* Checks whether 'a' belongs above 'b' in the heap chosen by 'fair'. */
+static short heap_above(const list_Node *const a, const list_Node *const b,
+                        short fair) {
+  if (fair && a->pass != b->pass)
+    return a->pass < b->pass;
+  return a->head > b->head;
+}
+
+/* Puts 'node' at slot 'i' of the heap chosen by 'fair'. */
+static void heap_set(Queue_prio_list *const queue_prio_list, short fair,
+                     unsigned int i, list_Node *const node) {
+  if (fair) {
+    queue_prio_list->fair[i] = node;
+    node->fair_slot = i;
+  } else {
+    queue_prio_list->heads[i] = node;
+    node->head_slot = i;
+  }
+}
+
+/* Moves 'node' up or down the heap chosen by 'fair' until it is in
+   its place. */
+static void heap_fix(Queue_prio_list *const queue_prio_list, short fair,
+                     list_Node *const node) {
+  list_Node **heap = fair ? queue_prio_list->fair : queue_prio_list->heads;
+  unsigned int i = fair ? node->fair_slot : node->head_slot;
+  unsigned int child;
+
+  while (i > 0 && heap_above(node, heap[(i - 1) / 2], fair)) {
+    heap_set(queue_prio_list, fair, i, heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  while ((child = 2 * i + 1) < queue_prio_list->active) {
+    if (child + 1 < queue_prio_list->active
+        && heap_above(heap[child + 1], heap[child], fair))
+      child++;
+    if (!heap_above(heap[child], node, fair))
+      break;
+    heap_set(queue_prio_list, fair, i, heap[child]);
+    i = child;
+  }
+  heap_set(queue_prio_list, fair, i, node);
+}
+
+/* Takes 'node' out of the heap chosen by 'fair'. The caller lowers
+   'active' once the node has left both heaps. */
+static void heap_remove(Queue_prio_list *const queue_prio_list, short fair,
+                        list_Node *const node) {
+  list_Node **heap = fair ? queue_prio_list->fair : queue_prio_list->heads;
+  unsigned int i = fair ? node->fair_slot : node->head_slot;
+  list_Node *last = heap[queue_prio_list->active - 1];
+
+  if (last != node) {
+    heap_set(queue_prio_list, fair, i, last);
+    queue_prio_list->active--;
+    heap_fix(queue_prio_list, fair, last);
+    queue_prio_list->active++;
+  }
+  if (fair)
+    node->fair_slot = LIST_NO_SLOT;
+  else
+    node->head_slot = LIST_NO_SLOT;
+}
+
+/* Brings a node's place in both heaps up to date with its queue's
+   head. */
+static void track_head(list_Node *const node) {
+  Queue_prio_list *queue_prio_list = node->list;
+  long long head = peek_priority(node->queue);
+
+  if (head == node->head)
+    return;
+
+  if (head < 0) {
+    heap_remove(queue_prio_list, 0, node);
+    heap_remove(queue_prio_list, 1, node);
+    queue_prio_list->active--;
+  } else if (node->head < 0) {
+    if (node->pass < queue_prio_list->fair_clock)
+      node->pass = queue_prio_list->fair_clock;
+    node->head = head;
+    queue_prio_list->active++;
+    heap_set(queue_prio_list, 0, queue_prio_list->active - 1, node);
+    heap_set(queue_prio_list, 1, queue_prio_list->active - 1, node);
+    heap_fix(queue_prio_list, 0, node);
+    heap_fix(queue_prio_list, 1, node);
+  } else {
+    node->head = head;
+    heap_fix(queue_prio_list, 0, node);
+    heap_fix(queue_prio_list, 1, node);
+  }
+  node->head = head;
+}
+
+/* Checks whether a wait record names 'queue'. */
+static short waits_for(const List_waiter *const waiter,
+                       const Queue_prio *const queue) {
+  unsigned int i;
+
+  for (i = 0; i < waiter->count; i++)
+    if (waiter->queues[i] == queue)
+      return 1;
+  return 0;
+}
+
+/* Wakes every producer waiting for room in 'queue', which may be
+   NULL, or in the list's budget. Each record is unlinked before its
+   producer is woken. */
+static void wake_producers(Queue_prio_list *const queue_prio_list,
+                           const Queue_prio *const queue) {
+  List_waiter **link = &queue_prio_list -> blocked;
+  List_waiter *waiter = NULL;
+
+  while (*link != NULL) {
+    waiter = *link;
+    if (waiter -> count > 0 && !waits_for(waiter, queue)) {
+      link = &waiter -> next;
+      continue;
+    }
+    *link = waiter -> next;
+    atomic_store(&waiter -> signaled, 1);
+    wake_word(&waiter -> signaled, 1);
+  }
+}
+
+/* The owner hook of every queue in the list. A queue giving up
+   elements may make room for a blocked producer. */
+static void queue_changed(Queue_prio *queue, const Queue_event *event,
+                          void *context) {
+  list_Node *node = context;
+
+  track_head(node);
+  if (node -> list -> blocked != NULL
+      && (event -> type == QUEUE_EVENT_DE_QUEUE
+          || event -> type == QUEUE_EVENT_REMOVE_BETWEEN
+          || event -> type == QUEUE_EVENT_CLEAR))
+    wake_producers(node -> list, queue);
+}
+
+/* Makes sure both heaps have room for every queue plus one more.
+   Returns 1 on success. */
+static short reserve_heaps(Queue_prio_list *const queue_prio_list) {
+  list_Node **heads = NULL;
+  list_Node **fair = NULL;
+  unsigned int capacity;
+
+  if ((unsigned int) queue_prio_list->size < queue_prio_list->heap_capacity)
+    return 1;
+
+  capacity = queue_prio_list->heap_capacity == 0 ? LIST_MIN_BUCKETS
+    : queue_prio_list->heap_capacity * 2;
+  heads = realloc(queue_prio_list->heads, capacity * sizeof(list_Node *));
+  if (heads == NULL)
+    return 0;
+  queue_prio_list->heads = heads;
+  fair = realloc(queue_prio_list->fair, capacity * sizeof(list_Node *));
+  if (fair == NULL)
+    return 0;
+  queue_prio_list->fair = fair;
+  queue_prio_list->heap_capacity = capacity;
+  return 1;
+}
 
 /* This function initializes a list of priority queues. 
    It sets the head of the list to NULL and the size to 0. 
@@ -21,8 +355,10 @@
 short init_queue_list(Queue_prio_list *const queue_prio_list){
   if(queue_prio_list == NULL)
     return 0;
+  memset(queue_prio_list, 0, sizeof(Queue_prio_list));
   queue_prio_list -> head = NULL;
   queue_prio_list -> size = 0;
+  pthread_mutex_init(&queue_prio_list -> lock, NULL);
   return 1;
 }
 
@@ -32,38 +368,52 @@ short init_queue_list(Queue_prio_list *const queue_prio_list){
    for failure. If the queue is successfully added, it returns 1.*/
 short add_queue_prio(Queue_prio_list *const queue_prio_list,
 		     const char new_queue_name[]){
+  return add_queue_prio_with_options(queue_prio_list, new_queue_name, NULL);
+}
+
+/* This function adds a new priority queue initialized with 'options'
+   (see init_queue_with_options; NULL for the defaults) to the list.
+   It returns 0 if either queue_prio_list or new_queue_name is NULL,
+   the name is taken, the options are invalid or memory runs out, and
+   1 if the queue is added.*/
+short add_queue_prio_with_options(Queue_prio_list *const queue_prio_list,
+                                  const char new_queue_name[],
+                                  const Queue_options *const options){
   /*Setting all variables to NULL to start*/
-  list_Node *curr = NULL;
   Queue_prio *queue = NULL;
   list_Node *ans_node = NULL;
   char *name = NULL;
+  unsigned int hash = 0;
 
   /*Check if either the queue_prio_list or new_queue_name 
     is NULL, and return 0 if so.*/
   if(queue_prio_list == NULL || new_queue_name == NULL)
     return 0;
 
-  /*Declare a pointer curr and initialize it with the 
-    head of the queue_prio_list.*/
-  curr = queue_prio_list -> head;
-
-  /*Traverse the existing list of queue names to check if new_queue_name 
-    already exists.*/
-  while(curr != NULL){
-    /* If new_queue_name matches the name of an existing queue, return 0
-    to indicate failure.*/
-    if(strcmp(curr ->  name,new_queue_name) == 0)
-      return 0;
-    curr = curr -> next;
-  }
+  /*Check the hash table to see if new_queue_name already exists.*/
+  hash = hash_name(new_queue_name);
+  if(find_node(queue_prio_list, new_queue_name, hash) != NULL)
+    return 0;
+  if(!reserve_bucket(queue_prio_list) || !reserve_heaps(queue_prio_list))
+    return 0;
   
-  /*Allocate memory for a new Queue_prio structure and a 
-    new list_Node structure.*/
+  /*Allocate memory for a new Queue_prio structure, a new list_Node
+    structure and a character array to store the new_queue_name.*/
   queue = calloc(1,sizeof(Queue_prio));
   ans_node = malloc(sizeof(list_Node));
-
-  /*Allocate memory for a new character array to store the new_queue_name.*/
   name = malloc(strlen(new_queue_name)+1);
+  if(queue == NULL || ans_node == NULL || name == NULL){
+    free(queue);
+    free(ans_node);
+    free(name);
+    return 0;
+  }
+  if(!init_queue_with_options(queue, options)){
+    free(queue);
+    free(ans_node);
+    free(name);
+    return 0;
+  }
   
   /*Assign the newly allocated queue to the queue field of the ans_node*/
   ans_node -> queue = queue;
@@ -75,14 +425,38 @@ short add_queue_prio(Queue_prio_list *const queue_prio_list,
   /*Set the name field of ans_node to point to the newly 
     allocated name character array*/
   ans_node -> name = name;
+  ans_node -> hash = hash;
+
+  /*Start the queue outside both heaps and let it report its changes.*/
+  ans_node -> list = queue_prio_list;
+  ans_node -> head = -1;
+  ans_node -> head_slot = LIST_NO_SLOT;
+  ans_node -> fair_slot = LIST_NO_SLOT;
+  ans_node -> stride = LIST_FAIR_STRIDE;
+  ans_node -> pass = queue_prio_list -> fair_clock;
+  queue -> owner.notify = queue_changed;
+  queue -> owner.context = ans_node;
+  queue -> budget = &queue_prio_list -> budget;
 
   /*Set the newly created queue to the begining of the queue list 
     given in the parameter.*/ 
+  ans_node -> prev = NULL;
   ans_node -> next = queue_prio_list -> head;
+  if(ans_node -> next != NULL)
+    ans_node -> next -> prev = ans_node;
   queue_prio_list -> head = ans_node;
 
+  /*File the node in the hash table and move a few old buckets along.*/
+  bucket_add(queue_prio_list, ans_node);
+  migrate(queue_prio_list, LIST_MIGRATE_STEP);
+
   /* Increase size reflect the addition of a new queue.*/
   queue_prio_list -> size += 1;
+
+  if(queue_prio_list -> observer.notify != NULL)
+    queue_prio_list -> observer.notify(queue_prio_list, QUEUE_LIST_EVENT_ADD,
+                                       name, queue,
+                                       queue_prio_list -> observer.context);
   return 1;
 }
 /* This function returns the number of priority queues in the list.
@@ -95,34 +469,34 @@ short num_queues(const Queue_prio_list *const queue_prio_list){
 }
 
 /* This function retrieves a specific priority queue by its 
-   name from the list. It searches the list for the specified 
-   name and returns the associated queue. If queue_prio_list 
+   name from the list. It looks the name up in the hash table 
+   and returns the associated queue. If queue_prio_list 
    or queue_name is NULL, or if the specified queue is not found, 
    it returns NULL.*/
 Queue_prio *get_queue(const Queue_prio_list *const queue_prio_list,
                       const char queue_name[]){
   Queue_prio *ans_queue = NULL;
-  list_Node *curr = NULL;
+  list_Node *found = NULL;
+  STATS_START(start);
   /* Check if queue_prio_list and queue_name are not NULL.*/
   if (queue_prio_list != NULL && queue_name != NULL) {
-    /*Initialize curr to point to the head of the queue_prio_list.*/
-    curr = queue_prio_list -> head;
-    
-    /*Iterate through the queue_prio_list to find the queue 
-      with a matching name.*/
-    while (curr != NULL) {
-      /*If the name of the current node matches 
-	queue_name, set ans_queue to the associated queue.*/
-      if (strcmp(curr -> name, queue_name) == 0)
-        ans_queue = curr -> queue;
-     
-      /* Move to the next node in the list.*/
-      curr = curr -> next;
-    }
+    found = find_node(queue_prio_list, queue_name, hash_name(queue_name));
+    if (found != NULL)
+      ans_queue = found -> queue;
   }
+  STATS_END(QUEUE_FUNCTION_GET_QUEUE, start);
   return ans_queue;
 }
 
+/* Frees a node together with its name and its queue. */
+static void free_list_node(list_Node *const node) {
+  memset(&node -> queue -> owner, 0, sizeof(Queue_observer));
+  clear_queue_prio(node -> queue);
+  free(node -> queue);
+  free(node -> name);
+  free(node);
+}
+
 /* 
  * Removes a priority queue from the linked list of priority queues.
  * Returns -1 if the operation is unsuccessful (e.g., the queue_to_remove 
@@ -135,43 +509,44 @@ short remove_queue(Queue_prio_list *const queue_prio_list,
                    const char queue_to_remove[]) {
   short ret = -1;
   list_Node *curr = NULL;
-  list_Node *prev = NULL;
 
   /* Check if the queue_prio_list and queue_to_remove are not NULL */
   if (queue_prio_list != NULL && queue_to_remove != NULL) {
-    /* Set the current node to the head of the linked list */
-    curr = queue_prio_list -> head;
+    /* Look the queue up in the hash table */
+    curr = find_node(queue_prio_list, queue_to_remove,
+                     hash_name(queue_to_remove));
 
-    /* Loop through each node in the linked list */
-    while (curr != NULL && ret != 1) {
-      /* Check if the name in the current node matches the 
-	 specified queue_to_remove */
-      if (strcmp(curr -> name, queue_to_remove) == 0) {
-	/* Remove the current node from the linked list */
-	if (prev != NULL)
-	  prev -> next = curr -> next;
-	else
-	  queue_prio_list -> head = curr -> next;
-
-	/* Clear the priority queue in the removed node */
-	clear_queue_prio(curr -> queue);
-
-	/* Update the size of the linked list */
-	queue_prio_list -> size--;
-
-	/* Set the return value to 1 (success) */
-	ret = 1;
-      } else {
-	/* Set the return value to 0 (operation successful, 
-	   removed queue was empty) */
-	ret = 0;
+    if (curr != NULL) {
+      if (queue_prio_list -> observer.notify != NULL)
+        queue_prio_list -> observer.notify(queue_prio_list,
+                                           QUEUE_LIST_EVENT_REMOVE,
+                                           curr -> name, curr -> queue,
+                                           queue_prio_list -> observer.context);
+
+      /* Remove the current node from the heaps, the hash table and
+         the list */
+      if (curr -> head >= 0) {
+        heap_remove(queue_prio_list, 0, curr);
+        heap_remove(queue_prio_list, 1, curr);
+        queue_prio_list -> active--;
       }
+      bucket_remove(queue_prio_list, curr);
+      if (curr -> prev != NULL)
+        curr -> prev -> next = curr -> next;
+      else
+        queue_prio_list -> head = curr -> next;
+      if (curr -> next != NULL)
+        curr -> next -> prev = curr -> prev;
 
-      /* Save the current node */
-      prev = curr;
+      /* Report whether the removed queue still held elements */
+      ret = has_no_elements(curr -> queue) ? 0 : 1;
 
-      /* Move to the next node */
-      curr = curr -> next;
+      /* Clear the priority queue and free the removed node */
+      free_list_node(curr);
+
+      /* Update the size of the linked list */
+      queue_prio_list -> size--;
+      migrate(queue_prio_list, LIST_MIGRATE_STEP);
     }
   }
 
@@ -186,24 +561,375 @@ short remove_queue(Queue_prio_list *const queue_prio_list,
 unsigned short clear_queue_prio_list(Queue_prio_list *const queue_prio_list) {
   unsigned short ret = 0;
   list_Node *curr = NULL;
+  list_Node *next = NULL;
+  Queue_list_observer observer;
+  size_t budget;
 
   /* Check if the queue_prio_list is not NULL */
   if (queue_prio_list != NULL) {
+    observer = queue_prio_list -> observer;
+    budget = queue_prio_list -> budget.limit;
+    if (observer.notify != NULL)
+      observer.notify(queue_prio_list, QUEUE_LIST_EVENT_CLEAR, NULL, NULL,
+                      observer.context);
+
     /* Set the current node to the head of the linked list */
     curr = queue_prio_list -> head;
 
     /* Loop through each node in the linked list */
     while (curr != NULL) {
-      /* Clear the priority queue in the current node */
-      clear_queue_prio(curr -> queue);
-
-      /* Move to the next node */
-      curr = curr -> next;
+      /* Move to the next node before freeing the current one */
+      next = curr -> next;
+      free_list_node(curr);
+      curr = next;
     }
 
+    /* Drop the hash tables and reset the list, keeping its observer
+       and its budget */
+    free(queue_prio_list -> buckets);
+    free(queue_prio_list -> old_buckets);
+    free(queue_prio_list -> heads);
+    free(queue_prio_list -> fair);
+    pthread_mutex_destroy(&queue_prio_list -> lock);
+    init_queue_list(queue_prio_list);
+    queue_prio_list -> observer = observer;
+    queue_prio_list -> budget.limit = budget;
+
     /* Set the return value to 1 (success) */
     ret = 1;
   }
 
   return ret;
 }
+
+/* 
+ * Returns the highest priority held by any queue of the list, or -1 if
+ * they are all empty or queue_prio_list is NULL. It looks at no queue
+ * but the best one.
+ */
+long long peek_priority_global(const Queue_prio_list *const queue_prio_list) {
+  if (queue_prio_list == NULL || queue_prio_list -> active == 0)
+    return -1;
+  return queue_prio_list -> heads[0] -> head;
+}
+
+/* 
+ * Dequeues the highest-priority element held by any queue of the list
+ * in O(log n) in the number of queues. If 'queue_name' is not NULL it
+ * is set to the name of the queue the element came from, which stays
+ * valid until that queue is removed.
+ * Returns the element as a malloc'd string, or NULL if every queue is
+ * empty, queue_prio_list is NULL or memory runs out.
+ */
+char *de_queue_global(Queue_prio_list *const queue_prio_list,
+                      const char **const queue_name) {
+  list_Node *best = NULL;
+  char *name = NULL;
+  STATS_START(start);
+
+  if (queue_prio_list != NULL && queue_prio_list -> active > 0) {
+    best = queue_prio_list -> heads[0];
+    if (queue_name != NULL)
+      *queue_name = best -> name;
+    name = de_queue(best -> queue);
+  }
+  STATS_END(QUEUE_FUNCTION_DE_QUEUE_GLOBAL, start);
+  return name;
+}
+
+/* 
+ * Dequeues up to 'k' elements across all queues of the list, highest
+ * priority first, into 'out' as malloc'd strings.
+ * Returns the number of elements dequeued, which is less than 'k' when
+ * the queues run out, and 0 if an argument is NULL.
+ */
+unsigned int de_queue_global_batch(Queue_prio_list *const queue_prio_list,
+                                   char *out[], unsigned int k) {
+  unsigned int count = 0;
+
+  if (queue_prio_list == NULL || out == NULL)
+    return 0;
+  while (count < k && (out[count] = de_queue_global(queue_prio_list, NULL))
+         != NULL)
+    count++;
+  return count;
+}
+
+/* 
+ * Sets the share of de_queue_fair dequeues the queue called
+ * 'queue_name' receives, relative to the weights of the other
+ * non-empty queues. Queues start with weight 1.
+ * Returns 1 if the operation is successful, 0 if an argument is NULL,
+ * there is no such queue or the weight is 0 or above QUEUE_MAX_WEIGHT.
+ */
+short set_queue_weight(Queue_prio_list *const queue_prio_list,
+                       const char queue_name[], unsigned int weight) {
+  list_Node *node = NULL;
+
+  if (queue_prio_list == NULL || queue_name == NULL || weight == 0
+      || weight > QUEUE_MAX_WEIGHT)
+    return 0;
+  node = find_node(queue_prio_list, queue_name, hash_name(queue_name));
+  if (node == NULL)
+    return 0;
+  node -> stride = LIST_FAIR_STRIDE / weight;
+  return 1;
+}
+
+/* 
+ * Dequeues the head of the queue whose turn it is in the weighted-fair
+ * order (see set_queue_weight), in O(log n) in the number of queues.
+ * Within a queue elements still come out highest priority first. If
+ * 'queue_name' is not NULL it is set as by de_queue_global.
+ * Returns the element as a malloc'd string, or NULL if every queue is
+ * empty, queue_prio_list is NULL or memory runs out.
+ */
+char *de_queue_fair(Queue_prio_list *const queue_prio_list,
+                    const char **const queue_name) {
+  list_Node *next = NULL;
+  char *name = NULL;
+  STATS_START(start);
+
+  if (queue_prio_list != NULL && queue_prio_list -> active > 0) {
+    next = queue_prio_list -> fair[0];
+    name = de_queue(next -> queue);
+  }
+  if (name != NULL) {
+    queue_prio_list -> fair_clock = next -> pass;
+    next -> pass += next -> stride;
+    if (next -> fair_slot != LIST_NO_SLOT)
+      heap_fix(queue_prio_list, 1, next);
+    if (queue_name != NULL)
+      *queue_name = next -> name;
+  }
+  STATS_END(QUEUE_FUNCTION_DE_QUEUE_FAIR, start);
+  return name;
+}
+
+/* Wakes the oldest consumer waiting on 'queue', if any. Called with
+   the list locked. */
+static void wake_waiter(Queue_prio_list *const queue_prio_list,
+                        const Queue_prio *const queue) {
+  List_waiter **link = &queue_prio_list -> waiters;
+
+  while (*link != NULL && !waits_for(*link, queue))
+    link = &(*link) -> next;
+  if (*link != NULL) {
+    atomic_store(&(*link) -> signaled, 1);
+    wake_word(&(*link) -> signaled, 1);
+    *link = (*link) -> next;
+  }
+}
+
+/* Unlinks a wait record from the FIFO starting at 'link' if nobody
+   has done so already. Called with the list locked. */
+static void drop_waiter(List_waiter **link, const List_waiter *const waiter) {
+  while (*link != NULL && *link != waiter)
+    link = &(*link) -> next;
+  if (*link != NULL)
+    *link = waiter -> next;
+}
+
+/* Dequeues the highest head among the record's queues, or returns NULL
+   if they are all empty. Called with the list locked. */
+static char *de_queue_best(const List_waiter *const waiter) {
+  Queue_prio *best = NULL;
+  long long best_priority = -1;
+  long long priority;
+  unsigned int i;
+
+  for (i = 0; i < waiter->count; i++) {
+    priority = peek_priority(waiter->queues[i]);
+    if (priority > best_priority) {
+      best_priority = priority;
+      best = waiter->queues[i];
+    }
+  }
+  return best != NULL ? de_queue(best) : NULL;
+}
+
+/* 
+ * Enqueues 'new_element' with 'priority' in the queue called
+ * 'queue_name' and hands it to a consumer blocked in de_queue_any on
+ * that queue, if there is one. When the queue is full and its policy
+ * is QUEUE_FULL_BLOCK, it first sleeps until elements leave the queue,
+ * or any queue of the list if the list's budget is what is full, and
+ * the element fits, or until the queue's 'block_ms' have passed. It
+ * may be called from any thread, as long as queues are not added or
+ * removed at the same time.
+ * Returns 1 if the operation is successful, 0 if an argument is NULL,
+ * there is no such queue or en_queue fails.
+ */
+unsigned short en_queue_list(Queue_prio_list *const queue_prio_list,
+                             const char queue_name[], const char new_element[],
+                             unsigned int priority) {
+  struct timespec deadline;
+  List_waiter waiter;
+  List_waiter **tail = NULL;
+  unsigned short ret = 0;
+  Queue_prio *queue = NULL;
+  short room = 1;
+  short awake = 1;
+
+  if (queue_prio_list == NULL || queue_name == NULL || new_element == NULL)
+    return 0;
+
+  pthread_mutex_lock(&queue_prio_list -> lock);
+  queue = get_queue(queue_prio_list, queue_name);
+  if (queue != NULL && queue -> limits.policy == QUEUE_FULL_BLOCK
+      && queue -> limits.block_ms > 0)
+    wait_deadline(queue -> limits.block_ms, &deadline);
+
+  while (queue != NULL && queue -> limits.policy == QUEUE_FULL_BLOCK
+         && queue -> limits.block_ms != 0 && awake
+         && (room = queue_room(queue, new_element)) != 1) {
+    /* Queue up behind the producers already waiting and sleep. */
+    waiter.queues = &queue;
+    waiter.count = room == 0 ? 1 : 0;
+    atomic_init(&waiter.signaled, 0);
+    waiter.next = NULL;
+    for (tail = &queue_prio_list -> blocked; *tail != NULL;
+         tail = &(*tail) -> next)
+      ;
+    *tail = &waiter;
+    pthread_mutex_unlock(&queue_prio_list -> lock);
+
+    while (awake && atomic_load(&waiter.signaled) == 0)
+      awake = wait_word(&waiter.signaled, 0,
+                        queue -> limits.block_ms > 0 ? &deadline : NULL);
+
+    pthread_mutex_lock(&queue_prio_list -> lock);
+    drop_waiter(&queue_prio_list -> blocked, &waiter);
+  }
+
+  if (queue != NULL && en_queue(queue, new_element, priority)) {
+    wake_waiter(queue_prio_list, queue);
+    ret = 1;
+  }
+  pthread_mutex_unlock(&queue_prio_list -> lock);
+  return ret;
+}
+
+/* 
+ * Dequeues the highest-priority element held by any of the queues
+ * named in 'queue_names', a NULL-terminated array; names that are not
+ * in the list are ignored. When they are all empty it sleeps until
+ * en_queue_list adds to one of them or 'timeout_ms' milliseconds have
+ * passed. A negative timeout waits for as long as it takes and 0 does
+ * not wait at all. It may be called from any thread, as long as queues
+ * are not added or removed at the same time.
+ * Returns the element as a malloc'd string, or NULL on timeout, if an
+ * argument is NULL or memory runs out.
+ */
+char *de_queue_any(Queue_prio_list *const queue_prio_list,
+                   const char *const queue_names[], long timeout_ms) {
+  struct timespec deadline;
+  List_waiter waiter;
+  List_waiter **tail = NULL;
+  char *name = NULL;
+  unsigned int count = 0;
+  unsigned int i;
+  short awake = 1;
+  short signaled = 0;
+
+  if (queue_prio_list == NULL || queue_names == NULL)
+    return NULL;
+  if (timeout_ms > 0)
+    wait_deadline(timeout_ms, &deadline);
+
+  while (queue_names[count] != NULL)
+    count++;
+  waiter.queues = malloc((count > 0 ? count : 1) * sizeof(Queue_prio *));
+  if (waiter.queues == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&queue_prio_list -> lock);
+  waiter.count = 0;
+  for (i = 0; i < count; i++)
+    if ((waiter.queues[waiter.count] = get_queue(queue_prio_list,
+                                                 queue_names[i])) != NULL)
+      waiter.count++;
+
+  for (;;) {
+    name = de_queue_best(&waiter);
+    if (name != NULL || timeout_ms == 0 || !awake || waiter.count == 0)
+      break;
+
+    /* Queue up behind the consumers already waiting and sleep. */
+    atomic_init(&waiter.signaled, 0);
+    waiter.next = NULL;
+    for (tail = &queue_prio_list -> waiters; *tail != NULL;
+         tail = &(*tail) -> next)
+      ;
+    *tail = &waiter;
+    pthread_mutex_unlock(&queue_prio_list -> lock);
+
+    while (awake && atomic_load(&waiter.signaled) == 0)
+      awake = wait_word(&waiter.signaled, 0,
+                        timeout_ms > 0 ? &deadline : NULL);
+
+    pthread_mutex_lock(&queue_prio_list -> lock);
+    drop_waiter(&queue_prio_list -> waiters, &waiter);
+    signaled = atomic_load(&waiter.signaled) != 0;
+  }
+
+  /* The wakeup for one queue may have been spent on an element that
+     arrived in another of ours meanwhile. Pass it on, so that no
+     consumer sleeps while a queue it waits on holds an element. */
+  if (name != NULL && signaled)
+    for (i = 0; i < waiter.count; i++)
+      if (has_no_elements(waiter.queues[i]) == 0)
+        wake_waiter(queue_prio_list, waiter.queues[i]);
+  pthread_mutex_unlock(&queue_prio_list -> lock);
+  free(waiter.queues);
+  return name;
+}
+
+/* 
+ * Sets the byte budget shared by every queue of the list: together
+ * their elements may take up at most 'bytes' bytes, each counted as
+ * for Queue_limits.byte_budget, and 0 lifts the limit. An element that
+ * does not fit is treated as by a full queue, following the policy of
+ * the queue it is offered to. Lowering the budget below what the
+ * queues already hold evicts nothing; it only keeps new elements out
+ * until enough have left.
+ * Returns 1 if the operation is successful, 0 if queue_prio_list is NULL.
+ */
+short set_queue_list_budget(Queue_prio_list *const queue_prio_list,
+                            size_t bytes) {
+  if (queue_prio_list == NULL)
+    return 0;
+  pthread_mutex_lock(&queue_prio_list -> lock);
+  queue_prio_list -> budget.limit = bytes;
+  wake_producers(queue_prio_list, NULL);
+  pthread_mutex_unlock(&queue_prio_list -> lock);
+  return 1;
+}
+
+/* 
+ * Returns the bytes the elements of every queue of the list take up,
+ * counted as for set_queue_list_budget, or 0 if queue_prio_list is
+ * NULL.
+ */
+size_t queue_list_bytes(const Queue_prio_list *const queue_prio_list) {
+  if (queue_prio_list == NULL)
+    return 0;
+  return queue_prio_list -> budget.used;
+}
+
+/* 
+ * Sets the observer told about queues being added and removed, or
+ * removes it if 'observer' is NULL. Changes inside a queue are reported
+ * by the queue's own observer (see set_queue_observer).
+ * Returns 1 if the operation is successful, 0 if queue_prio_list is NULL.
+ */
+short set_queue_list_observer(Queue_prio_list *const queue_prio_list,
+                              const Queue_list_observer *const observer) {
+  if (queue_prio_list == NULL)
+    return 0;
+  if (observer != NULL)
+    queue_prio_list -> observer = *observer;
+  else
+    memset(&queue_prio_list -> observer, 0, sizeof(Queue_list_observer));
+  return 1;
+}
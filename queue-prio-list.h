@@ -1,11 +1,46 @@
+#ifndef QUEUE_PRIO_LIST_H
+#define QUEUE_PRIO_LIST_H
+
 #include "queue-prio-list-datastructure.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 short init_queue_list(Queue_prio_list *const queue_prio_list);
 short add_queue_prio(Queue_prio_list *const queue_prio_list,
                      const char new_queue_name[]);
+short add_queue_prio_with_options(Queue_prio_list *const queue_prio_list,
+                                  const char new_queue_name[],
+                                  const Queue_options *const options);
 short num_queues(const Queue_prio_list *const queue_prio_list);
 Queue_prio *get_queue(const Queue_prio_list *const queue_prio_list,
                       const char queue_name[]);
 short remove_queue(Queue_prio_list *const queue_prio_list,
                    const char queue_to_remove[]);
 unsigned short clear_queue_prio_list(Queue_prio_list *const queue_prio_list);
+long long peek_priority_global(const Queue_prio_list *const queue_prio_list);
+char *de_queue_global(Queue_prio_list *const queue_prio_list,
+                      const char **const queue_name);
+unsigned int de_queue_global_batch(Queue_prio_list *const queue_prio_list,
+                                   char *out[], unsigned int k);
+short set_queue_weight(Queue_prio_list *const queue_prio_list,
+                       const char queue_name[], unsigned int weight);
+char *de_queue_fair(Queue_prio_list *const queue_prio_list,
+                    const char **const queue_name);
+unsigned short en_queue_list(Queue_prio_list *const queue_prio_list,
+                             const char queue_name[], const char new_element[],
+                             unsigned int priority);
+char *de_queue_any(Queue_prio_list *const queue_prio_list,
+                   const char *const queue_names[], long timeout_ms);
+short set_queue_list_budget(Queue_prio_list *const queue_prio_list,
+                            size_t bytes);
+size_t queue_list_bytes(const Queue_prio_list *const queue_prio_list);
+short set_queue_list_observer(Queue_prio_list *const queue_prio_list,
+                              const Queue_list_observer *const observer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
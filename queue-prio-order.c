@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include "queue-prio-engine.h"
+
+/*This file implements the ordered index a Queue_prio can keep next to
+  its engine: a skiplist of the stored priorities from highest to
+  lowest, each entry pointing at its node. It finds a priority, its
+  neighbours and the start of a priority range in O(log n) expected
+  time, so range queries and range removal cost O(log n + k) for k
+  matching elements. Towers come from the queue's arena, whose size
+  classes fit them as well as they fit strings, and are released with
+  the rest of the queue's storage.*/
+
+#define ORDER_FIRST_SEED 2463534242u
+
+/* Size of an entry with a tower of 'height' links. */
+static size_t entry_size(unsigned int height) {
+  return offsetof(Order_entry, forward) + height * sizeof(Order_entry *);
+}
+
+/* Picks the height of a new tower: each extra level with probability
+   1/4, which keeps about 1.33 links per entry. */
+static unsigned int random_height(Order_index *const index) {
+  unsigned int height = 1;
+  unsigned int x = index->seed;
+
+  if (x == 0)
+    x = ORDER_FIRST_SEED;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  index->seed = x;
+
+  while (height < QUEUE_ORDER_MAX_HEIGHT && (x & 3u) == 0) {
+    height++;
+    x >>= 2;
+  }
+  return height;
+}
+
+/* Returns the last entry whose priority is greater than 'priority',
+   which is the head if there is none. If 'update' is not NULL it
+   receives that entry for every level in use. */
+static Order_entry *find_above(const Order_index *const index,
+                               unsigned int priority,
+                               Order_entry *update[]) {
+  Order_entry *x = index->head;
+  unsigned int level;
+
+  for (level = index->height; level-- > 0;) {
+    while (x->forward[level] != NULL && x->forward[level]->priority > priority)
+      x = x->forward[level];
+    if (update != NULL)
+      update[level] = x;
+  }
+  return x;
+}
+
+/* Lowers the height in use past levels that have become empty. */
+static void trim_height(Order_index *const index) {
+  while (index->height > 0 && index->head->forward[index->height - 1] == NULL)
+    index->height--;
+}
+
+/*
+ * Adds a node to the ordered index. Returns 1 if the operation is
+ * successful and 0 if its priority is already present or memory runs
+ * out.
+ */
+unsigned short order_insert(Queue_prio *const queue_prio, Node *const node) {
+  Order_index *index = &queue_prio->order_index;
+  Order_entry *update[QUEUE_ORDER_MAX_HEIGHT];
+  Order_entry *entry = NULL;
+  Order_entry *above = NULL;
+  unsigned int priority = (unsigned int) node->priority;
+  unsigned int height;
+  unsigned int i;
+
+  /* The head is a full-height tower that holds no node. */
+  if (index->head == NULL) {
+    index->head = (Order_entry *)
+      arena_alloc_string(queue_prio, entry_size(QUEUE_ORDER_MAX_HEIGHT));
+    if (index->head == NULL)
+      return 0;
+    index->head->node = NULL;
+    for (i = 0; i < QUEUE_ORDER_MAX_HEIGHT; i++)
+      index->head->forward[i] = NULL;
+    index->height = 0;
+  }
+
+  above = find_above(index, priority, update);
+  if (above->forward[0] != NULL && above->forward[0]->priority == priority)
+    return 0;
+
+  height = random_height(index);
+  entry = (Order_entry *) arena_alloc_string(queue_prio, entry_size(height));
+  if (entry == NULL)
+    return 0;
+  entry->node = node;
+  entry->priority = priority;
+  entry->height = height;
+
+  /* Levels above the current height start from the head. */
+  for (i = index->height; i < height; i++)
+    update[i] = index->head;
+  if (height > index->height)
+    index->height = height;
+
+  for (i = 0; i < height; i++) {
+    entry->forward[i] = update[i]->forward[i];
+    update[i]->forward[i] = entry;
+  }
+  index->count++;
+  return 1;
+}
+
+/*
+ * Removes a node from the ordered index, if it is there.
+ */
+void order_remove(Queue_prio *const queue_prio, const Node *const node) {
+  Order_index *index = &queue_prio->order_index;
+  Order_entry *update[QUEUE_ORDER_MAX_HEIGHT];
+  Order_entry *entry = NULL;
+  unsigned int i;
+
+  if (index->head == NULL)
+    return;
+
+  entry = find_above(index, (unsigned int) node->priority, update)->forward[0];
+  if (entry == NULL || entry->node != node)
+    return;
+
+  for (i = 0; i < entry->height; i++)
+    update[i]->forward[i] = entry->forward[i];
+  trim_height(index);
+  index->count--;
+  arena_free_string(queue_prio, (char *) entry, entry_size(entry->height));
+}
+
+/*
+ * Returns the node stored under 'priority', or NULL if there is none.
+ */
+Node *order_find(const Order_index *const index, unsigned int priority) {
+  Order_entry *entry = NULL;
+
+  if (index->head == NULL)
+    return NULL;
+  entry = find_above(index, priority, NULL)->forward[0];
+  if (entry != NULL && entry->priority == priority)
+    return entry->node;
+  return NULL;
+}
+
+/*
+ * Returns the node with the lowest priority greater than 'priority',
+ * or NULL if there is none.
+ */
+Node *order_above(const Order_index *const index, unsigned int priority) {
+  Order_entry *above = NULL;
+
+  if (index->head == NULL)
+    return NULL;
+  above = find_above(index, priority, NULL);
+  return above == index->head ? NULL : above->node;
+}
+
+/*
+ * Returns the node with the lowest priority, or NULL if the index is
+ * empty. The search ends on the last entry above priority 0, which is
+ * the lowest unless priority 0 itself follows it.
+ */
+Node *order_lowest(const Order_index *const index) {
+  Order_entry *above = NULL;
+
+  if (index->head == NULL)
+    return NULL;
+  above = find_above(index, 0, NULL);
+  if (above->forward[0] != NULL)
+    return above->forward[0]->node;
+  return above == index->head ? NULL : above->node;
+}
+
+/*
+ * Returns the first entry whose priority is at most 'high', or NULL.
+ * The entries after it follow through forward[0] in descending order.
+ */
+const Order_entry *order_seek(const Order_index *const index,
+                              unsigned int high) {
+  if (index->head == NULL)
+    return NULL;
+  return find_above(index, high, NULL)->forward[0];
+}
+
+/*
+ * Removes every entry with low <= priority <= high from the index in
+ * one pass and returns how many there were. Their nodes are chained
+ * through 'next' from '*first' to '*last' in descending order, which
+ * for the list engine are the links it already has, and '*above' is
+ * set to the node just above the range (NULL if there is none). The
+ * nodes themselves stay in the engine and the other indexes.
+ */
+unsigned int order_detach_range(Queue_prio *const queue_prio,
+                                unsigned int low, unsigned int high,
+                                Node **const above, Node **const first,
+                                Node **const last) {
+  Order_index *index = &queue_prio->order_index;
+  Order_entry *update[QUEUE_ORDER_MAX_HEIGHT];
+  Order_entry *before = NULL;
+  Order_entry *entry = NULL;
+  Order_entry *next = NULL;
+  unsigned int count = 0;
+  unsigned int i;
+
+  if (index->head == NULL || low > high)
+    return 0;
+
+  before = find_above(index, high, update);
+  entry = before->forward[0];
+  if (entry == NULL || entry->priority < low)
+    return 0;
+  *above = before == index->head ? NULL : before->node;
+  *first = entry->node;
+
+  /* Bridge the range on the upper levels. The removed towers keep
+     their own links, so the walk can pass through them. */
+  for (i = 1; i < index->height; i++) {
+    next = update[i]->forward[i];
+    while (next != NULL && next->priority >= low)
+      next = next->forward[i];
+    update[i]->forward[i] = next;
+  }
+
+  /* Walk the bottom level, chaining the nodes and releasing the
+     towers, then bridge it too. */
+  while (entry != NULL && entry->priority >= low) {
+    next = entry->forward[0];
+    if (next != NULL && next->priority >= low)
+      entry->node->next = next->node;
+    *last = entry->node;
+    arena_free_string(queue_prio, (char *) entry, entry_size(entry->height));
+    count++;
+    entry = next;
+  }
+  update[0]->forward[0] = entry;
+
+  trim_height(index);
+  index->count -= count;
+  return count;
+}
+
+/*
+ * Forgets every entry. The towers themselves are released with the
+ * queue's storage by storage_release.
+ */
+void order_reset(Order_index *const index) {
+  index->head = NULL;
+  index->height = 0;
+  index->count = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef QUEUE_PRIO_PERSIST_DATASTRUCTURE_H
+#define QUEUE_PRIO_PERSIST_DATASTRUCTURE_H
+
+#include <stddef.h>
+#include "queue-prio-list-datastructure.h"
+
+/* When the write-ahead log is flushed to disk. QUEUE_SYNC_COMMIT,
+   the default, calls fsync at every group commit, so a committed
+   change survives a power failure. QUEUE_SYNC_INTERVAL calls it at a
+   group commit only once 'sync_interval_ms' have passed since the
+   last one, and QUEUE_SYNC_NONE never does, leaving writeback to the
+   operating system; both still survive a crash of the process. */
+typedef enum queue_sync{
+  QUEUE_SYNC_COMMIT = 0,
+  QUEUE_SYNC_INTERVAL,
+  QUEUE_SYNC_NONE
+}Queue_sync;
+
+/* Settings for open_queue_store. Records are buffered and written as
+   one group once 'group_records' of them or 'group_bytes' of data are
+   pending, or when commit_queue_store is called. Zero fields take the
+   defaults: 64 records, 64 KiB and 100 ms. */
+typedef struct queue_store_options{
+  Queue_sync sync;
+  unsigned int group_records;
+  unsigned int group_bytes;
+  unsigned int sync_interval_ms;
+}Queue_store_options;
+
+/* A Queue_prio_list kept on disk as a snapshot plus a write-ahead log
+   of every change made since (see queue-prio-persist.c). 'generation'
+   pairs the log with the snapshot it continues. Records not yet
+   written sit in 'buffer'. */
+typedef struct queue_store{
+  Queue_prio_list *list;
+  char *snapshot_path;
+  char *log_path;
+  int log_fd;
+  Queue_store_options options;
+  unsigned long long generation;
+  char *buffer;
+  size_t used;
+  size_t capacity;
+  unsigned int pending;
+  unsigned long long last_sync_ms;
+  unsigned short failed;
+}Queue_store;
+
+#endif
@@ -0,0 +1,930 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+#include "queue-prio-persist.h"
+#include "queue-prio-engine.h"
+
+/*This program keeps a Queue_prio_list on disk so that its queues
+  survive a crash. The state is a snapshot of the whole list plus a
+  write-ahead log of every change made after it. Once a store is open,
+  the list's observer and every queue's observer turn each successful
+  add_queue_prio, remove_queue, en_queue, de_queue, change_priority,
+  remove_elements_between and clear, and their handle variants, into a
+  log record, so callers keep using the ordinary functions. A priority
+  change is logged as a move from one priority to another, which
+  replays the same whatever the element's name. Records are buffered
+  and written in groups (group commit), and the log is fsynced
+  according to the store's Queue_sync policy.
+
+  snapshot_queue_store writes the list to a new snapshot file, renames
+  it over the old one and starts an empty log. Both files carry a
+  generation number; a log is only replayed on top of the snapshot of
+  the same generation, so a crash between the two renames cannot
+  apply a change twice. A log record is framed by its length and a
+  checksum, and recovery stops at the first record that is torn or
+  damaged, dropping it and everything after it.
+
+  The snapshot is mapped with mmap and read front to back. Queues are
+  stored from highest to lowest priority, with every string terminated
+  in the file, so each queue is rebuilt by one en_queue_batch call that
+  points straight into the mapping: no sort, no per-element malloc,
+  only slab and arena allocations. Loading is bound by how fast the
+  file can be read.
+
+  Both files use the host's byte order and are not meant to be moved
+  between machines. Custom allocators are not recorded; recovered
+  queues use malloc and free.
+
+  Snapshot layout, after a 24-byte header (magic, byte-order mark,
+  queue count, generation):
+    per queue: name, u32 engine, u32 indexes, [u32 max priority,]
+               [limits,] u32 element count
+    per element: u32 priority, element
+  where the max priority is only there for bucket engine queues, and
+  the limits (u32 capacity, u32 policy, u32 block_ms as a signed value
+  and the byte budget as two u32 halves, low first) only for bounded
+  queues, whose engine word has ENGINE_BOUNDED set. The record that
+  adds a queue to the log stores its settings the same way. Every
+  string is its u32 length, its bytes and a NUL. Log layout, after a
+  24-byte header (magic, byte-order mark, unused, generation):
+    per record: u32 payload length, u32 checksum, payload
+  where the payload is a type byte followed by the queue name and the
+  arguments of the change.*/
+
+#define SNAPSHOT_MAGIC "QMSNAP01"
+#define LOG_MAGIC "QMLOG001"
+#define BYTE_ORDER_MARK 0x01020304u
+#define HEADER_SIZE 24
+#define RECORD_HEADER 8
+
+#define DEFAULT_GROUP_RECORDS 64
+#define DEFAULT_GROUP_BYTES 65536
+#define DEFAULT_SYNC_INTERVAL_MS 100
+
+/* Log record types. */
+#define RECORD_ADD_QUEUE 'A'
+#define RECORD_REMOVE_QUEUE 'R'
+#define RECORD_CLEAR_LIST 'L'
+#define RECORD_EN_QUEUE 'E'
+#define RECORD_DE_QUEUE 'D'
+#define RECORD_CHANGE_PRIORITY 'P'
+#define RECORD_MOVE 'M'
+#define RECORD_REMOVE_BETWEEN 'B'
+#define RECORD_CLEAR_QUEUE 'C'
+
+/* Set in the engine word of a bounded queue, whose limits follow the
+   rest of its settings. */
+#define ENGINE_BOUNDED 0x80000000u
+
+/* The most u32 fields a queue's settings take: engine, indexes, max
+   priority and five for the limits. */
+#define SETTINGS_FIELDS 8
+
+/* The observer context of one queue: its store and its name, which is
+   the registry's own copy and lives as long as the queue. */
+typedef struct store_queue{
+  Queue_store *store;
+  const char *name;
+  unsigned int length;
+}Store_queue;
+
+/* A bounds-checked cursor over a mapped file. 'ok' drops to 0 at the
+   first read past the end or malformed string. */
+typedef struct reader{
+  const char *data;
+  size_t size;
+  size_t at;
+  unsigned short ok;
+}Reader;
+
+static unsigned long long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a over a record payload. */
+static unsigned int checksum(const char *data, size_t size) {
+  unsigned int hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < size; i++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* Returns a malloc'd copy of 'text' with 'suffix' appended, or NULL. */
+static char *join(const char text[], const char suffix[]) {
+  size_t length = strlen(text);
+  size_t extra = strlen(suffix);
+  char *copy = malloc(length + extra + 1);
+
+  if (copy != NULL) {
+    memcpy(copy, text, length);
+    memcpy(copy + length, suffix, extra + 1);
+  }
+  return copy;
+}
+
+/* Flushes the directory holding 'path', so a rename into it is
+   durable. Returns 1 on success. */
+static short sync_directory(const char path[]) {
+  const char *slash = strrchr(path, '/');
+  char *directory = NULL;
+  short ret = 0;
+  int fd;
+
+  if (slash == NULL)
+    directory = join(".", "");
+  else if (slash == path)
+    directory = join("/", "");
+  else if ((directory = join(path, "")) != NULL)
+    directory[slash - path] = '\0';
+  if (directory == NULL)
+    return 0;
+
+  fd = open(directory, O_RDONLY);
+  if (fd >= 0) {
+    ret = fsync(fd) == 0;
+    close(fd);
+  }
+  free(directory);
+  return ret;
+}
+
+/* Writes all of 'data' to 'fd'. Returns 1 on success. */
+static short write_all(int fd, const char *data, size_t size) {
+  ssize_t written;
+
+  while (size > 0) {
+    written = write(fd, data, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return 0;
+    data += written;
+    size -= (size_t) written;
+  }
+  return 1;
+}
+
+/* Fills in a 24-byte file header. */
+static void make_header(char header[], const char magic[],
+                        unsigned int count, unsigned long long generation) {
+  unsigned int mark = BYTE_ORDER_MARK;
+
+  memcpy(header, magic, 8);
+  memcpy(header + 8, &mark, 4);
+  memcpy(header + 12, &count, 4);
+  memcpy(header + 16, &generation, 8);
+}
+
+static unsigned char read_u8(Reader *const reader) {
+  if (reader->ok && reader->at < reader->size)
+    return (unsigned char) reader->data[reader->at++];
+  reader->ok = 0;
+  return 0;
+}
+
+static unsigned int read_u32(Reader *const reader) {
+  unsigned int value = 0;
+
+  if (reader->ok && reader->size - reader->at >= 4) {
+    memcpy(&value, reader->data + reader->at, 4);
+    reader->at += 4;
+  } else {
+    reader->ok = 0;
+  }
+  return value;
+}
+
+/* Returns a string stored as its length, its bytes and a NUL, in
+   place, or NULL if it is cut off or not terminated. */
+static const char *read_string(Reader *const reader) {
+  unsigned int length = read_u32(reader);
+  const char *text = NULL;
+
+  if (!reader->ok || reader->size - reader->at <= length
+      || reader->data[reader->at + length] != '\0') {
+    reader->ok = 0;
+    return NULL;
+  }
+  text = reader->data + reader->at;
+  reader->at += (size_t) length + 1;
+  return text;
+}
+
+/* Makes room for 'size' more bytes in the record buffer. On failure
+   the store is marked as failed. */
+static short reserve(Queue_store *const store, size_t size) {
+  size_t capacity = store->capacity == 0 ? 4096 : store->capacity;
+  char *buffer = NULL;
+
+  if (store->used + size <= store->capacity)
+    return 1;
+  while (capacity < store->used + size)
+    capacity *= 2;
+  buffer = realloc(store->buffer, capacity);
+  if (buffer == NULL) {
+    store->failed = 1;
+    return 0;
+  }
+  store->buffer = buffer;
+  store->capacity = capacity;
+  return 1;
+}
+
+static void put_u32(Queue_store *const store, unsigned int value) {
+  if (reserve(store, 4)) {
+    memcpy(store->buffer + store->used, &value, 4);
+    store->used += 4;
+  }
+}
+
+static void put_string(Queue_store *const store, const char text[],
+                       unsigned int length) {
+  put_u32(store, length);
+  if (reserve(store, (size_t) length + 1)) {
+    memcpy(store->buffer + store->used, text, length);
+    store->buffer[store->used + length] = '\0';
+    store->used += (size_t) length + 1;
+  }
+}
+
+/* Starts a record of the given type naming 'name' and returns where it
+   begins in the buffer. */
+static size_t begin_record(Queue_store *const store, char type,
+                           const char name[], unsigned int length) {
+  size_t start = store->used;
+
+  if (reserve(store, RECORD_HEADER + 1)) {
+    store->used += RECORD_HEADER;
+    store->buffer[store->used++] = type;
+  }
+  if (name != NULL)
+    put_string(store, name, length);
+  return start;
+}
+
+/* Writes the buffered records to the log and, if 'force' is set or
+   the policy asks for it, fsyncs the log. Returns 1 on success. */
+static short flush_log(Queue_store *const store, short force) {
+  unsigned long long now;
+
+  if (store->used > 0) {
+    if (!write_all(store->log_fd, store->buffer, store->used))
+      store->failed = 1;
+    store->used = 0;
+    store->pending = 0;
+  }
+  if (store->options.sync == QUEUE_SYNC_NONE)
+    return !store->failed;
+
+  now = now_ms();
+  if (force || store->options.sync == QUEUE_SYNC_COMMIT
+      || now - store->last_sync_ms >= store->options.sync_interval_ms) {
+    if (fsync(store->log_fd) != 0)
+      store->failed = 1;
+    store->last_sync_ms = now;
+  }
+  return !store->failed;
+}
+
+/* Frames the record started at 'start' with its length and checksum,
+   and commits the group once it is large enough. A record that could
+   not be built completely is dropped. */
+static void end_record(Queue_store *const store, size_t start) {
+  unsigned int length;
+  unsigned int sum;
+
+  if (store->failed) {
+    store->used = start;
+    return;
+  }
+  length = (unsigned int) (store->used - start - RECORD_HEADER);
+  sum = checksum(store->buffer + start + RECORD_HEADER, length);
+  memcpy(store->buffer + start, &length, 4);
+  memcpy(store->buffer + start + 4, &sum, 4);
+
+  if (++store->pending >= store->options.group_records
+      || store->used >= store->options.group_bytes)
+    flush_log(store, 0);
+}
+
+/* Checks whether a queue has limits to record. */
+static short has_limits(const Queue_prio *const queue) {
+  return queue->limits.capacity > 0 || queue->limits.byte_budget > 0
+    || queue->limits.policy != QUEUE_FULL_REJECT;
+}
+
+/* Fills 'values' with the settings of 'queue' as the snapshot and the
+   log store them, and returns how many fields there are. */
+static unsigned int queue_settings(const Queue_prio *const queue,
+                                   unsigned int values[]) {
+  unsigned long long byte_budget = queue->limits.byte_budget;
+  long block_ms = queue->limits.block_ms;
+  unsigned int fields = 0;
+
+  values[fields++] = (unsigned int) queue->engine
+    | (has_limits(queue) ? ENGINE_BOUNDED : 0);
+  values[fields++] = queue->indexes;
+  if (queue->engine == QUEUE_ENGINE_BUCKET)
+    values[fields++] = queue->buckets.max_priority;
+  if (has_limits(queue)) {
+    /* Every negative block time means the same, waiting for ever. */
+    if (block_ms < 0)
+      block_ms = -1;
+    else if (block_ms > 0x7FFFFFFFL)
+      block_ms = 0x7FFFFFFFL;
+    values[fields++] = queue->limits.capacity;
+    values[fields++] = (unsigned int) queue->limits.policy;
+    values[fields++] = (unsigned int) (int) block_ms;
+    values[fields++] = (unsigned int) (byte_budget & 0xFFFFFFFFu);
+    values[fields++] = (unsigned int) (byte_budget >> 32);
+  }
+  return fields;
+}
+
+/* Reads the settings stored by queue_settings into 'options', pointing
+   its limits at 'limits' when there are any. */
+static void read_settings(Reader *const reader, Queue_options *const options,
+                          Queue_limits *const limits) {
+  unsigned int engine = read_u32(reader);
+  unsigned long long byte_budget;
+
+  options->engine = (Queue_engine) (engine & ~ENGINE_BOUNDED);
+  options->indexes = read_u32(reader);
+  if (options->engine == QUEUE_ENGINE_BUCKET)
+    options->max_priority = read_u32(reader);
+  if (engine & ENGINE_BOUNDED) {
+    limits->capacity = read_u32(reader);
+    limits->policy = (Queue_full_policy) read_u32(reader);
+    limits->block_ms = (int) read_u32(reader);
+    byte_budget = read_u32(reader);
+    byte_budget |= (unsigned long long) read_u32(reader) << 32;
+    limits->byte_budget = (size_t) byte_budget;
+    options->limits = limits;
+  }
+}
+
+/* The observer of every queue in the store's list. */
+static void queue_notify(Queue_prio *queue_prio, const Queue_event *event,
+                         void *context) {
+  Store_queue *entry = context;
+  Queue_store *store = entry->store;
+  size_t start = 0;
+
+  (void) queue_prio;
+  switch (event->type) {
+  case QUEUE_EVENT_EN_QUEUE:
+    start = begin_record(store, RECORD_EN_QUEUE, entry->name, entry->length);
+    put_u32(store, event->priority);
+    put_string(store, event->element, event->length);
+    break;
+  case QUEUE_EVENT_CHANGE_PRIORITY:
+    /* Logged by priority rather than by name, so that replay moves
+       the same element even when others share its name. */
+    start = begin_record(store, RECORD_MOVE, entry->name, entry->length);
+    put_u32(store, event->previous);
+    put_u32(store, event->priority);
+    break;
+  case QUEUE_EVENT_DE_QUEUE:
+    start = begin_record(store, RECORD_DE_QUEUE, entry->name, entry->length);
+    break;
+  case QUEUE_EVENT_REMOVE_BETWEEN:
+    start = begin_record(store, RECORD_REMOVE_BETWEEN, entry->name,
+                         entry->length);
+    put_u32(store, event->priority);
+    put_u32(store, event->high);
+    break;
+  case QUEUE_EVENT_CLEAR:
+    start = begin_record(store, RECORD_CLEAR_QUEUE, entry->name,
+                         entry->length);
+    break;
+  case QUEUE_EVENT_EVICT:
+    /* Logged as the removal of its one priority, so that replay does
+       not depend on the queue's limits. */
+    start = begin_record(store, RECORD_REMOVE_BETWEEN, entry->name,
+                         entry->length);
+    put_u32(store, event->priority);
+    put_u32(store, event->priority);
+    break;
+  }
+  end_record(store, start);
+}
+
+/* Starts logging the changes made to 'queue', called 'name'. */
+static void attach_queue(Queue_store *const store, const char name[],
+                         Queue_prio *const queue) {
+  Store_queue *entry = malloc(sizeof(Store_queue));
+  Queue_observer observer;
+
+  if (entry == NULL) {
+    store->failed = 1;
+    return;
+  }
+  entry->store = store;
+  entry->name = name;
+  entry->length = (unsigned int) strlen(name);
+  observer.notify = queue_notify;
+  observer.context = entry;
+  set_queue_observer(queue, &observer);
+}
+
+/* Stops logging the changes made to 'queue'. */
+static void detach_queue(Queue_prio *const queue) {
+  if (queue->observer.notify == queue_notify) {
+    free(queue->observer.context);
+    set_queue_observer(queue, NULL);
+  }
+}
+
+/* The observer of the store's list. */
+static void list_notify(Queue_prio_list *queue_prio_list,
+                        Queue_list_event_type type, const char *name,
+                        Queue_prio *queue, void *context) {
+  Queue_store *store = context;
+  list_Node *curr = NULL;
+  size_t start;
+  unsigned int values[SETTINGS_FIELDS];
+  unsigned int length = name != NULL ? (unsigned int) strlen(name) : 0;
+  unsigned int fields;
+  unsigned int i;
+
+  switch (type) {
+  case QUEUE_LIST_EVENT_ADD:
+    start = begin_record(store, RECORD_ADD_QUEUE, name, length);
+    fields = queue_settings(queue, values);
+    for (i = 0; i < fields; i++)
+      put_u32(store, values[i]);
+    end_record(store, start);
+    attach_queue(store, name, queue);
+    break;
+  case QUEUE_LIST_EVENT_REMOVE:
+    detach_queue(queue);
+    start = begin_record(store, RECORD_REMOVE_QUEUE, name, length);
+    end_record(store, start);
+    break;
+  case QUEUE_LIST_EVENT_CLEAR:
+    for (curr = queue_prio_list->head; curr != NULL; curr = curr->next)
+      detach_queue(curr->queue);
+    start = begin_record(store, RECORD_CLEAR_LIST, NULL, 0);
+    end_record(store, start);
+    break;
+  }
+}
+
+/* Applies one log record to the list. Returns 0 if the record is
+   malformed. */
+static short apply_record(Queue_prio_list *const queue_prio_list,
+                          Reader *const reader) {
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  Queue_limits limits;
+  unsigned char type = read_u8(reader);
+  const char *name = NULL;
+  const char *element = NULL;
+  Queue_prio *queue = NULL;
+  Queue_handle handle;
+  unsigned int priority;
+  unsigned int high;
+  long long top;
+
+  if (type == RECORD_CLEAR_LIST) {
+    if (!reader->ok || reader->at != reader->size)
+      return 0;
+    return clear_queue_prio_list(queue_prio_list);
+  }
+  name = read_string(reader);
+  if (type != RECORD_ADD_QUEUE)
+    queue = get_queue(queue_prio_list, name);
+
+  switch (type) {
+  case RECORD_ADD_QUEUE:
+    read_settings(reader, &options, &limits);
+    if (reader->ok)
+      add_queue_prio_with_options(queue_prio_list, name, &options);
+    break;
+  case RECORD_REMOVE_QUEUE:
+    if (reader->ok)
+      remove_queue(queue_prio_list, name);
+    break;
+  case RECORD_EN_QUEUE:
+  case RECORD_CHANGE_PRIORITY:
+    /* Logs written before RECORD_MOVE name the element instead. */
+    priority = read_u32(reader);
+    element = read_string(reader);
+    if (reader->ok && type == RECORD_EN_QUEUE)
+      en_queue(queue, element, priority);
+    else if (reader->ok)
+      change_priority(queue, element, priority);
+    break;
+  case RECORD_MOVE:
+    /* The element at the first priority moves to the second. */
+    priority = read_u32(reader);
+    high = read_u32(reader);
+    if (reader->ok && get_handle(queue, priority, &handle))
+      change_priority_h(queue, &handle, high);
+    break;
+  case RECORD_DE_QUEUE:
+    /* Dropping the head by its priority needs no copy of its data. */
+    top = queue != NULL ? peek_priority(queue) : -1;
+    if (reader->ok && top >= 0)
+      remove_elements_between(queue, (unsigned int) top, (unsigned int) top);
+    break;
+  case RECORD_REMOVE_BETWEEN:
+    priority = read_u32(reader);
+    high = read_u32(reader);
+    if (reader->ok)
+      remove_elements_between(queue, priority, high);
+    break;
+  case RECORD_CLEAR_QUEUE:
+    if (reader->ok)
+      clear_queue_prio(queue);
+    break;
+  default:
+    return 0;
+  }
+  return reader->ok && reader->at == reader->size;
+}
+
+/* Checks a 24-byte header and returns its generation through
+   '*generation' and its count through '*count'. */
+static short check_header(const char *data, size_t size, const char magic[],
+                          unsigned int *count,
+                          unsigned long long *generation) {
+  unsigned int mark;
+
+  if (size < HEADER_SIZE || memcmp(data, magic, 8) != 0)
+    return 0;
+  memcpy(&mark, data + 8, 4);
+  memcpy(count, data + 12, 4);
+  memcpy(generation, data + 16, 8);
+  return mark == BYTE_ORDER_MARK;
+}
+
+/* Scratch arrays for the batch that rebuilds one queue. */
+typedef struct load_batch{
+  const char **items;
+  unsigned int *priorities;
+  unsigned int room;
+}Load_batch;
+
+/* Reads one queue of the snapshot and adds it to the list. Returns 1
+   on success. */
+static short load_queue(Queue_store *const store, Reader *const reader,
+                        Load_batch *const batch) {
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+  Queue_limits limits;
+  const char *name = NULL;
+  unsigned int count;
+  unsigned int i;
+  void *grown = NULL;
+
+  name = read_string(reader);
+  read_settings(reader, &options, &limits);
+  count = read_u32(reader);
+  if (!reader->ok || !add_queue_prio_with_options(store->list, name, &options))
+    return 0;
+
+  if (count > batch->room) {
+    grown = realloc(batch->items, count * sizeof(*batch->items));
+    if (grown == NULL)
+      return 0;
+    batch->items = grown;
+    grown = realloc(batch->priorities, count * sizeof(*batch->priorities));
+    if (grown == NULL)
+      return 0;
+    batch->priorities = grown;
+    batch->room = count;
+  }
+
+  /* Point the batch straight at the mapped elements. */
+  for (i = 0; i < count && reader->ok; i++) {
+    batch->priorities[i] = read_u32(reader);
+    batch->items[i] = read_string(reader);
+  }
+  if (!reader->ok)
+    return 0;
+  return count == 0
+    || en_queue_batch(get_queue(store->list, name), batch->items,
+                      batch->priorities, count, NULL) == count;
+}
+
+/* Rebuilds the list from the snapshot, if there is one. Returns 1 on
+   success, including when there is no snapshot yet. */
+static short load_snapshot(Queue_store *const store) {
+  Load_batch batch = {NULL, NULL, 0};
+  Reader reader = {NULL, 0, HEADER_SIZE, 1};
+  struct stat info;
+  unsigned int queues = 0;
+  unsigned int q;
+  void *map = MAP_FAILED;
+  short ok = 0;
+  int fd;
+
+  store->generation = 0;
+  fd = open(store->snapshot_path, O_RDONLY);
+  if (fd < 0)
+    return errno == ENOENT;
+  if (fstat(fd, &info) != 0 || (size_t) info.st_size < HEADER_SIZE) {
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+  posix_madvise(map, (size_t) info.st_size, POSIX_MADV_SEQUENTIAL);
+  reader.data = map;
+  reader.size = (size_t) info.st_size;
+
+  ok = check_header(reader.data, reader.size, SNAPSHOT_MAGIC, &queues,
+                    &store->generation);
+  for (q = 0; ok && q < queues; q++)
+    ok = load_queue(store, &reader, &batch);
+  ok = ok && reader.at == reader.size;
+
+  free(batch.items);
+  free(batch.priorities);
+  munmap(map, reader.size);
+  return ok;
+}
+
+/* Replaces the log with an empty one for the current generation and
+   opens it for appending. Returns 1 on success. */
+static short start_log(Queue_store *const store) {
+  char header[HEADER_SIZE];
+  char *temporary = join(store->log_path, ".tmp");
+  short ret = 0;
+  int fd = -1;
+
+  if (temporary == NULL)
+    return 0;
+  make_header(header, LOG_MAGIC, 0, store->generation);
+  fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd >= 0 && write_all(fd, header, HEADER_SIZE) && fsync(fd) == 0
+      && rename(temporary, store->log_path) == 0
+      && sync_directory(store->log_path)) {
+    if (store->log_fd >= 0)
+      close(store->log_fd);
+    store->log_fd = fd;
+    fd = -1;
+    ret = 1;
+  }
+  if (fd >= 0) {
+    close(fd);
+    unlink(temporary);
+  }
+  free(temporary);
+  return ret;
+}
+
+/* Replays the log on top of the loaded snapshot and leaves it open for
+   appending. A log from another generation is already contained in
+   the snapshot and is replaced. Returns 1 on success. */
+static short replay_log(Queue_store *const store) {
+  Reader reader = {NULL, 0, 0, 1};
+  Reader record = {NULL, 0, 0, 1};
+  struct stat info;
+  unsigned long long generation = 0;
+  unsigned int unused;
+  unsigned int length;
+  unsigned int sum;
+  size_t end = 0;
+  void *map = MAP_FAILED;
+  int fd;
+
+  fd = open(store->log_path, O_RDWR | O_APPEND);
+  if (fd < 0)
+    return errno == ENOENT && start_log(store);
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return 0;
+  }
+  if ((size_t) info.st_size >= HEADER_SIZE)
+    map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED
+      || !check_header(map, (size_t) info.st_size, LOG_MAGIC, &unused,
+                       &generation)
+      || generation != store->generation) {
+    if (map != MAP_FAILED)
+      munmap(map, (size_t) info.st_size);
+    close(fd);
+    return start_log(store);
+  }
+  posix_madvise(map, (size_t) info.st_size, POSIX_MADV_SEQUENTIAL);
+
+  /* Apply records until the first one that is cut off or damaged. */
+  reader.data = map;
+  reader.size = (size_t) info.st_size;
+  reader.at = HEADER_SIZE;
+  end = reader.at;
+  for (;;) {
+    length = read_u32(&reader);
+    sum = read_u32(&reader);
+    if (!reader.ok || reader.size - reader.at < length
+        || checksum(reader.data + reader.at, length) != sum)
+      break;
+    record.data = reader.data + reader.at;
+    record.size = length;
+    record.at = 0;
+    record.ok = 1;
+    if (!apply_record(store->list, &record))
+      break;
+    reader.at += length;
+    end = reader.at;
+  }
+  munmap(map, (size_t) info.st_size);
+
+  /* Cut off the damaged tail so new records follow the last good one. */
+  if (end < (size_t) info.st_size && ftruncate(fd, (off_t) end) != 0) {
+    close(fd);
+    return 0;
+  }
+  store->log_fd = fd;
+  return 1;
+}
+
+/*
+ * Opens a store for 'queue_prio_list', which must be initialized and
+ * empty: loads the snapshot at 'snapshot_path', replays the log at
+ * 'log_path' on top of it and from then on logs every change to the
+ * list and its queues. Either file may be missing. 'options' may be
+ * NULL for the defaults.
+ * Returns 1 if the operation is successful and 0 otherwise, in which
+ * case the list is left empty.
+ */
+short open_queue_store(Queue_store *const store,
+                       Queue_prio_list *const queue_prio_list,
+                       const char snapshot_path[], const char log_path[],
+                       const Queue_store_options *const options) {
+  Queue_list_observer observer;
+  list_Node *curr = NULL;
+
+  if (store == NULL || queue_prio_list == NULL || snapshot_path == NULL
+      || log_path == NULL || queue_prio_list->size != 0)
+    return 0;
+
+  memset(store, 0, sizeof(Queue_store));
+  store->list = queue_prio_list;
+  store->log_fd = -1;
+  if (options != NULL)
+    store->options = *options;
+  if (store->options.group_records == 0)
+    store->options.group_records = DEFAULT_GROUP_RECORDS;
+  if (store->options.group_bytes == 0)
+    store->options.group_bytes = DEFAULT_GROUP_BYTES;
+  if (store->options.sync_interval_ms == 0)
+    store->options.sync_interval_ms = DEFAULT_SYNC_INTERVAL_MS;
+  store->snapshot_path = join(snapshot_path, "");
+  store->log_path = join(log_path, "");
+
+  if (store->snapshot_path == NULL || store->log_path == NULL
+      || !load_snapshot(store) || !replay_log(store)) {
+    clear_queue_prio_list(queue_prio_list);
+    if (store->log_fd >= 0)
+      close(store->log_fd);
+    free(store->snapshot_path);
+    free(store->log_path);
+    memset(store, 0, sizeof(Queue_store));
+    return 0;
+  }
+
+  /* Log everything from here on. */
+  for (curr = queue_prio_list->head; curr != NULL; curr = curr->next)
+    attach_queue(store, curr->name, curr->queue);
+  observer.notify = list_notify;
+  observer.context = store;
+  set_queue_list_observer(queue_prio_list, &observer);
+  store->last_sync_ms = now_ms();
+  return !store->failed;
+}
+
+/*
+ * Writes every buffered log record and, unless the store's policy is
+ * QUEUE_SYNC_NONE, waits until the log is on disk.
+ * Returns 1 if the operation is successful and 0 if the store is NULL
+ * or a record has been lost since the last snapshot.
+ */
+short commit_queue_store(Queue_store *const store) {
+  if (store == NULL || store->log_fd < 0)
+    return 0;
+  return flush_log(store, 1);
+}
+
+/*
+ * Writes a snapshot of the whole list and starts an empty log, so the
+ * next recovery only has to replay what happens after this call. It
+ * also clears a failure reported by commit_queue_store.
+ * Returns 1 if the operation is successful, 0 otherwise.
+ */
+short snapshot_queue_store(Queue_store *const store) {
+  char header[HEADER_SIZE];
+  char *temporary = NULL;
+  list_Node *curr = NULL;
+  Node **nodes = NULL;
+  FILE *file = NULL;
+  unsigned int values[SETTINGS_FIELDS + 1];
+  unsigned int fields;
+  unsigned int count;
+  unsigned int i;
+  short ok = 1;
+
+  if (store == NULL || store->log_fd < 0)
+    return 0;
+  flush_log(store, 0);
+  temporary = join(store->snapshot_path, ".tmp");
+  if (temporary != NULL)
+    file = fopen(temporary, "wb");
+  if (file == NULL) {
+    free(temporary);
+    return 0;
+  }
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+  make_header(header, SNAPSHOT_MAGIC, (unsigned int) store->list->size,
+              store->generation + 1);
+  ok = fwrite(header, HEADER_SIZE, 1, file) == 1;
+
+  for (curr = store->list->head; ok && curr != NULL; curr = curr->next) {
+    count = (unsigned int) curr->queue->size;
+    nodes = sorted_nodes(curr->queue);
+    if (count > 0 && nodes == NULL) {
+      ok = 0;
+      break;
+    }
+    values[0] = (unsigned int) strlen(curr->name);
+    ok = fwrite(values, sizeof(unsigned int), 1, file) == 1
+      && fwrite(curr->name, values[0] + 1, 1, file) == 1;
+    fields = queue_settings(curr->queue, values);
+    values[fields++] = count;
+    ok = ok && fwrite(values, fields * sizeof(unsigned int), 1, file) == 1;
+
+    /* Highest priority first, the order en_queue_batch takes fastest. */
+    for (i = 0; ok && i < count; i++) {
+      values[0] = (unsigned int) nodes[i]->priority;
+      values[1] = nodes[i]->length;
+      ok = fwrite(values, 2 * sizeof(unsigned int), 1, file) == 1
+        && fwrite(nodes[i]->data, nodes[i]->length + 1, 1, file) == 1;
+    }
+    free(nodes);
+  }
+
+  ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temporary, store->snapshot_path) != 0
+      || !sync_directory(store->snapshot_path)) {
+    unlink(temporary);
+    free(temporary);
+    return 0;
+  }
+  free(temporary);
+
+  /* The old log is now part of the snapshot. If the new one cannot be
+     started, later records would be lost, so the store fails. */
+  store->generation++;
+  if (!start_log(store)) {
+    store->failed = 1;
+    return 0;
+  }
+  store->failed = 0;
+  store->last_sync_ms = now_ms();
+  return 1;
+}
+
+/*
+ * Commits the log, stops logging and releases the store. The list and
+ * its queues are left as they are.
+ * Returns 1 if the final commit succeeds, 0 otherwise.
+ */
+short close_queue_store(Queue_store *const store) {
+  list_Node *curr = NULL;
+  short ret;
+
+  if (store == NULL || store->log_fd < 0)
+    return 0;
+  ret = commit_queue_store(store);
+
+  set_queue_list_observer(store->list, NULL);
+  for (curr = store->list->head; curr != NULL; curr = curr->next)
+    detach_queue(curr->queue);
+  close(store->log_fd);
+  free(store->snapshot_path);
+  free(store->log_path);
+  free(store->buffer);
+  memset(store, 0, sizeof(Queue_store));
+  store->log_fd = -1;
+  return ret;
+}
@@ -0,0 +1,22 @@
+#ifndef QUEUE_PRIO_PERSIST_H
+#define QUEUE_PRIO_PERSIST_H
+
+#include "queue-prio-persist-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+short open_queue_store(Queue_store *const store,
+                       Queue_prio_list *const queue_prio_list,
+                       const char snapshot_path[], const char log_path[],
+                       const Queue_store_options *const options);
+short commit_queue_store(Queue_store *const store);
+short snapshot_queue_store(Queue_store *const store);
+short close_queue_store(Queue_store *const store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio.h"
+#include "queue-prio-engine.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*This file holds the vector kernels that scan arrays of 32-bit values,
+  such as the name hashes of the columns engine, from the end towards
+  the start. On x86 an AVX2 kernel compares 16 values per step, as two
+  8-wide compares, and an SSE2 kernel 8 values, as two 4-wide ones;
+  anywhere else, or on a processor without either, a plain loop does
+  the work. The kernel is picked once per process, the first time one
+  is needed, from what the processor reports. Setting the environment
+  variable QUEUEMANAGER_SCAN to "scalar", "sse2" or "avx2" asks for a
+  particular kernel instead, which is how the benchmarks compare them;
+  a kernel the processor cannot run is never picked.*/
+
+typedef long (*Scan_kernel)(const unsigned int values[], unsigned int end,
+                            unsigned int value);
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static Scan_kernel kernel;
+static const char *kernel_name = "scalar";
+
+/* Returns the highest i below 'end' with values[i] == value, or -1. */
+static long scan_scalar(const unsigned int values[], unsigned int end,
+                        unsigned int value) {
+  while (end > 0) {
+    end--;
+    if (values[end] == value)
+      return (long) end;
+  }
+  return -1;
+}
+
+#ifdef SCAN_X86
+
+/* Returns the position of the highest set bit of a non-zero mask. */
+static unsigned int highest_lane(unsigned int mask) {
+  return 31u - (unsigned int) __builtin_clz(mask);
+}
+
+#if defined(__SSE2__)
+static long scan_sse2(const unsigned int values[], unsigned int end,
+                      unsigned int value) {
+  const __m128i wanted = _mm_set1_epi32((int) value);
+  __m128i low;
+  __m128i high;
+  unsigned int mask;
+
+  while (end >= 8) {
+    end -= 8;
+    low = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (values + end)),
+                          wanted);
+    high = _mm_cmpeq_epi32(
+      _mm_loadu_si128((const __m128i *) (values + end + 4)), wanted);
+    mask = (unsigned int) _mm_movemask_ps(_mm_castsi128_ps(low))
+      | (unsigned int) _mm_movemask_ps(_mm_castsi128_ps(high)) << 4;
+    if (mask != 0)
+      return (long) (end + highest_lane(mask));
+  }
+  return scan_scalar(values, end, value);
+}
+#endif
+
+__attribute__((target("avx2")))
+static long scan_avx2(const unsigned int values[], unsigned int end,
+                      unsigned int value) {
+  const __m256i wanted = _mm256_set1_epi32((int) value);
+  __m256i low;
+  __m256i high;
+  unsigned int mask;
+
+  while (end >= 16) {
+    end -= 16;
+    low = _mm256_cmpeq_epi32(
+      _mm256_loadu_si256((const __m256i *) (values + end)), wanted);
+    high = _mm256_cmpeq_epi32(
+      _mm256_loadu_si256((const __m256i *) (values + end + 8)), wanted);
+    mask = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(low))
+      | (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8;
+    if (mask != 0)
+      return (long) (end + highest_lane(mask));
+  }
+  return scan_scalar(values, end, value);
+}
+
+#endif
+
+/* Picks the kernel for this process. */
+static void pick_kernel(void) {
+  const char *wanted = getenv("QUEUEMANAGER_SCAN");
+
+  /* Anything but the three names means no preference. */
+  if (wanted != NULL && strcmp(wanted, "scalar") != 0
+      && strcmp(wanted, "sse2") != 0 && strcmp(wanted, "avx2") != 0)
+    wanted = NULL;
+
+  kernel = scan_scalar;
+  kernel_name = "scalar";
+  if (wanted != NULL && strcmp(wanted, "scalar") == 0)
+    return;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")
+      && (wanted == NULL || strcmp(wanted, "avx2") == 0)) {
+    kernel = scan_avx2;
+    kernel_name = "avx2";
+    return;
+  }
+#if defined(__SSE2__)
+  kernel = scan_sse2;
+  kernel_name = "sse2";
+#endif
+#endif
+}
+
+/* This function returns the highest i below 'end' with
+   values[i] == value, or -1 if there is none. */
+long scan_equal_below(const unsigned int values[], unsigned int end,
+                      unsigned int value) {
+  pthread_once(&kernel_once, pick_kernel);
+  return kernel(values, end, value);
+}
+
+/* This function returns the name of the kernel scan_equal_below uses:
+   "scalar", "sse2" or "avx2". */
+const char *queue_scan_kernel(void) {
+  pthread_once(&kernel_once, pick_kernel);
+  return kernel_name;
+}
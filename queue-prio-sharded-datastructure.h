@@ -0,0 +1,64 @@
+#ifndef QUEUE_PRIO_SHARDED_DATASTRUCTURE_H
+#define QUEUE_PRIO_SHARDED_DATASTRUCTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "queue-prio-list-datastructure.h"
+
+#define QUEUE_SHARDED_MAX_SHARDS 256
+#define QUEUE_SHARDED_CACHE_LINE 64
+
+/* One shard of a sharded registry: an ordinary Queue_prio_list behind
+   its own mutex. 'pending' counts the elements in all of the shard's
+   queues and is only written with 'lock' held, so idle workers can
+   skip empty shards without locking them. Each queue keeps its own
+   node and string pools, so shards never share an allocator. */
+typedef struct list_shard{
+  _Alignas(QUEUE_SHARDED_CACHE_LINE) pthread_mutex_t lock;
+  Queue_prio_list list;
+  atomic_int pending;
+}List_shard;
+
+/* A registry of named queues partitioned by name hash. 'arrivals' and
+   'waiters' let idle workers sleep until an element is added, the same
+   way as in Queue_prio_concurrent. */
+typedef struct queue_prio_list_sharded{
+  List_shard *shards;
+  unsigned int shard_count;
+  _Alignas(QUEUE_SHARDED_CACHE_LINE) atomic_uint arrivals;
+  atomic_uint waiters;
+}Queue_prio_list_sharded;
+
+/* Called by a worker for every element it takes, with the queue it
+   came from and its priority. 'element' is only valid during the call. */
+typedef void (*Queue_work_handler)(const char *queue_name, const char *element,
+                                   unsigned int priority, void *context);
+
+struct queue_worker_pool;
+
+/* One worker thread. It drains shard 'home' first and steals from the
+   other shards when that one is empty. 'processed' and 'stolen' count
+   the elements it has handled and how many of those were stolen. */
+typedef struct queue_worker{
+  _Alignas(QUEUE_SHARDED_CACHE_LINE) pthread_t thread;
+  struct queue_worker_pool *pool;
+  unsigned int home;
+  unsigned long processed;
+  unsigned long stolen;
+}Queue_worker;
+
+/* A pool of workers draining a sharded registry. 'processed' and
+   'stolen' are the totals of the workers' counters, filled in when the
+   pool is stopped. */
+typedef struct queue_worker_pool{
+  Queue_prio_list_sharded *list;
+  Queue_worker *workers;
+  unsigned int worker_count;
+  Queue_work_handler handler;
+  void *context;
+  atomic_int stopping;
+  unsigned long processed;
+  unsigned long stolen;
+}Queue_worker_pool;
+
+#endif
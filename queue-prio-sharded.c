@@ -0,0 +1,366 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+#include "queue-prio-sharded.h"
+#include "queue-prio-engine.h"
+
+/*This program provides a registry of named priority queues for many
+  threads and many cores. The queues are partitioned by a hash of
+  their name across independent shards, each an ordinary
+  Queue_prio_list behind its own mutex, so threads working on queues
+  in different shards never touch the same lock or cache lines.
+
+  Taking the best head of a shard is de_queue_global on its list,
+  which keeps its queues in a heap by head priority, so it costs
+  O(log n) however many queues the shard holds.
+
+  A worker pool drains the registry. Each worker has a home shard and
+  repeatedly takes the highest-priority head among that shard's queues
+  and passes it to the handler with no lock held. When its home shard
+  is empty it steals from the other shards, starting with the next one
+  so idle workers spread out instead of piling onto shard 0, and
+  skipping shards whose 'pending' count is zero without locking them.
+  When every shard is empty it sleeps on the registry's 'arrivals'
+  word, and en_queue_sharded wakes one sleeper per element, only when
+  someone is asleep.
+
+  Priority order holds within a shard: a worker always takes the best
+  head of the shard it locked. Across shards, workers run concurrently
+  and make no global ordering promise.
+
+  Queues may be added and removed while workers run. Every function
+  except init_queue_list_sharded and clear_queue_list_sharded may be
+  called from any thread.*/
+
+#define DEFAULT_LIST_SHARDS 16
+
+/* Picks the shard that owns 'name'. The list inside the shard buckets
+   by the low bits of the same hash, so the shard uses a mixed copy. */
+static List_shard *shard_of(const Queue_prio_list_sharded *const list,
+                            const char name[]) {
+  unsigned int mixed = hash_name(name) * 0x9E3779B1u;
+
+  return &list->shards[((unsigned long long) mixed * list->shard_count) >> 32];
+}
+
+/* This function initializes a sharded registry with 'shard_count'
+   shards (0 for the default). It must not be called while other
+   threads use the registry. Returns 1 on success, 0 otherwise. */
+unsigned short init_queue_list_sharded(Queue_prio_list_sharded *const list,
+                                       unsigned int shard_count) {
+  unsigned int i;
+
+  if (list == NULL || shard_count > QUEUE_SHARDED_MAX_SHARDS)
+    return 0;
+  if (shard_count == 0)
+    shard_count = DEFAULT_LIST_SHARDS;
+
+  list->shards = aligned_alloc(QUEUE_SHARDED_CACHE_LINE,
+                               shard_count * sizeof(List_shard));
+  if (list->shards == NULL)
+    return 0;
+
+  for (i = 0; i < shard_count; i++) {
+    pthread_mutex_init(&list->shards[i].lock, NULL);
+    init_queue_list(&list->shards[i].list);
+    atomic_init(&list->shards[i].pending, 0);
+  }
+  list->shard_count = shard_count;
+  atomic_init(&list->arrivals, 0);
+  atomic_init(&list->waiters, 0);
+  return 1;
+}
+
+/* This function adds a queue called 'new_queue_name' set up with
+   'options' (NULL for the defaults). It returns 0 if an argument is
+   NULL, the name is taken, the options are invalid or memory runs out,
+   and 1 if the queue is added. */
+short add_queue_prio_sharded(Queue_prio_list_sharded *const list,
+                             const char new_queue_name[],
+                             const Queue_options *const options) {
+  List_shard *shard = NULL;
+  short ret;
+
+  if (list == NULL || new_queue_name == NULL)
+    return 0;
+
+  shard = shard_of(list, new_queue_name);
+  pthread_mutex_lock(&shard->lock);
+  ret = add_queue_prio_with_options(&shard->list, new_queue_name, options);
+  pthread_mutex_unlock(&shard->lock);
+  return ret;
+}
+
+/* This function removes the queue called 'queue_to_remove' together
+   with its elements. Like remove_queue it returns -1 if there is no
+   such queue or an argument is NULL, 0 if the removed queue was empty
+   and 1 if it held elements. */
+short remove_queue_sharded(Queue_prio_list_sharded *const list,
+                           const char queue_to_remove[]) {
+  List_shard *shard = NULL;
+  Queue_prio *queue = NULL;
+  short ret = -1;
+
+  if (list == NULL || queue_to_remove == NULL)
+    return -1;
+
+  shard = shard_of(list, queue_to_remove);
+  pthread_mutex_lock(&shard->lock);
+  queue = get_queue(&shard->list, queue_to_remove);
+  if (queue != NULL) {
+    atomic_fetch_sub(&shard->pending, queue->size);
+    ret = remove_queue(&shard->list, queue_to_remove);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return ret;
+}
+
+/* This function returns the number of queues in the registry, or -1 if
+   the pointer is NULL. */
+int num_queues_sharded(Queue_prio_list_sharded *const list) {
+  unsigned int i;
+  int count = 0;
+
+  if (list == NULL)
+    return -1;
+
+  for (i = 0; i < list->shard_count; i++) {
+    pthread_mutex_lock(&list->shards[i].lock);
+    count += num_queues(&list->shards[i].list);
+    pthread_mutex_unlock(&list->shards[i].lock);
+  }
+  return count;
+}
+
+/* This function enqueues 'new_element' with 'priority' in the queue
+   called 'queue_name' and wakes a sleeping worker if there is one. It
+   returns 1 on success and 0 if an argument is NULL, there is no such
+   queue or en_queue fails. */
+unsigned short en_queue_sharded(Queue_prio_list_sharded *const list,
+                                const char queue_name[],
+                                const char new_element[],
+                                unsigned int priority) {
+  List_shard *shard = NULL;
+  Queue_prio *queue = NULL;
+  unsigned short ret = 0;
+  int before;
+
+  if (list == NULL || queue_name == NULL || new_element == NULL)
+    return 0;
+
+  shard = shard_of(list, queue_name);
+  pthread_mutex_lock(&shard->lock);
+  queue = get_queue(&shard->list, queue_name);
+  if (queue != NULL) {
+    /* Count by the change in size: under QUEUE_FULL_EVICT_LOWEST a
+       successful en_queue may also evict an element. */
+    before = queue->size;
+    ret = en_queue(queue, new_element, priority);
+    atomic_fetch_add(&shard->pending, queue->size - before);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  if (ret) {
+    atomic_fetch_add(&list->arrivals, 1);
+    if (atomic_load(&list->waiters) > 0)
+      wake_word(&list->arrivals, 1);
+  }
+  return ret;
+}
+
+/* This function dequeues the highest-priority element of the queue
+   called 'queue_name' and returns it as a malloc'd string, or NULL if
+   the queue is empty, does not exist or an argument is NULL. */
+char *de_queue_sharded(Queue_prio_list_sharded *const list,
+                       const char queue_name[]) {
+  List_shard *shard = NULL;
+  Queue_prio *queue = NULL;
+  char *name = NULL;
+  int before;
+
+  if (list == NULL || queue_name == NULL)
+    return NULL;
+
+  shard = shard_of(list, queue_name);
+  pthread_mutex_lock(&shard->lock);
+  queue = get_queue(&shard->list, queue_name);
+  if (queue != NULL) {
+    before = queue->size;
+    name = de_queue(queue);
+    atomic_fetch_sub(&shard->pending, before - queue->size);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return name;
+}
+
+/* This function frees every queue and shard of the registry. It must
+   not be called while other threads or a worker pool use the registry.
+   Returns 1 on success, 0 otherwise. */
+unsigned short clear_queue_list_sharded(Queue_prio_list_sharded *const list) {
+  unsigned int i;
+
+  if (list == NULL || list->shards == NULL)
+    return 0;
+
+  for (i = 0; i < list->shard_count; i++) {
+    clear_queue_prio_list(&list->shards[i].list);
+    pthread_mutex_destroy(&list->shards[i].list.lock);
+    pthread_mutex_destroy(&list->shards[i].lock);
+  }
+  free(list->shards);
+  list->shards = NULL;
+  list->shard_count = 0;
+  return 1;
+}
+
+/* The element a worker took, copied out so the handler runs unlocked.
+   'queue_name' is a buffer the worker reuses between elements. */
+typedef struct work_item{
+  char *queue_name;
+  size_t capacity;
+  char *element;
+  unsigned int priority;
+}Work_item;
+
+/* Takes the highest-priority head among the queues of one shard into
+   'item'. Returns 1 if there was one, 0 if the shard is empty or
+   memory runs out. */
+static short take_from(List_shard *const shard, Work_item *const item) {
+  list_Node *best = NULL;
+  size_t length;
+  char *buffer = NULL;
+
+  if (atomic_load(&shard->pending) == 0)
+    return 0;
+
+  pthread_mutex_lock(&shard->lock);
+  best = shard->list.active > 0 ? shard->list.heads[0] : NULL;
+  if (best != NULL) {
+    length = strlen(best->name) + 1;
+    if (length > item->capacity) {
+      buffer = realloc(item->queue_name, length);
+      if (buffer != NULL) {
+        item->queue_name = buffer;
+        item->capacity = length;
+      }
+    }
+    if (length <= item->capacity) {
+      memcpy(item->queue_name, best->name, length);
+      item->priority = (unsigned int) best->head;
+      item->element = de_queue_global(&shard->list, NULL);
+      if (item->element != NULL)
+        atomic_fetch_sub(&shard->pending, 1);
+    }
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return item->element != NULL;
+}
+
+/* The body of a worker thread. */
+static void *work(void *arg) {
+  Queue_worker *worker = arg;
+  Queue_worker_pool *pool = worker->pool;
+  Queue_prio_list_sharded *list = pool->list;
+  Work_item item = {NULL, 0, NULL, 0};
+  unsigned int seen;
+  unsigned int i;
+  short found;
+
+  for (;;) {
+    seen = atomic_load(&list->arrivals);
+    found = take_from(&list->shards[worker->home], &item);
+
+    /* Steal, starting with the shard after the home one. */
+    for (i = 1; !found && i < list->shard_count; i++)
+      if (take_from(&list->shards[(worker->home + i) % list->shard_count],
+                    &item)) {
+        found = 1;
+        worker->stolen++;
+      }
+
+    if (found) {
+      pool->handler(item.queue_name, item.element, item.priority,
+                    pool->context);
+      free(item.element);
+      item.element = NULL;
+      worker->processed++;
+    } else if (atomic_load(&pool->stopping)) {
+      break;
+    } else {
+      atomic_fetch_add(&list->waiters, 1);
+      wait_word(&list->arrivals, seen, NULL);
+      atomic_fetch_sub(&list->waiters, 1);
+    }
+  }
+  free(item.queue_name);
+  return NULL;
+}
+
+/* This function starts 'worker_count' threads that hand every element
+   of 'list' to 'handler' along with 'context'. The home shard of
+   worker i is shard i modulo the shard count. Returns 1 on success and
+   0 if an argument is NULL or 0, or a thread cannot be started; in
+   that case the workers already started are stopped. */
+unsigned short start_worker_pool(Queue_worker_pool *const pool,
+                                 Queue_prio_list_sharded *const list,
+                                 unsigned int worker_count,
+                                 Queue_work_handler handler, void *context) {
+  unsigned int i;
+
+  if (pool == NULL || list == NULL || list->shards == NULL
+      || worker_count == 0 || handler == NULL)
+    return 0;
+
+  pool->workers = aligned_alloc(QUEUE_SHARDED_CACHE_LINE,
+                                worker_count * sizeof(Queue_worker));
+  if (pool->workers == NULL)
+    return 0;
+  pool->list = list;
+  pool->handler = handler;
+  pool->context = context;
+  pool->worker_count = 0;
+  atomic_init(&pool->stopping, 0);
+
+  for (i = 0; i < worker_count; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].home = i % list->shard_count;
+    pool->workers[i].processed = 0;
+    pool->workers[i].stolen = 0;
+    if (pthread_create(&pool->workers[i].thread, NULL, work,
+                       &pool->workers[i]) != 0) {
+      stop_worker_pool(pool);
+      return 0;
+    }
+    pool->worker_count++;
+  }
+  return 1;
+}
+
+/* This function lets the workers finish every element still in the
+   registry, joins them and adds their counters up in 'pool->processed'
+   and 'pool->stolen'. Returns 1 on success, 0 if the pool is NULL or
+   not running. */
+unsigned short stop_worker_pool(Queue_worker_pool *const pool) {
+  unsigned int i;
+
+  if (pool == NULL || pool->workers == NULL)
+    return 0;
+
+  atomic_store(&pool->stopping, 1);
+  atomic_fetch_add(&pool->list->arrivals, 1);
+  wake_word(&pool->list->arrivals, INT_MAX);
+
+  pool->processed = 0;
+  pool->stolen = 0;
+  for (i = 0; i < pool->worker_count; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+    pool->processed += pool->workers[i].processed;
+    pool->stolen += pool->workers[i].stolen;
+  }
+  free(pool->workers);
+  pool->workers = NULL;
+  pool->worker_count = 0;
+  return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef QUEUE_PRIO_SHARDED_H
+#define QUEUE_PRIO_SHARDED_H
+
+#include "queue-prio-sharded-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned short init_queue_list_sharded(Queue_prio_list_sharded *const list,
+                                       unsigned int shard_count);
+short add_queue_prio_sharded(Queue_prio_list_sharded *const list,
+                             const char new_queue_name[],
+                             const Queue_options *const options);
+short remove_queue_sharded(Queue_prio_list_sharded *const list,
+                           const char queue_to_remove[]);
+int num_queues_sharded(Queue_prio_list_sharded *const list);
+unsigned short en_queue_sharded(Queue_prio_list_sharded *const list,
+                                const char queue_name[],
+                                const char new_element[],
+                                unsigned int priority);
+char *de_queue_sharded(Queue_prio_list_sharded *const list,
+                       const char queue_name[]);
+unsigned short clear_queue_list_sharded(Queue_prio_list_sharded *const list);
+
+unsigned short start_worker_pool(Queue_worker_pool *const pool,
+                                 Queue_prio_list_sharded *const list,
+                                 unsigned int worker_count,
+                                 Queue_work_handler handler, void *context);
+unsigned short stop_worker_pool(Queue_worker_pool *const pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
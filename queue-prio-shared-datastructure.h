@@ -0,0 +1,25 @@
+#ifndef QUEUE_PRIO_SHARED_DATASTRUCTURE_H
+#define QUEUE_PRIO_SHARED_DATASTRUCTURE_H
+
+#include <stddef.h>
+#include "queue-prio-datastructure.h"
+
+/* Settings for create_queue_shared. 'capacity' is the most elements
+   the queue holds at once and 'string_bytes' the room for element
+   names too long to sit in a node (QUEUE_INLINE_DATA). Zero fields
+   take the defaults: 65536 elements and 4 MiB. */
+typedef struct queue_shared_options{
+  unsigned int capacity;
+  size_t string_bytes;
+}Queue_shared_options;
+
+/* One process's view of a shared queue: the mapping of its region
+   (see queue-prio-shared.c). Every process that opens the queue has
+   its own Queue_prio_shared; the region itself holds no pointers, so
+   it may be mapped at a different address in each. */
+typedef struct queue_prio_shared{
+  struct shared_header *region;
+  size_t region_size;
+}Queue_prio_shared;
+
+#endif
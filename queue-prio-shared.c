@@ -0,0 +1,607 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "queue-prio-shared.h"
+
+/*This program provides a priority queue that several processes on one
+  host can use at once. The whole queue lives in one POSIX shared
+  memory object: a header, a fixed array of nodes, a 4-ary max-heap of
+  node references, a hash table from priority to node for the
+  duplicate check, and an area for element names that do not fit in a
+  node. Nothing in the region is a pointer. Nodes are referred to by
+  their index plus one (0 meaning none) and strings by their offset
+  from the start of the region, so every process can map it wherever
+  it likes. The semantics are those of Queue_prio: unique priorities,
+  highest priority first.
+
+  create_queue_shared sizes the region once from its options; a full
+  queue rejects en_queue_shared rather than growing. Long names are
+  carved from the string area in power-of-two blocks from 32 bytes up,
+  and freed blocks go on a free list per size.
+
+  Every operation holds a process-shared mutex in the header. The
+  mutex is robust: if a process dies while holding it, the next one to
+  lock it takes it over. A process that dies in the middle of a change
+  may leave the queue half updated, so in that case the queue is
+  marked as damaged and every later call on it fails; size_shared and
+  has_no_elements_shared read an atomic counter and never lock.*/
+
+#define SHARED_MAGIC 0x514d5348u
+#define SHARED_VERSION 2
+#define SHARED_ARITY 4
+#define SHARED_CLASSES 16
+#define SHARED_MIN_BLOCK 32
+#define DEFAULT_CAPACITY 65536
+#define DEFAULT_STRING_BYTES (4u << 20)
+
+/* A node in the region. 'data' is the offset of an out-of-line name,
+   or 0 if the name sits in 'small'. 'next_free' chains free nodes. */
+typedef struct shared_node{
+  unsigned int priority;
+  unsigned int length;
+  unsigned long long data;
+  unsigned int next_free;
+  char small[QUEUE_INLINE_DATA];
+}Shared_node;
+
+/* The start of the region. 'ready' is set last by the creator, so a
+   process that opens the queue never sees it half built. The other
+   offsets locate the node array, the heap, the hash table and the
+   string area. 'dirty' is set while a change is under way (see
+   begin_change); 'damaged' is set for good once a process has died
+   with it set. */
+typedef struct shared_header{
+  atomic_uint ready;
+  unsigned int version;
+  unsigned long long region_size;
+  pthread_mutex_t lock;
+  atomic_uint dirty;
+  atomic_uint damaged;
+  atomic_int size;
+  unsigned int capacity;
+  unsigned int hash_capacity;
+  unsigned int free_nodes;
+  unsigned int fresh_nodes;
+  unsigned long long nodes;
+  unsigned long long heap;
+  unsigned long long hash;
+  unsigned long long strings;
+  unsigned long long string_bytes;
+  unsigned long long string_used;
+  unsigned long long free_blocks[SHARED_CLASSES];
+}Shared_header;
+
+#define AT(REGION, OFFSET) ((char *) (REGION) + (OFFSET))
+
+/* Rounds 'size' up to a multiple of 8. */
+static unsigned long long align8(unsigned long long size) {
+  return (size + 7) & ~7ull;
+}
+
+static Shared_node *node_at(Shared_header *const region, unsigned int ref) {
+  return (Shared_node *) AT(region, region->nodes) + (ref - 1);
+}
+
+static unsigned int *heap_of(Shared_header *const region) {
+  return (unsigned int *) AT(region, region->heap);
+}
+
+static unsigned int *hash_of(Shared_header *const region) {
+  return (unsigned int *) AT(region, region->hash);
+}
+
+static char *node_data(Shared_header *const region, Shared_node *const node) {
+  return node->data != 0 ? AT(region, node->data) : node->small;
+}
+
+/* Locks the region. Returns 1 on success and 0 if the lock failed or
+   the queue is damaged, in which case it is not held. */
+static short lock_region(Shared_header *const region) {
+  int rc = pthread_mutex_lock(&region->lock);
+
+  /* The previous owner died. Its change may be incomplete. */
+  if (rc == EOWNERDEAD) {
+    if (atomic_load(&region->dirty))
+      atomic_store(&region->damaged, 1);
+    pthread_mutex_consistent(&region->lock);
+    rc = 0;
+  }
+  if (rc != 0)
+    return 0;
+  if (atomic_load(&region->damaged)) {
+    pthread_mutex_unlock(&region->lock);
+    return 0;
+  }
+  return 1;
+}
+
+/* Marks the region as in the middle of a change. The fence keeps the
+   compiler from sinking the store past the changes that follow, which
+   it could otherwise do since nothing in this process reads 'dirty'
+   back; a process killed among them must leave 'dirty' set. */
+static void begin_change(Shared_header *const region) {
+  atomic_store(&region->dirty, 1);
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+/* Marks the change begun by begin_change as complete. */
+static void end_change(Shared_header *const region) {
+  atomic_signal_fence(memory_order_seq_cst);
+  atomic_store(&region->dirty, 0);
+}
+
+/* Scrambles a priority into a slot number of the hash table. */
+static unsigned int home_slot(unsigned int priority, unsigned int capacity) {
+  priority *= 0x9E3779B1u;
+  priority ^= priority >> 16;
+  return priority & (capacity - 1);
+}
+
+/* Returns the node holding 'priority', or 0. */
+static unsigned int hash_find(Shared_header *const region,
+                              unsigned int priority) {
+  unsigned int *slots = hash_of(region);
+  unsigned int mask = region->hash_capacity - 1;
+  unsigned int i = home_slot(priority, region->hash_capacity);
+
+  while (slots[i] != 0 && node_at(region, slots[i])->priority != priority)
+    i = (i + 1) & mask;
+  return slots[i];
+}
+
+static void hash_insert(Shared_header *const region, unsigned int ref) {
+  unsigned int *slots = hash_of(region);
+  unsigned int mask = region->hash_capacity - 1;
+  unsigned int i = home_slot(node_at(region, ref)->priority,
+                             region->hash_capacity);
+
+  while (slots[i] != 0)
+    i = (i + 1) & mask;
+  slots[i] = ref;
+}
+
+/* Removes a node from the hash table, shifting the rest of its probe
+   run back like queue-prio-index.c does. */
+static void hash_remove(Shared_header *const region, unsigned int ref) {
+  unsigned int *slots = hash_of(region);
+  unsigned int mask = region->hash_capacity - 1;
+  unsigned int hole = home_slot(node_at(region, ref)->priority,
+                                region->hash_capacity);
+  unsigned int home;
+  unsigned int i;
+
+  while (slots[hole] != ref)
+    hole = (hole + 1) & mask;
+  slots[hole] = 0;
+
+  for (i = (hole + 1) & mask; slots[i] != 0; i = (i + 1) & mask) {
+    home = home_slot(node_at(region, slots[i])->priority,
+                     region->hash_capacity);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      slots[hole] = slots[i];
+      slots[i] = 0;
+      hole = i;
+    }
+  }
+}
+
+/* Moves the node at 'slot' towards the root of the heap. */
+static void sift_up(Shared_header *const region, unsigned int slot) {
+  unsigned int *heap = heap_of(region);
+  unsigned int ref = heap[slot];
+  unsigned int priority = node_at(region, ref)->priority;
+  unsigned int parent;
+
+  while (slot > 0) {
+    parent = (slot - 1) / SHARED_ARITY;
+    if (node_at(region, heap[parent])->priority >= priority)
+      break;
+    heap[slot] = heap[parent];
+    slot = parent;
+  }
+  heap[slot] = ref;
+}
+
+/* Moves the node at 'slot' towards the leaves of a heap of 'count'. */
+static void sift_down(Shared_header *const region, unsigned int slot,
+                      unsigned int count) {
+  unsigned int *heap = heap_of(region);
+  unsigned int ref = heap[slot];
+  unsigned int priority = node_at(region, ref)->priority;
+  unsigned int child;
+  unsigned int best;
+  unsigned int last;
+
+  for (;;) {
+    child = slot * SHARED_ARITY + 1;
+    if (child >= count)
+      break;
+    best = child;
+    last = child + SHARED_ARITY < count ? child + SHARED_ARITY : count;
+    for (child = child + 1; child < last; child++)
+      if (node_at(region, heap[child])->priority
+          > node_at(region, heap[best])->priority)
+        best = child;
+    if (node_at(region, heap[best])->priority <= priority)
+      break;
+    heap[slot] = heap[best];
+    slot = best;
+  }
+  heap[slot] = ref;
+}
+
+/* Returns the size class of a block holding 'size' bytes, or -1 if
+   it is larger than the biggest class. */
+static int block_class(size_t size) {
+  int class = 0;
+
+  while (class < SHARED_CLASSES && ((size_t) SHARED_MIN_BLOCK << class) < size)
+    class++;
+  return class < SHARED_CLASSES ? class : -1;
+}
+
+/* Returns the offset of a block of at least 'size' bytes, or 0 if the
+   string area is full. */
+static unsigned long long block_alloc(Shared_header *const region,
+                                      size_t size) {
+  int class = block_class(size);
+  unsigned long long offset;
+  unsigned long long bytes;
+
+  if (class < 0)
+    return 0;
+  offset = region->free_blocks[class];
+  if (offset != 0) {
+    memcpy(&region->free_blocks[class], AT(region, offset),
+           sizeof(unsigned long long));
+    return offset;
+  }
+  bytes = (unsigned long long) SHARED_MIN_BLOCK << class;
+  if (region->string_bytes - region->string_used < bytes)
+    return 0;
+  offset = region->strings + region->string_used;
+  region->string_used += bytes;
+  return offset;
+}
+
+/* Puts a block of 'size' bytes on the free list of its class. */
+static void block_free(Shared_header *const region, unsigned long long offset,
+                       size_t size) {
+  int class = block_class(size);
+
+  memcpy(AT(region, offset), &region->free_blocks[class],
+         sizeof(unsigned long long));
+  region->free_blocks[class] = offset;
+}
+
+/* Takes the top node out of the heap and the hash table and frees it.
+   Called with the region locked and marked dirty. */
+static void remove_top(Shared_header *const region) {
+  unsigned int *heap = heap_of(region);
+  unsigned int count = (unsigned int) atomic_load(&region->size);
+  unsigned int ref = heap[0];
+  Shared_node *node = node_at(region, ref);
+
+  hash_remove(region, ref);
+  heap[0] = heap[count - 1];
+  if (count > 2)
+    sift_down(region, 0, count - 1);
+  if (node->data != 0)
+    block_free(region, node->data, (size_t) node->length + 1);
+  node->next_free = region->free_nodes;
+  region->free_nodes = ref;
+  atomic_store_explicit(&region->size, (int) count - 1, memory_order_release);
+}
+
+/* Returns a malloc'd copy of the top element, or NULL if the queue is
+   empty or memory runs out. Called with the region locked. */
+static char *copy_top(Shared_header *const region) {
+  Shared_node *node = NULL;
+  char *name = NULL;
+
+  if (atomic_load(&region->size) == 0)
+    return NULL;
+  node = node_at(region, heap_of(region)[0]);
+  name = malloc((size_t) node->length + 1);
+  if (name != NULL)
+    memcpy(name, node_data(region, node), (size_t) node->length + 1);
+  return name;
+}
+
+/* This function creates a shared queue called 'name' (a POSIX shared
+   memory name such as "/jobs") sized by 'options', which may be NULL
+   for the defaults, and maps it into this process. It returns 1 on
+   success and 0 if the name is taken, an argument is NULL or the
+   region cannot be created. */
+unsigned short create_queue_shared(Queue_prio_shared *const queue,
+                                   const char name[],
+                                   const Queue_shared_options *const options) {
+  pthread_mutexattr_t attributes;
+  Shared_header *region = NULL;
+  unsigned long long string_bytes = DEFAULT_STRING_BYTES;
+  unsigned long long total;
+  unsigned int capacity = DEFAULT_CAPACITY;
+  unsigned int hash_capacity = 16;
+  void *map = NULL;
+  int fd;
+
+  if (queue == NULL || name == NULL)
+    return 0;
+  if (options != NULL && options->capacity > 0)
+    capacity = options->capacity;
+  if (options != NULL && options->string_bytes > 0)
+    string_bytes = align8(options->string_bytes);
+  if (capacity > 0x40000000u)
+    return 0;
+
+  /* Keep the hash table at most half full. */
+  while (hash_capacity < 2 * capacity)
+    hash_capacity *= 2;
+  total = align8(sizeof(Shared_header))
+    + align8((unsigned long long) capacity * sizeof(Shared_node))
+    + align8((unsigned long long) capacity * sizeof(unsigned int))
+    + align8((unsigned long long) hash_capacity * sizeof(unsigned int))
+    + string_bytes;
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    return 0;
+  if (ftruncate(fd, (off_t) total) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return 0;
+  }
+  map = mmap(NULL, (size_t) total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    return 0;
+  }
+
+  /* The object starts out zeroed, so only the layout needs filling in. */
+  region = map;
+  region->version = SHARED_VERSION;
+  region->region_size = total;
+  region->capacity = capacity;
+  region->hash_capacity = hash_capacity;
+  region->nodes = align8(sizeof(Shared_header));
+  region->heap = region->nodes
+    + align8((unsigned long long) capacity * sizeof(Shared_node));
+  region->hash = region->heap
+    + align8((unsigned long long) capacity * sizeof(unsigned int));
+  region->strings = region->hash
+    + align8((unsigned long long) hash_capacity * sizeof(unsigned int));
+  region->string_bytes = string_bytes;
+  atomic_init(&region->size, 0);
+  atomic_init(&region->dirty, 0);
+  atomic_init(&region->damaged, 0);
+
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+  if (pthread_mutex_init(&region->lock, &attributes) != 0) {
+    pthread_mutexattr_destroy(&attributes);
+    munmap(map, (size_t) total);
+    shm_unlink(name);
+    return 0;
+  }
+  pthread_mutexattr_destroy(&attributes);
+
+  atomic_store_explicit(&region->ready, SHARED_MAGIC, memory_order_release);
+  queue->region = region;
+  queue->region_size = (size_t) total;
+  return 1;
+}
+
+/* This function maps the existing shared queue called 'name' into
+   this process. It returns 1 on success and 0 if there is no such
+   queue, its creator has not finished setting it up, or it was made
+   by an incompatible version. */
+unsigned short open_queue_shared(Queue_prio_shared *const queue,
+                                 const char name[]) {
+  Shared_header *region = NULL;
+  struct stat info;
+  void *map = NULL;
+  int fd;
+
+  if (queue == NULL || name == NULL)
+    return 0;
+  fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Shared_header)) {
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, (size_t) info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  region = map;
+  if (atomic_load_explicit(&region->ready, memory_order_acquire)
+      != SHARED_MAGIC || region->version != SHARED_VERSION
+      || region->region_size != (unsigned long long) info.st_size) {
+    munmap(map, (size_t) info.st_size);
+    return 0;
+  }
+  queue->region = region;
+  queue->region_size = (size_t) info.st_size;
+  return 1;
+}
+
+/* This function unmaps the queue from this process. The queue and its
+   elements stay available to other processes. Returns 1 on success,
+   0 otherwise. */
+unsigned short close_queue_shared(Queue_prio_shared *const queue) {
+  if (queue == NULL || queue->region == NULL)
+    return 0;
+  munmap(queue->region, queue->region_size);
+  queue->region = NULL;
+  queue->region_size = 0;
+  return 1;
+}
+
+/* This function removes the name of a shared queue. Processes that
+   have it open keep using it until they close it. Returns 1 on
+   success, 0 otherwise. */
+unsigned short unlink_queue_shared(const char name[]) {
+  return name != NULL && shm_unlink(name) == 0;
+}
+
+/* This function enqueues a new element with a specified priority. It
+   returns 1 if the operation is successful and 0 if the priority is
+   already taken, the queue or its string area is full, an argument is
+   NULL or the queue is damaged. */
+unsigned short en_queue_shared(Queue_prio_shared *const queue,
+                               const char new_element[],
+                               unsigned int priority) {
+  Shared_header *region = NULL;
+  Shared_node *node = NULL;
+  unsigned long long data = 0;
+  unsigned int count;
+  unsigned int ref = 0;
+  size_t length;
+
+  if (queue == NULL || queue->region == NULL || new_element == NULL)
+    return 0;
+  region = queue->region;
+  length = strlen(new_element);
+  if (length > 0xFFFFFFFEu || !lock_region(region))
+    return 0;
+
+  count = (unsigned int) atomic_load(&region->size);
+  if (count == region->capacity || hash_find(region, priority) != 0) {
+    pthread_mutex_unlock(&region->lock);
+    return 0;
+  }
+  begin_change(region);
+  if (length >= QUEUE_INLINE_DATA) {
+    data = block_alloc(region, length + 1);
+    if (data == 0) {
+      end_change(region);
+      pthread_mutex_unlock(&region->lock);
+      return 0;
+    }
+  }
+  if (region->free_nodes != 0) {
+    ref = region->free_nodes;
+    region->free_nodes = node_at(region, ref)->next_free;
+  } else {
+    ref = ++region->fresh_nodes;
+  }
+  node = node_at(region, ref);
+  node->priority = priority;
+  node->length = (unsigned int) length;
+  node->data = data;
+  memcpy(node_data(region, node), new_element, length + 1);
+
+  hash_insert(region, ref);
+  heap_of(region)[count] = ref;
+  sift_up(region, count);
+  atomic_store_explicit(&region->size, (int) count + 1, memory_order_release);
+  end_change(region);
+
+  pthread_mutex_unlock(&region->lock);
+  return 1;
+}
+
+/* This function returns a malloc'd copy of the highest-priority
+   element, or NULL if the queue is empty, damaged or the pointer is
+   NULL. */
+char *peek_shared(Queue_prio_shared *const queue) {
+  char *name = NULL;
+
+  if (queue == NULL || queue->region == NULL || !lock_region(queue->region))
+    return NULL;
+  name = copy_top(queue->region);
+  pthread_mutex_unlock(&queue->region->lock);
+  return name;
+}
+
+/* This function returns the priority of the highest-priority element,
+   or -1 if the queue is empty, damaged or the pointer is NULL. */
+long long peek_priority_shared(Queue_prio_shared *const queue) {
+  Shared_header *region = NULL;
+  long long priority = -1;
+
+  if (queue == NULL || queue->region == NULL || !lock_region(queue->region))
+    return -1;
+  region = queue->region;
+  if (atomic_load(&region->size) > 0)
+    priority = node_at(region, heap_of(region)[0])->priority;
+  pthread_mutex_unlock(&region->lock);
+  return priority;
+}
+
+/* This function dequeues the highest-priority element and returns it
+   as a malloc'd string, or NULL if the queue is empty, damaged, the
+   pointer is NULL or memory runs out. */
+char *de_queue_shared(Queue_prio_shared *const queue) {
+  Shared_header *region = NULL;
+  char *name = NULL;
+
+  if (queue == NULL || queue->region == NULL || !lock_region(queue->region))
+    return NULL;
+  region = queue->region;
+  name = copy_top(region);
+  if (name != NULL) {
+    begin_change(region);
+    remove_top(region);
+    end_change(region);
+  }
+  pthread_mutex_unlock(&region->lock);
+  return name;
+}
+
+/* This function dequeues the highest-priority element into a buffer
+   supplied by the caller, like de_queue_into: it returns the length of
+   the element's data and dequeues it only if that length is less than
+   'buffer_size'. It returns -1 if the queue is empty, damaged or the
+   pointer is NULL. */
+long de_queue_shared_into(Queue_prio_shared *const queue, char buffer[],
+                          size_t buffer_size) {
+  Shared_header *region = NULL;
+  Shared_node *node = NULL;
+  long length = -1;
+
+  if (queue == NULL || queue->region == NULL || !lock_region(queue->region))
+    return -1;
+  region = queue->region;
+  if (atomic_load(&region->size) > 0) {
+    node = node_at(region, heap_of(region)[0]);
+    length = (long) node->length;
+    if (buffer != NULL && node->length < buffer_size) {
+      memcpy(buffer, node_data(region, node), (size_t) node->length + 1);
+      begin_change(region);
+      remove_top(region);
+      end_change(region);
+    }
+  }
+  pthread_mutex_unlock(&region->lock);
+  return length;
+}
+
+/* This function returns -1 if the queue pointer is NULL, 1 if the
+   queue is empty and 0 if it holds elements. It never blocks. */
+short has_no_elements_shared(const Queue_prio_shared *const queue) {
+  if (queue == NULL || queue->region == NULL)
+    return -1;
+  return atomic_load_explicit(&queue->region->size, memory_order_acquire) == 0;
+}
+
+/* This function returns the number of elements in the queue. It never
+   blocks. */
+int size_shared(const Queue_prio_shared *const queue) {
+  if (queue == NULL || queue->region == NULL)
+    return -1;
+  return atomic_load_explicit(&queue->region->size, memory_order_acquire);
+}
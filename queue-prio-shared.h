@@ -0,0 +1,32 @@
+#ifndef QUEUE_PRIO_SHARED_H
+#define QUEUE_PRIO_SHARED_H
+
+#include "queue-prio-shared-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned short create_queue_shared(Queue_prio_shared *const queue,
+                                   const char name[],
+                                   const Queue_shared_options *const options);
+unsigned short open_queue_shared(Queue_prio_shared *const queue,
+                                 const char name[]);
+unsigned short close_queue_shared(Queue_prio_shared *const queue);
+unsigned short unlink_queue_shared(const char name[]);
+unsigned short en_queue_shared(Queue_prio_shared *const queue,
+                               const char new_element[],
+                               unsigned int priority);
+char *peek_shared(Queue_prio_shared *const queue);
+long long peek_priority_shared(Queue_prio_shared *const queue);
+char *de_queue_shared(Queue_prio_shared *const queue);
+long de_queue_shared_into(Queue_prio_shared *const queue, char buffer[],
+                          size_t buffer_size);
+short has_no_elements_shared(const Queue_prio_shared *const queue);
+int size_shared(const Queue_prio_shared *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "queue-prio-engine.h"
+
+/*This file sorts the batches of en_queue_batch and
+  build_queue_from_arrays from highest to lowest priority, ties going
+  to the item that came first. Priorities are 32-bit, so a batch is
+  sorted with a least-significant-digit radix sort: four stable passes
+  of one byte each, in O(n), skipping any byte every entry shares.
+  Entries arrive in position order and every pass is stable, so ties
+  stay in that order. Small batches go to qsort instead.
+
+  A large batch on a machine with several processors is cut into one
+  slice per thread and the slices are sorted at the same time; the
+  runs are then merged in pairs, each round of merges again spread
+  over the threads, until one run is left. If a thread cannot be
+  started its share is done by the calling thread, and if the scratch
+  buffer cannot be had the whole batch goes to qsort, so the result
+  never depends on either.*/
+
+#define SORT_RADIX_MIN 256
+#define SORT_PARALLEL_MIN 65536
+#define SORT_MAX_THREADS 16
+
+/* One thread's share: sort 'count' entries at 'from' in place, using
+   'to' as scratch space, or, when 'merge' is set, merge the runs
+   from[0, left) and from[left, count) into 'to'. */
+typedef struct sort_task{
+  Batch_entry *from;
+  Batch_entry *to;
+  unsigned int left;
+  unsigned int count;
+  unsigned short merge;
+}Sort_task;
+
+/* qsort comparator putting higher priorities first and, among equal
+   priorities, the item that came first in the batch. */
+static int compare_batch(const void *a, const void *b) {
+  const Batch_entry *ea = a;
+  const Batch_entry *eb = b;
+
+  if (ea->priority != eb->priority)
+    return ea->priority < eb->priority ? 1 : -1;
+  return ea->position < eb->position ? -1 : (ea->position > eb->position);
+}
+
+/* Sorts 'count' entries with a byte-wise radix sort on the inverted
+   priority, moving them between 'entries' and 'scratch' and leaving
+   the result in 'entries'. */
+static void radix_sort(Batch_entry entries[], Batch_entry scratch[],
+                       unsigned int count) {
+  unsigned int counts[4][256];
+  unsigned int offset;
+  unsigned int total;
+  unsigned int shift;
+  unsigned int digit;
+  unsigned int pass;
+  unsigned int i;
+  Batch_entry *from = entries;
+  Batch_entry *to = scratch;
+  Batch_entry *swap = NULL;
+
+  /* Count every byte in one read of the batch. */
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < count; i++)
+    for (pass = 0; pass < 4; pass++)
+      counts[pass][(~entries[i].priority >> (8 * pass)) & 0xFF]++;
+
+  for (pass = 0; pass < 4; pass++) {
+    shift = 8 * pass;
+    if (counts[pass][(~entries[0].priority >> shift) & 0xFF] == count)
+      continue;
+
+    /* Turn the counts into starting offsets and scatter. */
+    offset = 0;
+    for (digit = 0; digit < 256; digit++) {
+      total = counts[pass][digit];
+      counts[pass][digit] = offset;
+      offset += total;
+    }
+    for (i = 0; i < count; i++)
+      to[counts[pass][(~from[i].priority >> shift) & 0xFF]++] = from[i];
+    swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if (from != entries)
+    memcpy(entries, from, count * sizeof(Batch_entry));
+}
+
+/* Merges two sorted runs. The runs come from consecutive slices of
+   the batch, so taking from the left run on equal priorities keeps
+   the earlier item first. */
+static void merge_runs(const Sort_task *const task) {
+  const Batch_entry *left = task->from;
+  const Batch_entry *left_end = task->from + task->left;
+  const Batch_entry *right = left_end;
+  const Batch_entry *right_end = task->from + task->count;
+  Batch_entry *out = task->to;
+
+  while (left < left_end && right < right_end) {
+    if (right->priority > left->priority)
+      *out++ = *right++;
+    else
+      *out++ = *left++;
+  }
+  memcpy(out, left, (size_t) (left_end - left) * sizeof(Batch_entry));
+  out += left_end - left;
+  memcpy(out, right, (size_t) (right_end - right) * sizeof(Batch_entry));
+}
+
+static void *run_task(void *argument) {
+  Sort_task *task = argument;
+
+  if (task->merge)
+    merge_runs(task);
+  else
+    radix_sort(task->from, task->to, task->count);
+  return NULL;
+}
+
+/* Runs 'count' tasks at the same time, the last one in the calling
+   thread, and waits for all of them. */
+static void run_tasks(Sort_task tasks[], unsigned int count) {
+  pthread_t threads[SORT_MAX_THREADS];
+  unsigned short started[SORT_MAX_THREADS];
+  unsigned int i;
+
+  for (i = 0; i + 1 < count; i++)
+    started[i] = pthread_create(&threads[i], NULL, run_task, &tasks[i]) == 0;
+  run_task(&tasks[count - 1]);
+  for (i = 0; i + 1 < count; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      run_task(&tasks[i]);
+  }
+}
+
+/* Returns how many threads to sort 'count' entries with: a power of
+   two no larger than the processors online, and small enough that
+   each thread gets at least SORT_PARALLEL_MIN entries. */
+static unsigned int sort_threads(unsigned int count) {
+  long processors = 1;
+  unsigned int threads = 1;
+
+  if (count >= 2 * SORT_PARALLEL_MIN)
+    processors = sysconf(_SC_NPROCESSORS_ONLN);
+  while (threads * 2 <= SORT_MAX_THREADS && threads * 2 <= processors
+         && count / (threads * 2) >= SORT_PARALLEL_MIN)
+    threads *= 2;
+  return threads;
+}
+
+/*
+ * Sorts 'count' batch entries from highest to lowest priority and,
+ * among equal priorities, by position.
+ */
+void sort_batch(Batch_entry entries[], unsigned int count) {
+  Sort_task tasks[SORT_MAX_THREADS];
+  unsigned int bounds[SORT_MAX_THREADS + 1];
+  unsigned int threads = sort_threads(count);
+  unsigned int width;
+  unsigned int i;
+  Batch_entry *buffer = NULL;
+  Batch_entry *from = entries;
+  Batch_entry *to = NULL;
+  Batch_entry *swap = NULL;
+
+  if (count >= SORT_RADIX_MIN)
+    buffer = malloc(count * sizeof(Batch_entry));
+  if (buffer == NULL) {
+    qsort(entries, count, sizeof(Batch_entry), compare_batch);
+    return;
+  }
+
+  /* Sort one slice per thread. */
+  for (i = 0; i <= threads; i++)
+    bounds[i] = (unsigned int) ((unsigned long long) count * i / threads);
+  for (i = 0; i < threads; i++) {
+    tasks[i].from = entries + bounds[i];
+    tasks[i].to = buffer + bounds[i];
+    tasks[i].left = 0;
+    tasks[i].count = bounds[i + 1] - bounds[i];
+    tasks[i].merge = 0;
+  }
+  run_tasks(tasks, threads);
+
+  /* Merge neighbouring runs, switching buffers every round. */
+  to = buffer;
+  for (width = 1; width < threads; width *= 2) {
+    for (i = 0; i < threads / (2 * width); i++) {
+      tasks[i].from = from + bounds[2 * width * i];
+      tasks[i].to = to + bounds[2 * width * i];
+      tasks[i].left = bounds[2 * width * i + width] - bounds[2 * width * i];
+      tasks[i].count = bounds[2 * width * (i + 1)] - bounds[2 * width * i];
+      tasks[i].merge = 1;
+    }
+    run_tasks(tasks, threads / (2 * width));
+    swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if (from != entries)
+    memcpy(entries, from, count * sizeof(Batch_entry));
+  free(buffer);
+}
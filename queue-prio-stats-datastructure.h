@@ -0,0 +1,66 @@
+#ifndef QUEUE_PRIO_STATS_DATASTRUCTURE_H
+#define QUEUE_PRIO_STATS_DATASTRUCTURE_H
+
+/* Latency bucket i counts calls that took at most 2^i nanoseconds and
+   more than 2^(i-1); the last bucket also takes everything slower. */
+#define QUEUE_STATS_BUCKETS 32
+
+/* The counters kept when the library is built with QUEUE_STATS. */
+typedef enum queue_stat{
+  /* Elements enqueued and dequeued, by any function. */
+  QUEUE_STAT_EN_QUEUED,
+  QUEUE_STAT_DE_QUEUED,
+  /* en_queue and en_queue_batch items turned down because their
+     priority was taken. */
+  QUEUE_STAT_REJECTED,
+  /* en_queue items turned down because a bounded queue was full, and
+     elements evicted to make room for others. */
+  QUEUE_STAT_FULL,
+  QUEUE_STAT_EVICTED,
+  /* Nodes the list engine stepped over to find an insert position. */
+  QUEUE_STAT_INSERT_WALK,
+  /* Queue_prio_list lookups by name, and the bucket entries they
+     compared. */
+  QUEUE_STAT_LOOKUPS,
+  QUEUE_STAT_LOOKUP_WALK,
+  /* Blocks obtained for node pools and string arenas. */
+  QUEUE_STAT_ALLOCATIONS,
+  QUEUE_STAT_COUNTERS
+}Queue_stat;
+
+/* The public functions whose latency is recorded. */
+typedef enum queue_stat_function{
+  QUEUE_FUNCTION_EN_QUEUE,
+  QUEUE_FUNCTION_EN_QUEUE_BATCH,
+  QUEUE_FUNCTION_DE_QUEUE,
+  QUEUE_FUNCTION_DE_QUEUE_BATCH,
+  QUEUE_FUNCTION_PEEK,
+  QUEUE_FUNCTION_CHANGE_PRIORITY,
+  QUEUE_FUNCTION_REMOVE_ELEMENTS_BETWEEN,
+  QUEUE_FUNCTION_GET_QUEUE,
+  QUEUE_FUNCTION_DE_QUEUE_GLOBAL,
+  QUEUE_FUNCTION_DE_QUEUE_FAIR,
+  QUEUE_FUNCTION_BUILD_QUEUE,
+  QUEUE_FUNCTION_CHANGE_PRIORITY_H,
+  QUEUE_FUNCTION_REMOVE_H,
+  QUEUE_FUNCTIONS
+}Queue_stat_function;
+
+/* The latency of one function: how many calls, their total time and
+   how they spread over the buckets. */
+typedef struct queue_latency{
+  unsigned long long count;
+  unsigned long long sum_ns;
+  unsigned long long buckets[QUEUE_STATS_BUCKETS];
+}Queue_latency;
+
+/* Totals over every thread that has used the library, including
+   threads that have exited. 'depth_high_water' is the largest size any
+   queue has reached. */
+typedef struct queue_stats{
+  unsigned long long counters[QUEUE_STAT_COUNTERS];
+  unsigned long long depth_high_water;
+  Queue_latency latency[QUEUE_FUNCTIONS];
+}Queue_stats;
+
+#endif
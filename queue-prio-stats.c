@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "queue-prio-stats.h"
+#include "queue-prio-engine.h"
+
+/*This program keeps the library's statistics. They cost nothing
+  unless the library is built with QUEUE_STATS defined (the
+  QUEUEMANAGER_STATS CMake option): without it every hook in the hot
+  paths compiles to nothing and queue_stats_snapshot reports zeros.
+
+  With it, each thread counts into a block of its own, created the
+  first time the thread records anything. Only the owning thread
+  writes a block, with relaxed loads and stores rather than locked
+  read-modify-write instructions, so recording never contends. Readers
+  add the blocks up under a mutex that writers never take. When a
+  thread exits its block is folded into the totals of retired threads
+  and freed.
+
+  Latencies are taken with the monotonic clock around each recorded
+  public function and filed in power-of-two nanosecond buckets.*/
+
+#ifdef QUEUE_STATS
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* The statistics of one thread. */
+typedef struct thread_stats{
+  atomic_ullong counters[QUEUE_STAT_COUNTERS];
+  atomic_ullong depth_high_water;
+  struct{
+    atomic_ullong count;
+    atomic_ullong sum_ns;
+    atomic_ullong buckets[QUEUE_STATS_BUCKETS];
+  }latency[QUEUE_FUNCTIONS];
+  struct thread_stats *next;
+}Thread_stats;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+static pthread_key_t registry_key;
+static Thread_stats *live;
+static Queue_stats retired;
+static _Thread_local Thread_stats *mine;
+
+/* Adds to a counter only this thread writes. */
+static void bump(atomic_ullong *const counter, unsigned long long amount) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter,
+                                                      memory_order_relaxed)
+                        + amount, memory_order_relaxed);
+}
+
+/* Reads a counter another thread may be writing. */
+static unsigned long long read_counter(atomic_ullong *const counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* Adds one thread's block into 'stats'. Called with the registry
+   locked. */
+static void add_thread(Queue_stats *const stats, Thread_stats *const thread) {
+  unsigned long long high_water = read_counter(&thread->depth_high_water);
+  unsigned int i;
+  unsigned int j;
+
+  for (i = 0; i < QUEUE_STAT_COUNTERS; i++)
+    stats->counters[i] += read_counter(&thread->counters[i]);
+  if (high_water > stats->depth_high_water)
+    stats->depth_high_water = high_water;
+  for (i = 0; i < QUEUE_FUNCTIONS; i++) {
+    stats->latency[i].count += read_counter(&thread->latency[i].count);
+    stats->latency[i].sum_ns += read_counter(&thread->latency[i].sum_ns);
+    for (j = 0; j < QUEUE_STATS_BUCKETS; j++)
+      stats->latency[i].buckets[j]
+        += read_counter(&thread->latency[i].buckets[j]);
+  }
+}
+
+/* Folds an exiting thread's block into the retired totals. */
+static void retire_thread(void *block) {
+  Thread_stats *thread = block;
+  Thread_stats **link = &live;
+
+  pthread_mutex_lock(&registry_lock);
+  add_thread(&retired, thread);
+  while (*link != NULL && *link != thread)
+    link = &(*link)->next;
+  if (*link != NULL)
+    *link = thread->next;
+  pthread_mutex_unlock(&registry_lock);
+  mine = NULL;
+  free(thread);
+}
+
+static void make_key(void) {
+  pthread_key_create(&registry_key, retire_thread);
+}
+
+/* Returns this thread's block, creating it on first use, or NULL if
+   memory runs out. */
+static Thread_stats *this_thread(void) {
+  if (mine != NULL)
+    return mine;
+
+  pthread_once(&registry_once, make_key);
+  mine = calloc(1, sizeof(Thread_stats));
+  if (mine == NULL)
+    return NULL;
+  pthread_mutex_lock(&registry_lock);
+  mine->next = live;
+  live = mine;
+  pthread_mutex_unlock(&registry_lock);
+  pthread_setspecific(registry_key, mine);
+  return mine;
+}
+
+/*
+ * Adds 'amount' to one of the calling thread's counters.
+ */
+void stats_count(Queue_stat stat, unsigned long long amount) {
+  Thread_stats *thread = this_thread();
+
+  if (thread != NULL)
+    bump(&thread->counters[stat], amount);
+}
+
+/*
+ * Raises the depth high-water mark to 'depth' if it is lower.
+ */
+void stats_depth(int depth) {
+  Thread_stats *thread = this_thread();
+
+  if (thread != NULL && depth > 0
+      && (unsigned long long) depth > read_counter(&thread->depth_high_water))
+    atomic_store_explicit(&thread->depth_high_water,
+                          (unsigned long long) depth, memory_order_relaxed);
+}
+
+/*
+ * Returns the monotonic clock in nanoseconds.
+ */
+unsigned long long stats_clock(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000000000ull
+    + (unsigned long long) now.tv_nsec;
+}
+
+/*
+ * Records one call of 'function' that started at 'start' (from
+ * stats_clock).
+ */
+void stats_latency(Queue_stat_function function, unsigned long long start) {
+  Thread_stats *thread = this_thread();
+  unsigned long long elapsed = stats_clock() - start;
+  unsigned int bucket = 0;
+
+  if (thread == NULL)
+    return;
+  while (bucket < QUEUE_STATS_BUCKETS - 1 && (1ull << bucket) < elapsed)
+    bucket++;
+  bump(&thread->latency[function].count, 1);
+  bump(&thread->latency[function].sum_ns, elapsed);
+  bump(&thread->latency[function].buckets[bucket], 1);
+}
+
+#endif
+
+/* This function returns 1 if the library was built with statistics
+   (QUEUE_STATS) and 0 if every statistic stays zero. */
+unsigned short queue_stats_enabled(void) {
+#ifdef QUEUE_STATS
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* This function fills 'stats' with the totals over every thread so
+   far. The counters of threads still running are read while they may
+   be changing, so the totals are each exact but not one instant's.
+   Returns 1 on success and 0 if 'stats' is NULL or the library was
+   built without statistics, in which case 'stats' is zeroed. */
+unsigned short queue_stats_snapshot(Queue_stats *const stats) {
+#ifdef QUEUE_STATS
+  Thread_stats *thread = NULL;
+#endif
+
+  if (stats == NULL)
+    return 0;
+  memset(stats, 0, sizeof(Queue_stats));
+#ifdef QUEUE_STATS
+  pthread_mutex_lock(&registry_lock);
+  *stats = retired;
+  for (thread = live; thread != NULL; thread = thread->next)
+    add_thread(stats, thread);
+  pthread_mutex_unlock(&registry_lock);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* Appends printf-style output at 'used', keeping count of the room the
+   whole text needs even past the end of the buffer. */
+static void append(char buffer[], size_t size, size_t *const used,
+                   const char *format, ...) {
+  va_list args;
+  int written;
+
+  va_start(args, format);
+  written = vsnprintf(*used < size ? buffer + *used : NULL,
+                      *used < size ? size - *used : 0, format, args);
+  va_end(args);
+  if (written > 0)
+    *used += (size_t) written;
+}
+
+/* This function writes the statistics into 'buffer' in the Prometheus
+   text exposition format. Like snprintf, it returns the length of the
+   whole text and writes at most 'size' bytes including the
+   terminator, so a return value of 'size' or more means the text was
+   cut short. Without statistics the text is empty. */
+size_t queue_stats_prometheus(char buffer[], size_t size) {
+  static const char *const counter_names[QUEUE_STAT_COUNTERS][2] = {
+    {"en_queued_total", "Elements enqueued."},
+    {"de_queued_total", "Elements dequeued."},
+    {"rejected_total", "Items turned down because their priority was taken."},
+    {"full_total", "Items turned down because a bounded queue was full."},
+    {"evicted_total", "Elements evicted to make room in a bounded queue."},
+    {"insert_walk_nodes_total",
+     "Nodes the list engine stepped over to find an insert position."},
+    {"lookups_total", "Queue lookups by name in a Queue_prio_list."},
+    {"lookup_walk_entries_total",
+     "Hash bucket entries compared by queue lookups."},
+    {"allocations_total", "Blocks obtained for node pools and string arenas."}
+  };
+  static const char *const function_names[QUEUE_FUNCTIONS] = {
+    "en_queue", "en_queue_batch", "de_queue", "de_queue_batch", "peek",
+    "change_priority", "remove_elements_between", "get_queue",
+    "de_queue_global", "de_queue_fair", "build_queue_from_arrays",
+    "change_priority_h", "remove_h"
+  };
+  Queue_stats stats;
+  unsigned long long cumulative;
+  size_t used = 0;
+  unsigned int i;
+  unsigned int j;
+
+  if (buffer != NULL && size > 0)
+    buffer[0] = '\0';
+  if (buffer == NULL)
+    size = 0;
+  if (!queue_stats_snapshot(&stats))
+    return 0;
+
+  for (i = 0; i < QUEUE_STAT_COUNTERS; i++)
+    append(buffer, size, &used,
+           "# HELP queuemanager_%s %s\n# TYPE queuemanager_%s counter\n"
+           "queuemanager_%s %llu\n", counter_names[i][0],
+           counter_names[i][1], counter_names[i][0], counter_names[i][0],
+           stats.counters[i]);
+  append(buffer, size, &used,
+         "# HELP queuemanager_depth_high_water Largest size any queue has "
+         "reached.\n# TYPE queuemanager_depth_high_water gauge\n"
+         "queuemanager_depth_high_water %llu\n", stats.depth_high_water);
+
+  append(buffer, size, &used,
+         "# HELP queuemanager_call_duration_seconds Time spent in public "
+         "functions.\n# TYPE queuemanager_call_duration_seconds histogram\n");
+  for (i = 0; i < QUEUE_FUNCTIONS; i++) {
+    cumulative = 0;
+    for (j = 0; j < QUEUE_STATS_BUCKETS - 1; j++) {
+      cumulative += stats.latency[i].buckets[j];
+      append(buffer, size, &used, "queuemanager_call_duration_seconds_bucket"
+             "{function=\"%s\",le=\"%.9g\"} %llu\n", function_names[i],
+             (double) (1ull << j) / 1e9, cumulative);
+    }
+    append(buffer, size, &used, "queuemanager_call_duration_seconds_bucket"
+           "{function=\"%s\",le=\"+Inf\"} %llu\n"
+           "queuemanager_call_duration_seconds_sum{function=\"%s\"} %.9g\n"
+           "queuemanager_call_duration_seconds_count{function=\"%s\"} %llu\n",
+           function_names[i], stats.latency[i].count, function_names[i],
+           (double) stats.latency[i].sum_ns / 1e9, function_names[i],
+           stats.latency[i].count);
+  }
+  return used;
+}
@@ -0,0 +1,19 @@
+#ifndef QUEUE_PRIO_STATS_H
+#define QUEUE_PRIO_STATS_H
+
+#include <stddef.h>
+#include "queue-prio-stats-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned short queue_stats_enabled(void);
+unsigned short queue_stats_snapshot(Queue_stats *const stats);
+size_t queue_stats_prometheus(char buffer[], size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
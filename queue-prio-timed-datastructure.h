@@ -0,0 +1,55 @@
+#ifndef QUEUE_PRIO_TIMED_DATASTRUCTURE_H
+#define QUEUE_PRIO_TIMED_DATASTRUCTURE_H
+
+#include "queue-prio-datastructure.h"
+
+/* The timing wheel has QUEUE_TIMER_LEVELS levels of QUEUE_TIMER_SLOTS
+   slots. A slot of level 0 spans one millisecond and a slot of each
+   level above spans a whole turn of the level below, so six levels of
+   64 slots reach 2^36 ms, a little over two years, ahead. */
+#define QUEUE_TIMER_LEVELS 6
+#define QUEUE_TIMER_SLOT_BITS 6
+#define QUEUE_TIMER_SLOTS (1u << QUEUE_TIMER_SLOT_BITS)
+
+/* Element names shorter than this are stored inside the timer. */
+#define QUEUE_TIMER_INLINE 24
+
+/* An element waiting for its delivery time. 'data' points either at
+   'small' or at a malloc'd copy of the element. */
+typedef struct timer_entry{
+  struct timer_entry *next;
+  unsigned long long deliver_at;
+  unsigned int priority;
+  unsigned int length;
+  char *data;
+  char small[QUEUE_TIMER_INLINE];
+}Timer_entry;
+
+/* A hierarchical timing wheel. 'now' is the last millisecond the wheel
+   has been advanced to; every timer still in a slot is due later. Bit
+   s of occupied[level] is set while slots[level][s] is non-empty, so
+   the wheel can skip over empty slots without looking at them. */
+typedef struct timer_wheel{
+  Timer_entry *slots[QUEUE_TIMER_LEVELS][QUEUE_TIMER_SLOTS];
+  unsigned long long occupied[QUEUE_TIMER_LEVELS];
+  unsigned long long now;
+  unsigned int pending;
+}Timer_wheel;
+
+/* A priority queue whose elements may be held back until a delivery
+   time. 'ready' is an ordinary Queue_prio holding the elements that
+   are due. The others wait in 'wheel'; 'held' chains those that are
+   due but whose priority is still taken in 'ready'. Timers are
+   allocated from blocks chained on 'blocks' and recycled through
+   'free_entries'. */
+typedef struct queue_prio_timed{
+  Queue_prio ready;
+  Timer_wheel wheel;
+  Timer_entry *held;
+  unsigned int held_count;
+  Timer_entry *free_entries;
+  void *blocks;
+  unsigned int next_block;
+}Queue_prio_timed;
+
+#endif
@@ -0,0 +1,448 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue-prio.h"
+#include "queue-prio-timed.h"
+
+/*This program provides Queue_prio_timed, a priority queue whose
+  elements can be given a delivery time with en_queue_at. Until then
+  they are invisible to peek_timed and de_queue_timed; once due they
+  join an ordinary Queue_prio, 'ready', and compete by priority as
+  usual. Times are milliseconds on the clock of queue_time_ms.
+
+  Waiting elements sit in a hierarchical timing wheel. Level 0 has one
+  slot per millisecond, and every slot of level L covers a whole turn
+  of level L-1. A timer goes into the lowest level whose range reaches
+  its delivery time, in the slot its time falls in, so en_queue_at is
+  O(1) whatever the number of timers. When the wheel reaches a slot of
+  a higher level, the slot is emptied and its timers are put back one
+  or more levels lower (cascaded), until they reach level 0 and fall
+  due. Each timer is cascaded at most once per level. Timers further
+  away than the top level reaches wait in its last slot and are placed
+  again when they get there.
+
+  The wheel does not visit every millisecond: a bitmap per level marks
+  the non-empty slots, so advancing goes straight to the next slot
+  that holds timers. All timers that fall due during one advance are
+  promoted together with a single en_queue_batch.
+
+  'ready' keeps the rule that priorities are unique. A timer that falls
+  due while its priority is still in 'ready' is held back and offered
+  again on every later advance, so no element is lost, and among held
+  timers with the same priority the first to fall due goes first.*/
+
+#define TIMER_FIRST_BLOCK 64
+#define TIMER_MAX_BLOCK 4096
+#define PROMOTE_ON_STACK 64
+#define SLOT_MASK (QUEUE_TIMER_SLOTS - 1)
+
+/* Header of a block of timers. */
+typedef struct timer_block{
+  struct timer_block *next;
+  Timer_entry entries[];
+}Timer_block;
+
+/* Returns the position of the lowest set bit of a non-zero word. */
+static unsigned int lowest_bit(unsigned long long bits) {
+#if defined(__GNUC__)
+  return (unsigned int) __builtin_ctzll(bits);
+#else
+  unsigned int bit = 0;
+
+  while (!(bits & 1ull)) {
+    bits >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+/* Returns a timer from the free list, refilling it with a new block
+   when it is empty, or NULL if memory runs out. */
+static Timer_entry *timer_alloc(Queue_prio_timed *const queue) {
+  Timer_block *block = NULL;
+  Timer_entry *entry = NULL;
+  unsigned int i;
+
+  if (queue->free_entries == NULL) {
+    if (queue->next_block == 0)
+      queue->next_block = TIMER_FIRST_BLOCK;
+    block = malloc(sizeof(Timer_block)
+                   + queue->next_block * sizeof(Timer_entry));
+    if (block == NULL)
+      return NULL;
+    block->next = queue->blocks;
+    queue->blocks = block;
+    for (i = queue->next_block; i-- > 0;) {
+      block->entries[i].next = queue->free_entries;
+      queue->free_entries = &block->entries[i];
+    }
+    if (queue->next_block < TIMER_MAX_BLOCK)
+      queue->next_block *= 2;
+  }
+
+  entry = queue->free_entries;
+  queue->free_entries = entry->next;
+  return entry;
+}
+
+/* Frees a timer's element and puts the timer back on the free list. */
+static void timer_release(Queue_prio_timed *const queue,
+                          Timer_entry *const entry) {
+  if (entry->data != entry->small)
+    free(entry->data);
+  entry->next = queue->free_entries;
+  queue->free_entries = entry;
+}
+
+/* Frees the elements of a chain of timers linked through 'next'. */
+static void release_data(Timer_entry *entry) {
+  while (entry != NULL) {
+    if (entry->data != entry->small)
+      free(entry->data);
+    entry = entry->next;
+  }
+}
+
+/* Files a timer that is due after 'now' in the lowest level that
+   reaches its delivery time. */
+static void wheel_insert(Timer_wheel *const wheel, Timer_entry *const entry) {
+  unsigned long long delta = entry->deliver_at - wheel->now;
+  unsigned long long when = entry->deliver_at;
+  unsigned int level = 0;
+  unsigned int slot;
+
+  while (level < QUEUE_TIMER_LEVELS - 1
+         && delta >> (QUEUE_TIMER_SLOT_BITS * (level + 1)) != 0)
+    level++;
+
+  /* Beyond the top level: wait in its furthest slot. */
+  if (delta >> (QUEUE_TIMER_SLOT_BITS * QUEUE_TIMER_LEVELS) != 0)
+    when = wheel->now
+      + (1ull << (QUEUE_TIMER_SLOT_BITS * QUEUE_TIMER_LEVELS)) - 1;
+
+  slot = (unsigned int) (when >> (QUEUE_TIMER_SLOT_BITS * level)) & SLOT_MASK;
+  entry->next = wheel->slots[level][slot];
+  wheel->slots[level][slot] = entry;
+  wheel->occupied[level] |= 1ull << slot;
+  wheel->pending++;
+}
+
+/* Returns the first millisecond after 'now' at which a non-empty slot
+   is reached. The wheel must hold at least one timer. */
+static unsigned long long next_event(const Timer_wheel *const wheel) {
+  unsigned long long tick = wheel->now + 1;
+  unsigned long long best = ~0ull;
+  unsigned long long unit;
+  unsigned long long span;
+  unsigned long long when;
+  unsigned long long ahead;
+  unsigned int level;
+  unsigned int first;
+  unsigned int slot;
+
+  for (level = 0; level < QUEUE_TIMER_LEVELS; level++) {
+    if (wheel->occupied[level] == 0)
+      continue;
+    unit = 1ull << (QUEUE_TIMER_SLOT_BITS * level);
+    span = unit << QUEUE_TIMER_SLOT_BITS;
+
+    /* The current slot of a level was already emptied unless 'tick'
+       is the moment the wheel reaches it. */
+    first = (unsigned int) (tick >> (QUEUE_TIMER_SLOT_BITS * level))
+      & SLOT_MASK;
+    if ((tick & (unit - 1)) != 0)
+      first++;
+
+    /* Look for the next occupied slot from 'first' on, wrapping round
+       into the next turn of the level. */
+    ahead = first < QUEUE_TIMER_SLOTS
+      ? wheel->occupied[level] & (~0ull << first) : 0;
+    slot = lowest_bit(ahead != 0 ? ahead : wheel->occupied[level]);
+    when = (tick & ~(span - 1)) + slot * unit;
+    if (when < tick)
+      when += span;
+    if (when < best)
+      best = when;
+  }
+  return best;
+}
+
+/* Moves the wheel to 'tick', the next moment a non-empty slot is
+   reached. The slots reached are emptied: timers due by 'tick', which
+   are all due exactly then, are pushed onto '*due' and the others are
+   filed again lower down. */
+static void wheel_tick(Timer_wheel *const wheel, unsigned long long tick,
+                       Timer_entry **const due) {
+  Timer_entry *entry = NULL;
+  Timer_entry *next = NULL;
+  unsigned int level;
+  unsigned int slot;
+
+  wheel->now = tick;
+  for (level = QUEUE_TIMER_LEVELS; level-- > 0;) {
+    if ((tick & ((1ull << (QUEUE_TIMER_SLOT_BITS * level)) - 1)) != 0)
+      continue;
+    slot = (unsigned int) (tick >> (QUEUE_TIMER_SLOT_BITS * level))
+      & SLOT_MASK;
+    entry = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ull << slot);
+
+    while (entry != NULL) {
+      next = entry->next;
+      wheel->pending--;
+      if (entry->deliver_at <= tick) {
+        entry->next = *due;
+        *due = entry;
+      } else {
+        wheel_insert(wheel, entry);
+      }
+      entry = next;
+    }
+  }
+}
+
+/* Offers the held timers and then those in 'due' to 'ready' with one
+   en_queue_batch. Timers turned down stay held. Returns the number of
+   elements promoted. */
+static unsigned int promote(Queue_prio_timed *const queue, Timer_entry *due) {
+  Timer_entry *small_entries[PROMOTE_ON_STACK];
+  const char *small_items[PROMOTE_ON_STACK];
+  unsigned int small_priorities[PROMOTE_ON_STACK];
+  unsigned char small_rejected[PROMOTE_ON_STACK];
+  const char **items = small_items;
+  unsigned int *priorities = small_priorities;
+  unsigned char *rejected = small_rejected;
+  Timer_entry **entries = small_entries;
+  Timer_entry *entry = NULL;
+  Timer_entry *next = NULL;
+  unsigned int count = queue->held_count;
+  unsigned int promoted;
+  unsigned int i = 0;
+
+  /* Due timers are offered after the held ones, which are older. */
+  for (entry = due; entry != NULL; entry = entry->next)
+    count++;
+  if (count == 0)
+    return 0;
+
+  /* The few timers of a typical tick fit on the stack. */
+  if (count > PROMOTE_ON_STACK) {
+    entries = malloc(count * (sizeof(Timer_entry *) + sizeof(char *)
+                              + sizeof(unsigned int) + 1));
+    if (entries == NULL) {
+      /* Keep everything held and try again on the next advance. */
+      while (due != NULL) {
+        next = due->next;
+        due->next = queue->held;
+        queue->held = due;
+        queue->held_count++;
+        due = next;
+      }
+      return 0;
+    }
+    items = (const char **) (entries + count);
+    priorities = (unsigned int *) (items + count);
+    rejected = (unsigned char *) (priorities + count);
+  }
+
+  /* 'due' runs from the latest delivery time back to the earliest, so
+     it is laid out from the end. */
+  for (entry = queue->held; entry != NULL; entry = entry->next)
+    entries[i++] = entry;
+  for (entry = due, i = count; entry != NULL; entry = entry->next)
+    entries[--i] = entry;
+  for (i = 0; i < count; i++) {
+    items[i] = entries[i]->data;
+    priorities[i] = entries[i]->priority;
+  }
+
+  promoted = en_queue_batch(&queue->ready, items, priorities, count,
+                            rejected);
+
+  /* Rebuild the held chain in the same order from what was turned
+     down. */
+  queue->held = NULL;
+  queue->held_count = 0;
+  for (i = count; i-- > 0;) {
+    if (rejected[i]) {
+      entries[i]->next = queue->held;
+      queue->held = entries[i];
+      queue->held_count++;
+    } else {
+      timer_release(queue, entries[i]);
+    }
+  }
+  if (entries != small_entries)
+    free(entries);
+  return promoted;
+}
+
+/* This function returns the current time in milliseconds on the
+   monotonic clock, the clock delivery times are given on. */
+unsigned long long queue_time_ms(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000ull
+    + (unsigned long long) now.tv_nsec / 1000000ull;
+}
+
+/* This function initializes an empty timed queue. 'options' configure
+   the queue of due elements, as for init_queue_with_options, and may
+   be NULL. It returns 1 on success and 0 if queue is NULL or the
+   options are invalid. */
+unsigned short init_queue_timed(Queue_prio_timed *const queue,
+                                const Queue_options *const options) {
+  if (queue == NULL)
+    return 0;
+  memset(queue, 0, sizeof(Queue_prio_timed));
+  if (!init_queue_with_options(&queue->ready, options))
+    return 0;
+  queue->wheel.now = queue_time_ms();
+  return 1;
+}
+
+/* This function enqueues a copy of 'new_element' with 'priority', to
+   be delivered at 'deliver_at' (see queue_time_ms). An element whose
+   time has already come is enqueued at once, like en_queue, and is
+   turned down if its priority is taken. A later one waits in the wheel
+   and, if its priority is taken when it falls due, is held back until
+   the priority is free. It returns 1 on success and 0 if an argument
+   is NULL, the element is turned down or memory runs out. */
+unsigned short en_queue_at(Queue_prio_timed *const queue,
+                           const char new_element[], unsigned int priority,
+                           unsigned long long deliver_at) {
+  Timer_entry *entry = NULL;
+  size_t length;
+
+  if (queue == NULL || new_element == NULL)
+    return 0;
+  if (deliver_at <= queue->wheel.now)
+    return en_queue(&queue->ready, new_element, priority);
+
+  length = strlen(new_element);
+  entry = timer_alloc(queue);
+  if (entry == NULL)
+    return 0;
+  if (length < QUEUE_TIMER_INLINE) {
+    entry->data = entry->small;
+  } else {
+    entry->data = malloc(length + 1);
+    if (entry->data == NULL) {
+      entry->data = entry->small;
+      timer_release(queue, entry);
+      return 0;
+    }
+  }
+  memcpy(entry->data, new_element, length + 1);
+  entry->length = (unsigned int) length;
+  entry->priority = priority;
+  entry->deliver_at = deliver_at;
+  wheel_insert(&queue->wheel, entry);
+  return 1;
+}
+
+/* This function moves the wheel on to 'now' and promotes every element
+   due by then, together with any held back earlier, into the ready
+   queue in one batch. The wheel never moves back: an earlier 'now'
+   only retries the held elements. peek_timed and de_queue_timed call
+   it with queue_time_ms(); calling it directly lets the caller drive
+   the wheel from a clock of its own. It returns the number of elements
+   promoted. */
+unsigned int advance_queue_timed(Queue_prio_timed *const queue,
+                                 unsigned long long now) {
+  Timer_entry *due = NULL;
+  unsigned long long tick;
+
+  if (queue == NULL)
+    return 0;
+
+  while (queue->wheel.pending > 0) {
+    tick = next_event(&queue->wheel);
+    if (tick > now)
+      break;
+    wheel_tick(&queue->wheel, tick, &due);
+  }
+  if (now > queue->wheel.now)
+    queue->wheel.now = now;
+  return promote(queue, due);
+}
+
+/* This function returns a copy of the highest-priority element that
+   is due, or NULL if the queue is NULL, nothing is due or memory runs
+   out. */
+char *peek_timed(Queue_prio_timed *const queue) {
+  if (queue == NULL)
+    return NULL;
+  advance_queue_timed(queue, queue_time_ms());
+  return peek(&queue->ready);
+}
+
+/* This function dequeues the highest-priority element that is due and
+   returns it; the caller frees it. It returns NULL if the queue is
+   NULL or nothing is due. */
+char *de_queue_timed(Queue_prio_timed *const queue) {
+  if (queue == NULL)
+    return NULL;
+  advance_queue_timed(queue, queue_time_ms());
+  return de_queue(&queue->ready);
+}
+
+/* This function dequeues the highest-priority element that is due into
+   a buffer supplied by the caller, with the same return values as
+   de_queue_into. */
+long de_queue_into_timed(Queue_prio_timed *const queue, char buffer[],
+                         size_t buffer_size) {
+  if (queue == NULL)
+    return -1;
+  advance_queue_timed(queue, queue_time_ms());
+  return de_queue_into(&queue->ready, buffer, buffer_size);
+}
+
+/* This function returns the number of elements that are due and
+   waiting in the ready queue, as of the last advance. */
+int size_timed(const Queue_prio_timed *const queue) {
+  return queue->ready.size;
+}
+
+/* This function returns the number of elements not yet in the ready
+   queue: those waiting for their time and those held back. */
+unsigned int pending_timed(const Queue_prio_timed *const queue) {
+  return queue->wheel.pending + queue->held_count;
+}
+
+/* This function frees every element, due or not, leaving an empty
+   queue that can be used again. It returns 1 on success and 0 if
+   queue is NULL. */
+unsigned short clear_queue_prio_timed(Queue_prio_timed *const queue) {
+  Timer_block *block = NULL;
+  Timer_block *next = NULL;
+  unsigned int level;
+  unsigned int slot;
+
+  if (queue == NULL)
+    return 0;
+
+  for (level = 0; level < QUEUE_TIMER_LEVELS; level++)
+    for (slot = 0; slot < QUEUE_TIMER_SLOTS; slot++)
+      release_data(queue->wheel.slots[level][slot]);
+  release_data(queue->held);
+  for (block = queue->blocks; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+
+  clear_queue_prio(&queue->ready);
+  memset(queue->wheel.slots, 0, sizeof(queue->wheel.slots));
+  memset(queue->wheel.occupied, 0, sizeof(queue->wheel.occupied));
+  queue->wheel.pending = 0;
+  queue->held = NULL;
+  queue->held_count = 0;
+  queue->free_entries = NULL;
+  queue->blocks = NULL;
+  queue->next_block = 0;
+  return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef QUEUE_PRIO_TIMED_H
+#define QUEUE_PRIO_TIMED_H
+
+#include "queue-prio-timed-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long long queue_time_ms(void);
+unsigned short init_queue_timed(Queue_prio_timed *const queue,
+                                const Queue_options *const options);
+unsigned short en_queue_at(Queue_prio_timed *const queue,
+                           const char new_element[], unsigned int priority,
+                           unsigned long long deliver_at);
+unsigned int advance_queue_timed(Queue_prio_timed *const queue,
+                                 unsigned long long now);
+char *peek_timed(Queue_prio_timed *const queue);
+char *de_queue_timed(Queue_prio_timed *const queue);
+long de_queue_into_timed(Queue_prio_timed *const queue, char buffer[],
+                         size_t buffer_size);
+int size_timed(const Queue_prio_timed *const queue);
+unsigned int pending_timed(const Queue_prio_timed *const queue);
+unsigned short clear_queue_prio_timed(Queue_prio_timed *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+#include "queue-prio-engine.h"
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*This file implements the blocking used by de_queue_wait_concurrent
+  and de_queue_any. A waiter sleeps on a 32-bit word for as long as it
+  holds the value it last saw, and a producer changes the word and
+  wakes a given number of sleepers. On Linux this is a futex, so a
+  sleeping consumer costs nothing and a wakeup is one system call that
+  reaches exactly the threads asked for. Elsewhere the waiter polls the
+  word every millisecond.*/
+
+#define POLL_NS 1000000L
+
+/*
+ * Sets '*deadline' to 'timeout_ms' milliseconds from now on the
+ * monotonic clock.
+ */
+void wait_deadline(long timeout_ms, struct timespec *const deadline) {
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += timeout_ms / 1000;
+  deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Checks whether the monotonic clock has reached 'deadline'. */
+static short deadline_passed(const struct timespec *const deadline) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > deadline->tv_sec
+    || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/*
+ * Sleeps while '*word' equals 'seen', until woken or until 'deadline'
+ * (NULL for no limit). May also return early for no reason, so callers
+ * check their condition again. Returns 0 if the deadline has passed
+ * and 1 otherwise.
+ */
+short wait_word(atomic_uint *const word, unsigned int seen,
+                const struct timespec *const deadline) {
+#ifdef __linux__
+  if (atomic_load(word) == seen
+      && syscall(SYS_futex, (unsigned int *) word,
+                 FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, seen, deadline,
+                 NULL, FUTEX_BITSET_MATCH_ANY) == -1
+      && errno == ETIMEDOUT)
+    return 0;
+#else
+  struct timespec pause = {0, POLL_NS};
+
+  if (atomic_load(word) == seen)
+    nanosleep(&pause, NULL);
+#endif
+  return deadline == NULL || !deadline_passed(deadline);
+}
+
+/*
+ * Wakes up to 'count' threads sleeping on 'word'. The caller changes
+ * the word first.
+ */
+void wake_word(atomic_uint *const word, int count) {
+#ifdef __linux__
+  syscall(SYS_futex, (unsigned int *) word, FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+          count, NULL, NULL, 0);
+#else
+  (void) word;
+  (void) count;
+#endif
+}
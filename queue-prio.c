@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "queue-prio.h"
+#include "queue-prio-engine.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -18,94 +19,994 @@
   highest-priority element without dequeuing it, providing a "peek" 
   functionality.Dequeuing elements removes the highest-priority element from 
   the queue and updates the size accordingly. Moreover, users can retrieve the 
-  names of all elements in the queue as an array of strings.*/
+  names of all elements in the queue as an array of strings.
+
+  The nodes themselves are stored by an engine chosen when the queue is
+  initialized (see queue-prio-engine.h). The list engine below is the
+  original sorted linked list; the heap engine lives in
+  queue-prio-heap.c, the bucket engine in queue-prio-bucket.c and the
+  columns engine in queue-prio-columns.c.*/
+
+
+/* Returns the engine operations a queue was initialized with. */
+static const Queue_engine_ops *engine_ops(const Queue_prio *const queue_prio) {
+  if (queue_prio->engine == QUEUE_ENGINE_HEAP)
+    return &heap_engine_ops;
+  if (queue_prio->engine == QUEUE_ENGINE_BUCKET)
+    return &bucket_engine_ops;
+  if (queue_prio->engine == QUEUE_ENGINE_COLUMNS)
+    return &columns_engine_ops;
+  return &list_engine_ops;
+}
+
+/* Returns the bytes an element whose name is 'length' characters long
+   counts against the limits of its queue. */
+static size_t element_bytes(size_t length) {
+  return sizeof(Node) + (length < QUEUE_INLINE_DATA ? 0 : length + 1);
+}
+
+/* Fills a fresh node with a copy of 'element' and counts it against
+   the queue's limits. Short names are kept inside the node; longer
+   ones are copied into the string arena. Returns 0 if memory runs
+   out. */
+static unsigned short node_fill(Queue_prio *const queue_prio,
+                                Node *const node, const char element[],
+                                unsigned int priority) {
+  size_t length = strlen(element);
+
+  if (length < QUEUE_INLINE_DATA) {
+    node->data = node->small;
+  } else {
+    node->data = arena_alloc_string(queue_prio, length + 1);
+    if (node->data == NULL)
+      return 0;
+  }
+  memcpy(node->data, element, length + 1);
+  node->priority = priority;
+  node->hash = hash_name(element);
+  node->length = (unsigned int) length;
+  node->next = NULL;
+  node->slot = 0;
+  queue_prio->bytes += element_bytes(length);
+  if (queue_prio->budget != NULL)
+    queue_prio->budget->used += element_bytes(length);
+  return 1;
+}
+
+/* Allocates a node holding a copy of 'element' from the queue's node
+   pool. Returns NULL if memory runs out. */
+static Node *node_create(Queue_prio *const queue_prio, const char element[],
+                         unsigned int priority) {
+  Node *node = NULL;
+
+  node = pool_alloc_node(queue_prio);
+  if (node == NULL)
+    return NULL;
+  if (!node_fill(queue_prio, node, element, priority)) {
+    pool_free_node(queue_prio, node);
+    return NULL;
+  }
+  return node;
+}
+
+/* Gives back a node's out-of-line data, if it has any, stops counting
+   it against the queue's limits and turns down the handles to it. */
+static void node_release_data(Queue_prio *const queue_prio,
+                              Node *const node) {
+  size_t bytes = element_bytes(node->length);
+
+  node->generation++;
+  if (node->data != node->small)
+    arena_free_string(queue_prio, node->data, node->length + 1);
+  queue_prio->bytes -= bytes;
+  if (queue_prio->budget != NULL)
+    queue_prio->budget->used -= bytes;
+}
+
+/* Returns a node and any out-of-line data to the queue's pool and
+   arena. */
+static void node_destroy(Queue_prio *const queue_prio, Node *const node) {
+  node_release_data(queue_prio, node);
+  pool_free_node(queue_prio, node);
+}
+
+/* Returns a malloc'd copy of a node's data, or NULL if memory runs
+   out. */
+static char *node_copy_data(const Node *const node) {
+  char *name = malloc(node->length + 1);
+
+  if (name != NULL)
+    memcpy(name, node->data, node->length + 1);
+  return name;
+}
+
+/* Checks whether a node holds 'element', whose length and hash the
+   caller has already worked out. */
+static int node_matches(const Node *const node, const char element[],
+                        size_t length, unsigned int hash) {
+  return node->hash == hash && node->length == length
+    && memcmp(node->data, element, length) == 0;
+}
+
+/* Returns the node holding 'priority', using the priority or ordered
+   index when the queue keeps one. The bucket engine looks a priority
+   up faster than either. */
+static Node *find_priority(const Queue_prio *const queue_prio,
+                           unsigned int priority) {
+  if (queue_prio->engine == QUEUE_ENGINE_BUCKET)
+    return bucket_engine_ops.find_priority(queue_prio, priority);
+  if (queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+    return index_find_priority(&queue_prio->priority_index, priority);
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER)
+    return order_find(&queue_prio->order_index, priority);
+  return engine_ops(queue_prio)->find_priority(queue_prio, priority);
+}
+
+/* Drops a node from the hash indexes the queue keeps. */
+static void forget_hashed(Queue_prio *const queue_prio,
+                          const Node *const node) {
+  if (queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+    index_remove(&queue_prio->priority_index, node);
+  if (queue_prio->indexes & QUEUE_INDEX_NAME)
+    index_remove(&queue_prio->name_index, node);
+}
+
+/* Drops a node from the indexes the queue keeps. */
+static void forget_node(Queue_prio *const queue_prio, const Node *const node) {
+  forget_hashed(queue_prio, node);
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER)
+    order_remove(queue_prio, node);
+}
+
+/* Records a node in the indexes the queue keeps. Returns 1 on
+   success; on failure, which includes the ordered index already
+   holding the priority, the indexes are left as they were. */
+static unsigned short index_node(Queue_prio *const queue_prio,
+                                 Node *const node) {
+  if ((queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+      && !index_insert(&queue_prio->priority_index, node))
+    return 0;
+  if ((queue_prio->indexes & QUEUE_INDEX_NAME)
+      && !index_insert(&queue_prio->name_index, node)) {
+    if (queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+      index_remove(&queue_prio->priority_index, node);
+    return 0;
+  }
+  if ((queue_prio->indexes & QUEUE_INDEX_ORDER)
+      && !order_insert(queue_prio, node)) {
+    forget_hashed(queue_prio, node);
+    return 0;
+  }
+  return 1;
+}
+
+/* Records a node in the indexes the queue keeps and lets the engine
+   place it. Returns 1 on success; on failure the queue is left as it
+   was. */
+static unsigned short place_node(Queue_prio *const queue_prio,
+                                 Node *const node) {
+  if (!index_node(queue_prio, node))
+    return 0;
+  if (!engine_ops(queue_prio)->insert(queue_prio, node)) {
+    forget_node(queue_prio, node);
+    return 0;
+  }
+  return 1;
+}
+
+/* Takes a node out of the engine and the indexes. */
+static void take_node(Queue_prio *const queue_prio, Node *const node) {
+  engine_ops(queue_prio)->unlink(queue_prio, node);
+  forget_node(queue_prio, node);
+}
+
+/* Tells the queue's observer and owner, if it has them, about a
+   change. 'node' is the element concerned, or NULL. */
+static void notify(Queue_prio *const queue_prio, Queue_event_type type,
+                   const Node *const node, unsigned int low,
+                   unsigned int high) {
+  Queue_event event;
+
+  if (queue_prio->observer.notify == NULL && queue_prio->owner.notify == NULL)
+    return;
+  event.type = type;
+  event.element = node != NULL ? node->data : NULL;
+  event.length = node != NULL ? node->length : 0;
+  event.priority = node != NULL ? (unsigned int) node->priority : low;
+  event.high = high;
+  /* A moved element comes with its old priority in 'low'. */
+  event.previous = type == QUEUE_EVENT_CHANGE_PRIORITY ? low
+    : event.priority;
+  if (queue_prio->observer.notify != NULL)
+    queue_prio->observer.notify(queue_prio, &event,
+                                queue_prio->observer.context);
+  if (queue_prio->owner.notify != NULL)
+    queue_prio->owner.notify(queue_prio, &event, queue_prio->owner.context);
+}
+
+/* Fills in a handle to a node of the queue. */
+static void make_handle(const Queue_prio *const queue_prio, Node *const node,
+                        Queue_handle *const handle) {
+  handle->queue = queue_prio;
+  handle->node = node;
+  handle->generation = node->generation;
+  handle->epoch = queue_prio->epoch;
+}
+
+/* Returns the node a handle names, or NULL if the handle is for
+   another queue or its element has left. The epoch is checked first,
+   because after a clear the node's memory may be gone. */
+static Node *handle_node(const Queue_prio *const queue_prio,
+                         const Queue_handle *const handle) {
+  if (queue_prio == NULL || handle == NULL || handle->queue != queue_prio
+      || handle->node == NULL || handle->epoch != queue_prio->epoch
+      || handle->node->generation != handle->generation)
+    return NULL;
+  return handle->node;
+}
+
+/* Checks whether a queue has limits or shares a budget that has one. */
+static unsigned short bounded(const Queue_prio *const queue_prio) {
+  return queue_prio->limits.capacity > 0 || queue_prio->limits.byte_budget > 0
+    || (queue_prio->budget != NULL && queue_prio->budget->limit > 0);
+}
+
+/* Checks whether an element costing 'bytes' fits in the queue's own
+   limits. */
+static unsigned short fits_limits(const Queue_prio *const queue_prio,
+                                  size_t bytes) {
+  return (queue_prio->limits.capacity == 0
+          || (unsigned int) queue_prio->size < queue_prio->limits.capacity)
+    && (queue_prio->limits.byte_budget == 0
+        || queue_prio->bytes + bytes <= queue_prio->limits.byte_budget);
+}
+
+/* Checks whether an element costing 'bytes' fits in the budget the
+   queue shares, if it shares one. */
+static unsigned short fits_budget(const Queue_prio *const queue_prio,
+                                  size_t bytes) {
+  return queue_prio->budget == NULL || queue_prio->budget->limit == 0
+    || queue_prio->budget->used + bytes <= queue_prio->budget->limit;
+}
+
+/* Returns the lowest-priority node, from the engine if it can reach
+   it directly and otherwise from the ordered index, or NULL. */
+static Node *lowest_node(const Queue_prio *const queue_prio) {
+  const Queue_engine_ops *ops = engine_ops(queue_prio);
+
+  if (ops->bottom != NULL)
+    return ops->bottom(queue_prio);
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER)
+    return order_lowest(&queue_prio->order_index);
+  return NULL;
+}
+
+/* Makes room for an element with 'priority' costing 'bytes'. Under
+   QUEUE_FULL_EVICT_LOWEST the lowest elements are evicted one at a
+   time until it fits, as long as they are lower than the new one;
+   nothing is evicted if even an empty queue would leave no room for
+   it, or for a priority beyond a bucket engine queue's range. Returns
+   1 if the element fits. */
+static unsigned short make_room(Queue_prio *const queue_prio,
+                                unsigned int priority, size_t bytes) {
+  Node *lowest = NULL;
+
+  if (fits_limits(queue_prio, bytes) && fits_budget(queue_prio, bytes))
+    return 1;
+  if (queue_prio->limits.policy != QUEUE_FULL_EVICT_LOWEST
+      || (queue_prio->engine == QUEUE_ENGINE_BUCKET
+          && priority > queue_prio->buckets.max_priority)
+      || (queue_prio->limits.byte_budget > 0
+          && bytes > queue_prio->limits.byte_budget)
+      || (queue_prio->budget != NULL && queue_prio->budget->limit > 0
+          && queue_prio->budget->used - queue_prio->bytes + bytes
+             > queue_prio->budget->limit))
+    return 0;
+
+  while (!fits_limits(queue_prio, bytes) || !fits_budget(queue_prio, bytes)) {
+    lowest = lowest_node(queue_prio);
+    if (lowest == NULL || (unsigned int) lowest->priority >= priority)
+      return 0;
+    take_node(queue_prio, lowest);
+    notify(queue_prio, QUEUE_EVENT_EVICT, lowest, 0, 0);
+    node_destroy(queue_prio, lowest);
+    STATS_COUNT(QUEUE_STAT_EVICTED, 1);
+  }
+  return 1;
+}
+
+/* Checks whether 'element' fits in a queue's limits. Returns 1 if it
+   does, 0 if the queue's own limits leave no room for it and -1 if
+   only the budget it shares does not. */
+short queue_room(const Queue_prio *const queue_prio, const char element[]) {
+  size_t bytes = element_bytes(strlen(element));
+
+  if (!fits_limits(queue_prio, bytes))
+    return 0;
+  return fits_budget(queue_prio, bytes) ? 1 : -1;
+}
+
+/* qsort comparator putting higher priorities first. */
+static int compare_descending(const void *a, const void *b) {
+  unsigned int pa = (unsigned int) (*(Node *const *) a)->priority;
+  unsigned int pb = (unsigned int) (*(Node *const *) b)->priority;
+
+  return pa < pb ? 1 : (pa > pb ? -1 : 0);
+}
+
+/* Returns every node of the queue ordered from highest to lowest
+   priority in a newly allocated array, or NULL if the queue is empty
+   or memory runs out. */
+Node **sorted_nodes(const Queue_prio *const queue_prio) {
+  const Queue_engine_ops *ops = engine_ops(queue_prio);
+  unsigned int cursor = 0;
+  unsigned int i = 0;
+  Node **nodes = NULL;
+  Node *curr = NULL;
+
+  if (queue_prio->size <= 0)
+    return NULL;
+  nodes = malloc(sizeof(Node *) * queue_prio->size);
+  if (nodes == NULL)
+    return NULL;
+
+  for (curr = ops->first(queue_prio, &cursor); curr != NULL;
+       curr = ops->next(queue_prio, curr, &cursor))
+    nodes[i++] = curr;
+
+  /* Engines that do not store their nodes in order need a sort. */
+  if (!ops->ordered)
+    qsort(nodes, i, sizeof(Node *), compare_descending);
+  return nodes;
+}
+
+/* The list engine: nodes are chained through 'next' from the highest
+   priority at 'head' to the lowest at 'tail'. */
+
+/* Links a new node in front of the first node with a lower priority.
+   The walk passes the spot where an equal priority would sit, so the
+   duplicate check costs nothing extra. A node below every other one
+   goes straight after the tail. */
+static unsigned short list_insert(Queue_prio *const queue_prio,
+                                  Node *const new_entry) {
+  unsigned int priority = (unsigned int) new_entry->priority;
+  unsigned int steps = 0;
+  Node *curr = queue_prio->head;
+  Node *prev = NULL;
+
+  if (queue_prio->tail != NULL
+      && (unsigned int) queue_prio->tail->priority > priority) {
+    new_entry->next = NULL;
+    queue_prio->tail->next = new_entry;
+    queue_prio->tail = new_entry;
+    queue_prio->size += 1;
+    return 1;
+  }
+
+  /*With an ordered index, start the walk at the node that will
+    precede the new one.*/
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER) {
+    prev = order_above(&queue_prio->order_index, priority);
+    if (prev != NULL)
+      curr = prev->next;
+  }
+
+  /*If the queue is empty or the new element has higher priority, 
+    insert at the head.*/ 
+  if (prev == NULL
+      && (curr == NULL || (unsigned int) curr->priority < priority)) {
+    new_entry->next = curr;
+    queue_prio->head = new_entry;
+  } else {
+    /*Walk past every node with a higher priority and insert the new
+      element after the last of them.*/
+    while (curr != NULL && (unsigned int) curr->priority > priority) {
+      prev = curr;
+      curr = curr->next;
+      steps++;
+    }
+    STATS_COUNT(QUEUE_STAT_INSERT_WALK, steps);
+
+    /*Check if the priority already exists in the queue.*/
+    if (curr != NULL && (unsigned int) curr->priority == priority) {
+      STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+      return 0;
+    }
+
+    if (prev == NULL)
+      queue_prio->head = new_entry;
+    else
+      prev->next = new_entry;
+    new_entry->next = curr;
+  }
+  if (curr == NULL)
+    queue_prio->tail = new_entry;
+  queue_prio->size += 1;
+  return 1;
+}
+
+/* Merges a sorted run into the list in a single walk: the list
+   position only ever moves forward, because the run is sorted the same
+   way as the list. */
+static unsigned int list_insert_sorted(Queue_prio *const queue_prio,
+                                       Node *nodes[], unsigned int count) {
+  unsigned int inserted = 0;
+  unsigned int steps = 0;
+  unsigned int priority;
+  unsigned int i;
+  Node *curr = queue_prio->head;
+  Node *prev = NULL;
+
+  for (i = 0; i < count; i++) {
+    priority = (unsigned int) nodes[i]->priority;
+
+    /* Move past every node with a higher priority. */
+    while (curr != NULL && (unsigned int) curr->priority > priority) {
+      prev = curr;
+      curr = curr->next;
+      steps++;
+    }
+
+    /* Reject a priority the list already holds. */
+    if (curr != NULL && (unsigned int) curr->priority == priority) {
+      nodes[i] = NULL;
+      continue;
+    }
+
+    /* Link the node in; it becomes the predecessor of what follows. */
+    nodes[i]->next = curr;
+    if (prev == NULL)
+      queue_prio->head = nodes[i];
+    else
+      prev->next = nodes[i];
+    if (curr == NULL)
+      queue_prio->tail = nodes[i];
+    prev = nodes[i];
+    inserted++;
+  }
+  STATS_COUNT(QUEUE_STAT_INSERT_WALK, steps);
+  queue_prio->size += (int) inserted;
+  return inserted;
+}
+
+/* Unchains a node, searching for its predecessor, or asking the
+   ordered index for it when the queue keeps one. */
+static void list_unlink(Queue_prio *const queue_prio, Node *const node) {
+  Node *curr = queue_prio->head;
+  Node *prev = NULL;
+
+  if ((queue_prio->indexes & QUEUE_INDEX_ORDER) && curr != node) {
+    prev = order_above(&queue_prio->order_index,
+                       (unsigned int) node->priority);
+    if (prev != NULL)
+      curr = prev->next;
+  }
+
+  while (curr != NULL && curr != node) {
+    prev = curr;
+    curr = curr->next;
+  }
+  if (curr == NULL)
+    return;
+
+  if (prev == NULL)
+    queue_prio->head = curr->next;
+  else
+    prev->next = curr->next;
+  if (curr->next == NULL)
+    queue_prio->tail = prev;
+  queue_prio->size -= 1;
+}
+
+static Node *list_top(const Queue_prio *const queue_prio) {
+  return queue_prio->head;
+}
+
+static Node *list_bottom(const Queue_prio *const queue_prio) {
+  return queue_prio->tail;
+}
+
+static Node *list_find_priority(const Queue_prio *const queue_prio,
+                                unsigned int priority) {
+  Node *curr = queue_prio->head;
+
+  /* The list is sorted, so stop once priorities drop below the one
+     being looked for. */
+  while (curr != NULL && (unsigned int) curr->priority >= priority) {
+    if ((unsigned int) curr->priority == priority)
+      return curr;
+    curr = curr->next;
+  }
+  return NULL;
+}
+
+static Node *list_first(const Queue_prio *const queue_prio,
+                        unsigned int *const cursor) {
+  (void) cursor;
+  return queue_prio->head;
+}
+
+static Node *list_next(const Queue_prio *const queue_prio,
+                       const Node *const node, unsigned int *const cursor) {
+  (void) queue_prio;
+  (void) cursor;
+  return node->next;
+}
+
+/* The list is sorted, so the nodes in range form one run: skip the
+   nodes above it, then cut the run out where priorities drop below
+   'low'. */
+static Node *list_detach_between(Queue_prio *const queue_prio,
+                                 unsigned int low, unsigned int high) {
+  Node *curr = queue_prio->head;
+  Node *prev = NULL;
+  Node *first = NULL;
+  Node *last = NULL;
+  unsigned int count = 0;
+
+  /* Skip every node above the range */
+  while (curr != NULL && (unsigned int) curr->priority > high) {
+    prev = curr;
+    curr = curr->next;
+  }
+
+  /* Find the end of the run of nodes in range */
+  first = curr;
+  while (curr != NULL && (unsigned int) curr->priority >= low) {
+    last = curr;
+    curr = curr->next;
+    count++;
+  }
+  if (count == 0)
+    return NULL;
+
+  /* Remove the run from the queue */
+  if (prev == NULL)
+    queue_prio->head = curr;
+  else
+    prev->next = curr;
+  if (curr == NULL)
+    queue_prio->tail = prev;
+  last->next = NULL;
+  queue_prio->size -= (int) count;
+  return first;
+}
+
+/* The run is already linked in order; splice it out after 'above'. */
+static Node *list_detach_run(Queue_prio *const queue_prio, Node *const above,
+                             Node *const first, Node *const last,
+                             unsigned int count) {
+  if (above == NULL)
+    queue_prio->head = last->next;
+  else
+    above->next = last->next;
+  if (last->next == NULL)
+    queue_prio->tail = above;
+  last->next = NULL;
+  queue_prio->size -= (int) count;
+  return first;
+}
+
+static void list_reset(Queue_prio *const queue_prio) {
+  queue_prio->head = NULL;
+  queue_prio->tail = NULL;
+  queue_prio->size = 0;
+}
+
+const Queue_engine_ops list_engine_ops = {
+  1,
+  list_insert,
+  list_insert_sorted,
+  list_unlink,
+  list_top,
+  list_bottom,
+  list_find_priority,
+  list_first,
+  list_next,
+  list_detach_between,
+  list_detach_run,
+  list_reset,
+  NULL
+};
 
 /* This function initializes a priority queue and sets its initial values.
    It takes a pointer to a 'Queue_prio' structure as an argument. */
 unsigned short init_queue(Queue_prio *const queue_prio) {
+  /* Initialization with no options gives the list engine. */
+  return init_queue_with_options(queue_prio, NULL);
+}
+
+/* This function initializes a list-engine priority queue whose nodes
+   and element strings are obtained through 'allocator'. Strings handed
+   back to the caller (by peek, de_queue and all_element_names) still
+   come from malloc. It returns 1 on success and 0 if queue_prio is
+   NULL or the allocator lacks one of its hooks. */
+unsigned short init_queue_with_allocator(Queue_prio *const queue_prio,
+                                         const Queue_allocator *const allocator) {
+  Queue_options options = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+
+  options.allocator = allocator;
+  return init_queue_with_options(queue_prio, &options);
+}
+
+/* This function initializes a priority queue with the settings in
+   'options', which may be NULL for the defaults. It returns 1 if
+   initialization is successful and 0 if queue_prio is NULL, the
+   options name an unknown engine, a bucket engine range above
+   QUEUE_BUCKET_MAX_PRIORITY or limits with an unknown policy. */
+unsigned short init_queue_with_options(Queue_prio *const queue_prio,
+                                       const Queue_options *const options) {
   /*Declare a variable 'ret' to store the return value.*/
   unsigned short ret = 0;
-  
-  /*Check if the provided parameter is not NULL.*/
-  if (queue_prio != NULL) {
-    
-    /*Set the head to NULL, indicating an empty queue.*/
-    queue_prio -> head = NULL;
-    
-    /*Set the size to 0 since it's initially empty.*/
-    queue_prio -> size = 0;
+  Queue_engine engine = QUEUE_ENGINE_LIST;
+  unsigned int indexes = 0;
+  unsigned int max_priority = QUEUE_BUCKET_DEFAULT_MAX;
+  Queue_limits limits = {0, 0, QUEUE_FULL_REJECT, 0};
+
+  if (options != NULL) {
+    engine = options->engine;
+    indexes = options->indexes
+      & (QUEUE_INDEX_PRIORITY | QUEUE_INDEX_NAME | QUEUE_INDEX_ORDER);
+    if (options->max_priority > 0)
+      max_priority = options->max_priority;
+
+    /*A custom allocator needs both of its hooks.*/
+    if (options->allocator != NULL
+        && (options->allocator->alloc == NULL
+            || options->allocator->free == NULL))
+      return 0;
+
+    if (options->limits != NULL) {
+      if (options->limits->policy != QUEUE_FULL_REJECT
+          && options->limits->policy != QUEUE_FULL_EVICT_LOWEST
+          && options->limits->policy != QUEUE_FULL_BLOCK)
+        return 0;
+      limits = *options->limits;
+    }
+  }
+
+  /*The heap engine relies on the priority index for duplicate checks.*/
+  if (engine == QUEUE_ENGINE_HEAP)
+    indexes |= QUEUE_INDEX_PRIORITY;
+
+  /*The bucket engine finds priorities itself, so a priority index
+    would only duplicate its buckets.*/
+  if (engine == QUEUE_ENGINE_BUCKET) {
+    indexes &= ~QUEUE_INDEX_PRIORITY;
+    if (max_priority > QUEUE_BUCKET_MAX_PRIORITY)
+      return 0;
+  }
+
+  /*A queue that evicts has to find and unlink its lowest element
+    cheaply. The heap engine can only find it through the ordered
+    index, and the list engine, which reaches its tail directly, needs
+    the index to find the node before it.*/
+  if (limits.policy == QUEUE_FULL_EVICT_LOWEST
+      && (engine == QUEUE_ENGINE_LIST || engine == QUEUE_ENGINE_HEAP))
+    indexes |= QUEUE_INDEX_ORDER;
+
+  /*Check if the provided parameter is not NULL and the engine exists.*/
+  if (queue_prio != NULL
+      && (engine == QUEUE_ENGINE_LIST || engine == QUEUE_ENGINE_HEAP
+          || engine == QUEUE_ENGINE_BUCKET
+          || engine == QUEUE_ENGINE_COLUMNS)) {
+
+    /*Start from an all-empty queue, indicating no elements and no
+      engine storage.*/
+    memset(queue_prio, 0, sizeof(Queue_prio));
+    queue_prio->engine = engine;
+    queue_prio->indexes = indexes;
+    queue_prio->name_index.by_name = 1;
+    if (engine == QUEUE_ENGINE_BUCKET)
+      queue_prio->buckets.max_priority = max_priority;
+    if (options != NULL && options->allocator != NULL)
+      queue_prio->allocator = *options->allocator;
+    queue_prio->limits = limits;
 
     /*Update the return value to 1 to indicate successful initialization.*/
     ret = 1;
   }
 
   /* Return the value of ret, which will be 1 if initialization is 
-     successful, or 0 if queue_prio is NULL and initialization fails.*/
+     successful, or 0 if it fails.*/
   return ret;
 }
 
 /* This function enqueue new element with a specified priority in the 
    priority queue.It returns 1 if the operation is successful, 0 if 
    the element cannot be enqueued, and handles NULL for queue_prio 
-   and new_element appropriately.*/
+   and new_element appropriately. When a bounded queue is full (see
+   Queue_limits) the element is turned down, or under
+   QUEUE_FULL_EVICT_LOWEST takes the place of the lowest elements if
+   they are lower than it; if they run out first the element is turned
+   down and the ones evicted stay evicted.*/
 unsigned short en_queue(Queue_prio *const queue_prio, 
-			const char new_element[], unsigned int priority) { 
-  Node *curr = NULL;
-  Node *prev = NULL;
+                        const char new_element[], unsigned int priority) { 
+  return en_queue_h(queue_prio, new_element, priority, NULL);
+}
+
+/* This function enqueues like en_queue and, when it succeeds and
+   'handle' is not NULL, sets 'handle' to name the new element for
+   get_priority_h, change_priority_h and remove_h.*/
+unsigned short en_queue_h(Queue_prio *const queue_prio,
+                          const char new_element[], unsigned int priority,
+                          Queue_handle *const handle) {
   Node *new_entry = NULL;
+  unsigned short ret = 0;
+  STATS_START(start);
+
   /*Check if queue_prio and new_element pointers are not NULL.*/ 
-  if (queue_prio != NULL && new_element != NULL) { 
-    curr = queue_prio->head; 
-	     
-    /*Create a new entry for the element and allocate memory for its data.*/ 
-    new_entry = malloc(sizeof(Node)); 
-    new_entry->data = malloc(strlen(new_element) + 1); 
-    strcpy(new_entry->data, new_element); 
-    new_entry->priority = priority;
-    new_entry -> next = NULL;
-	 
-    /*Check if the priority already exists in the queue, return 0 if found.*/ 
-    while (curr != NULL) { 
-      if (curr->priority == priority) 
-	return 0; 
-      curr = curr->next; 
-    } 
-	 
-    curr = queue_prio->head; 
-    prev = NULL; 
-	 
-    /*If the queue is empty or the new element has higher priority, 
-      insert at the head.*/ 
-    if (curr == NULL || curr->priority < priority) { 
-      new_entry->next = curr; 
-      queue_prio->head = new_entry; 
-      queue_prio->size += 1; 
-      return 1; 
-    } else { 
-	       
-      /*Insert the new element in appropriate position based on priority.*/ 
-      while (curr != NULL) { 
-	if (prev != NULL && prev->priority > priority && 
-	    curr->priority < priority) { 
-	  prev->next = new_entry; 
-	  new_entry->next = curr; 
-	  queue_prio->size += 1; 
-	  return 1; 
-	} 
-	prev = curr; 
-	curr = curr->next; 
-      } 
-	       
-      /*If the new element has the lowest priority, insert it at the end.*/ 
-      prev->next = new_entry; 
-      queue_prio->size += 1;
-      return 1; 
-    
-    } 
-  }
-  return 0; 
+  if (queue_prio == NULL || new_element == NULL)
+    return 0;
+
+  /*Check if the priority already exists in the queue, and turn the
+    element down if so. Without an index on priorities the engine does
+    this check while looking for the insert position; the bucket
+    engine answers it with a bit test. A queue that may evict checks
+    first, so that a duplicate never costs an eviction. Then a bounded
+    queue has to make room for the element.*/ 
+  if ((queue_prio->engine == QUEUE_ENGINE_BUCKET
+       || queue_prio->limits.policy == QUEUE_FULL_EVICT_LOWEST
+       || (queue_prio->indexes & (QUEUE_INDEX_PRIORITY | QUEUE_INDEX_ORDER)))
+      && find_priority(queue_prio, priority) != NULL) {
+    STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+  } else if (bounded(queue_prio)
+             && !make_room(queue_prio, priority,
+                           element_bytes(strlen(new_element)))) {
+    STATS_COUNT(QUEUE_STAT_FULL, 1);
+  } else {
+    /*Create a new entry for the element and let the engine place it.*/ 
+    new_entry = node_create(queue_prio, new_element, priority);
+    if (new_entry != NULL && place_node(queue_prio, new_entry)) {
+      if (handle != NULL)
+        make_handle(queue_prio, new_entry, handle);
+      notify(queue_prio, QUEUE_EVENT_EN_QUEUE, new_entry, 0, 0);
+      STATS_COUNT(QUEUE_STAT_EN_QUEUED, 1);
+      STATS_DEPTH(queue_prio->size);
+      ret = 1;
+    } else if (new_entry != NULL) {
+      node_destroy(queue_prio, new_entry);
+    }
+  }
+  STATS_END(QUEUE_FUNCTION_EN_QUEUE, start);
+  return ret;
 } 
 
+/* This function enqueues 'count' elements in one call. items[i] is
+   enqueued with priorities[i]. The batch is sorted once and merged into
+   the queue in a single pass, instead of one queue walk per element.
+   An item is rejected if its priority is already in the queue, if an
+   earlier item of the batch has the same priority, if it is NULL or if
+   memory runs out. If 'rejected' is not NULL, rejected[i] is set to 1
+   for every rejected item and to 0 for every enqueued one. A bounded
+   queue takes the items one at a time with en_queue, so that each is
+   checked against its limits, and a later item may evict an earlier
+   one. It returns the number of elements enqueued.*/
+unsigned int en_queue_batch(Queue_prio *const queue_prio,
+                            const char *const items[],
+                            const unsigned int priorities[],
+                            unsigned int count, unsigned char rejected[]) {
+  const Queue_engine_ops *ops = NULL;
+  Batch_entry *entries = NULL;
+  Node **nodes = NULL;
+  Node **created = NULL;
+  unsigned int inserted = 0;
+  unsigned int kept = 0;
+  unsigned int position;
+  unsigned int previous = 0;
+  unsigned int i;
+  unsigned short seen = 0;
+  unsigned short in_order = 1;
+  Node *node = NULL;
+  STATS_START(start);
+
+  /*Start with every item marked as rejected.*/
+  if (rejected != NULL)
+    memset(rejected, 1, count);
+  if (queue_prio == NULL || items == NULL || priorities == NULL || count == 0)
+    return 0;
+  ops = engine_ops(queue_prio);
+
+  if (bounded(queue_prio)) {
+    for (i = 0; i < count; i++) {
+      if (en_queue(queue_prio, items[i], priorities[i])) {
+        if (rejected != NULL)
+          rejected[i] = 0;
+        inserted++;
+      }
+    }
+    STATS_END(QUEUE_FUNCTION_EN_QUEUE_BATCH, start);
+    return inserted;
+  }
+
+  entries = malloc(count * sizeof(Batch_entry));
+  nodes = malloc(2 * count * sizeof(Node *));
+  if (entries == NULL || nodes == NULL) {
+    free(entries);
+    free(nodes);
+    STATS_END(QUEUE_FUNCTION_EN_QUEUE_BATCH, start);
+    return 0;
+  }
+  created = nodes + count;
+
+  /*Sort the batch from highest to lowest priority. An engine that
+    does not keep its nodes in order and a priority index that catches
+    duplicates inside the batch make the sort unnecessary, and so does
+    a batch that already comes in strictly descending order.*/
+  for (i = 0; i < count; i++) {
+    entries[i].priority = priorities[i];
+    entries[i].position = i;
+    if (i > 0 && priorities[i] >= priorities[i - 1])
+      in_order = 0;
+  }
+  if (!in_order
+      && (ops->ordered || !(queue_prio->indexes & QUEUE_INDEX_PRIORITY)))
+    sort_batch(entries, count);
+
+  /*Size the hash indexes for the whole batch up front. If that fails
+    they still grow one step at a time.*/
+  if (queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+    index_reserve(&queue_prio->priority_index, count);
+  if (queue_prio->indexes & QUEUE_INDEX_NAME)
+    index_reserve(&queue_prio->name_index, count);
+
+  /*Create nodes for every item that survives the cheap checks. The
+    survivors are packed at the front of 'entries' as we go.*/
+  for (i = 0; i < count; i++) {
+    position = entries[i].position;
+    if (items[position] == NULL)
+      continue;
+    if (seen && entries[i].priority == previous) {
+      STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+      continue;
+    }
+    seen = 1;
+    previous = entries[i].priority;
+    if ((queue_prio->engine == QUEUE_ENGINE_BUCKET
+         || (queue_prio->indexes & (QUEUE_INDEX_PRIORITY | QUEUE_INDEX_ORDER)))
+        && find_priority(queue_prio, entries[i].priority) != NULL) {
+      STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+      continue;
+    }
+
+    node = node_create(queue_prio, items[position], entries[i].priority);
+    if (node == NULL)
+      continue;
+    if (!index_node(queue_prio, node)) {
+      node_destroy(queue_prio, node);
+      continue;
+    }
+    entries[kept].position = position;
+    nodes[kept] = node;
+    created[kept] = node;
+    kept++;
+  }
+
+  /*Merge the sorted run into the queue in one pass.*/
+  if (kept > 0)
+    inserted = ops->insert_sorted(queue_prio, nodes, kept);
+
+  /*Release the nodes the engine turned down and report the rest.*/
+  for (i = 0; i < kept; i++) {
+    if (nodes[i] == NULL) {
+      forget_node(queue_prio, created[i]);
+      node_destroy(queue_prio, created[i]);
+    } else {
+      notify(queue_prio, QUEUE_EVENT_EN_QUEUE, nodes[i], 0, 0);
+      if (rejected != NULL)
+        rejected[entries[i].position] = 0;
+    }
+  }
+
+  free(entries);
+  free(nodes);
+  STATS_COUNT(QUEUE_STAT_EN_QUEUED, inserted);
+  STATS_DEPTH(queue_prio->size);
+  STATS_END(QUEUE_FUNCTION_EN_QUEUE_BATCH, start);
+  return inserted;
+}
+
+/* This function fills an empty queue with 'count' elements in one
+   call: names[i] is enqueued with priorities[i]. The input is sorted
+   once, on several threads when it is large, duplicate priorities are
+   found in the same pass over the sorted order (the item that comes
+   first in the arrays wins), and every node is taken from one block,
+   laid out from highest to lowest priority. Items with a NULL name or
+   a duplicate priority are left out. If the queue already holds
+   elements or is bounded this is en_queue_batch. It returns the number
+   of elements enqueued, or 0 if memory runs out. */
+unsigned int build_queue_from_arrays(Queue_prio *const queue_prio,
+                                     const char *const names[],
+                                     const unsigned int priorities[],
+                                     unsigned int count) {
+  Batch_entry *entries = NULL;
+  Node **nodes = NULL;
+  Node *run = NULL;
+  Node *node = NULL;
+  unsigned int inserted = 0;
+  unsigned int kept = 0;
+  unsigned int position;
+  unsigned int previous = 0;
+  unsigned int i;
+  unsigned short seen = 0;
+  STATS_START(start);
+
+  if (queue_prio == NULL || names == NULL || priorities == NULL || count == 0)
+    return 0;
+  if (queue_prio->size > 0 || bounded(queue_prio))
+    return en_queue_batch(queue_prio, names, priorities, count, NULL);
+
+  entries = malloc(count * sizeof(Batch_entry));
+  nodes = malloc(count * sizeof(Node *));
+  if (entries != NULL && nodes != NULL)
+    run = pool_alloc_run(queue_prio, count);
+  if (run == NULL) {
+    free(entries);
+    free(nodes);
+    STATS_END(QUEUE_FUNCTION_BUILD_QUEUE, start);
+    return 0;
+  }
+
+  for (i = 0; i < count; i++) {
+    entries[i].priority = priorities[i];
+    entries[i].position = i;
+  }
+  sort_batch(entries, count);
+
+  if (queue_prio->indexes & QUEUE_INDEX_PRIORITY)
+    index_reserve(&queue_prio->priority_index, count);
+  if (queue_prio->indexes & QUEUE_INDEX_NAME)
+    index_reserve(&queue_prio->name_index, count);
+
+  /*The queue is empty, so a priority can only clash with the one
+    sorted just before it. Node i of the run holds the i-th element
+    kept.*/
+  for (i = 0; i < count; i++) {
+    position = entries[i].position;
+    if (names[position] == NULL)
+      continue;
+    if (seen && entries[i].priority == previous) {
+      STATS_COUNT(QUEUE_STAT_REJECTED, 1);
+      continue;
+    }
+    seen = 1;
+    previous = entries[i].priority;
+
+    node = run + kept;
+    if (!node_fill(queue_prio, node, names[position], entries[i].priority))
+      continue;
+    if (!index_node(queue_prio, node)) {
+      node_release_data(queue_prio, node);
+      continue;
+    }
+    nodes[kept++] = node;
+  }
+
+  if (kept > 0)
+    inserted = engine_ops(queue_prio)->insert_sorted(queue_prio, nodes, kept);
+
+  /*Report the nodes placed and return the rest of the run to the
+    pool.*/
+  for (i = 0; i < count; i++) {
+    if (i < kept && nodes[i] != NULL) {
+      notify(queue_prio, QUEUE_EVENT_EN_QUEUE, nodes[i], 0, 0);
+    } else {
+      if (i < kept) {
+        forget_node(queue_prio, run + i);
+        node_release_data(queue_prio, run + i);
+      }
+      pool_free_node(queue_prio, run + i);
+    }
+  }
+
+  free(entries);
+  free(nodes);
+  STATS_COUNT(QUEUE_STAT_EN_QUEUED, inserted);
+  STATS_DEPTH(queue_prio->size);
+  STATS_END(QUEUE_FUNCTION_BUILD_QUEUE, start);
+  return inserted;
+}
+
 /* This function checks if a given priority queue has no elements. 
    It returns -1 if the queue pointer is NULL, 1 if the queue is empty, 
    and 0 if the queue contains elements. */
@@ -113,7 +1014,7 @@ short has_no_elements(const Queue_prio *const queue_prio) {
   short ret = 0;
   if (queue_prio == NULL)
     ret = -1;
-  if (queue_prio -> head == NULL)
+  else if (queue_prio -> size == 0)
     ret = 1;
   return ret;
 }
@@ -123,43 +1024,146 @@ short size(const Queue_prio *const queue_prio) {
   return queue_prio -> size;
 }
 
+/* This function returns the bytes the elements of the queue count
+   against its limits (see Queue_limits), or 0 if the queue pointer is
+   NULL.*/
+size_t queue_bytes(const Queue_prio *const queue_prio) {
+  return queue_prio != NULL ? queue_prio->bytes : 0;
+}
+
 /* This function retrieves a copy of the data from the head 
    of the priority queue and returns it as a dynamically 
    allocated string. It returns NULL if the queue pointer is 
    NULL or if there's no data in the queue.*/
 char *peek(const Queue_prio *const queue_prio) {
   char *name = NULL;
+  Node *top = NULL;
+  STATS_START(start);
   /*Check if the queue pointer is NULL.*/
-  if (queue_prio != NULL){
+  if (queue_prio != NULL)
+    top = engine_ops(queue_prio)->top(queue_prio);
+  if (top != NULL){
     /*Allocate memory for a copy of the data and copy it to name.*/
-    name = malloc(strlen(queue_prio->head->data) + 1);
-    strcpy(name, queue_prio->head->data);
+    name = node_copy_data(top);
   }
+  STATS_END(QUEUE_FUNCTION_PEEK, start);
   return name;
 }
 
+/* This function returns the data of the head of the priority queue
+   without copying it, and stores its length in '*length' unless
+   'length' is NULL. The string belongs to the queue and stays valid
+   only until the queue is next modified. It returns NULL if the queue
+   pointer is NULL or the queue is empty.*/
+const char *peek_ref(const Queue_prio *const queue_prio,
+                     size_t *const length) {
+  Node *top = NULL;
+
+  if (queue_prio != NULL)
+    top = engine_ops(queue_prio)->top(queue_prio);
+  if (top == NULL)
+    return NULL;
+  if (length != NULL)
+    *length = top->length;
+  return top->data;
+}
+
+/* This function returns the priority of the head of the priority
+   queue, or -1 if the queue pointer is NULL or the queue is empty.*/
+long long peek_priority(const Queue_prio *const queue_prio) {
+  Node *top = NULL;
+
+  if (queue_prio != NULL)
+    top = engine_ops(queue_prio)->top(queue_prio);
+  if (top == NULL)
+    return -1;
+  return (unsigned int) top->priority;
+}
+
 /* This function dequeues the head element from the prioritys queue, 
    updates the head pointer, and decreases the queue size by 1. 
-   It returns the data of the dequeued element as a string, or NULL 
-   if the queue is empty or the queue pointer is NULL.*/
+   It returns the data of the dequeued element as a string allocated
+   with malloc, or NULL if the queue is empty, the queue pointer is
+   NULL or memory runs out.*/
 char *de_queue(Queue_prio *const queue_prio) {
   Node *temp = NULL;
   char *name = NULL;
+  STATS_START(start);
 
   /*Check if the queue pointer is not NULL and if the queue is not empty.*/
-  if (queue_prio != NULL && queue_prio->head != NULL) {
-    /*Assign the data of the head element to 'name'.*/
-    name = queue_prio->head->data;
-    temp = queue_prio->head;
-    /*Update the head pointer to the next element.*/
-    queue_prio->head = queue_prio->head->next;
-    free(temp);
-    /*Decrease the queue size by 1.*/
-    queue_prio->size -= 1;
+  if (queue_prio != NULL && queue_prio->size > 0) {
+    temp = engine_ops(queue_prio)->top(queue_prio);
+    /*Copy the data of the head element out of the queue's arena.*/
+    name = node_copy_data(temp);
+    /*Take the head element out of the queue; this also decreases the
+      queue size by 1.*/
+    if (name != NULL) {
+      take_node(queue_prio, temp);
+      notify(queue_prio, QUEUE_EVENT_DE_QUEUE, temp, 0, 0);
+      node_destroy(queue_prio, temp);
+      STATS_COUNT(QUEUE_STAT_DE_QUEUED, 1);
+    }
   }
+  STATS_END(QUEUE_FUNCTION_DE_QUEUE, start);
   return name;
 }
 
+/* This function dequeues the head element into a buffer supplied by
+   the caller, so no memory is allocated. Like snprintf, it returns the
+   length of the element's data; the element is copied, terminated and
+   dequeued only if that length is less than 'buffer_size', and left in
+   the queue otherwise so the caller can retry with a larger buffer.
+   It returns -1 if the queue pointer is NULL or the queue is empty.*/
+long de_queue_into(Queue_prio *const queue_prio, char buffer[],
+                   size_t buffer_size) {
+  Node *temp = NULL;
+  long length = 0;
+
+  if (queue_prio == NULL || queue_prio->size == 0)
+    return -1;
+
+  temp = engine_ops(queue_prio)->top(queue_prio);
+  length = (long) temp->length;
+  if (buffer != NULL && temp->length < buffer_size) {
+    memcpy(buffer, temp->data, temp->length + 1);
+    take_node(queue_prio, temp);
+    notify(queue_prio, QUEUE_EVENT_DE_QUEUE, temp, 0, 0);
+    node_destroy(queue_prio, temp);
+    STATS_COUNT(QUEUE_STAT_DE_QUEUED, 1);
+  }
+  return length;
+}
+
+/* This function dequeues up to 'k' of the highest-priority elements in
+   one call, storing them in out[0..] from highest to lowest priority as
+   strings allocated with malloc. It returns the number of elements
+   dequeued, which is less than 'k' if the queue runs out (or memory
+   does).*/
+unsigned int de_queue_batch(Queue_prio *const queue_prio, char *out[],
+                            unsigned int k) {
+  const Queue_engine_ops *ops = NULL;
+  unsigned int count = 0;
+  Node *top = NULL;
+  STATS_START(start);
+
+  if (queue_prio == NULL || out == NULL)
+    return 0;
+  ops = engine_ops(queue_prio);
+
+  while (count < k && (top = ops->top(queue_prio)) != NULL) {
+    out[count] = node_copy_data(top);
+    if (out[count] == NULL)
+      break;
+    take_node(queue_prio, top);
+    notify(queue_prio, QUEUE_EVENT_DE_QUEUE, top, 0, 0);
+    node_destroy(queue_prio, top);
+    count++;
+  }
+  STATS_COUNT(QUEUE_STAT_DE_QUEUED, count);
+  STATS_END(QUEUE_FUNCTION_DE_QUEUE_BATCH, start);
+  return count;
+}
+
 /* This function retrieves the names of all elements in the priority queue
    and returns them as an array of strings. The array is dynamically 
    allocated. It also returns NULL if the queue is empty or the queue 
@@ -168,20 +1172,27 @@ char **all_element_names(const Queue_prio *const queue_prio) {
 
   /*Get the current size of the queue.*/
   int count = 0;
-  Node *curr = NULL;
+  Node **nodes = NULL;
   char **names = NULL;
   int i;
 
+  if (queue_prio == NULL)
+    return NULL;
+
   count = queue_prio->size;
-  curr = queue_prio->head;
-  names = malloc(sizeof(queue_prio) * (count + 1));
+  nodes = sorted_nodes(queue_prio);
+  names = malloc(sizeof(char *) * (count + 1));
+  if (names == NULL || (count > 0 && nodes == NULL)) {
+    free(nodes);
+    free(names);
+    return NULL;
+  }
 
   /*Iterate through the queue and copy the names into the names array.*/
   for (i = 0; i < count; i++) {
-    names[i] = malloc(strlen(curr -> data)+1);
-    strcpy(names[i], curr -> data);
-    curr = curr -> next;
+    names[i] = node_copy_data(nodes[i]);
   }
+  free(nodes);
   
   /*Set the last element of the name array to NULL to indicate the end.*/
   names[count] = NULL;
@@ -217,37 +1228,29 @@ unsigned short free_name_list(char *name_list[]) {
 
 /* 
  * Clears the memory used by a priority queue.
- * Frees the memory of all nodes in the queue and resets the size to 0.
+ * Releases the slabs and chunks holding its nodes and strings, which
+ * costs one free per slab rather than one per element, and resets the
+ * size to 0.
  * Returns 1 if the operation is successful, 0 otherwise.
  */
 unsigned short clear_queue_prio(Queue_prio *const queue_prio) {
   unsigned short ret = 0;
-  Node *curr = NULL;
-  Node *prev = NULL;
 
   /* Check if the queue_prio is not NULL */
   if (queue_prio != NULL) {
-    /* Set the current node to the head of the queue */
-    curr = queue_prio -> head;
-
-    /* Loop through each node in the queue */
-    while (curr != NULL) {
-      /* Free the memory of the data (string) in the node, if it exists */
-      if (curr -> data != NULL)
-	free(curr -> data);
-
-      /* Save the current node */
-      prev = curr;
+    /* Let the engine drop its storage and reset the size to 0 */
+    engine_ops(queue_prio)->reset(queue_prio);
+    index_free(&queue_prio->priority_index);
+    index_free(&queue_prio->name_index);
+    order_reset(&queue_prio->order_index);
 
-      /* Move to the next node */
-      curr = curr -> next;
-
-      /* Free the memory of the current node */
-      free(prev);
-    }
-
-    /* Reset the size of the queue to 0 */
-    queue_prio -> size = 0;
+    /* Release every node and string in bulk */
+    storage_release(queue_prio);
+    queue_prio->epoch++;
+    if (queue_prio->budget != NULL)
+      queue_prio->budget->used -= queue_prio->bytes;
+    queue_prio->bytes = 0;
+    notify(queue_prio, QUEUE_EVENT_CLEAR, NULL, 0, 0);
 
     /* Set the return value to 1 (success) */
     ret = 1;
@@ -261,25 +1264,52 @@ unsigned short clear_queue_prio(Queue_prio *const queue_prio) {
  * Returns -1 if the element is not found or if the priority queue is NULL.
  */
 int get_priority(const Queue_prio *const queue_prio, const char element[]) {
+  const Queue_engine_ops *ops = NULL;
   int ret = -1;
+  unsigned int cursor = 0;
+  unsigned int hash = 0;
+  size_t length = 0;
   Node *curr = NULL;
 
   /* Check if the queue_prio and element are not NULL */
-  if (queue_prio != NULL && element != NULL) {
-    /* Set the current node to the head of the queue */
-    curr = queue_prio -> head;
+  if (queue_prio == NULL || element == NULL)
+    return ret;
+  hash = hash_name(element);
+  length = strlen(element);
 
-    /* Loop through each node in the queue */
-    while (curr != NULL) {
-      /* Check if the data (string) in the current node matches the specified element */
-      if (strcmp(curr -> data, element) == 0) {
-	/* Update the highest priority if the current priority is greater */
-	if (curr->priority > ret)
-	  ret = curr -> priority;
-      }
+  /* With a name index only the nodes holding the element are visited */
+  if (queue_prio->indexes & QUEUE_INDEX_NAME) {
+    for (curr = index_first_name(&queue_prio->name_index, element, hash,
+                                 &cursor);
+         curr != NULL;
+         curr = index_next_name(&queue_prio->name_index, element, hash,
+                                &cursor))
+      if (curr->priority > ret)
+        ret = curr->priority;
+    return ret;
+  }
+  ops = engine_ops(queue_prio);
+
+  /* An engine that can scan its name hashes visits the nodes from the
+     highest priority down, so the first node that matches is the
+     answer */
+  if (ops->find_hash != NULL) {
+    for (curr = ops->find_hash(queue_prio, hash, &cursor); curr != NULL;
+         curr = ops->find_hash(queue_prio, hash, &cursor))
+      if (node_matches(curr, element, length, hash))
+        return curr->priority;
+    return ret;
+  }
 
-      /* Move to the next node */
-      curr = curr -> next;
+  /* Loop through each node in the queue */
+  for (curr = ops->first(queue_prio, &cursor); curr != NULL;
+       curr = ops->next(queue_prio, curr, &cursor)) {
+    /* Check if the data (string) in the current node matches the
+       specified element; the cached hash and length settle most nodes */
+    if (node_matches(curr, element, length, hash)) {
+      /* Update the highest priority if the current priority is greater */
+      if (curr->priority > ret)
+        ret = curr -> priority;
     }
   }
 
@@ -294,56 +1324,145 @@ int get_priority(const Queue_prio *const queue_prio, const char element[]) {
 unsigned int remove_elements_between(Queue_prio *const queue_prio,
                                      unsigned int low, unsigned int high) {
   unsigned int count = 0;
+  Node *above = NULL;
+  Node *first = NULL;
+  Node *last = NULL;
   Node *curr;
-  Node *prev;
   Node *test;
+  STATS_START(start);
 
   /* Check if the queue_prio is NULL */
   if (queue_prio == NULL)
     return 0;
 
-  /* Set the current node to the head of the queue */
-  curr = queue_prio -> head;
-
-  /* Initialize the previous node to NULL */
-  prev = NULL;
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER) {
+    /* The ordered index finds the run of nodes in range and drops it
+       in one pass; the engine then cuts the same run out */
+    count = order_detach_range(queue_prio, low, high, &above, &first, &last);
+    if (count == 0) {
+      STATS_END(QUEUE_FUNCTION_REMOVE_ELEMENTS_BETWEEN, start);
+      return 0;
+    }
+    curr = engine_ops(queue_prio)->detach_run(queue_prio, above, first, last,
+                                             count);
+  } else {
+    /* Let the engine take every node in range out of the queue */
+    curr = engine_ops(queue_prio)->detach_between(queue_prio, low, high);
+  }
 
-  /* Loop through each node in the queue */
+  /* Drop each removed node from the hash indexes and release any
+     out-of-line data, which also stops counting it against the
+     queue's limits */
+  count = 0;
+  first = curr;
   while (curr != NULL) {
-    /* Check if the priority of the current node is within the 
-       specified range */
-    if (curr -> priority >= low && curr -> priority <= high) {
-      /* Remove the current node from the queue */
-      if (prev == NULL)
-	queue_prio -> head = curr -> next;
-      else
-	prev -> next = curr -> next;
+    test = curr;
+    forget_hashed(queue_prio, test);
+    node_release_data(queue_prio, test);
+    curr = curr -> next;
+    count++;
+    last = test;
+  }
 
-      /* Save the current node for later memory deallocation */
-      test = curr;
+  /* Give the nodes back to the pool in one step */
+  if (first != NULL)
+    pool_free_chain(queue_prio, first, last);
 
-      /* Move to the next node */
-      curr = curr -> next;
+  if (count > 0)
+    notify(queue_prio, QUEUE_EVENT_REMOVE_BETWEEN, NULL, low, high);
+  STATS_END(QUEUE_FUNCTION_REMOVE_ELEMENTS_BETWEEN, start);
+  return count;
+}
 
-      /* Free the memory of the data (string) in the current node */
-      free(test -> data);
+/* 
+ * Returns the number of elements whose priority is greater than or
+ * equal to 'low' and less than or equal to 'high'. With an ordered
+ * index this costs O(log n + k) for k matches.
+ */
+unsigned int count_between(const Queue_prio *const queue_prio,
+                           unsigned int low, unsigned int high) {
+  const Queue_engine_ops *ops = NULL;
+  const Order_entry *entry = NULL;
+  unsigned int cursor = 0;
+  unsigned int count = 0;
+  Node *curr = NULL;
 
-      /* Free the memory of the current node */
-      free(test);
+  if (queue_prio == NULL || low > high)
+    return 0;
 
-      /* Update the size of the queue */
-      queue_prio -> size--;
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER) {
+    for (entry = order_seek(&queue_prio->order_index, high);
+         entry != NULL && entry->priority >= low; entry = entry->forward[0])
+      count++;
+    return count;
+  }
 
-      /* Increment the count of removed elements */
+  ops = engine_ops(queue_prio);
+  for (curr = ops->first(queue_prio, &cursor); curr != NULL;
+       curr = ops->next(queue_prio, curr, &cursor)) {
+    /* An ordered engine has passed the range once it drops below it */
+    if (ops->ordered && (unsigned int) curr->priority < low)
+      break;
+    if ((unsigned int) curr->priority >= low
+        && (unsigned int) curr->priority <= high)
       count++;
-    } else {
-      /* Move to the next node */
-      prev = curr;
-      curr = curr -> next;
+  }
+  return count;
+}
+
+/* 
+ * Returns the names of the elements whose priority is greater than or
+ * equal to 'low' and less than or equal to 'high', from highest to
+ * lowest priority, as a NULL-terminated array to be released with
+ * free_name_list. Returns NULL if the queue pointer is NULL or memory
+ * runs out. With an ordered index this costs O(log n + k) for k
+ * matches.
+ */
+char **elements_between(const Queue_prio *const queue_prio,
+                        unsigned int low, unsigned int high) {
+  const Queue_engine_ops *ops = NULL;
+  const Order_entry *entry = NULL;
+  unsigned int count = 0;
+  unsigned int cursor = 0;
+  unsigned int i = 0;
+  Node **nodes = NULL;
+  char **names = NULL;
+  Node *curr = NULL;
+
+  if (queue_prio == NULL)
+    return NULL;
+  count = count_between(queue_prio, low, high);
+  names = malloc(sizeof(char *) * (count + 1));
+  if (names == NULL)
+    return NULL;
+
+  if (queue_prio->indexes & QUEUE_INDEX_ORDER) {
+    /* The index already visits the range in order */
+    for (entry = order_seek(&queue_prio->order_index, high);
+         i < count; entry = entry->forward[0])
+      names[i++] = node_copy_data(entry->node);
+  } else if (count > 0) {
+    /* Collect the matching nodes and put them in order */
+    nodes = malloc(sizeof(Node *) * count);
+    if (nodes == NULL) {
+      free(names);
+      return NULL;
     }
+    ops = engine_ops(queue_prio);
+    for (curr = ops->first(queue_prio, &cursor); curr != NULL && i < count;
+         curr = ops->next(queue_prio, curr, &cursor))
+      if ((unsigned int) curr->priority >= low
+          && (unsigned int) curr->priority <= high)
+        nodes[i++] = curr;
+    if (!ops->ordered)
+      qsort(nodes, count, sizeof(Node *), compare_descending);
+    for (i = 0; i < count; i++)
+      names[i] = node_copy_data(nodes[i]);
+    free(nodes);
   }
 
-  return count;
+  names[count] = NULL;
+  return names;
 }
 
 /* 
@@ -352,78 +1471,216 @@ unsigned int remove_elements_between(Queue_prio *const queue_prio,
  */
 unsigned int change_priority(Queue_prio *const queue_prio,
                              const char element[], unsigned int new_priority) {
+  const Queue_engine_ops *ops = NULL;
   int element_test = 0;
-  int priority_test = 0;
+  unsigned int cursor = 0;
+  unsigned int hash = 0;
+  size_t length = 0;
   Node *curr = NULL;
-  Node *prev = NULL;
+  Node *match = NULL;
+  unsigned int old_priority;
+  STATS_START(start);
 
   /* Check if the queue_prio or element is NULL */
   if (queue_prio == NULL || element == NULL) {
     return 0;
   }
+  ops = engine_ops(queue_prio);
+  hash = hash_name(element);
+  length = strlen(element);
 
-  /* Set the current node to the head of the queue */
-  curr = queue_prio->head;
-
-  /* Loop through each node in the queue */
-  while (curr != NULL) {
-    /* Check if the data (string) in the current node matches 
-       the specified element */
-    if (strcmp(curr -> data, element) == 0)
-      element_test++;
+  /* Check if the new priority is already taken, or out of a bucket
+     engine queue's range */
+  if (find_priority(queue_prio, new_priority) != NULL
+      || (queue_prio->engine == QUEUE_ENGINE_BUCKET
+          && new_priority > queue_prio->buckets.max_priority)) {
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY, start);
+    return 0;
+  }
 
-    /* Check if the priority of the current node matches the 
-       specified new_priority */
-    if (curr -> priority == new_priority)
-      priority_test++;
+  if (queue_prio->indexes & QUEUE_INDEX_NAME) {
+    /* Look the element up in the name index; a second hit is enough
+       to know it is not unique */
+    match = index_first_name(&queue_prio->name_index, element, hash,
+                             &cursor);
+    if (match != NULL)
+      element_test = 1;
+    if (match != NULL && index_next_name(&queue_prio->name_index, element,
+                                         hash, &cursor) != NULL)
+      element_test = 2;
+  } else if (ops->find_hash != NULL) {
+    /* Scan the engine's name hashes, stopping at a second match */
+    for (curr = ops->find_hash(queue_prio, hash, &cursor);
+         curr != NULL && element_test < 2;
+         curr = ops->find_hash(queue_prio, hash, &cursor)) {
+      if (node_matches(curr, element, length, hash)) {
+        element_test++;
+        match = curr;
+      }
+    }
+  } else {
+    /* Loop through each node in the queue */
+    for (curr = ops->first(queue_prio, &cursor); curr != NULL;
+         curr = ops->next(queue_prio, curr, &cursor)) {
+      /* Check if the data (string) in the current node matches 
+         the specified element */
+      if (node_matches(curr, element, length, hash)) {
+        element_test++;
+        match = curr;
+      }
+    }
+  }
 
-    /* Move to the next node */
-    curr = curr -> next;
+  /* The element has to be present exactly once */
+  if (element_test != 1) {
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY, start);
+    return 0;
   }
 
-  /* Check conditions for changing priority */
-  if (element_test != 1 || priority_test > 0) {
+  /* Take the node out, give it the new priority and place it again.
+     The node and its data are reused, so nothing is reallocated. */
+  old_priority = (unsigned int) match -> priority;
+  take_node(queue_prio, match);
+  match -> priority = new_priority;
+  if (!place_node(queue_prio, match)) {
+    /* Put it back where it was, as change_priority_h does; if even
+       that fails the element is lost, and reported as removed. */
+    match -> priority = old_priority;
+    if (!place_node(queue_prio, match)) {
+      node_destroy(queue_prio, match);
+      notify(queue_prio, QUEUE_EVENT_REMOVE_BETWEEN, NULL, old_priority,
+             old_priority);
+    }
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY, start);
     return 0;
   }
+  notify(queue_prio, QUEUE_EVENT_CHANGE_PRIORITY, match, old_priority, 0);
 
-  /* Reset the current node to the head of the queue */
-  curr = queue_prio->head;
+  /* Return 1 to indicate success */
+  STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY, start);
+  return 1;
+}
 
-  /* Initialize the previous node to NULL */
-  prev = NULL;
+/* 
+ * Sets 'handle' to name the element holding 'priority', for elements
+ * enqueued without en_queue_h. It finds the element as en_queue finds
+ * a duplicate priority.
+ * Returns 1 if there is such an element, 0 otherwise or if an argument
+ * is NULL.
+ */
+unsigned short get_handle(const Queue_prio *const queue_prio,
+                          unsigned int priority, Queue_handle *const handle) {
+  Node *node = NULL;
 
-  /* Loop through each node in the queue */
-  while (curr != NULL) {
-    /* Check if the data (string) in the current node matches 
-       the specified element */
-    if (strcmp(curr -> data, element) == 0) {
-      /* Remove the current node from the queue */
-      if (prev != NULL)
-	prev -> next = curr->next;
-      else
-	queue_prio -> head = curr -> next;
+  if (queue_prio == NULL || handle == NULL)
+    return 0;
+  node = find_priority(queue_prio, priority);
+  if (node == NULL)
+    return 0;
+  make_handle(queue_prio, node, handle);
+  return 1;
+}
 
-      /* Free the memory of the data (string) in the current node */
-      free(curr -> data);
+/* 
+ * Returns the priority of the element 'handle' names, or -1 if it has
+ * left the queue or an argument is NULL. O(1) on every engine.
+ */
+long long get_priority_h(const Queue_prio *const queue_prio,
+                         const Queue_handle *const handle) {
+  Node *node = handle_node(queue_prio, handle);
 
-      /* Free the memory of the current node */
-      free(curr);
+  return node != NULL ? (long long) (unsigned int) node->priority : -1;
+}
 
-      /* Update the size of the queue */
-      queue_prio -> size--;
+/* 
+ * Gives the element 'handle' names the priority 'new_priority',
+ * without comparing a single name: the node is taken out and placed
+ * again as it is, so nothing is reallocated and the handle stays good.
+ * On the heap engine this costs O(log n), on the bucket engine O(1),
+ * and on the list engine O(log n) with QUEUE_INDEX_ORDER (O(n)
+ * without, to find the node before it). The columns engine finds the
+ * entry by binary search and moves the entries in between.
+ * Returns 1 if the operation is successful, and 0 if the handle is
+ * turned down, the new priority is taken by another element or out of
+ * a bucket engine queue's range, or memory runs out, in which case the
+ * element keeps its priority.
+ */
+unsigned short change_priority_h(Queue_prio *const queue_prio,
+                                 const Queue_handle *const handle,
+                                 unsigned int new_priority) {
+  Node *node = handle_node(queue_prio, handle);
+  unsigned int old_priority;
+  STATS_START(start);
 
-      /* Add the element back to the queue with the new priority */
-      en_queue(queue_prio, element, new_priority);
+  if (node == NULL)
+    return 0;
+  old_priority = (unsigned int) node->priority;
+  if (new_priority == old_priority) {
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY_H, start);
+    return 1;
+  }
+  if (find_priority(queue_prio, new_priority) != NULL
+      || (queue_prio->engine == QUEUE_ENGINE_BUCKET
+          && new_priority > queue_prio->buckets.max_priority)) {
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY_H, start);
+    return 0;
+  }
 
-      /* Return 1 to indicate success */
-      return 1;
+  take_node(queue_prio, node);
+  node->priority = new_priority;
+  if (!place_node(queue_prio, node)) {
+    /* Put it back where it was; if even that fails the element is
+       lost, and reported as removed. */
+    node->priority = old_priority;
+    if (!place_node(queue_prio, node)) {
+      node_destroy(queue_prio, node);
+      notify(queue_prio, QUEUE_EVENT_REMOVE_BETWEEN, NULL, old_priority,
+             old_priority);
     }
-
-    /* Move to the next node */
-    prev = curr;
-    curr = curr -> next;
+    STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY_H, start);
+    return 0;
   }
+  notify(queue_prio, QUEUE_EVENT_CHANGE_PRIORITY, node, old_priority, 0);
+  STATS_END(QUEUE_FUNCTION_CHANGE_PRIORITY_H, start);
+  return 1;
+}
 
-  /* Return 0 to indicate failure (element not found) */
-  return 0;
+/* 
+ * Removes the element 'handle' names, at the cost of taking its node
+ * out as change_priority_h does. Observers see the removal of its one
+ * priority, as from remove_elements_between.
+ * Returns 1 if the operation is successful, 0 if the handle is turned
+ * down.
+ */
+unsigned short remove_h(Queue_prio *const queue_prio,
+                        const Queue_handle *const handle) {
+  Node *node = handle_node(queue_prio, handle);
+  unsigned int priority;
+  STATS_START(start);
+
+  if (node == NULL)
+    return 0;
+  priority = (unsigned int) node->priority;
+  take_node(queue_prio, node);
+  node_destroy(queue_prio, node);
+  notify(queue_prio, QUEUE_EVENT_REMOVE_BETWEEN, NULL, priority, priority);
+  STATS_END(QUEUE_FUNCTION_REMOVE_H, start);
+  return 1;
+}
+
+/* 
+ * Sets the observer told about every later change to the queue, or
+ * removes it if 'observer' is NULL. Reinitializing the queue removes
+ * it too.
+ * Returns 1 if the operation is successful, 0 if queue_prio is NULL.
+ */
+unsigned short set_queue_observer(Queue_prio *const queue_prio,
+                                  const Queue_observer *const observer) {
+  if (queue_prio == NULL)
+    return 0;
+  if (observer != NULL)
+    queue_prio->observer = *observer;
+  else
+    memset(&queue_prio->observer, 0, sizeof(Queue_observer));
+  return 1;
 }
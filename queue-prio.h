@@ -1,19 +1,78 @@
+#ifndef QUEUE_PRIO_H
+#define QUEUE_PRIO_H
+
 #include "queue-prio-datastructure.h"
 
 #define ARRSIZE(ARR) ((int) (sizeof(ARR) / sizeof((ARR)[0])))
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 unsigned short init_queue(Queue_prio *const queue_prio);
+unsigned short init_queue_with_options(Queue_prio *const queue_prio,
+                                       const Queue_options *const options);
+unsigned short init_queue_with_allocator(Queue_prio *const queue_prio,
+                                         const Queue_allocator *const allocator);
 unsigned short en_queue(Queue_prio *const queue_prio,
                         const char new_element[], unsigned int priority);
+unsigned short en_queue_h(Queue_prio *const queue_prio,
+                          const char new_element[], unsigned int priority,
+                          Queue_handle *const handle);
+unsigned int en_queue_batch(Queue_prio *const queue_prio,
+                            const char *const items[],
+                            const unsigned int priorities[],
+                            unsigned int count, unsigned char rejected[]);
+unsigned int build_queue_from_arrays(Queue_prio *const queue_prio,
+                                     const char *const names[],
+                                     const unsigned int priorities[],
+                                     unsigned int count);
 short has_no_elements(const Queue_prio *const queue_prio);
 short size(const Queue_prio *const queue_prio);
+size_t queue_bytes(const Queue_prio *const queue_prio);
 char *peek(const Queue_prio *const queue_prio);
+const char *peek_ref(const Queue_prio *const queue_prio, size_t *const length);
+long long peek_priority(const Queue_prio *const queue_prio);
 char *de_queue(Queue_prio *const queue_prio);
+unsigned int de_queue_batch(Queue_prio *const queue_prio, char *out[],
+                            unsigned int k);
+long de_queue_into(Queue_prio *const queue_prio, char buffer[],
+                   size_t buffer_size);
 char **all_element_names(const Queue_prio *const queue_prio);
 unsigned short free_name_list(char *name_list[]);
+unsigned short open_cursor(Queue_cursor *const cursor,
+                           const Queue_prio *const queue_prio);
+unsigned short cursor_next(Queue_cursor *const cursor,
+                           Queue_element *const element);
+void close_cursor(Queue_cursor *const cursor);
+unsigned int visit_elements(const Queue_prio *const queue_prio,
+                            unsigned int k, Queue_visitor visitor,
+                            void *context);
 unsigned short clear_queue_prio(Queue_prio *const queue_prio);
 int get_priority(const Queue_prio *const queue_prio, const char element[]);
 unsigned int remove_elements_between(Queue_prio *const queue_prio,
                                      unsigned int low, unsigned int high);
+unsigned int count_between(const Queue_prio *const queue_prio,
+                           unsigned int low, unsigned int high);
+char **elements_between(const Queue_prio *const queue_prio,
+                        unsigned int low, unsigned int high);
 unsigned int change_priority(Queue_prio *const queue_prio,
-                             const char element[], unsigned int new_priority)
+                             const char element[], unsigned int new_priority);
+unsigned short get_handle(const Queue_prio *const queue_prio,
+                          unsigned int priority, Queue_handle *const handle);
+long long get_priority_h(const Queue_prio *const queue_prio,
+                         const Queue_handle *const handle);
+unsigned short change_priority_h(Queue_prio *const queue_prio,
+                                 const Queue_handle *const handle,
+                                 unsigned int new_priority);
+unsigned short remove_h(Queue_prio *const queue_prio,
+                        const Queue_handle *const handle);
+unsigned short set_queue_observer(Queue_prio *const queue_prio,
+                                  const Queue_observer *const observer);
+const char *queue_scan_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
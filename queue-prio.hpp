@@ -0,0 +1,686 @@
+#ifndef QUEUE_PRIO_HPP
+#define QUEUE_PRIO_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "queue-prio.h"
+#include "queue-prio-list.h"
+
+/*This file provides PriorityQueue and QueueRegistry, header-only C++
+  wrappers that queue objects of any type T instead of strings. They are
+  built over the same engines as Queue_prio and Queue_prio_list: the
+  engine orders and stores a 5-byte name per element, short enough to
+  sit inside the node, which names the slot holding the T. Slots come
+  from chunks that never move, so emplace constructs each payload once,
+  where it will stay, and pop moves it straight out to the caller; a
+  payload is never copied or serialized. The chunks, and every block
+  the engine allocates for its nodes and indexes, come from the
+  Allocator given to the container.
+
+  Ordering follows en_queue and de_queue: each key is held by at most
+  one element, an element whose key is taken is turned down, and the
+  element that Compare ranks highest leaves first. With the default
+  std::less that is the greatest key, as with std::priority_queue.
+  Keys are integers of at most 32 bits (see key_order), so the engine
+  can order them as priorities.
+
+  Neither container is safer to share between threads than the C
+  structure it wraps; callers that share one use a lock of their own.*/
+
+namespace queuemanager {
+
+/* Maps keys to engine priorities and back, so that the engine's
+   highest priority is the key Compare ranks highest. Specializations
+   exist for std::less and std::greater; others can be added for other
+   comparisons of keys that fit in 32 bits. */
+template <typename Key, typename Compare>
+struct key_order;
+
+namespace detail {
+
+/* Lays out any integer of at most 32 bits on 0 .. highest() in the
+   order of its values. */
+template <typename Key>
+struct key_range {
+  static_assert(std::is_integral<Key>::value
+                && sizeof(Key) <= sizeof(unsigned int),
+                "keys must be integers of at most 32 bits");
+
+  static constexpr unsigned int highest() {
+    return static_cast<unsigned int>(
+      static_cast<long long>(std::numeric_limits<Key>::max())
+      - static_cast<long long>(std::numeric_limits<Key>::min()));
+  }
+
+  static unsigned int lift(Key key) {
+    return static_cast<unsigned int>(
+      static_cast<long long>(key)
+      - static_cast<long long>(std::numeric_limits<Key>::min()));
+  }
+
+  static Key lower(unsigned int priority) {
+    return static_cast<Key>(
+      static_cast<long long>(priority)
+      + static_cast<long long>(std::numeric_limits<Key>::min()));
+  }
+};
+
+} // namespace detail
+
+template <typename Key>
+struct key_order<Key, std::less<Key> > {
+  static unsigned int to_priority(Key key) {
+    return detail::key_range<Key>::lift(key);
+  }
+  static Key from_priority(unsigned int priority) {
+    return detail::key_range<Key>::lower(priority);
+  }
+};
+
+template <typename Key>
+struct key_order<Key, std::greater<Key> > {
+  static unsigned int to_priority(Key key) {
+    return detail::key_range<Key>::highest()
+      - detail::key_range<Key>::lift(key);
+  }
+  static Key from_priority(unsigned int priority) {
+    return detail::key_range<Key>::lower(
+      detail::key_range<Key>::highest() - priority);
+  }
+};
+
+namespace detail {
+
+/* Length of the name that stands for a slot: seven bits of the slot
+   number per byte, with the top bit set so no byte is ever 0. */
+enum { slot_name_length = 5 };
+
+inline void encode_slot(unsigned int slot, char name[]) {
+  int i;
+
+  for (i = 0; i < slot_name_length; i++) {
+    name[i] = static_cast<char>(0x80u | (slot & 0x7fu));
+    slot >>= 7;
+  }
+  name[slot_name_length] = '\0';
+}
+
+inline unsigned int decode_slot(const char name[]) {
+  unsigned int slot = 0;
+  int i;
+
+  for (i = slot_name_length - 1; i >= 0; i--)
+    slot = slot << 7 | (static_cast<unsigned char>(name[i]) & 0x7fu);
+  return slot;
+}
+
+/* Queue_allocator hooks that take the engine's blocks from an
+   Allocator rebound to std::max_align_t. The C hooks do not pass the
+   size back on free, so each block starts with one unit holding its
+   length. An allocator that throws is reported as out of memory, since
+   the exception cannot cross the C code. */
+template <typename Allocator>
+struct engine_memory {
+  typedef typename std::allocator_traits<Allocator>::template
+    rebind_alloc<std::max_align_t> unit_allocator;
+  typedef std::allocator_traits<unit_allocator> unit_traits;
+
+  static void *alloc(std::size_t size, void *context) {
+    unit_allocator &units = *static_cast<unit_allocator *>(context);
+    std::size_t count = (size + sizeof(std::max_align_t) - 1)
+      / sizeof(std::max_align_t) + 1;
+    std::max_align_t *block = NULL;
+
+    try {
+      block = unit_traits::allocate(units, count);
+    } catch (...) {
+      return NULL;
+    }
+    *reinterpret_cast<std::size_t *>(block) = count;
+    return block + 1;
+  }
+
+  static void free(void *block, void *context) {
+    unit_allocator &units = *static_cast<unit_allocator *>(context);
+    std::max_align_t *start = NULL;
+
+    if (block == NULL)
+      return;
+    start = static_cast<std::max_align_t *>(block) - 1;
+    unit_traits::deallocate(units, start,
+                            *reinterpret_cast<std::size_t *>(start));
+  }
+};
+
+/* Payload storage: slots of 'chunk_slots' each, numbered in order, so
+   a slot never moves once made. A free slot holds the number of the
+   next free one instead of a T. */
+template <typename T, typename Allocator>
+class slot_pool {
+public:
+  explicit slot_pool(const Allocator &allocator)
+    : slots_(allocator), chunks_(chunk_allocator(allocator)), free_(no_slot),
+      made_(0) {}
+
+  ~slot_pool() {
+    typename std::vector<slot *, chunk_allocator>::iterator chunk;
+
+    for (chunk = chunks_.begin(); chunk != chunks_.end(); ++chunk)
+      slot_traits::deallocate(slots_, *chunk, chunk_slots);
+  }
+
+  /* Constructs a T in a free slot and returns the slot's number. */
+  template <typename... Args>
+  unsigned int make(Args &&... args) {
+    unsigned int number = reserve();
+
+    try {
+      ::new (static_cast<void *>(&at(number)))
+        T(std::forward<Args>(args)...);
+    } catch (...) {
+      give_back(number);
+      throw;
+    }
+    return number;
+  }
+
+  T &at(unsigned int number) const {
+    return chunks_[number / chunk_slots][number % chunk_slots].value;
+  }
+
+  void destroy(unsigned int number) {
+    at(number).~T();
+    give_back(number);
+  }
+
+private:
+  enum { chunk_slots = 256 };
+  static const unsigned int no_slot = ~0u;
+
+  union slot {
+    T value;
+    unsigned int next;
+    slot() {}
+    ~slot() {}
+  };
+
+  typedef typename std::allocator_traits<Allocator>::template
+    rebind_alloc<slot> slot_allocator;
+  typedef std::allocator_traits<slot_allocator> slot_traits;
+  typedef typename std::allocator_traits<Allocator>::template
+    rebind_alloc<slot *> chunk_allocator;
+
+  slot &cell(unsigned int number) const {
+    return chunks_[number / chunk_slots][number % chunk_slots];
+  }
+
+  unsigned int reserve() {
+    unsigned int number = free_;
+
+    if (number != no_slot) {
+      free_ = cell(number).next;
+      return number;
+    }
+    if (made_ == chunks_.size() * chunk_slots) {
+      slot *chunk = slot_traits::allocate(slots_, chunk_slots);
+
+      try {
+        chunks_.push_back(chunk);
+      } catch (...) {
+        slot_traits::deallocate(slots_, chunk, chunk_slots);
+        throw;
+      }
+    }
+    return made_++;
+  }
+
+  void give_back(unsigned int number) {
+    cell(number).next = free_;
+    free_ = number;
+  }
+
+  slot_allocator slots_;
+  std::vector<slot *, chunk_allocator> chunks_;
+  unsigned int free_;
+  unsigned int made_;
+};
+
+/* Destroys the payload of every element of a queue, leaving the
+   elements themselves to the caller. */
+template <typename Pool>
+void destroy_payloads(Pool &pool, const Queue_prio *queue) {
+  Queue_cursor cursor;
+  Queue_element element;
+
+  if (!open_cursor(&cursor, queue))
+    return;
+  while (cursor_next(&cursor, &element))
+    pool.destroy(decode_slot(element.element));
+  close_cursor(&cursor);
+}
+
+/* Observer that destroys the payloads of evicted elements. */
+template <typename Pool>
+void destroy_evicted(Queue_prio *queue, const Queue_event *event,
+                     void *context) {
+  (void) queue;
+  if (event->type == QUEUE_EVENT_EVICT)
+    static_cast<Pool *>(context)->destroy(decode_slot(event->element));
+}
+
+/* Takes the head of 'queue' out and moves its payload into 'out'.
+   Returns false if the queue is empty. */
+template <typename T, typename Pool>
+bool pop_payload(Pool &pool, Queue_prio *queue, T &out) {
+  char name[slot_name_length + 1];
+  unsigned int number;
+
+  if (de_queue_into(queue, name, sizeof(name)) != slot_name_length)
+    return false;
+  number = decode_slot(name);
+  out = std::move(pool.at(number));
+  pool.destroy(number);
+  return true;
+}
+
+/* The part of a container that must not move: the engine's structures
+   point at it. It is allocated through the container's Allocator. */
+template <typename Structure, typename T, typename Allocator>
+struct core {
+  typedef engine_memory<Allocator> memory_type;
+
+  explicit core(const Allocator &allocator)
+    : structure(), units(allocator), payloads(allocator) {
+    hooks.alloc = &memory_type::alloc;
+    hooks.free = &memory_type::free;
+    hooks.context = &units;
+    evictions.notify = &destroy_evicted<slot_pool<T, Allocator> >;
+    evictions.context = &payloads;
+  }
+
+  Structure structure;
+  typename memory_type::unit_allocator units;
+  slot_pool<T, Allocator> payloads;
+  Queue_allocator hooks;
+  Queue_observer evictions;
+};
+
+template <typename Core, typename Allocator>
+Core *make_core(const Allocator &allocator) {
+  typedef typename std::allocator_traits<Allocator>::template
+    rebind_alloc<Core> core_allocator;
+  typedef std::allocator_traits<core_allocator> core_traits;
+  core_allocator cores(allocator);
+  Core *made = core_traits::allocate(cores, 1);
+
+  try {
+    ::new (static_cast<void *>(made)) Core(allocator);
+  } catch (...) {
+    core_traits::deallocate(cores, made, 1);
+    throw;
+  }
+  return made;
+}
+
+template <typename Core, typename Allocator>
+void drop_core(Core *made, const Allocator &allocator) {
+  typedef typename std::allocator_traits<Allocator>::template
+    rebind_alloc<Core> core_allocator;
+  core_allocator cores(allocator);
+
+  made->~Core();
+  std::allocator_traits<core_allocator>::deallocate(cores, made, 1);
+}
+
+} // namespace detail
+
+/* A priority queue of T keyed by Key (see the top of the file). It
+   can be moved but not copied; a moved-from queue may only be assigned
+   to or destroyed. */
+template <typename T, typename Key = unsigned int,
+          typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<T> >
+class PriorityQueue {
+public:
+  typedef T value_type;
+  typedef Key key_type;
+  typedef Compare key_compare;
+  typedef Allocator allocator_type;
+  typedef std::size_t size_type;
+
+  explicit PriorityQueue(const Allocator &allocator = Allocator())
+    : allocator_(allocator), core_(NULL) {
+    start(NULL);
+  }
+
+  /* Takes the engine, indexes, bucket range and limits from 'options';
+     its allocator is ignored in favour of 'allocator'. With the bucket
+     engine, max_priority bounds the engine priorities of key_order.
+     Throws std::bad_alloc if the queue cannot be set up. */
+  explicit PriorityQueue(const Queue_options &options,
+                         const Allocator &allocator = Allocator())
+    : allocator_(allocator), core_(NULL) {
+    start(&options);
+  }
+
+  PriorityQueue(PriorityQueue &&other)
+    : allocator_(std::move(other.allocator_)), core_(other.core_) {
+    other.core_ = NULL;
+  }
+
+  PriorityQueue &operator=(PriorityQueue &&other) {
+    if (this != &other) {
+      release();
+      allocator_ = std::move(other.allocator_);
+      core_ = other.core_;
+      other.core_ = NULL;
+    }
+    return *this;
+  }
+
+  PriorityQueue(const PriorityQueue &) = delete;
+  PriorityQueue &operator=(const PriorityQueue &) = delete;
+
+  ~PriorityQueue() { release(); }
+
+  /* Constructs a T from 'args' and enqueues it under 'key'. Returns
+     false, with nothing left behind, when the key is taken or a
+     bounded queue has no room for it, as en_queue does; an element
+     a bounded queue evicts is destroyed. */
+  template <typename... Args>
+  bool emplace(Key key, Args &&... args) {
+    char name[detail::slot_name_length + 1];
+    unsigned int number = core_->payloads.make(std::forward<Args>(args)...);
+
+    detail::encode_slot(number, name);
+    if (!en_queue(&core_->structure, name, order::to_priority(key))) {
+      core_->payloads.destroy(number);
+      return false;
+    }
+    return true;
+  }
+
+  bool push(Key key, const T &value) { return emplace(key, value); }
+  bool push(Key key, T &&value) { return emplace(key, std::move(value)); }
+
+  /* The element that leaves next, and its key. The queue must not be
+     empty. */
+  T &top() const {
+    return core_->payloads.at(
+      detail::decode_slot(peek_ref(&core_->structure, NULL)));
+  }
+
+  Key top_key() const {
+    return order::from_priority(
+      static_cast<unsigned int>(peek_priority(&core_->structure)));
+  }
+
+  /* Dequeues the top element and moves it out. The queue must not be
+     empty. */
+  T pop() {
+    char name[detail::slot_name_length + 1];
+    unsigned int number;
+
+    de_queue_into(&core_->structure, name, sizeof(name));
+    number = detail::decode_slot(name);
+    T value(std::move(core_->payloads.at(number)));
+    core_->payloads.destroy(number);
+    return value;
+  }
+
+  /* Dequeues the top element into 'out' by move assignment. Returns
+     false if the queue is empty. */
+  bool try_pop(T &out) {
+    return detail::pop_payload(core_->payloads, &core_->structure, out);
+  }
+
+  /* Calls visitor(key, value) for each element, in the order they
+     would be dequeued, until it has seen them all or returns false. */
+  template <typename Visitor>
+  void for_each(Visitor visitor) const {
+    Queue_cursor cursor;
+    Queue_element element;
+
+    if (!open_cursor(&cursor, &core_->structure))
+      return;
+    while (cursor_next(&cursor, &element)) {
+      if (!visitor(order::from_priority(element.priority),
+                   static_cast<const T &>(core_->payloads.at(
+                     detail::decode_slot(element.element)))))
+        break;
+    }
+    close_cursor(&cursor);
+  }
+
+  bool empty() const { return has_no_elements(&core_->structure) != 0; }
+
+  /* Read from the structure, since the C size() is a short. */
+  size_type size() const {
+    return static_cast<size_type>(core_->structure.size);
+  }
+
+  void clear() {
+    detail::destroy_payloads(core_->payloads, &core_->structure);
+    clear_queue_prio(&core_->structure);
+  }
+
+  allocator_type get_allocator() const { return allocator_; }
+
+  /* The queue underneath, for the read-only C functions. */
+  const Queue_prio *native() const { return &core_->structure; }
+
+private:
+  typedef key_order<Key, Compare> order;
+  typedef detail::core<Queue_prio, T, Allocator> core_type;
+
+  void start(const Queue_options *options) {
+    Queue_options settings = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+
+    if (options != NULL)
+      settings = *options;
+    core_ = detail::make_core<core_type>(allocator_);
+    settings.allocator = &core_->hooks;
+    if (!init_queue_with_options(&core_->structure, &settings)) {
+      detail::drop_core(core_, allocator_);
+      core_ = NULL;
+      throw std::bad_alloc();
+    }
+    set_queue_observer(&core_->structure, &core_->evictions);
+  }
+
+  void release() {
+    if (core_ == NULL)
+      return;
+    clear();
+    detail::drop_core(core_, allocator_);
+    core_ = NULL;
+  }
+
+  Allocator allocator_;
+  core_type *core_;
+};
+
+/* Named queues of T sharing one Queue_prio_list, so that elements can
+   be taken from one queue or from whichever holds the top key. Each
+   queue follows the rules of PriorityQueue. Queue names are C strings
+   as in queue-prio-list.c. The registry can be moved but not copied. */
+template <typename T, typename Key = unsigned int,
+          typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<T> >
+class QueueRegistry {
+public:
+  typedef T value_type;
+  typedef Key key_type;
+  typedef Compare key_compare;
+  typedef Allocator allocator_type;
+  typedef std::size_t size_type;
+
+  /* Throws std::bad_alloc if the list cannot be set up. */
+  explicit QueueRegistry(const Allocator &allocator = Allocator())
+    : allocator_(allocator), core_(NULL) {
+    core_ = detail::make_core<core_type>(allocator_);
+    if (!init_queue_list(&core_->structure)) {
+      detail::drop_core(core_, allocator_);
+      core_ = NULL;
+      throw std::bad_alloc();
+    }
+  }
+
+  QueueRegistry(QueueRegistry &&other)
+    : allocator_(std::move(other.allocator_)), core_(other.core_) {
+    other.core_ = NULL;
+  }
+
+  QueueRegistry &operator=(QueueRegistry &&other) {
+    if (this != &other) {
+      release();
+      allocator_ = std::move(other.allocator_);
+      core_ = other.core_;
+      other.core_ = NULL;
+    }
+    return *this;
+  }
+
+  QueueRegistry(const QueueRegistry &) = delete;
+  QueueRegistry &operator=(const QueueRegistry &) = delete;
+
+  ~QueueRegistry() { release(); }
+
+  /* Adds a queue called 'name', set up from 'options' as for
+     PriorityQueue. Returns false if the name is taken or memory runs
+     out. */
+  bool add(const char name[], const Queue_options *options = NULL) {
+    Queue_options settings = {QUEUE_ENGINE_LIST, 0, NULL, 0, NULL};
+
+    if (options != NULL)
+      settings = *options;
+    settings.allocator = &core_->hooks;
+    if (!add_queue_prio_with_options(&core_->structure, name, &settings))
+      return false;
+    set_queue_observer(get_queue(&core_->structure, name),
+                       &core_->evictions);
+    return true;
+  }
+
+  /* Removes the queue called 'name' with its elements. Returns false
+     if there is none. */
+  bool remove(const char name[]) {
+    Queue_prio *queue = get_queue(&core_->structure, name);
+
+    if (queue == NULL)
+      return false;
+    detail::destroy_payloads(core_->payloads, queue);
+    return remove_queue(&core_->structure, name) != 0;
+  }
+
+  bool contains(const char name[]) const {
+    return get_queue(&core_->structure, name) != NULL;
+  }
+
+  size_type queues() const {
+    return static_cast<size_type>(num_queues(&core_->structure));
+  }
+
+  /* The number of elements in the queue called 'name', 0 if there is
+     none. */
+  size_type size(const char name[]) const {
+    Queue_prio *queue = get_queue(&core_->structure, name);
+
+    return queue == NULL ? 0 : static_cast<size_type>(queue->size);
+  }
+
+  /* Constructs a T from 'args' and enqueues it under 'key' in the
+     queue called 'name'. Returns false, with nothing left behind, if
+     there is no such queue or it turns the element down. */
+  template <typename... Args>
+  bool emplace(const char name[], Key key, Args &&... args) {
+    char slot_name[detail::slot_name_length + 1];
+    Queue_prio *queue = get_queue(&core_->structure, name);
+    unsigned int number;
+
+    if (queue == NULL)
+      return false;
+    number = core_->payloads.make(std::forward<Args>(args)...);
+    detail::encode_slot(number, slot_name);
+    if (!en_queue(queue, slot_name, order::to_priority(key))) {
+      core_->payloads.destroy(number);
+      return false;
+    }
+    return true;
+  }
+
+  bool push(const char name[], Key key, const T &value) {
+    return emplace(name, key, value);
+  }
+
+  bool push(const char name[], Key key, T &&value) {
+    return emplace(name, key, std::move(value));
+  }
+
+  /* Dequeues the top element of the queue called 'name' into 'out' by
+     move assignment. Returns false if there is no such queue or it is
+     empty. */
+  bool try_pop(const char name[], T &out) {
+    Queue_prio *queue = get_queue(&core_->structure, name);
+
+    return queue != NULL
+      && detail::pop_payload(core_->payloads, queue, out);
+  }
+
+  /* Dequeues the element with the top key across every queue, as
+     de_queue_global does, into 'out'. If 'name' is not NULL it is set
+     to the name of the queue the element came from. Returns false if
+     every queue is empty. */
+  bool try_pop_global(T &out, const char **name = NULL) {
+    char *slot_name = de_queue_global(&core_->structure, name);
+    unsigned int number;
+
+    if (slot_name == NULL)
+      return false;
+    number = detail::decode_slot(slot_name);
+    std::free(slot_name);
+    out = std::move(core_->payloads.at(number));
+    core_->payloads.destroy(number);
+    return true;
+  }
+
+  /* Removes every queue and element. */
+  void clear() {
+    list_Node *node = NULL;
+
+    for (node = core_->structure.head; node != NULL; node = node->next)
+      detail::destroy_payloads(core_->payloads, node->queue);
+    clear_queue_prio_list(&core_->structure);
+  }
+
+  allocator_type get_allocator() const { return allocator_; }
+
+  /* The list underneath, for the read-only C functions. */
+  const Queue_prio_list *native() const { return &core_->structure; }
+
+private:
+  typedef key_order<Key, Compare> order;
+  typedef detail::core<Queue_prio_list, T, Allocator> core_type;
+
+  void release() {
+    if (core_ == NULL)
+      return;
+    clear();
+    detail::drop_core(core_, allocator_);
+    core_ = NULL;
+  }
+
+  Allocator allocator_;
+  core_type *core_;
+};
+
+} // namespace queuemanager
+
+#endif
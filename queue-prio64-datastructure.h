@@ -0,0 +1,28 @@
+#ifndef QUEUE_PRIO64_DATASTRUCTURE_H
+#define QUEUE_PRIO64_DATASTRUCTURE_H
+
+#include <stddef.h>
+
+/* One element of a Queue_prio64. Its key is the pair (priority,
+   sequence): 'sequence' numbers the en_queue64 calls of the queue, so
+   among equal priorities the entry enqueued first sorts first. 'data'
+   is a malloc'd copy of the element. */
+typedef struct entry64{
+  unsigned long long priority;
+  unsigned long long sequence;
+  char *data;
+  size_t length;
+}Entry64;
+
+/* A priority queue with 64-bit priorities where any number of elements
+   may share a priority and are dequeued first in, first out. The
+   entries themselves are stored in 'heap', a 4-ary max-heap on their
+   key. A zeroed Queue_prio64 is an empty queue. */
+typedef struct queue_prio64{
+  Entry64 *heap;
+  unsigned int size;
+  unsigned int capacity;
+  unsigned long long next_sequence;
+}Queue_prio64;
+
+#endif
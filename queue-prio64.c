@@ -0,0 +1,238 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "queue-prio64.h"
+
+/*This program provides Queue_prio64, a priority queue for callers
+  whose priorities do not fit the rules of Queue_prio: priorities are
+  64-bit, and equal priorities are not rejected but dequeued in the
+  order they were enqueued. Every entry is keyed by its priority and a
+  sequence number taken from a per-queue counter, so the key is unique
+  and a plain heap on it is exactly FIFO among ties; no timestamp needs
+  to be folded into the priority and no en_queue has to be retried.
+
+  The queue is a specialization rather than a mode of Queue_prio: the
+  key comparison is a static inline function below, so the compiler
+  inlines it into every sift instead of going through the engine
+  table. Entries are kept by value in a 4-ary max-heap, which puts the
+  keys a sift compares next to each other in memory. en_queue64 and
+  de_queue64 are O(log n) and peek64 is O(1).*/
+
+#define HEAP_ARITY 4
+#define HEAP_MIN_CAPACITY 16
+
+/* Whether entry 'a' leaves the queue before entry 'b': a higher
+   priority first, then the earlier sequence number. */
+static inline int entry_above(const Entry64 *const a, const Entry64 *const b) {
+  return a->priority > b->priority
+    || (a->priority == b->priority && a->sequence < b->sequence);
+}
+
+/* Moves the entry at 'slot' towards the root until its parent leaves
+   the queue before it. */
+static void sift_up(Queue_prio64 *const queue, unsigned int slot) {
+  Entry64 entry = queue->heap[slot];
+  unsigned int parent;
+
+  while (slot > 0) {
+    parent = (slot - 1) / HEAP_ARITY;
+    if (!entry_above(&entry, &queue->heap[parent]))
+      break;
+    queue->heap[slot] = queue->heap[parent];
+    slot = parent;
+  }
+  queue->heap[slot] = entry;
+}
+
+/* Moves the entry at 'slot' towards the leaves until it leaves the
+   queue before all of its children. */
+static void sift_down(Queue_prio64 *const queue, unsigned int slot) {
+  Entry64 entry = queue->heap[slot];
+  unsigned int child;
+  unsigned int best;
+  unsigned int last;
+
+  for (;;) {
+    child = slot * HEAP_ARITY + 1;
+    if (child >= queue->size)
+      break;
+
+    /* Pick the child that leaves first. */
+    best = child;
+    last = child + HEAP_ARITY < queue->size ? child + HEAP_ARITY
+      : queue->size;
+    for (child = child + 1; child < last; child++)
+      if (entry_above(&queue->heap[child], &queue->heap[best]))
+        best = child;
+
+    if (!entry_above(&queue->heap[best], &entry))
+      break;
+    queue->heap[slot] = queue->heap[best];
+    slot = best;
+  }
+  queue->heap[slot] = entry;
+}
+
+/* Removes the top entry and returns it. The queue must not be
+   empty. */
+static Entry64 take_top(Queue_prio64 *const queue) {
+  Entry64 top = queue->heap[0];
+
+  queue->size--;
+  if (queue->size > 0) {
+    queue->heap[0] = queue->heap[queue->size];
+    sift_down(queue, 0);
+  }
+  return top;
+}
+
+/* This function initializes an empty Queue_prio64. It returns 1 on
+   success and 0 if queue is NULL. */
+unsigned short init_queue64(Queue_prio64 *const queue) {
+  if (queue == NULL)
+    return 0;
+  memset(queue, 0, sizeof(Queue_prio64));
+  return 1;
+}
+
+/* This function enqueues a copy of 'new_element' with 'priority'.
+   Elements that share a priority are all kept and leave in the order
+   they were enqueued. It returns 1 on success and 0 if an argument is
+   NULL, the heap cannot grow any further or memory runs out. */
+unsigned short en_queue64(Queue_prio64 *const queue, const char new_element[],
+                          unsigned long long priority) {
+  unsigned int capacity;
+  size_t length;
+  Entry64 *heap = NULL;
+  Entry64 *entry = NULL;
+
+  if (queue == NULL || new_element == NULL)
+    return 0;
+
+  /* Grow the heap by doubling when it is full, unless the count or
+     the byte size would overflow. */
+  if (queue->size == queue->capacity) {
+    if (queue->capacity > UINT_MAX / 2
+        || (size_t) queue->capacity * 2 > SIZE_MAX / sizeof(Entry64))
+      return 0;
+    capacity = queue->capacity == 0 ? HEAP_MIN_CAPACITY
+      : queue->capacity * 2;
+    heap = realloc(queue->heap, (size_t) capacity * sizeof(Entry64));
+    if (heap == NULL)
+      return 0;
+    queue->heap = heap;
+    queue->capacity = capacity;
+  }
+
+  entry = &queue->heap[queue->size];
+  length = strlen(new_element);
+  entry->data = malloc(length + 1);
+  if (entry->data == NULL)
+    return 0;
+  memcpy(entry->data, new_element, length + 1);
+  entry->length = length;
+  entry->priority = priority;
+  entry->sequence = queue->next_sequence++;
+  sift_up(queue, queue->size++);
+  return 1;
+}
+
+/* This function returns a malloc'd copy of the element at the head of
+   the queue, or NULL if the queue is NULL or empty or memory runs
+   out. */
+char *peek64(const Queue_prio64 *const queue) {
+  char *name = NULL;
+
+  if (queue == NULL || queue->size == 0)
+    return NULL;
+  name = malloc(queue->heap[0].length + 1);
+  if (name != NULL)
+    memcpy(name, queue->heap[0].data, queue->heap[0].length + 1);
+  return name;
+}
+
+/* This function returns the element at the head of the queue without
+   copying it, and its length in '*length' if length is not NULL. The
+   pointer stays valid until the queue is next modified. It returns
+   NULL if the queue is NULL or empty. */
+const char *peek_ref64(const Queue_prio64 *const queue, size_t *const length) {
+  if (queue == NULL || queue->size == 0)
+    return NULL;
+  if (length != NULL)
+    *length = queue->heap[0].length;
+  return queue->heap[0].data;
+}
+
+/* This function stores the priority of the head element in
+   '*priority'. It returns 1 on success and 0 if an argument is NULL or
+   the queue is empty. */
+unsigned short peek_priority64(const Queue_prio64 *const queue,
+                               unsigned long long *const priority) {
+  if (queue == NULL || priority == NULL || queue->size == 0)
+    return 0;
+  *priority = queue->heap[0].priority;
+  return 1;
+}
+
+/* This function dequeues the head element and returns it. The string
+   is the queue's own copy, handed over rather than copied again, and
+   must be freed by the caller. It returns NULL if the queue is NULL or
+   empty. */
+char *de_queue64(Queue_prio64 *const queue) {
+  if (queue == NULL || queue->size == 0)
+    return NULL;
+  return take_top(queue).data;
+}
+
+/* This function dequeues the head element into a buffer supplied by
+   the caller. Like de_queue_into, it returns the length of the
+   element's data; the element is copied, terminated and dequeued only
+   if that length is less than 'buffer_size', and left in the queue
+   otherwise. It returns -1 if the queue is NULL or empty. */
+long de_queue_into64(Queue_prio64 *const queue, char buffer[],
+                     size_t buffer_size) {
+  Entry64 top;
+  long length = 0;
+
+  if (queue == NULL || queue->size == 0)
+    return -1;
+
+  length = (long) queue->heap[0].length;
+  if (buffer != NULL && queue->heap[0].length < buffer_size) {
+    top = take_top(queue);
+    memcpy(buffer, top.data, top.length + 1);
+    free(top.data);
+  }
+  return length;
+}
+
+/* This function returns -1 if the queue pointer is NULL, 1 if the
+   queue is empty and 0 if it holds elements. */
+short has_no_elements64(const Queue_prio64 *const queue) {
+  if (queue == NULL)
+    return -1;
+  return queue->size == 0;
+}
+
+/* This function returns the number of elements in the queue. */
+unsigned int size64(const Queue_prio64 *const queue) {
+  return queue->size;
+}
+
+/* This function frees every element and the heap, leaving an empty
+   queue that can be used again. The sequence counter keeps running.
+   It returns 1 on success and 0 if queue is NULL. */
+unsigned short clear_queue_prio64(Queue_prio64 *const queue) {
+  unsigned int i;
+
+  if (queue == NULL)
+    return 0;
+  for (i = 0; i < queue->size; i++)
+    free(queue->heap[i].data);
+  free(queue->heap);
+  queue->heap = NULL;
+  queue->size = 0;
+  queue->capacity = 0;
+  return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef QUEUE_PRIO64_H
+#define QUEUE_PRIO64_H
+
+#include "queue-prio64-datastructure.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned short init_queue64(Queue_prio64 *const queue);
+unsigned short en_queue64(Queue_prio64 *const queue, const char new_element[],
+                          unsigned long long priority);
+char *peek64(const Queue_prio64 *const queue);
+const char *peek_ref64(const Queue_prio64 *const queue, size_t *const length);
+unsigned short peek_priority64(const Queue_prio64 *const queue,
+                               unsigned long long *const priority);
+char *de_queue64(Queue_prio64 *const queue);
+long de_queue_into64(Queue_prio64 *const queue, char buffer[],
+                     size_t buffer_size);
+short has_no_elements64(const Queue_prio64 *const queue);
+unsigned int size64(const Queue_prio64 *const queue);
+unsigned short clear_queue_prio64(Queue_prio64 *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif